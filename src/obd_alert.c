@@ -0,0 +1,283 @@
+/*
+ * obd_alert.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "obd_alert.h"
+#include "obd_session.h"
+#include "obd_trace.h"
+#include "obd_time.h"
+
+void obd_alerts_init(obd_alerts_t* a, const obd_pid_t* channels, int nchannels) {
+    memset(a, 0, sizeof(*a));
+    a->channels = channels;
+    a->nchannels = nchannels > OBD_MAX_CHANNELS ? OBD_MAX_CHANNELS : nchannels;
+    a->sock = -1;
+}
+
+// "5s", "300ms", "2" (seconds) in microseconds
+static int64_t parse_duration(const char* s) {
+    char* end;
+    double v = strtod(s, &end);
+    if (strcmp(end, "ms") == 0) return (int64_t)(v * 1000);
+    return (int64_t)(v * 1000000);
+}
+
+int obd_alert_add(obd_alerts_t* a, const char* definition) {
+    char buf[256], channel[32];
+
+    if (a->nrules >= OBD_ALERT_MAX_RULES) {
+        fprintf(stderr, "alerts: more than %d rules\n", OBD_ALERT_MAX_RULES);
+        return -1;
+    }
+
+    obd_alert_rule_t* r = &a->rules[a->nrules];
+    memset(r, 0, sizeof(*r));
+    snprintf(buf, sizeof(buf), "%s", definition);
+
+    char* colon = strchr(buf, ':');
+    if (!colon) goto syntax;
+    *colon = '\0';
+    if (sscanf(buf, "%31s", r->name) != 1) goto syntax;
+
+    char* tok = strtok(colon + 1, " \t");
+    if (!tok) goto syntax;
+    if (strncmp(tok, "rate(", 5) == 0 && tok[strlen(tok) - 1] == ')') {
+        r->rate = 1;
+        snprintf(channel, sizeof(channel), "%.*s", (int)strlen(tok) - 6, tok + 5);
+    } else {
+        snprintf(channel, sizeof(channel), "%s", tok);
+    }
+    r->channel = obd_pid_index(a->channels, a->nchannels, channel);
+    if (r->channel < 0) {
+        fprintf(stderr, "alerts: %s: unknown channel %s\n", r->name, channel);
+        return -1;
+    }
+
+    tok = strtok(NULL, " \t");
+    if (!tok || (strcmp(tok, ">") != 0 && strcmp(tok, "<") != 0)) goto syntax;
+    r->above = tok[0] == '>';
+    if (!(tok = strtok(NULL, " \t"))) goto syntax;
+    r->threshold = r->clear = atof(tok);
+
+    while ((tok = strtok(NULL, " \t")) != NULL) {
+        char* arg = strtok(NULL, " \t");
+        if (!arg) goto syntax;
+        if (strcmp(tok, "clear") == 0) r->clear = atof(arg);
+        else if (strcmp(tok, "for") == 0) r->debounce_us = parse_duration(arg);
+        else goto syntax;
+    }
+    if (r->above ? r->clear > r->threshold : r->clear < r->threshold) {
+        fprintf(stderr, "alerts: %s: clear level is on the wrong side of the threshold\n", r->name);
+        return -1;
+    }
+
+    a->nrules++;
+    return 0;
+
+syntax:
+    fprintf(stderr, "alerts: expected \"name: [rate(]Channel[)] >|< threshold [clear x] [for t]\": %s\n", definition);
+    return -1;
+}
+
+int obd_alerts_load(obd_alerts_t* a, const char* path) {
+    char line[256];
+    int added = 0;
+
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        char* p = line;
+        while (isspace((unsigned char)*p)) ++p;
+        char* hash = strchr(p, '#');
+        if (hash) *hash = '\0';
+        p[strcspn(p, "\r\n")] = '\0';
+        if (!*p) continue;
+
+        if (obd_alert_add(a, p) != 0) {
+            fclose(f);
+            return -1;
+        }
+        added++;
+    }
+    fclose(f);
+    return added;
+}
+
+// Delivery
+// ========
+
+static void deliver(obd_alerts_t* a, const obd_alert_event_t* e) {
+    const obd_alert_rule_t* r = &a->rules[e->rule];
+    const obd_pid_t* ch = &a->channels[r->channel];
+    char ts[32], msg[256];
+
+    obd_format_time(ts, sizeof(ts), e->t_us);
+    int n = snprintf(msg, sizeof(msg), "%s,%s,%s,%s%s%s,%.*f\n", ts, r->name, e->fired ? "FIRED" : "CLEARED",
+                     r->rate ? "rate(" : "", ch->name, r->rate ? ")" : "", ch->decimals, e->value);
+
+    if (a->sock >= 0) {
+        struct sockaddr_un addr = { 0 };
+        addr.sun_family = AF_UNIX;
+        snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", a->sock_path);
+        // Nobody listening is fine
+        sendto(a->sock, msg, n, MSG_DONTWAIT, (struct sockaddr*)&addr, sizeof(addr));
+    }
+    if (a->log) {
+        fputs(msg, a->log);
+        fflush(a->log);
+    }
+    printf("Alert: %s", msg);
+    fflush(stdout);
+
+    metrics_observe(a->latency, obd_now_us() - e->reply_us);
+}
+
+static void* alert_thread(void* arg) {
+    obd_alerts_t* a = arg;
+
+    trace_thread_name("alerts");
+    pthread_mutex_lock(&a->lock);
+    for (;;) {
+        while (a->queued == 0 && !a->stopping) pthread_cond_wait(&a->not_empty, &a->lock);
+        if (a->queued == 0) break;
+
+        obd_alert_event_t e = a->queue[a->head];
+        a->head = (a->head + 1) % OBD_ALERT_QUEUE;
+        a->queued--;
+        pthread_mutex_unlock(&a->lock);
+
+        uint64_t span = TRACE_BEGIN();
+        deliver(a, &e);
+        TRACE_END("alert", span, a->rules[e.rule].name);
+
+        pthread_mutex_lock(&a->lock);
+    }
+    pthread_mutex_unlock(&a->lock);
+    return NULL;
+}
+
+int obd_alerts_start(obd_alerts_t* a, const char* log_path, const char* sock_path, obd_metrics_t* metrics) {
+    obd_alert_rule_t rules[OBD_ALERT_MAX_RULES];
+    int n = 0;
+
+    // Flat table: the rules of each channel next to each other
+    for (int c = 0; c < OBD_MAX_CHANNELS; ++c) {
+        a->first[c] = (int16_t)n;
+        for (int i = 0; i < a->nrules; ++i) {
+            if (a->rules[i].channel == c) rules[n++] = a->rules[i];
+        }
+        a->count[c] = (int16_t)(n - a->first[c]);
+    }
+    memcpy(a->rules, rules, n * sizeof(rules[0]));
+    memset(a->state, 0, sizeof(a->state));
+
+    if (log_path) {
+        a->log = fopen(log_path, "w");
+        if (!a->log) perror(log_path);
+        else fprintf(a->log, "Timestamp,Alert,State,Channel,Value\n");
+    }
+    if (sock_path) {
+        snprintf(a->sock_path, sizeof(a->sock_path), "%s", sock_path);
+        a->sock = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (a->sock < 0) perror("alert socket");
+    }
+    a->latency = metrics_histogram(metrics, "obd_alert_latency_seconds",
+                                   "Time from the ECU reply to the alert being delivered.", NULL, NULL);
+
+    pthread_mutex_init(&a->lock, NULL);
+    pthread_cond_init(&a->not_empty, NULL);
+    if (pthread_create(&a->thread, NULL, alert_thread, a) != 0) {
+        perror("pthread_create");
+        return -1;
+    }
+    a->started = 1;
+    return 0;
+}
+
+static void post(obd_alerts_t* a, int rule, int fired, double value, int64_t t_us, uint64_t reply_us) {
+    obd_alert_event_t e = { t_us, reply_us, rule, fired, value };
+
+    pthread_mutex_lock(&a->lock);
+    if (a->queued < OBD_ALERT_QUEUE) {
+        a->queue[(a->head + a->queued) % OBD_ALERT_QUEUE] = e;
+        a->queued++;
+        if (fired) a->fired++;
+        pthread_cond_signal(&a->not_empty);
+    } else {
+        a->dropped++;
+    }
+    pthread_mutex_unlock(&a->lock);
+}
+
+void obd_alerts_update(obd_alerts_t* a, int channel, double value, int64_t t_us, uint64_t reply_us) {
+    if (!a->started || channel < 0 || channel >= OBD_MAX_CHANNELS) return;
+
+    for (int i = a->first[channel], end = i + a->count[channel]; i < end; ++i) {
+        const obd_alert_rule_t* r = &a->rules[i];
+        obd_alert_state_t* s = &a->state[i];
+        double v = value;
+
+        if (r->rate) {
+            int64_t dt = t_us - s->prev_t_us;
+            int primed = s->primed && dt > 0;
+            v = primed ? (value - s->prev) * 1e6 / dt : 0;
+            s->prev = value;
+            s->prev_t_us = t_us;
+            s->primed = 1;
+            if (!primed) continue;
+        }
+
+        if (s->active) {
+            if (r->above ? v <= r->clear : v >= r->clear) {
+                s->active = 0;
+                post(a, i, 0, v, t_us, reply_us);
+            }
+            continue;
+        }
+
+        if (r->above ? v > r->threshold : v < r->threshold) {
+            if (!s->pending_since) s->pending_since = t_us;
+            if (t_us - s->pending_since >= r->debounce_us) {
+                s->active = 1;
+                s->pending_since = 0;
+                post(a, i, 1, v, t_us, reply_us);
+                if (a->on_fire) a->on_fire(a->on_fire_ctx, r, v, t_us);
+            }
+        } else {
+            s->pending_since = 0;
+        }
+    }
+}
+
+void obd_alerts_stop(obd_alerts_t* a) {
+    if (!a->started) return;
+
+    pthread_mutex_lock(&a->lock);
+    a->stopping = 1;
+    pthread_cond_signal(&a->not_empty);
+    pthread_mutex_unlock(&a->lock);
+    pthread_join(a->thread, NULL);
+
+    if (a->log) fclose(a->log);
+    if (a->sock >= 0) close(a->sock);
+    a->log = NULL;
+    a->sock = -1;
+    a->started = 0;
+}
@@ -0,0 +1,126 @@
+/*
+ * obd_alert.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+#ifndef OBD_ALERT_H
+#define OBD_ALERT_H
+
+//
+// Threshold and rate-of-change alerts on decoded values.
+//
+// Rules are written one per line:
+//
+//    Overheat: Coolant > 105 clear 100 for 5s
+//    Overrev:  RPM > 6000 clear 5500
+//    Braking:  rate(Speed) < -25 for 300ms
+//
+//    name:       reported with the alert
+//    Channel     any channel of the table, derived channels included
+//    rate(...)   change per second between consecutive values instead
+//    > or <      fire above / below the threshold
+//    clear x     hysteresis: stays active until the value is back to x
+//                (the threshold itself when missing)
+//    for t       debounce: the condition has to hold for t (ms or s)
+//
+// At start-up the rules are sorted by channel into a flat table, so a new
+// value only visits the rules of its channel: one or two comparisons each.
+// The acquisition loop calls obd_alerts_update() as soon as a value is
+// decoded, without waiting for the rest of the round.
+//
+// Fired and cleared alerts go to a small queue and a delivery thread writes
+// them to the alert CSV, stdout and a Unix datagram socket for local
+// listeners. The time from the ECU reply to delivery is recorded in
+// obd_alert_latency_seconds. A full queue drops the alert and counts it in
+// dropped.
+//
+// on_fire, when set, runs in the acquisition thread as a rule fires, for
+// work that has to follow the alert at once (obd_snapshot.h).
+//
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "obd_pids.h"
+#include "obd_metrics.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OBD_ALERT_MAX_RULES 64
+#define OBD_ALERT_QUEUE 64
+#define OBD_ALERT_SOCKET "/tmp/obd_alerts.sock"
+
+typedef struct {
+    char name[32];
+    int channel;
+    uint8_t rate;           // compare the change per second
+    uint8_t above;          // fire above (1) or below (0) the threshold
+    double threshold;
+    double clear;
+    int64_t debounce_us;
+} obd_alert_rule_t;
+
+typedef struct {
+    uint8_t active;
+    uint8_t primed;
+    int64_t pending_since;  // 0 when the condition does not hold
+    double prev;
+    int64_t prev_t_us;
+} obd_alert_state_t;
+
+typedef struct {
+    int64_t t_us;           // sample time, unix microseconds
+    uint64_t reply_us;      // CLOCK_MONOTONIC when the ECU reply was read
+    int rule;
+    int fired;              // 1 fired, 0 cleared
+    double value;
+} obd_alert_event_t;
+
+typedef struct {
+    const obd_pid_t* channels;
+    int nchannels;
+
+    obd_alert_rule_t rules[OBD_ALERT_MAX_RULES];
+    obd_alert_state_t state[OBD_ALERT_MAX_RULES];
+    int nrules;
+    int16_t first[OBD_MAX_CHANNELS];   // rules of channel c: first[c] .. first[c] + count[c]
+    int16_t count[OBD_MAX_CHANNELS];
+
+    // Delivery
+    FILE* log;
+    int sock;
+    char sock_path[108];
+    metrics_hist_t* latency;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    obd_alert_event_t queue[OBD_ALERT_QUEUE];
+    int head, queued, stopping, started;
+    uint64_t fired, dropped;
+
+    void (*on_fire)(void* ctx, const obd_alert_rule_t* rule, double value, int64_t t_us);
+    void* on_fire_ctx;
+} obd_alerts_t;
+
+void obd_alerts_init(obd_alerts_t* a, const obd_pid_t* channels, int nchannels);
+// One rule in the syntax above, 0 on success
+int obd_alert_add(obd_alerts_t* a, const char* definition);
+// One rule per line, # starts a comment; returns the number added or -1
+int obd_alerts_load(obd_alerts_t* a, const char* path);
+
+// Builds the per-channel table and starts delivery; log_path and sock_path
+// may be NULL
+int obd_alerts_start(obd_alerts_t* a, const char* log_path, const char* sock_path, obd_metrics_t* metrics);
+void obd_alerts_update(obd_alerts_t* a, int channel, double value, int64_t t_us, uint64_t reply_us);
+void obd_alerts_stop(obd_alerts_t* a);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
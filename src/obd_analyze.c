@@ -0,0 +1,649 @@
+/*
+ * obd_analyze.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+//
+// Offline analytics over the obd_log_*.csv archive.
+//
+// Features
+// ========
+//
+// Per-channel count, min, max, average and standard deviation, histograms and
+// row filters over any number of segments, on all cores:
+//
+//    - every segment is cut into 8 MiB chunks on line boundaries and each
+//      chunk is memory-mapped on its own, so a multi-GB archive needs no more
+//      address space than a few chunks per thread (fine on a 32-bit Pi OS)
+//    - the chunks are dealt to per-thread queues; a thread that runs out
+//      steals from the others, so a slow core or a big file does not leave
+//      the rest idle at the end
+//    - each thread keeps its own totals, merged once at the end, and numbers
+//      are parsed by hand instead of strtod(): no locks and no allocation on
+//      the hot path
+//
+// Filters use the derived-channel expression language (obd_expr.h) with
+// and / or / not: -f "rpm > 4000 and coolant > 100". Only matching rows count
+// in the statistics and histograms. The time functions (integrate, ddt, ema)
+// need rows in order and are not available here.
+//
+// Segments may have different columns (derived channels added later, the
+// headers of the older loggers); channels are matched by name (obd_csv.h).
+// -1 in the CSV is a missing value.
+//
+// -G writes a synthetic archive of drive-like segments for benchmarks and -b
+// runs the same analysis with 1, 2, 4, ... threads and prints the speed-up.
+// Run -b on files in the page cache to measure the CPU side; an archive larger
+// than RAM measures the storage instead.
+//
+// Compile & Run
+// =============
+//
+// gcc -O2 obd_analyze.c obd_csv.c obd_expr.c obd_pids.c -o obd_analyze -lpthread -lm
+//
+// ./obd_analyze                                       all of /home/pi/obd_logs
+// ./obd_analyze -f "rpm > 4000 and coolant > 100" -H RPM:0:8000:16 /media/pi/OBD_USB
+// ./obd_analyze -j 2 obd_log_20261018_081500.csv obd_log_20261019_174210.csv
+// ./obd_analyze -G 4096 /tmp/archive                  4 GiB synthetic archive
+// ./obd_analyze -b /tmp/archive
+//
+// Options: -f filter, -H channel:min:max:bins (repeatable), -j threads (all
+// cores by default), -b thread scaling benchmark, -G size_mb dir.
+//
+// Example Output
+// ==============
+//
+// ./obd_analyze -H RPM:0:8000:16 /tmp/archive     (-G 96 archive, one core, page cache)
+//
+// Channel,Count,Min,Max,Avg,StdDev
+// RPM,2415577,780,4299,3258.87,1215.95
+// Speed,2415577,0,120,83.83,45.55
+// Coolant,2415577,86,89,87.50,1.12
+// ...
+//
+// RPM                       count
+// 0-500                         0
+// 500-1000                 245586 #######
+// 1000-1500                 92458 ##
+// ...
+// 4000-4500               1272213 ########################################
+// ...
+//
+// 2415577 rows, 2415577 matched in 2 files, 134.2 MB in 0.603 s (223 MB/s, 1 threads)
+//
+
+#define _GNU_SOURCE
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "obd_pids.h"
+#include "obd_expr.h"
+#include "obd_csv.h"
+
+#define DEFAULT_DIR "/home/pi/obd_logs"
+#define CHUNK_BYTES (8 << 20)
+#define MAX_THREADS 64
+#define MAX_HISTOGRAMS 8
+#define MAX_BINS 64
+#define GEN_SEGMENT_MB 64
+
+typedef struct {
+    char* path;
+    off_t size;
+    off_t data;                     // first byte after the header line
+    int ncolumns;
+    int8_t column[OBD_MAX_CHANNELS];    // CSV column (after the timestamp) -> channel, -1 ignored
+} segment_t;
+
+typedef struct {
+    int segment;
+    off_t begin, end;
+} task_t;
+
+typedef struct {
+    int channel;
+    double lo, hi;
+    int bins;
+} histogram_t;
+
+typedef struct {
+    uint64_t n;
+    double sum, sumsq, min, max;
+} stats_t;
+
+// Per-thread totals, merged at the end
+typedef struct {
+    stats_t stats[OBD_MAX_CHANNELS];
+    uint64_t hist[MAX_HISTOGRAMS][MAX_BINS + 2];    // [0] below lo, [bins + 1] above hi
+    uint64_t rows, matched, bytes;
+} totals_t;
+
+// Work-stealing queue: the owner pops at the tail, thieves take from the head
+typedef struct {
+    pthread_mutex_t lock;
+    int* tasks;
+    int head, tail;
+} deque_t;
+
+// Channels of all segments, by name
+static char names[OBD_MAX_CHANNELS][24];
+static obd_pid_t schema[OBD_MAX_CHANNELS];
+static int nschema;
+
+static segment_t* segments;
+static int nsegments;
+static task_t* tasks;
+static int ntasks;
+
+static obd_expr_t filter;
+static int filtering;
+static histogram_t histograms[MAX_HISTOGRAMS];
+static int nhistograms;
+
+static int nthreads;
+static deque_t deques[MAX_THREADS];
+static totals_t* thread_totals;
+static long page_size;
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Archive
+// =======
+
+static int schema_channel(const char* name) {
+    for (int i = 0; i < nschema; ++i) {
+        if (strcasecmp(names[i], name) == 0) return i;
+    }
+    if (nschema == OBD_MAX_CHANNELS) return -1;
+
+    // Known PIDs keep their unit and decimals, anything else gets 2 decimals
+    int pid = obd_pid_find(name);
+    snprintf(names[nschema], sizeof(names[0]), "%.23s", name);
+    schema[nschema] = pid >= 0 ? OBD_PIDS[pid] : (obd_pid_t){ 0 };
+    schema[nschema].name = names[nschema];
+    if (pid < 0) {
+        schema[nschema].unit = "";
+        schema[nschema].decimals = 2;
+    }
+    return nschema++;
+}
+
+static int add_segment(const char* path) {
+    char header[OBD_CSV_MAX_LINE];
+    char columns[OBD_MAX_CHANNELS][24];
+    struct stat st;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    ssize_t n = fstat(fd, &st) == 0 ? pread(fd, header, sizeof(header) - 1, 0) : -1;
+    close(fd);
+    if (n <= 0) return -1;
+    header[n] = '\0';
+
+    const char* line = obd_csv_comments(header, header + n, NULL, 0);
+    const char* eol = strchr(line, '\n');
+    int ncolumns = eol ? obd_csv_columns(line, eol, columns, OBD_MAX_CHANNELS) : -1;
+    if (ncolumns < 0) {
+        fprintf(stderr, "%s: not an obd_log CSV, skipped\n", path);
+        return -1;
+    }
+
+    if (nsegments % 256 == 0) {
+        segment_t* grown = realloc(segments, (nsegments + 256) * sizeof(*segments));
+        if (!grown) return -1;
+        segments = grown;
+    }
+    segment_t* s = &segments[nsegments];
+    memset(s, 0, sizeof(*s));
+    s->path = strdup(path);
+    s->size = st.st_size;
+    s->data = eol - header + 1;
+    s->ncolumns = ncolumns;
+    for (int i = 0; i < ncolumns; ++i) s->column[i] = (int8_t)schema_channel(columns[i]);
+    nsegments++;
+    return 0;
+}
+
+static int by_path(const void* a, const void* b) {
+    return strcmp(((const segment_t*)a)->path, ((const segment_t*)b)->path);
+}
+
+static void add_path(const char* path) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        perror(path);
+        return;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        add_segment(path);
+        return;
+    }
+
+    DIR* d = opendir(path);
+    if (!d) {
+        perror(path);
+        return;
+    }
+    struct dirent* e;
+    while ((e = readdir(d)) != NULL) {
+        const char* dot = strrchr(e->d_name, '.');
+        if (strncmp(e->d_name, "obd_log_", 8) != 0 || !dot || strcmp(dot, ".csv") != 0) continue;
+        char full[1024];
+        snprintf(full, sizeof(full), "%s/%s", path, e->d_name);
+        add_segment(full);
+    }
+    closedir(d);
+}
+
+static int make_tasks(void) {
+    ntasks = 0;
+    for (int i = 0; i < nsegments; ++i) ntasks += (int)((segments[i].size - segments[i].data) / CHUNK_BYTES) + 1;
+    tasks = malloc(ntasks * sizeof(*tasks));
+    if (!tasks) return -1;
+
+    ntasks = 0;
+    for (int i = 0; i < nsegments; ++i) {
+        for (off_t b = segments[i].data; b < segments[i].size; b += CHUNK_BYTES) {
+            off_t e = b + CHUNK_BYTES;
+            tasks[ntasks++] = (task_t){ i, b, e < segments[i].size ? e : segments[i].size };
+        }
+    }
+    return 0;
+}
+
+// Scanning
+// ========
+
+static void add_row(totals_t* t, const double* values, uint32_t valid) {
+    t->rows++;
+    if (filtering) {
+        double r;
+        if (obd_expr_eval(&filter, NULL, 0, values, valid, &r) != 0 || r == 0) return;
+    }
+    t->matched++;
+
+    for (uint32_t v = valid; v; v &= v - 1) {
+        int c = __builtin_ctz(v);
+        stats_t* s = &t->stats[c];
+        double x = values[c];
+        if (s->n++ == 0 || x < s->min) s->min = x;
+        if (s->n == 1 || x > s->max) s->max = x;
+        s->sum += x;
+        s->sumsq += x * x;
+    }
+    for (int h = 0; h < nhistograms; ++h) {
+        const histogram_t* hg = &histograms[h];
+        if (!(valid & (1u << hg->channel))) continue;
+        double x = values[hg->channel];
+        int b = x < hg->lo ? 0 : x >= hg->hi ? hg->bins + 1 : 1 + (int)((x - hg->lo) / (hg->hi - hg->lo) * hg->bins);
+        t->hist[h][b]++;
+    }
+}
+
+// Rows whose first byte lies in [begin, end) belong to the chunk
+static void scan_chunk(const task_t* task, totals_t* t) {
+    const segment_t* seg = &segments[task->segment];
+    double values[OBD_MAX_CHANNELS];
+
+    // One byte before begin tells whether begin starts a line
+    off_t map_off = (task->begin - 1) & ~(off_t)(page_size - 1);
+    off_t map_end = task->end + OBD_CSV_MAX_LINE < seg->size ? task->end + OBD_CSV_MAX_LINE : seg->size;
+    size_t len = (size_t)(map_end - map_off);
+
+    int fd = open(seg->path, O_RDONLY);
+    if (fd < 0) {
+        perror(seg->path);
+        return;
+    }
+    char* map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, map_off);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        return;
+    }
+    madvise(map, len, MADV_SEQUENTIAL);
+
+    const char* p = map + (task->begin - map_off);
+    const char* stop = map + (task->end - map_off);
+    const char* limit = map + len;
+
+    if (p[-1] != '\n') {
+        p = memchr(p, '\n', limit - p);
+        p = p ? p + 1 : limit;
+    }
+    t->bytes += task->end - task->begin;
+
+    while (p < stop) {
+        const char* eol = memchr(p, '\n', limit - p);
+        if (!eol) {
+            if (map_end < seg->size) break;     // longer than OBD_CSV_MAX_LINE: not ours to judge
+            eol = limit;                         // last line without a newline
+        }
+
+        uint32_t valid = obd_csv_fields(p, eol, seg->column, seg->ncolumns, values);
+        if (valid) add_row(t, values, valid);
+        p = eol + 1;
+    }
+    munmap(map, len);
+}
+
+// Own tasks from the tail, then steal from the head of the others
+static int next_task(int id) {
+    deque_t* own = &deques[id];
+    int task = -1;
+
+    pthread_mutex_lock(&own->lock);
+    if (own->head < own->tail) task = own->tasks[--own->tail];
+    pthread_mutex_unlock(&own->lock);
+
+    for (int k = 1; task < 0 && k < nthreads; ++k) {
+        deque_t* victim = &deques[(id + k) % nthreads];
+        pthread_mutex_lock(&victim->lock);
+        if (victim->head < victim->tail) task = victim->tasks[victim->head++];
+        pthread_mutex_unlock(&victim->lock);
+    }
+    return task;
+}
+
+static void* worker(void* arg) {
+    int id = (int)(intptr_t)arg;
+    int task;
+
+    while ((task = next_task(id)) >= 0) scan_chunk(&tasks[task], &thread_totals[id]);
+    return NULL;
+}
+
+static int run(int threads, totals_t* out, double* seconds) {
+    pthread_t tid[MAX_THREADS];
+
+    nthreads = threads;
+    thread_totals = calloc(threads, sizeof(*thread_totals));
+    if (!thread_totals) return -1;
+
+    // Chunks of a segment go round-robin, so every thread starts on every file
+    for (int i = 0; i < threads; ++i) {
+        deques[i].tasks = malloc(ntasks * sizeof(int));
+        deques[i].head = deques[i].tail = 0;
+        pthread_mutex_init(&deques[i].lock, NULL);
+    }
+    for (int k = 0; k < ntasks; ++k) {
+        deque_t* d = &deques[k % threads];
+        d->tasks[d->tail++] = k;
+    }
+
+    double t0 = now_s();
+    for (int i = 1; i < threads; ++i) pthread_create(&tid[i], NULL, worker, (void*)(intptr_t)i);
+    worker((void*)0);
+    for (int i = 1; i < threads; ++i) pthread_join(tid[i], NULL);
+    *seconds = now_s() - t0;
+
+    memset(out, 0, sizeof(*out));
+    for (int i = 0; i < threads; ++i) {
+        const totals_t* t = &thread_totals[i];
+        out->rows += t->rows;
+        out->matched += t->matched;
+        out->bytes += t->bytes;
+        for (int c = 0; c < nschema; ++c) {
+            const stats_t* s = &t->stats[c];
+            stats_t* o = &out->stats[c];
+            if (s->n == 0) continue;
+            if (o->n == 0 || s->min < o->min) o->min = s->min;
+            if (o->n == 0 || s->max > o->max) o->max = s->max;
+            o->n += s->n;
+            o->sum += s->sum;
+            o->sumsq += s->sumsq;
+        }
+        for (int h = 0; h < nhistograms; ++h) {
+            for (int b = 0; b < histograms[h].bins + 2; ++b) out->hist[h][b] += t->hist[h][b];
+        }
+        free(deques[i].tasks);
+        pthread_mutex_destroy(&deques[i].lock);
+    }
+    free(thread_totals);
+    return 0;
+}
+
+// Report
+// ======
+
+static void print_stats(const totals_t* t) {
+    printf("Channel,Count,Min,Max,Avg,StdDev\n");
+    for (int c = 0; c < nschema; ++c) {
+        const stats_t* s = &t->stats[c];
+        int d = schema[c].decimals;
+        if (s->n == 0) continue;
+        double avg = s->sum / s->n;
+        double var = s->sumsq / s->n - avg * avg;
+        printf("%s,%llu,%.*f,%.*f,%.2f,%.2f\n", names[c], (unsigned long long)s->n, d, s->min, d, s->max, avg,
+               var > 0 ? sqrt(var) : 0);
+    }
+}
+
+static void print_histogram(const totals_t* t, int h) {
+    const histogram_t* hg = &histograms[h];
+    const uint64_t* n = t->hist[h];
+    uint64_t top = 1;
+    char label[64];
+
+    for (int b = 0; b < hg->bins + 2; ++b) if (n[b] > top) top = n[b];
+
+    printf("\n%-20s %10s\n", names[hg->channel], "count");
+    for (int b = 0; b < hg->bins + 2; ++b) {
+        double w = (hg->hi - hg->lo) / hg->bins;
+        if (b == 0) snprintf(label, sizeof(label), "< %g", hg->lo);
+        else if (b == hg->bins + 1) snprintf(label, sizeof(label), ">= %g", hg->hi);
+        else snprintf(label, sizeof(label), "%g-%g", hg->lo + (b - 1) * w, hg->lo + b * w);
+        if ((b == 0 || b == hg->bins + 1) && n[b] == 0) continue;
+        printf("%-20s %10llu %.*s\n", label, (unsigned long long)n[b], (int)(40 * n[b] / top),
+               "########################################");
+    }
+}
+
+static int parse_histogram(const char* spec) {
+    char name[32];
+    histogram_t* hg = &histograms[nhistograms];
+
+    if (nhistograms == MAX_HISTOGRAMS ||
+        sscanf(spec, "%31[^:]:%lf:%lf:%d", name, &hg->lo, &hg->hi, &hg->bins) != 4 ||
+        hg->bins < 1 || hg->bins > MAX_BINS || hg->hi <= hg->lo) {
+        fprintf(stderr, "Histogram: expected channel:min:max:bins (bins <= %d), got %s\n", MAX_BINS, spec);
+        return -1;
+    }
+    for (hg->channel = 0; hg->channel < nschema && strcasecmp(names[hg->channel], name) != 0; ++hg->channel) {}
+    if (hg->channel == nschema) {
+        fprintf(stderr, "Histogram: no channel %s in the archive\n", name);
+        return -1;
+    }
+    nhistograms++;
+    return 0;
+}
+
+// Synthetic archive
+// =================
+
+typedef struct {
+    const char* dir;
+    int files;
+    int next;
+} gen_t;
+
+// A drive: idle, accelerate, cruise, brake, every 10 minutes, with noise
+static void gen_row(char* line, int maxlen, time_t t, unsigned int* seed) {
+    double phase = fmod((double)t, 600) / 600;
+    double speed = phase < 0.1 ? 0 : phase < 0.3 ? (phase - 0.1) * 600 : phase < 0.8 ? 120 : (1 - phase) * 600;
+    double noise = rand_r(seed) / (double)RAND_MAX - 0.5;
+    double rpm = speed > 0 ? 1200 + speed * 25 + noise * 200 : 800 + noise * 40;
+    double values[] = { rpm, speed, 88 + noise * 4, 30 + noise * 6, fmax(0, speed / 2 + noise * 10), 30 + speed / 2,
+                        20 + speed / 2, 300, 10 + noise * 8, rpm / 100 + noise };
+    char ts[32];
+    struct tm tm;
+
+    strftime(ts, sizeof(ts), "%Y-%m-%d %H:%M:%S", localtime_r(&t, &tm));
+    int pos = snprintf(line, maxlen, "%s", ts);
+    for (int i = 0; i < OBD_PID_COUNT && i < (int)(sizeof(values) / sizeof(values[0])); ++i) {
+        char field[32];
+        obd_pid_format(&OBD_PIDS[i], values[i], field, sizeof(field));
+        pos += snprintf(line + pos, maxlen - pos, ",%s", field);
+    }
+    snprintf(line + pos, maxlen - pos, "\n");
+}
+
+static void* gen_worker(void* arg) {
+    gen_t* g = arg;
+    int i;
+
+    while ((i = __atomic_fetch_add(&g->next, 1, __ATOMIC_RELAXED)) < g->files) {
+        // One segment per day, counting back from now
+        time_t t = time(NULL) / 86400 * 86400 - (time_t)(g->files - i) * 86400;
+        unsigned int seed = (unsigned int)i;
+        char path[1024], ts[32], line[512];
+        struct tm tm;
+
+        strftime(ts, sizeof(ts), "%Y%m%d_%H%M%S", localtime_r(&t, &tm));
+        snprintf(path, sizeof(path), "%s/obd_log_%s.csv", g->dir, ts);
+        FILE* f = fopen(path, "w");
+        if (!f) {
+            perror(path);
+            continue;
+        }
+        setvbuf(f, NULL, _IOFBF, 1 << 20);
+
+        fprintf(f, "Timestamp");
+        for (int c = 0; c < OBD_PID_COUNT; ++c) fprintf(f, ",%s", OBD_PIDS[c].name);
+        fprintf(f, "\n");
+        for (long written = 0; written < GEN_SEGMENT_MB * (1L << 20); ++t) {
+            gen_row(line, sizeof(line), t, &seed);
+            written += fputs(line, f) >= 0 ? (long)strlen(line) : GEN_SEGMENT_MB * (1L << 20);
+        }
+        fclose(f);
+    }
+    return NULL;
+}
+
+static int generate(const char* dir, int size_mb, int threads) {
+    pthread_t tid[MAX_THREADS];
+    gen_t g = { dir, (size_mb + GEN_SEGMENT_MB - 1) / GEN_SEGMENT_MB, 0 };
+
+    mkdir(dir, 0755);
+    double t0 = now_s();
+    for (int i = 0; i < threads; ++i) pthread_create(&tid[i], NULL, gen_worker, &g);
+    for (int i = 0; i < threads; ++i) pthread_join(tid[i], NULL);
+    printf("Wrote %d segments of %d MB to %s in %.1f s\n", g.files, GEN_SEGMENT_MB, dir, now_s() - t0);
+    return 0;
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [-f filter] [-H channel:min:max:bins]... [-j threads] [-b] [dir|file]...\n"
+                    "       %s -G size_mb dir\n", prog, prog);
+}
+
+int main(int argc, char** argv) {
+    const char* filter_text = NULL;
+    const char* hist_specs[MAX_HISTOGRAMS];
+    int nspecs = 0;
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int bench = 0, gen_mb = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "bf:G:H:j:")) != -1) {
+        switch (opt) {
+            case 'b': bench = 1; break;
+            case 'f': filter_text = optarg; break;
+            case 'G': gen_mb = atoi(optarg); break;
+            case 'H':
+                if (nspecs < MAX_HISTOGRAMS) hist_specs[nspecs++] = optarg;
+                break;
+            case 'j': threads = atoi(optarg); break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (threads < 1) threads = 1;
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+    page_size = sysconf(_SC_PAGESIZE);
+
+    if (gen_mb > 0) {
+        if (optind >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        return generate(argv[optind], gen_mb, threads);
+    }
+
+    if (optind == argc) add_path(DEFAULT_DIR);
+    for (int i = optind; i < argc; ++i) add_path(argv[i]);
+    if (nsegments == 0) {
+        fprintf(stderr, "No obd_log_*.csv segments found\n");
+        return 1;
+    }
+    qsort(segments, nsegments, sizeof(*segments), by_path);
+    if (make_tasks() != 0) {
+        perror("malloc");
+        return 1;
+    }
+
+    if (filter_text) {
+        char err[128];
+        if (obd_expr_compile(&filter, filter_text, schema, nschema, err, sizeof(err)) != 0) {
+            fprintf(stderr, "Filter: %s\n", err);
+            return 1;
+        }
+        if (filter.nstate > 0) {
+            fprintf(stderr, "Filter: integrate, ddt and ema need rows in order, not available here\n");
+            return 1;
+        }
+        filtering = 1;
+    }
+    for (int i = 0; i < nspecs; ++i) {
+        if (parse_histogram(hist_specs[i]) != 0) return 1;
+    }
+
+    static totals_t totals;
+    double seconds;
+
+    if (bench) {
+        // The first pass also warms the page cache
+        double base = 0;
+        run(1, &totals, &seconds);
+        printf("Threads,Seconds,MB/s,Speedup,Efficiency\n");
+        for (int n = 1; n <= threads; n = n * 2 > threads && n < threads ? threads : n * 2) {
+            run(n, &totals, &seconds);
+            if (n == 1) base = seconds;
+            printf("%d,%.3f,%.0f,%.2f,%.0f%%\n", n, seconds, totals.bytes / 1e6 / seconds, base / seconds,
+                   100 * base / seconds / n);
+            fflush(stdout);
+        }
+    } else {
+        run(threads, &totals, &seconds);
+        print_stats(&totals);
+        for (int h = 0; h < nhistograms; ++h) print_histogram(&totals, h);
+        printf("\n");
+    }
+
+    printf("%llu rows, %llu matched in %d files, %.1f MB in %.3f s (%.0f MB/s, %d threads)\n",
+           (unsigned long long)totals.rows, (unsigned long long)totals.matched, nsegments, totals.bytes / 1e6,
+           seconds, totals.bytes / 1e6 / seconds, nthreads);
+    return 0;
+}
@@ -25,7 +25,7 @@
 // Compile & Run:
 // ==============
 //
-// gcc obd_background_logger_dtc.c -o obd_logger_dtc -lbluetooth
+// gcc obd_background_logger_dtc.c obd_dtc.c obd_session.c obd_metrics.c obd_trace.c obd_capture.c -o obd_logger_dtc -lbluetooth -lpthread -lm
 // ./obd_logger_dtc
 //
 // Output:
@@ -101,6 +101,8 @@
 #include <bluetooth/bluetooth.h>
 #include <bluetooth/rfcomm.h>
 
+#include "obd_dtc.h"
+
 #define BT_ADDR "00:1D:A5:68:98:8B"
 #define RFCOMM_CHANNEL 1
 
@@ -131,25 +133,6 @@ int parse_response(const char* response, const char* expected_pid, int* bytes, u
     return 0;
 }
 
-void decode_dtc(const unsigned char* data, int len, FILE* dtc_log, const char* timestamp) {
-    if (len < 3 || data[0] != 0x43) return;
-
-    for (int i = 1; i + 1 < len && (data[i] != 0x00 || data[i+1] != 0x00); i += 2) {
-        char dtc[6];
-        char first;
-
-        switch ((data[i] & 0xC0) >> 6) {
-            case 0: first = 'P'; break;
-            case 1: first = 'C'; break;
-            case 2: first = 'B'; break;
-            case 3: first = 'U'; break;
-        }
-
-        snprintf(dtc, sizeof(dtc), "%c%01X%02X", first, (data[i] & 0x3F) >> 4, ((data[i] & 0x0F) << 4) | (data[i+1] >> 4));
-        fprintf(dtc_log, "%s,DTC,%s\n", timestamp, dtc);
-    }
-}
-
 char* generate_filename(const char* prefix) {
     static char filename[64];
     time_t now = time(NULL);
@@ -226,10 +209,14 @@ int main() {
         if (++dtc_counter >= 60) {
             dtc_counter = 0;
             send_obd_command(sock, "03", response, sizeof(response));
-            if (parse_response(response, "43", &len, data) == 0 && len > 1) {
-                decode_dtc(data, len, dtc_log, ts);
-                fflush(dtc_log);
+            uint16_t codes[OBD_DTC_MAX];
+            int n = obd_dtc_decode(0x03, response, codes, OBD_DTC_MAX);
+            for (int i = 0; i < n; ++i) {
+                char dtc[6];
+                obd_dtc_format(codes[i], dtc);
+                fprintf(dtc_log, "%s,DTC,%s\n", ts, dtc);
             }
+            if (n > 0) fflush(dtc_log);
         }
 
         sleep(1);
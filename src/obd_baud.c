@@ -0,0 +1,249 @@
+/*
+ * obd_baud.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "obd_baud.h"
+#include "obd_device.h"
+
+static const int RATES[] = { 500000, 230400, 115200 };
+#define NRATES ((int)(sizeof(RATES) / sizeof(RATES[0])))
+
+// Link
+// ====
+
+static int send_raw(obd_session_t* s, const char* text) {
+    return s->ops->write(s->ctx, text, (int)strlen(text)) == (int)strlen(text) ? 0 : -1;
+}
+
+// Reads until one of the stop strings arrives or timeout_ms passes;
+// the index of the stop string, -1 without one
+static int read_until(obd_session_t* s, char* buf, int maxlen, const char* const* stops, int timeout_ms) {
+    uint64_t deadline = obd_now_us() + (uint64_t)timeout_ms * 1000;
+    int len = 0;
+
+    buf[0] = '\0';
+    while (len < maxlen - 1) {
+        uint64_t now = obd_now_us();
+        if (now >= deadline) break;
+        int n = s->ops->read(s->ctx, buf + len, maxlen - 1 - len, (int)((deadline - now + 999) / 1000));
+        if (n <= 0) break;
+        len += n;
+        buf[len] = '\0';
+        // Garbage at the wrong rate may contain NULs
+        for (int i = len - n; i < len; ++i) {
+            if (buf[i] == '\0') buf[i] = '.';
+        }
+        for (int k = 0; stops[k]; ++k) {
+            if (strstr(buf, stops[k])) return k;
+        }
+    }
+    return -1;
+}
+
+static const char* const PROMPT[] = { ">", NULL };
+
+// "AT E0" answered with OK and a prompt at the current rate
+static int responds(obd_session_t* s) {
+    char buf[128];
+
+    return send_raw(s, "AT E0\r") == 0 && read_until(s, buf, sizeof(buf), PROMPT, OBD_RESYNC_TIMEOUT_MS) == 0 &&
+           strstr(buf, "OK");
+}
+
+// 1 switched, 0 not at this rate, -1 no AT BRD at all
+static int handshake(obd_session_t* s, int from, int baud) {
+    static const char* const ANSWER[] = { "OK", "?", NULL };
+    static const char* const ID[] = { "\r", NULL };
+    char cmd[16], buf[128];
+
+    snprintf(cmd, sizeof(cmd), "AT BRD %02X\r", (4000000 + baud / 2) / baud);
+    if (send_raw(s, cmd) != 0) return 0;
+    int answer = read_until(s, buf, sizeof(buf), ANSWER, OBD_RESYNC_TIMEOUT_MS);
+    if (answer != 0) {
+        if (!strchr(buf, '>')) read_until(s, buf, sizeof(buf), PROMPT, OBD_RESYNC_TIMEOUT_MS);
+        return answer == 1 ? -1 : 0;
+    }
+
+    // The AT I string at the new rate, then our confirmation
+    if (obd_device_configure_tty(s->fd, baud) == 0 &&
+        read_until(s, buf, sizeof(buf), ID, OBD_BAUD_BRT_MS) == 0 && strstr(buf, "ELM") &&
+        send_raw(s, "\r") == 0 && read_until(s, buf, sizeof(buf), PROMPT, OBD_RESYNC_TIMEOUT_MS) == 0)
+        return 1;
+
+    // The adapter falls back after the timeout and prompts at the old rate
+    obd_device_configure_tty(s->fd, from);
+    read_until(s, buf, sizeof(buf), PROMPT, OBD_BAUD_BRT_MS + OBD_RESYNC_TIMEOUT_MS);
+    return 0;
+}
+
+void obd_baud_measure(obd_session_t* s, const char* cmd, int n, double* bytes_per_s, double* samples_per_s) {
+    char line[32], buf[512];
+    long bytes = 0;
+    int answered = 0;
+
+    snprintf(line, sizeof(line), "%s\r", cmd);
+    // The first request may start the protocol search, it is not timed
+    send_raw(s, line);
+    read_until(s, buf, sizeof(buf), PROMPT, OBD_DEFAULT_TIMEOUT_MS);
+
+    uint64_t start = obd_now_us();
+    for (int i = 0; i < n; ++i) {
+        if (send_raw(s, line) != 0) break;
+        int got = read_until(s, buf, sizeof(buf), PROMPT, OBD_DEFAULT_TIMEOUT_MS);
+        bytes += (long)strlen(line) + (long)strlen(buf);
+        if (got == 0 && obd_classify_reply(buf) == OBD_REPLY_OK) answered++;
+    }
+    double elapsed = (obd_now_us() - start) / 1e6;
+
+    *bytes_per_s = elapsed > 0 ? bytes / elapsed : 0;
+    *samples_per_s = elapsed > 0 ? answered / elapsed : 0;
+}
+
+// Cache
+// =====
+
+typedef struct {
+    char device[128];
+    int baud;
+    long long updated;
+} entry_t;
+
+static int load_cache(const char* path, entry_t* entries) {
+    char line[256];
+    int n = 0;
+
+    FILE* f = fopen(path, "r");
+    if (!f) return 0;
+    while (n < OBD_BAUD_CACHE_MAX && fgets(line, sizeof(line), f)) {
+        char* baud = strchr(line, '\t');
+        char* updated = baud ? strchr(baud + 1, '\t') : NULL;
+        if (!updated || baud == line) continue;
+        *baud++ = '\0';
+
+        entry_t* e = &entries[n++];
+        snprintf(e->device, sizeof(e->device), "%.127s", line);
+        e->baud = atoi(baud);
+        e->updated = atoll(updated + 1);
+    }
+    fclose(f);
+    return n;
+}
+
+static void save_cache(const char* path, const entry_t* entries, int n) {
+    char tmp[520];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+    FILE* f = fopen(tmp, "w");
+    if (!f) {
+        perror(tmp);
+        return;
+    }
+    for (int i = 0; i < n; ++i) fprintf(f, "%s\t%d\t%lld\n", entries[i].device, entries[i].baud, entries[i].updated);
+    if (fclose(f) != 0 || rename(tmp, path) != 0) {
+        perror(path);
+        remove(tmp);
+    }
+}
+
+static void remember(const char* path, const char* device, int baud) {
+    entry_t entries[OBD_BAUD_CACHE_MAX];
+    entry_t* e = NULL;
+    int n = load_cache(path, entries);
+
+    for (int i = 0; i < n && !e; ++i) {
+        if (strcmp(entries[i].device, device) == 0) e = &entries[i];
+    }
+    if (e && e->baud == baud) return;
+    if (!e && n < OBD_BAUD_CACHE_MAX) {
+        e = &entries[n++];
+    } else if (!e) {
+        // Full: the entry updated longest ago makes room
+        e = &entries[0];
+        for (int i = 1; i < n; ++i) {
+            if (entries[i].updated < e->updated) e = &entries[i];
+        }
+    }
+    snprintf(e->device, sizeof(e->device), "%s", device);
+    e->baud = baud;
+    e->updated = (long long)time(NULL);
+    save_cache(path, entries, n);
+}
+
+static int remembered(const char* path, const char* device) {
+    entry_t entries[OBD_BAUD_CACHE_MAX];
+    int n = path ? load_cache(path, entries) : 0;
+
+    for (int i = 0; i < n; ++i) {
+        if (strcmp(entries[i].device, device) == 0) return entries[i].baud;
+    }
+    return 0;
+}
+
+// Negotiation
+// ===========
+
+int obd_baud_negotiate(obd_baud_t* b, obd_session_t* s, int max_baud, int measure,
+                       const char* device, const char* cache_path) {
+    char key[128];
+
+    memset(b, 0, sizeof(*b));
+    b->from = b->baud = obd_device_baud(s->fd);
+    if (b->baud == 0) return -1;
+
+    // The device without "@baud"
+    snprintf(key, sizeof(key), "%.*s", (int)strcspn(device, "@"), device);
+    int cached = remembered(cache_path, key);
+
+    if (!responds(s)) {
+        // An earlier run may have left the adapter at the remembered rate
+        if (cached > 0 && cached != b->from && obd_device_configure_tty(s->fd, cached) == 0 && responds(s)) {
+            b->baud = cached;
+            b->cached = b->resumed = 1;
+            return b->baud;
+        }
+        obd_device_configure_tty(s->fd, b->from);
+        return -1;
+    }
+    if (cached == b->from) {
+        b->cached = 1;
+        return b->baud;
+    }
+
+    // The remembered rate first, then the others from the top
+    int order[NRATES + 1], n = 0;
+    if (cached > b->from && cached <= max_baud) order[n++] = cached;
+    for (int i = 0; i < NRATES; ++i) {
+        if (RATES[i] > b->from && RATES[i] <= max_baud && RATES[i] != cached) order[n++] = RATES[i];
+    }
+    if (n == 0) return b->baud;
+
+    if (measure > 0) obd_baud_measure(s, "0100", measure, &b->bytes_per_s[0], &b->samples_per_s[0]);
+
+    char buf[64];
+    snprintf(buf, sizeof(buf), "AT BRT %02X\r", OBD_BAUD_BRT_MS / 5);
+    int supported = send_raw(s, buf) == 0 && read_until(s, buf, sizeof(buf), PROMPT, OBD_RESYNC_TIMEOUT_MS) == 0 &&
+                    !strchr(buf, '?');
+
+    for (int i = 0; supported && i < n; ++i) {
+        b->attempts++;
+        int r = handshake(s, b->from, order[i]);
+        if (r < 0) break;
+        if (r == 0) continue;
+        b->baud = order[i];
+        b->cached = order[i] == cached;
+        break;
+    }
+
+    if (cache_path) remember(cache_path, key, b->baud);
+    if (measure > 0 && b->baud != b->from)
+        obd_baud_measure(s, "0100", measure, &b->bytes_per_s[1], &b->samples_per_s[1]);
+    return b->baud;
+}
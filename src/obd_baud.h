@@ -0,0 +1,81 @@
+/*
+ * obd_baud.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+#ifndef OBD_BAUD_H
+#define OBD_BAUD_H
+
+//
+// Serial link speed-up for wired ELM327 adapters. Sockets and RFCOMM ttys
+// (/dev/rfcomm*) have no line rate to change (obd_device_baud() is 0) and
+// are left alone.
+//
+// At the 38400 baud an ELM327 starts at, "010C" and its reply are about 20
+// bytes, 5 ms on the wire, and a multi-frame reply takes much longer. The
+// ELM327 (v1.2 and later) can switch to a faster rate on request:
+//
+//    AT BRT 28        handshake timeout, 0x28 * 5 ms = 200 ms
+//    AT BRD 08        divisor of 4 MHz: 23 = 115200, 11 = 230400, 08 = 500000
+//    OK               still at the old rate; the adapter switches, then sends
+//    ELM327 v1.5      its AT I string at the new rate
+//    \r               which we confirm within the timeout; the adapter
+//    >                answers with a prompt at the new rate
+//
+// Without the confirmation (garbage at our end, or a USB bridge that cannot
+// do the rate) the adapter goes back to the old rate on its own, we do the
+// same, and the next lower rate is tried. "?" means the adapter has no
+// AT BRD and nothing more is tried.
+//
+// The rate that worked is remembered per device in obd_baud.cache:
+//
+//    <device>\t<baud>\t<updated unix time>
+//
+// The next negotiation goes straight to it instead of trying the faster
+// rates again. A logger restarted without a power cycle in between finds
+// the adapter still at that rate, and so does a reconnect. A cached rate
+// equal to the start rate means "no speed-up" and nothing is tried.
+//
+// AT Z puts the adapter back at its power-on rate, AT WS keeps the rate:
+// negotiate first, then reset with AT WS when the rate changed.
+// obd_baud_negotiate() talks to the transport below obd_session_command(),
+// so the handshake shows up neither in the metrics nor in a capture.
+//
+
+#include "obd_session.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OBD_BAUD_CACHE_FILE "obd_baud.cache"
+#define OBD_BAUD_CACHE_MAX 16
+#define OBD_BAUD_MAX 500000
+#define OBD_BAUD_BRT_MS 200
+#define OBD_BAUD_MEASURE 8          // timed requests before and after
+
+typedef struct {
+    int from, baud;                 // rate the port was opened at, rate in use
+    int cached;                     // baud came from the cache
+    int resumed;                    // the adapter was still at baud from an earlier run
+    int attempts;                   // AT BRD handshakes sent
+    double bytes_per_s[2], samples_per_s[2];    // before and after, 0 when not measured
+} obd_baud_t;
+
+// Switches the serial port behind s (and the adapter) to the fastest rate up
+// to max_baud both manage. With measure > 0 that many "0100" requests are
+// timed before the first handshake and after a successful one. Returns the
+// rate in use, -1 when s is not a serial port or the adapter does not answer.
+int obd_baud_negotiate(obd_baud_t* b, obd_session_t* s, int max_baud, int measure,
+                       const char* device, const char* cache_path);
+
+// Times n requests of cmd: bytes/s both ways, and answered requests/s
+void obd_baud_measure(obd_session_t* s, const char* cmd, int n, double* bytes_per_s, double* samples_per_s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,651 @@
+/*
+ * obd_bench.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+//
+// End-to-end benchmark of the acquisition pipeline
+//
+// Runs obd_logger_merged against obd_emulator for a few configurations and
+// reports, per configuration:
+//
+//    samples/s per PID    rows in the log with a value for that channel
+//    rounds/s             complete polling rounds written
+//    disk latency         p50 / p90 / p99 from the first request of a round
+//                         to its sample being written to the log file
+//                         (obd_sample_disk_latency_seconds, interpolated)
+//    CPU %, max RSS       of the logger process (wait4 rusage)
+//    drops                obd_ring_overflows_total (sink queues that overflowed)
+//
+// Configurations: one PID per request vs six PIDs per request (-B 6), and
+// the CSV vs the binary log (-f csv / -f bin). The logger polls back to
+// back (-i 0) so the numbers show the pipeline limit, not the 1 s default.
+// The *-spaced runs keep spaces in the adapter replies (-w spaced); against
+// the others they show what AT S0 saves in bytes per sample and what that
+// buys in samples/s once the link is slow (-b 38400):
+//
+//    bytes_per_sample     adapter bytes in and out per decoded value
+//                         (obd_bytes_in_total + obd_bytes_out_total)
+//
+// The result is JSON on stdout (or -o file), one object per configuration,
+// so runs can be diffed or plotted to catch regressions.
+//
+// Recovery (-R): one run per fault type of obd_fault.h, injected every -G ms
+// (8000 by default) into the logger's adapter link. Per fault it reports the
+// time to recover, from the fault to the end of the first complete round
+// after it, and the samples lost against the fault-free round rate. The
+// logger runs with -T 1000 unless -T says otherwise, as that timeout bounds
+// most recovery paths.
+//
+// Compile & Run
+// =============
+//
+// gcc obd_bench.c obd_store.c obd_pids.c -o obd_bench -lm
+//
+// ./obd_bench                               10 s per configuration, 5 ms adapter latency
+// ./obd_bench -t 30 -l 20 -b 38400 -o bench.json
+// ./obd_bench -c single-bin                 one configuration only
+// ./obd_bench -b 38400 -c single-spaced     the same link with spaces in the replies
+// ./obd_bench -R -t 40                      recovery per fault type
+//
+// Options: -t seconds, -l emulator latency ms, -b emulator baud (0 = no
+// throttling), -e emulator binary, -g logger binary, -p metrics port,
+// -c configuration (or fault with -R), -o output file, -R recovery mode,
+// -T logger command timeout ms, -G ms between faults.
+//
+// Example Output
+// ==============
+//
+// ./obd_bench -t 4 (emulator at its default 5 ms latency, no throttling):
+//
+// {"duration_s":4,"emulator_latency_ms":5,"emulator_baud":0,"runs":[
+// {"name":"single-csv","pids_per_request":1,"format":"csv","wire":"compact","rounds_per_s":18.67,
+//  "samples_per_s":{"RPM":18.67,"Speed":18.67,...},"total_samples_per_s":186.67,"bytes_per_sample":14.4,
+//  "disk_latency_ms":{"p50":75.000,"p90":95.000,"p99":99.500,"count":111},
+//  "cpu_percent":1.0,"max_rss_kb":2816,"drops":0},
+// ...
+// {"name":"batch-csv","pids_per_request":6,"format":"csv","wire":"compact","rounds_per_s":94.67,
+//  "samples_per_s":{"RPM":94.67,"Speed":94.67,...},"total_samples_per_s":946.67,"bytes_per_sample":10.1,
+//  "disk_latency_ms":{"p50":17.513,"p90":23.524,"p99":24.877,"count":559},
+//  "cpu_percent":2.0,"max_rss_kb":2920,"drops":0},
+// ...
+// ]}
+//
+// ./obd_bench -R -t 18 -G 5000 (a fault every 5 s rather than the default 8):
+//
+// {"duration_s":18,"emulator_latency_ms":5,"command_timeout_ms":1000,"gap_ms":5000,"faults":[
+// {"fault":"corrupt","events":3,"recovered":3,"ttr_ms":{"mean":76.8,"max":95.9},"samples_lost":{"mean":1.2,"total":4}},
+// {"fault":"disconnect","events":3,"recovered":3,"ttr_ms":{"mean":3581.1,"max":3598.3},"samples_lost":{"mean":1008.1,"total":3024}},
+// ...
+// ]}
+//
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <math.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "obd_pids.h"
+#include "obd_store.h"
+
+#define WARMUP_SEC 2
+#define METRICS_PORT 9181
+#define MAX_BUCKETS 32
+#define RECOVERY_SECONDS 40
+#define RECOVERY_TIMEOUT_MS 1000
+#define RECOVERY_GAP_MS 8000
+
+typedef struct {
+    const char* name;
+    int per_request;
+    const char* format;
+    const char* wire;       // logger -w
+} bench_config_t;
+
+static const bench_config_t CONFIGS[] = {
+    { "single-csv",    1, "csv", "compact" },
+    { "single-bin",    1, "bin", "compact" },
+    { "batch-csv",     6, "csv", "compact" },
+    { "batch-bin",     6, "bin", "compact" },
+    { "single-spaced", 1, "csv", "spaced" },
+    { "batch-spaced",  6, "csv", "spaced" },
+};
+static const int NCONFIGS = sizeof(CONFIGS) / sizeof(CONFIGS[0]);
+
+typedef struct {
+    double rounds_per_s;
+    double samples_per_s[OBD_MAX_CHANNELS];
+    double total_per_s;
+    double bytes_per_s;     // adapter link, both ways
+    double p50, p90, p99;
+    unsigned long long latency_count;
+    double cpu_percent;
+    long max_rss_kb;
+    unsigned long long drops;
+} bench_result_t;
+
+static double unix_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static pid_t spawn(char* const argv[], const char* log_path) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        int fd = open(log_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd >= 0) {
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+            close(fd);
+        }
+        execv(argv[0], argv);
+        perror(argv[0]);
+        _exit(127);
+    }
+    if (pid < 0) perror("fork");
+    return pid;
+}
+
+static int wait_for_path(const char* path, int timeout_ms) {
+    struct stat st;
+    for (int waited = 0; waited < timeout_ms; waited += 10) {
+        if (stat(path, &st) == 0) return 0;
+        usleep(10000);
+    }
+    return -1;
+}
+
+// GET http://127.0.0.1:port/metrics into a malloc'ed string
+static char* fetch_metrics(int port) {
+    struct sockaddr_in addr = { 0 };
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return NULL;
+
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return NULL;
+    }
+
+    const char* req = "GET /metrics HTTP/1.0\r\n\r\n";
+    if (write(fd, req, strlen(req)) < 0) {
+        close(fd);
+        return NULL;
+    }
+
+    size_t cap = 65536, len = 0;
+    char* buf = malloc(cap);
+    ssize_t n;
+    while (buf && (n = read(fd, buf + len, cap - len - 1)) > 0) {
+        len += n;
+        if (len + 1 >= cap) {
+            cap *= 2;
+            buf = realloc(buf, cap);
+        }
+    }
+    close(fd);
+    if (buf) buf[len] = '\0';
+    return buf;
+}
+
+// Quantile from cumulative Prometheus buckets, linear inside a bucket
+static double bucket_quantile(const double* le, const double* cum, int n, double q) {
+    if (n == 0 || cum[n - 1] == 0) return -1;
+    double rank = q * cum[n - 1];
+    double prev_le = 0, prev_cum = 0;
+
+    for (int i = 0; i < n; ++i) {
+        if (cum[i] >= rank) {
+            if (isinf(le[i])) return prev_le;
+            double in_bucket = cum[i] - prev_cum;
+            double f = in_bucket > 0 ? (rank - prev_cum) / in_bucket : 1;
+            return prev_le + f * (le[i] - prev_le);
+        }
+        prev_le = le[i];
+        prev_cum = cum[i];
+    }
+    return prev_le;
+}
+
+// obd_bytes_in_total + obd_bytes_out_total
+static double link_bytes(const char* text) {
+    double bytes = 0;
+    for (const char* line = text; line && *line; ) {
+        const char* eol = strchr(line, '\n');
+        if (strncmp(line, "obd_bytes_in_total ", 19) == 0) bytes += atof(line + 19);
+        else if (strncmp(line, "obd_bytes_out_total ", 20) == 0) bytes += atof(line + 20);
+        line = eol ? eol + 1 : NULL;
+    }
+    return bytes;
+}
+
+static void parse_metrics(const char* text, const char* sink, bench_result_t* r) {
+    double le[MAX_BUCKETS], cum[MAX_BUCKETS];
+    int n = 0;
+    char prefix[128];
+
+    snprintf(prefix, sizeof(prefix), "obd_sample_disk_latency_seconds_bucket{sink=\"%s\",le=\"", sink);
+
+    for (const char* line = text; line && *line; ) {
+        const char* eol = strchr(line, '\n');
+
+        if (strncmp(line, prefix, strlen(prefix)) == 0 && n < MAX_BUCKETS) {
+            const char* p = line + strlen(prefix);
+            le[n] = strncmp(p, "+Inf", 4) == 0 ? INFINITY : atof(p);
+            const char* v = strchr(p, ' ');
+            cum[n] = v ? atof(v + 1) : 0;
+            n++;
+        } else if (strncmp(line, "obd_ring_overflows_total ", 25) == 0) {
+            r->drops = strtoull(line + 25, NULL, 10);
+        }
+        line = eol ? eol + 1 : NULL;
+    }
+
+    r->latency_count = n ? (unsigned long long)cum[n - 1] : 0;
+    r->p50 = bucket_quantile(le, cum, n, 0.50) * 1000;
+    r->p90 = bucket_quantile(le, cum, n, 0.90) * 1000;
+    r->p99 = bucket_quantile(le, cum, n, 0.99) * 1000;
+}
+
+static int find_log(const char* dir, const char* ext, char* out, size_t len) {
+    DIR* d = opendir(dir);
+    struct dirent* e;
+    if (!d) return -1;
+
+    int found = -1;
+    while ((e = readdir(d)) != NULL) {
+        const char* dot = strrchr(e->d_name, '.');
+        if (strncmp(e->d_name, "obd_log_", 8) == 0 && dot && strcmp(dot + 1, ext) == 0) {
+            snprintf(out, len, "%s/%s", dir, e->d_name);
+            found = 0;
+        }
+    }
+    closedir(d);
+    return found;
+}
+
+// Counts values per channel in rows stamped inside [from, to) unix seconds
+static int count_samples(const char* dir, const char* format, long from, long to, long* per_channel, long* rows) {
+    char path[600];
+
+    *rows = 0;
+    for (int i = 0; i < OBD_MAX_CHANNELS; ++i) per_channel[i] = 0;
+
+    if (strcmp(format, "bin") == 0) {
+        obd_store_reader_t r;
+        if (find_log(dir, "bin", path, sizeof(path)) != 0 || obd_store_open(&r, path) != 0) return -1;
+
+        uint64_t first = obd_store_lower_bound(&r, (int64_t)from * 1000000);
+        uint64_t last = obd_store_lower_bound(&r, (int64_t)to * 1000000);
+        for (uint64_t k = first; k < last; ++k) {
+            uint32_t valid = obd_store_record(&r, k)->valid;
+            for (uint32_t i = 0; i < r.hdr->nchannels; ++i) {
+                if (valid & (1u << i)) per_channel[i]++;
+            }
+            (*rows)++;
+        }
+        obd_store_unmap(&r);
+        return 0;
+    }
+
+    if (find_log(dir, "csv", path, sizeof(path)) != 0) return -1;
+    FILE* f = fopen(path, "r");
+    if (!f) return -1;
+
+    char line[1024];
+    if (!fgets(line, sizeof(line), f)) {
+        fclose(f);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        struct tm tm = { 0 };
+        char* rest = strptime(line, "%Y-%m-%d %H:%M:%S", &tm);
+        if (!rest) continue;
+        tm.tm_isdst = -1;
+        long t = (long)mktime(&tm);
+        if (t < from || t >= to) continue;
+
+        (*rows)++;
+        int ch = 0;
+        for (char* tok = strtok(rest, ",\n"); tok && ch < OBD_MAX_CHANNELS; tok = strtok(NULL, ",\n"), ++ch) {
+            if (strcmp(tok, "-1") != 0 && strcmp(tok, "-1.00") != 0) per_channel[ch]++;
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+static void remove_tree(const char* dir) {
+    char cmd[600];
+    snprintf(cmd, sizeof(cmd), "rm -rf '%s'", dir);
+    if (system(cmd) != 0) fprintf(stderr, "could not remove %s\n", dir);
+}
+
+typedef struct {
+    const char* emulator;
+    const char* logger;
+    int seconds, latency_ms, baud, port;
+    int timeout_ms;         // logger -T, 0 = its default
+} bench_env_t;
+
+typedef struct {
+    char log_log[300];
+    double started, stopped, wall;
+    struct rusage ru;
+    char* metrics;          // malloc'ed, NULL when the scrape failed
+    double link_bytes_per_s;    // between the end of the warm-up and the last scrape
+} bench_run_t;
+
+// Emulator plus logger in dir for the warm-up and the measured seconds
+static int run_logger(const bench_env_t* env, const char* name, int per_request, const char* format,
+                      const char* wire, const char* fault_spec, const char* dir, bench_run_t* run) {
+    char sock[256], device[300], lat[16], bd[16], per[8], prt[16], tmo[16], emu_log[300];
+    snprintf(sock, sizeof(sock), "%s/elm.sock", dir);
+    snprintf(device, sizeof(device), "unix:%s", sock);
+    snprintf(lat, sizeof(lat), "%d", env->latency_ms);
+    snprintf(bd, sizeof(bd), "%d", env->baud);
+    snprintf(per, sizeof(per), "%d", per_request);
+    snprintf(prt, sizeof(prt), "%d", env->port);
+    snprintf(tmo, sizeof(tmo), "%d", env->timeout_ms > 0 ? env->timeout_ms : 5000);
+    snprintf(emu_log, sizeof(emu_log), "%s/emulator.log", dir);
+    snprintf(run->log_log, sizeof(run->log_log), "%s/logger.log", dir);
+
+    char* emu_argv[] = { (char*)env->emulator, "-u", sock, "-l", lat, "-b", bd, "-L", "ATZ=0", NULL };
+    pid_t emu = spawn(emu_argv, emu_log);
+    if (emu < 0 || wait_for_path(sock, 3000) != 0) {
+        fprintf(stderr, "%s: emulator did not start, see %s\n", name, emu_log);
+        if (emu > 0) kill(emu, SIGTERM);
+        return -1;
+    }
+
+    char* log_argv[] = { (char*)env->logger, "-d", device, "-o", (char*)dir, "-i", "0", "-B", per,
+                         "-f", (char*)format, "-m", prt, "-s", "none", "-T", tmo, "-g", "run", "-w", (char*)wire,
+                         fault_spec ? "-F" : NULL, (char*)fault_spec, NULL };
+    run->started = unix_now();
+    pid_t lg = spawn(log_argv, run->log_log);
+    if (lg < 0) {
+        kill(emu, SIGTERM);
+        waitpid(emu, NULL, 0);
+        return -1;
+    }
+
+    sleep(WARMUP_SEC);
+    char* warm = fetch_metrics(env->port);
+    double warm_at = unix_now();
+    sleep(env->seconds);
+    run->metrics = fetch_metrics(env->port);
+    run->stopped = unix_now();
+    run->link_bytes_per_s = warm && run->metrics ? (link_bytes(run->metrics) - link_bytes(warm)) / (run->stopped - warm_at) : 0;
+    free(warm);
+    kill(lg, SIGTERM);
+
+    int status;
+    if (wait4(lg, &status, 0, &run->ru) < 0) perror("wait4");
+    run->wall = unix_now() - run->started;
+    kill(emu, SIGTERM);
+    waitpid(emu, NULL, 0);
+    return 0;
+}
+
+static int run_config(const bench_env_t* env, const bench_config_t* c, bench_result_t* r) {
+    char dir[] = "/tmp/obd_bench.XXXXXX";
+    bench_run_t run;
+
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return -1;
+    }
+    if (run_logger(env, c->name, c->per_request, c->format, c->wire, NULL, dir, &run) != 0) return -1;
+
+    memset(r, 0, sizeof(*r));
+    const struct rusage* ru = &run.ru;
+    double cpu = ru->ru_utime.tv_sec + ru->ru_utime.tv_usec / 1e6 + ru->ru_stime.tv_sec + ru->ru_stime.tv_usec / 1e6;
+    r->cpu_percent = run.wall > 0 ? 100.0 * cpu / run.wall : 0;
+    r->max_rss_kb = ru->ru_maxrss;
+    r->bytes_per_s = run.link_bytes_per_s;
+
+    if (run.metrics) {
+        parse_metrics(run.metrics, strcmp(c->format, "bin") == 0 ? "store" : "csv", r);
+        free(run.metrics);
+    } else {
+        fprintf(stderr, "%s: no metrics on port %d\n", c->name, env->port);
+        r->p50 = r->p90 = r->p99 = -1;
+    }
+
+    // Whole seconds after the warm-up, so CSV timestamps count exactly
+    long from = (long)ceil(run.started + WARMUP_SEC), to = (long)floor(run.stopped);
+    long per_channel[OBD_MAX_CHANNELS], rows;
+    if (to <= from || count_samples(dir, c->format, from, to, per_channel, &rows) != 0) {
+        fprintf(stderr, "%s: no samples, see %s\n", c->name, run.log_log);
+        return -1;
+    }
+
+    r->rounds_per_s = (double)rows / (to - from);
+    for (int i = 0; i < OBD_PID_COUNT; ++i) {
+        r->samples_per_s[i] = (double)per_channel[i] / (to - from);
+        r->total_per_s += r->samples_per_s[i];
+    }
+
+    remove_tree(dir);
+    return 0;
+}
+
+static void print_result(FILE* out, const bench_config_t* c, const bench_result_t* r, int first) {
+    fprintf(out, "%s\n{\"name\":\"%s\",\"pids_per_request\":%d,\"format\":\"%s\",\"wire\":\"%s\",\"rounds_per_s\":%.2f,",
+            first ? "" : ",", c->name, c->per_request, c->format, c->wire, r->rounds_per_s);
+    fprintf(out, "\"samples_per_s\":{");
+    for (int i = 0; i < OBD_PID_COUNT; ++i)
+        fprintf(out, "%s\"%s\":%.2f", i ? "," : "", OBD_PIDS[i].name, r->samples_per_s[i]);
+    fprintf(out, "},\"total_samples_per_s\":%.2f,\"bytes_per_sample\":%.1f,", r->total_per_s,
+            r->total_per_s > 0 ? r->bytes_per_s / r->total_per_s : 0);
+    fprintf(out, "\"disk_latency_ms\":{\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f,\"count\":%llu},",
+            r->p50, r->p90, r->p99, r->latency_count);
+    fprintf(out, "\"cpu_percent\":%.1f,\"max_rss_kb\":%ld,\"drops\":%llu}",
+            r->cpu_percent, r->max_rss_kb, r->drops);
+}
+
+// Recovery
+// ========
+
+typedef struct {
+    int events, recovered;
+    double ttr_sum_ms, ttr_max_ms;
+    double lost_sum;
+} recovery_result_t;
+
+static int cmp_int64(const void* a, const void* b) {
+    int64_t x = *(const int64_t*)a, y = *(const int64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+// For every fault: time until the first complete round after it has been
+// written, and the samples a fault-free run would have had meanwhile
+static void analyse_faults(const obd_store_reader_t* st, const int64_t* faults, int nfaults, recovery_result_t* r) {
+    uint64_t n = st->count;
+    uint32_t full = 0;
+    memset(r, 0, sizeof(*r));
+    if (n < 3) return;
+
+    for (uint64_t k = 0; k < n; ++k) full |= obd_store_record(st, k)->valid;
+    int nch = __builtin_popcount(full);
+
+    // Typical round time: median spacing between rounds
+    int64_t* gaps = malloc((n - 1) * sizeof(int64_t));
+    if (!gaps) return;
+    for (uint64_t k = 1; k < n; ++k) gaps[k - 1] = obd_store_record(st, k)->t_us - obd_store_record(st, k - 1)->t_us;
+    qsort(gaps, n - 1, sizeof(int64_t), cmp_int64);
+    double round_us = (double)gaps[(n - 1) / 2];
+    free(gaps);
+
+    for (int i = 0; i < nfaults; ++i) {
+        int64_t tf = faults[i];
+        uint64_t k = obd_store_lower_bound(st, tf + 1);
+        if (k == 0 || k >= n) continue;
+        r->events++;
+
+        // The round that was running when the fault hit
+        uint64_t hit = k - 1;
+        while (k < n && obd_store_record(st, k)->valid != full) ++k;
+        if (k + 1 >= n) continue;
+        if (i + 1 < nfaults && faults[i + 1] < obd_store_record(st, k + 1)->t_us) continue;
+
+        int64_t done = obd_store_record(st, k + 1)->t_us;
+        long delivered = 0;
+        for (uint64_t j = hit; j <= k; ++j) delivered += __builtin_popcount(obd_store_record(st, j)->valid);
+        double expected = (done - obd_store_record(st, hit)->t_us) / round_us * nch;
+        double ttr_ms = (done - tf) / 1000.0;
+
+        r->recovered++;
+        r->ttr_sum_ms += ttr_ms;
+        if (ttr_ms > r->ttr_max_ms) r->ttr_max_ms = ttr_ms;
+        r->lost_sum += expected > delivered ? expected - delivered : 0;
+    }
+}
+
+static int run_recovery(const bench_env_t* env, const char* fault, int gap_ms, recovery_result_t* r) {
+    char dir[] = "/tmp/obd_bench.XXXXXX";
+    char spec[600], path[600];
+    bench_run_t run;
+
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return -1;
+    }
+    snprintf(spec, sizeof(spec), "%s=1,gap=%d,seed=1,log=%s/faults.csv", fault, gap_ms, dir);
+    if (run_logger(env, fault, 1, "bin", "compact", spec, dir, &run) != 0) return -1;
+    free(run.metrics);
+
+    int64_t faults[1024];
+    int nfaults = 0;
+    snprintf(path, sizeof(path), "%s/faults.csv", dir);
+    FILE* f = fopen(path, "r");
+    if (f) {
+        long long t;
+        while (nfaults < 1024 && fscanf(f, "%lld,%*s", &t) == 1) faults[nfaults++] = t;
+        fclose(f);
+    }
+
+    obd_store_reader_t st;
+    if (find_log(dir, "bin", path, sizeof(path)) != 0 || obd_store_open(&st, path) != 0) {
+        fprintf(stderr, "%s: no samples, see %s\n", fault, run.log_log);
+        return -1;
+    }
+    analyse_faults(&st, faults, nfaults, r);
+    obd_store_unmap(&st);
+
+    remove_tree(dir);
+    return 0;
+}
+
+static void print_recovery(FILE* out, const char* fault, const recovery_result_t* r, int first) {
+    fprintf(out, "%s\n{\"fault\":\"%s\",\"events\":%d,\"recovered\":%d,", first ? "" : ",", fault, r->events, r->recovered);
+    if (r->recovered) {
+        fprintf(out, "\"ttr_ms\":{\"mean\":%.1f,\"max\":%.1f},\"samples_lost\":{\"mean\":%.1f,\"total\":%.0f}}",
+                r->ttr_sum_ms / r->recovered, r->ttr_max_ms, r->lost_sum / r->recovered, r->lost_sum);
+    } else {
+        fprintf(out, "\"ttr_ms\":null,\"samples_lost\":null}");
+    }
+}
+
+static const char* const FAULTS[] = { "delay", "truncate", "corrupt", "drop", "searching", "disconnect", "reset" };
+static const int NFAULTS = sizeof(FAULTS) / sizeof(FAULTS[0]);
+
+int main(int argc, char** argv) {
+    bench_env_t env = { "./obd_emulator", "./obd_logger_merged", 10, 5, 0, METRICS_PORT, 0 };
+    const char* only = NULL;
+    const char* out_path = NULL;
+    int recovery = 0, gap_ms = RECOVERY_GAP_MS, seconds_set = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:l:b:e:g:p:c:o:RT:G:")) != -1) {
+        switch (opt) {
+            case 't': env.seconds = atoi(optarg); seconds_set = 1; break;
+            case 'l': env.latency_ms = atoi(optarg); break;
+            case 'b': env.baud = atoi(optarg); break;
+            case 'e': env.emulator = optarg; break;
+            case 'g': env.logger = optarg; break;
+            case 'p': env.port = atoi(optarg); break;
+            case 'c': only = optarg; break;
+            case 'o': out_path = optarg; break;
+            case 'R': recovery = 1; break;
+            case 'T': env.timeout_ms = atoi(optarg); break;
+            case 'G': gap_ms = atoi(optarg); break;
+            default:
+                fprintf(stderr, "Usage: %s [-t seconds] [-l latency_ms] [-b baud] [-e emulator] [-g logger] "
+                                "[-p metrics_port] [-c config|fault] [-o out.json] [-R [-T timeout_ms] [-G gap_ms]]\n",
+                        argv[0]);
+                return 1;
+        }
+    }
+
+    FILE* out = out_path ? fopen(out_path, "w") : stdout;
+    if (!out) {
+        perror(out_path);
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    int first = 1, failed = 0;
+
+    if (recovery) {
+        if (!seconds_set) env.seconds = RECOVERY_SECONDS;
+        if (env.timeout_ms <= 0) env.timeout_ms = RECOVERY_TIMEOUT_MS;
+        fprintf(out, "{\"duration_s\":%d,\"emulator_latency_ms\":%d,\"command_timeout_ms\":%d,\"gap_ms\":%d,\"faults\":[",
+                env.seconds, env.latency_ms, env.timeout_ms, gap_ms);
+
+        for (int i = 0; i < NFAULTS; ++i) {
+            if (only && strcmp(only, FAULTS[i]) != 0) continue;
+
+            recovery_result_t r;
+            fprintf(stderr, "Injecting %s for %d s...\n", FAULTS[i], env.seconds);
+            if (run_recovery(&env, FAULTS[i], gap_ms, &r) != 0) {
+                failed++;
+                continue;
+            }
+            print_recovery(out, FAULTS[i], &r, first);
+            first = 0;
+            fflush(out);
+        }
+    } else {
+        fprintf(out, "{\"duration_s\":%d,\"emulator_latency_ms\":%d,\"emulator_baud\":%d,\"runs\":[",
+                env.seconds, env.latency_ms, env.baud);
+
+        for (int i = 0; i < NCONFIGS; ++i) {
+            if (only && strcmp(only, CONFIGS[i].name) != 0) continue;
+
+            bench_result_t r;
+            fprintf(stderr, "Running %s for %d s...\n", CONFIGS[i].name, env.seconds);
+            if (run_config(&env, &CONFIGS[i], &r) != 0) {
+                failed++;
+                continue;
+            }
+            print_result(out, &CONFIGS[i], &r, first);
+            first = 0;
+            fflush(out);
+        }
+    }
+
+    fprintf(out, "\n]}\n");
+    if (out != stdout) fclose(out);
+    return failed ? 1 : 0;
+}
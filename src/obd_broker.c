@@ -0,0 +1,555 @@
+/*
+ * obd_broker.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+//
+// Shared adapter broker
+//
+// Only one process can hold the RFCOMM link, so obd_extended, obd_dtc_decoder
+// and the logger could not run at the same time. The broker owns the adapter
+// and lets any number of local clients share it over a Unix socket.
+//
+// Features
+// ========
+//
+// Speaks the ELM327 protocol on the socket: send "010C\r", read until '>'.
+// Any tool that opens its link with obd_device_open() can use the broker by
+// passing unix:/tmp/obd_broker.sock instead of the Bluetooth address.
+//
+// Fair bus access: each client has its own FIFO and the broker serves the
+// clients round-robin, one bus request at a time.
+//
+// Request coalescing: identical requests waiting at the head of several
+// client queues go to the bus once, and every answer is cached for a short
+// TTL (500 ms by default). A diagnostic tool asking for RPM while the logger
+// polls it rides on the logger's traffic and adds no bus load.
+//
+// Adapter settings belong to the broker. The link runs with echo, linefeeds
+// and headers off and spaces on. Reset and formatting commands from clients
+// (AT Z, AT E0, AT L0, AT SP 0, ...) are answered locally with OK so one
+// client cannot change the link under another; see local_at() for what each
+// one means for the client. AT SH (3, 6 or 8 hex digits) is tracked per
+// client and applied before that client's requests. AT RV / AT DP / AT DPN
+// go to the adapter; other AT commands are answered with "?". Mode 04 (clear
+// DTCs) is never cached or coalesced.
+//
+// Replies a client's socket does not take at once are kept and sent when it
+// is writable again; a client that stops reading them is closed.
+//
+// When the link drops, the broker keeps serving: requests are answered with
+// "UNABLE TO CONNECT" and the adapter is reopened every 2 seconds in between.
+//
+// Compile & Run
+// =============
+//
+// gcc obd_broker.c obd_device.c obd_session.c obd_capture.c obd_metrics.c obd_trace.c -o obd_broker -lbluetooth -lpthread
+// ./obd_broker [-d 00:1D:A5:68:98:8B] [-s /tmp/obd_broker.sock] [-t ttl_ms]
+//
+// ./obd_extended unix:/tmp/obd_broker.sock
+// ./obd_logger_merged -d unix:/tmp/obd_broker.sock
+//
+// Journal output every 60 seconds:
+//
+// broker: 3 clients, 1240 requests, 610 bus commands, 630 cache hits, 12 coalesced
+//
+// For systemd, run the broker as its own service (RuntimeDirectory=obd gives
+// /run/obd for the socket with -s /run/obd/broker.sock) and order the logger
+// after it.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "obd_device.h"
+#include "obd_session.h"
+
+#define BT_ADDR "00:1D:A5:68:98:8B"
+#define SOCKET_PATH "/tmp/obd_broker.sock"
+#define DEFAULT_TTL_MS 500
+#define DEFAULT_HEADER "7DF"
+#define MAX_CLIENTS 32
+#define CLIENT_QUEUE 16
+#define CACHE_SIZE 128
+#define CMD_LEN 32
+#define HEADER_LEN 12
+#define RESPONSE_LEN 1024
+#define CLIENT_OUT (CLIENT_QUEUE * (RESPONSE_LEN + 8))
+#define STATS_SEC 60
+#define RECONNECT_SEC 2
+
+typedef struct {
+    char cmd[CMD_LEN];
+    char header[HEADER_LEN];
+} request_t;
+
+typedef struct {
+    int fd;
+    char in[256];
+    int in_len;
+    char last_cmd[CMD_LEN];
+    char header[HEADER_LEN];
+    int compact;                    // AT S0: spaces stripped from bus replies
+    request_t queue[CLIENT_QUEUE];
+    int q_head, q_len;
+    char out[CLIENT_OUT];           // replies the socket did not take yet
+    int out_len;
+    int dead;                       // closed by the main loop
+} client_t;
+
+typedef struct {
+    request_t req;
+    char response[RESPONSE_LEN];
+    uint64_t at_us;
+} cache_entry_t;
+
+volatile sig_atomic_t keep_running = 1;
+
+static client_t clients[MAX_CLIENTS];
+static int nclients;
+static cache_entry_t cache[CACHE_SIZE];
+static int ncache;
+static int ttl_ms = DEFAULT_TTL_MS;
+static int rr_next;
+
+static const char* ADAPTER_SETUP[] = { "AT E0", "AT L0", "AT S1", "AT H0", "AT SP 0", NULL };
+
+static const char* device_spec = BT_ADDR;
+static obd_session_t adapter;
+static obd_metrics_t metrics;
+static char adapter_header[HEADER_LEN];
+static int adapter_up;
+static uint64_t adapter_retry_us;
+static char adapter_id[64] = "ELM327 v1.5";
+
+static unsigned long stat_requests, stat_bus, stat_cache_hits, stat_coalesced;
+
+void int_handler(int dummy) {
+    keep_running = 0;
+}
+
+// Upper case, no spaces: "01 0c" and "010C" are the same request
+static void normalize(const char* in, char* out, int maxlen) {
+    int n = 0;
+    for (; *in && n < maxlen - 1; ++in) {
+        if (*in == ' ' || *in == '\t') continue;
+        out[n++] = (char)toupper((unsigned char)*in);
+    }
+    out[n] = '\0';
+}
+
+static int same_request(const request_t* a, const request_t* b) {
+    return strcmp(a->cmd, b->cmd) == 0 && strcmp(a->header, b->header) == 0;
+}
+
+static int cacheable(const request_t* r) {
+    return strncmp(r->cmd, "04", 2) != 0;
+}
+
+static cache_entry_t* cache_lookup(const request_t* r) {
+    uint64_t now = obd_now_us();
+    for (int i = 0; i < ncache; ++i) {
+        if (same_request(&cache[i].req, r) && now - cache[i].at_us <= (uint64_t)ttl_ms * 1000)
+            return &cache[i];
+    }
+    return NULL;
+}
+
+static void cache_store(const request_t* r, const char* response) {
+    cache_entry_t* slot = NULL;
+    for (int i = 0; i < ncache && !slot; ++i)
+        if (same_request(&cache[i].req, r)) slot = &cache[i];
+
+    if (!slot && ncache < CACHE_SIZE) slot = &cache[ncache++];
+    if (!slot) {
+        // Full: reuse the oldest entry
+        slot = &cache[0];
+        for (int i = 1; i < ncache; ++i)
+            if (cache[i].at_us < slot->at_us) slot = &cache[i];
+    }
+
+    slot->req = *r;
+    snprintf(slot->response, sizeof(slot->response), "%s", response);
+    slot->at_us = obd_now_us();
+}
+
+// Sends what the socket takes now; the rest waits for POLLOUT
+static void client_flush(client_t* c) {
+    while (c->out_len > 0 && !c->dead) {
+        ssize_t n = send(c->fd, c->out, c->out_len, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        if (n <= 0) {
+            c->dead = 1;
+            return;
+        }
+        memmove(c->out, c->out + n, c->out_len - n);
+        c->out_len -= n;
+    }
+}
+
+// A client that lets a queue's worth of replies pile up is not reading
+// them and is dropped rather than sent half an answer
+static void client_reply(client_t* c, const char* response) {
+    if (c->dead) return;
+    int n = snprintf(c->out + c->out_len, sizeof(c->out) - c->out_len, "%s\r\r>", response);
+    if (n >= (int)sizeof(c->out) - c->out_len) {
+        fprintf(stderr, "Client not reading its replies, closing it\n");
+        c->dead = 1;
+        return;
+    }
+    c->out_len += n;
+    client_flush(c);
+}
+
+// A reply from the bus (or the cache), in the client's format
+static void client_answer(client_t* c, const char* response) {
+    char out[RESPONSE_LEN];
+    int n = 0;
+
+    if (!c->compact) {
+        client_reply(c, response);
+        return;
+    }
+    for (const char* p = response; *p && n < (int)sizeof(out) - 1; ++p) {
+        if (*p != ' ') out[n++] = *p;
+    }
+    out[n] = '\0';
+    client_reply(c, out);
+}
+
+static void client_pop(client_t* c) {
+    c->q_head = (c->q_head + 1) % CLIENT_QUEUE;
+    c->q_len--;
+}
+
+static request_t* client_head(client_t* c) {
+    return c->q_len ? &c->queue[c->q_head] : NULL;
+}
+
+static void client_close(int idx) {
+    close(clients[idx].fd);
+    clients[idx] = clients[--nclients];
+    if (rr_next >= nclients) rr_next = 0;
+}
+
+// Settings the broker owns are answered without touching the adapter.
+// Returns 1 and fills reply when the command was handled locally.
+//
+// Only AT S0 / AT S1 and AT SH take effect, per client; AT H1 is refused
+// because the shared link runs without headers. Everything in ok_prefixes
+// is acknowledged and ignored: the client sees the broker's echo, linefeed,
+// protocol, timing and CAN settings whatever it asked for.
+static int local_at(client_t* c, const char* cmd, char* reply, int maxlen) {
+    static const char* const ok_prefixes[] = {
+        "ATE", "ATL", "ATH0", "ATSP", "ATTP", "ATAT", "ATST", "ATM0", "ATM1", "ATD", "ATCAF", "ATAL", "ATNL"
+    };
+
+    if (strncmp(cmd, "AT", 2) != 0) return 0;
+
+    if (strcmp(cmd, "ATZ") == 0 || strcmp(cmd, "ATWS") == 0 || strcmp(cmd, "ATI") == 0) {
+        if (cmd[2] != 'I') c->compact = 0;
+        snprintf(reply, maxlen, "%s", adapter_id);
+        return 1;
+    }
+    if (strcmp(cmd, "ATS0") == 0 || strcmp(cmd, "ATS1") == 0) {
+        c->compact = cmd[3] == '0';
+        snprintf(reply, maxlen, "OK");
+        return 1;
+    }
+    if (strcmp(cmd, "ATRV") == 0 || strcmp(cmd, "ATDP") == 0 || strcmp(cmd, "ATDPN") == 0)
+        return 0;
+    if (strncmp(cmd, "ATSH", 4) == 0) {
+        // 11 bit "7E0", ISO / J1850 "686AF1", 29 bit "18DA10F1"; anything
+        // else gets the ELM327's "?" and leaves the header as it was
+        size_t len = strlen(cmd + 4);
+        if ((len != 3 && len != 6 && len != 8) || strspn(cmd + 4, "0123456789ABCDEF") != len) {
+            snprintf(reply, maxlen, "?");
+            return 1;
+        }
+        memcpy(c->header, cmd + 4, len + 1);
+        snprintf(reply, maxlen, "OK");
+        return 1;
+    }
+    for (size_t i = 0; i < sizeof(ok_prefixes) / sizeof(ok_prefixes[0]); ++i) {
+        if (strncmp(cmd, ok_prefixes[i], strlen(ok_prefixes[i])) == 0) {
+            snprintf(reply, maxlen, "OK");
+            return 1;
+        }
+    }
+
+    snprintf(reply, maxlen, "?");
+    return 1;
+}
+
+static void client_request(client_t* c, const char* line) {
+    char cmd[CMD_LEN];
+    char reply[128];
+
+    normalize(line, cmd, sizeof(cmd));
+    if (cmd[0] == '\0') {
+        // ELM327 repeats the last command on an empty line
+        if (!c->last_cmd[0]) return;
+        snprintf(cmd, sizeof(cmd), "%s", c->last_cmd);
+    }
+    snprintf(c->last_cmd, sizeof(c->last_cmd), "%s", cmd);
+    stat_requests++;
+
+    if (local_at(c, cmd, reply, sizeof(reply))) {
+        client_reply(c, reply);
+        return;
+    }
+
+    if (c->q_len >= CLIENT_QUEUE) {
+        client_reply(c, "BUFFER FULL");
+        return;
+    }
+
+    request_t* r = &c->queue[(c->q_head + c->q_len) % CLIENT_QUEUE];
+    snprintf(r->cmd, sizeof(r->cmd), "%s", cmd);
+    snprintf(r->header, sizeof(r->header), "%s", c->header);
+    c->q_len++;
+}
+
+static void client_read(int idx) {
+    client_t* c = &clients[idx];
+    char buf[256];
+    ssize_t n = read(c->fd, buf, sizeof(buf));
+
+    if (n <= 0) {
+        client_close(idx);
+        return;
+    }
+
+    for (ssize_t i = 0; i < n; ++i) {
+        if (buf[i] == '\r') {
+            c->in[c->in_len] = '\0';
+            client_request(c, c->in);
+            c->in_len = 0;
+        } else if (buf[i] != '\n' && c->in_len < (int)sizeof(c->in) - 1) {
+            c->in[c->in_len++] = buf[i];
+        }
+    }
+}
+
+static int adapter_init(void) {
+    char response[RESPONSE_LEN];
+    obd_init_t init;
+
+    int fd = obd_device_open(device_spec);
+    if (fd < 0) return -1;
+    obd_session_init(&adapter, fd, &metrics);
+    obd_session_set_recovery(&adapter, ADAPTER_SETUP, NULL, NULL);
+
+    obd_session_init_adapter(&adapter, &init);
+    fprintf(stderr, "Adapter init: %.0f ms (%s, %d commands)\n", init.elapsed_us / 1000.0, init.reset, init.commands);
+    if (obd_session_command(&adapter, "AT I", response, sizeof(response)) == OBD_REPLY_OK && response[0])
+        snprintf(adapter_id, sizeof(adapter_id), "%.63s", response);
+
+    adapter_header[0] = '\0';
+    adapter_up = 1;
+    return 0;
+}
+
+// Called from the main loop; one attempt, so clients are not held up
+static void adapter_reconnect(void) {
+    if (adapter_up || obd_now_us() < adapter_retry_us) return;
+
+    fprintf(stderr, "Adapter link lost, reconnecting to %s...\n", device_spec);
+    metrics_add(&metrics, M_RECONNECT, 1);
+    if (adapter_init() != 0) adapter_retry_us = obd_now_us() + RECONNECT_SEC * 1000000ull;
+}
+
+static void adapter_lost(void) {
+    close(adapter.fd);
+    adapter_up = 0;
+    adapter_retry_us = obd_now_us() + RECONNECT_SEC * 1000000ull;
+}
+
+static obd_reply_t adapter_request(const request_t* r, char* response, int maxlen) {
+    if (strcmp(r->header, adapter_header) != 0) {
+        char at_sh[CMD_LEN + 8];
+        snprintf(at_sh, sizeof(at_sh), "AT SH %s", r->header[0] ? r->header : DEFAULT_HEADER);
+        obd_session_command(&adapter, at_sh, response, maxlen);
+        snprintf(adapter_header, sizeof(adapter_header), "%s", r->header);
+    }
+
+    stat_bus++;
+    obd_reply_t rc = obd_session_command(&adapter, r->cmd, response, maxlen);
+    if (rc == OBD_REPLY_IO_ERROR) adapter_lost();
+    return rc;
+}
+
+// Answers every queue head that a fresh cache entry covers
+static void serve_from_cache(void) {
+    for (int i = 0; i < nclients; ++i) {
+        request_t* r;
+        while ((r = client_head(&clients[i])) && cacheable(r)) {
+            cache_entry_t* e = cache_lookup(r);
+            if (!e) break;
+            client_answer(&clients[i], e->response);
+            client_pop(&clients[i]);
+            stat_cache_hits++;
+        }
+    }
+}
+
+// One bus request for the next client in round-robin order; every other
+// client waiting on the same request gets the same answer.
+static void dispatch(void) {
+    for (int k = 0; k < nclients; ++k) {
+        int idx = (rr_next + k) % nclients;
+        request_t* head = client_head(&clients[idx]);
+        if (!head) continue;
+
+        request_t req = *head;
+        char response[RESPONSE_LEN];
+        obd_reply_t rc = adapter_up ? adapter_request(&req, response, sizeof(response)) : OBD_REPLY_IO_ERROR;
+
+        if (rc == OBD_REPLY_IO_ERROR) snprintf(response, sizeof(response), "UNABLE TO CONNECT");
+        else if (rc == OBD_REPLY_TIMEOUT) snprintf(response, sizeof(response), "NO DATA");
+        else if (cacheable(&req)) cache_store(&req, response);
+
+        for (int j = 0; j < nclients; ++j) {
+            request_t* h = client_head(&clients[j]);
+            if (!h || !same_request(h, &req)) continue;
+            if (j != idx && !cacheable(&req)) continue;
+            client_answer(&clients[j], response);
+            client_pop(&clients[j]);
+            if (j != idx) stat_coalesced++;
+        }
+
+        rr_next = (idx + 1) % (nclients ? nclients : 1);
+        return;
+    }
+}
+
+static int has_pending(void) {
+    for (int i = 0; i < nclients; ++i)
+        if (clients[i].q_len) return 1;
+    return 0;
+}
+
+static int listen_unix(const char* path) {
+    struct sockaddr_un addr = { 0 };
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    unlink(path);
+
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 8) < 0) {
+        perror("bind");
+        close(fd);
+        return -1;
+    }
+    chmod(path, 0660);
+    return fd;
+}
+
+int main(int argc, char** argv) {
+    const char* socket_path = SOCKET_PATH;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "d:s:t:")) != -1) {
+        switch (opt) {
+            case 'd': device_spec = optarg; break;
+            case 's': socket_path = optarg; break;
+            case 't': ttl_ms = atoi(optarg); break;
+            default:
+                fprintf(stderr, "Usage: %s [-d device] [-s socket_path] [-t cache_ttl_ms]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    signal(SIGINT, int_handler);
+    signal(SIGTERM, int_handler);
+    // A dropped link shows up as a write error, not as a signal
+    signal(SIGPIPE, SIG_IGN);
+    metrics_init(&metrics);
+
+    if (adapter_init() != 0) return 1;
+
+    int srv = listen_unix(socket_path);
+    if (srv < 0) {
+        close(adapter.fd);
+        return 1;
+    }
+
+    printf("Broker for %s (%s) on %s, cache TTL %d ms\n", device_spec, adapter_id, socket_path, ttl_ms);
+    fflush(stdout);
+
+    uint64_t last_stats = obd_now_us();
+
+    while (keep_running) {
+        struct pollfd fds[MAX_CLIENTS + 1];
+        fds[0].fd = srv;
+        fds[0].events = POLLIN;
+        for (int i = 0; i < nclients; ++i) {
+            fds[i + 1].fd = clients[i].fd;
+            fds[i + 1].events = POLLIN | (clients[i].out_len ? POLLOUT : 0);
+        }
+
+        int rc = poll(fds, nclients + 1, has_pending() ? 0 : 1000);
+        if (rc < 0 && errno != EINTR) {
+            perror("poll");
+            break;
+        }
+
+        if (rc > 0) {
+            // Walk backwards, client_close() moves the last client into the gap
+            for (int i = nclients - 1; i >= 0; --i) {
+                if (fds[i + 1].revents & POLLOUT) client_flush(&clients[i]);
+                if (fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)) client_read(i);
+            }
+
+            if (fds[0].revents & POLLIN) {
+                int fd = accept(srv, NULL, NULL);
+                if (fd >= 0 && nclients < MAX_CLIENTS) {
+                    memset(&clients[nclients], 0, sizeof(client_t));
+                    clients[nclients++].fd = fd;
+                } else if (fd >= 0) {
+                    close(fd);
+                }
+            }
+        }
+
+        // Send errors mark a client dead; its queued requests never reach the bus
+        for (int i = nclients - 1; i >= 0; --i)
+            if (clients[i].dead) client_close(i);
+
+        adapter_reconnect();
+        serve_from_cache();
+        if (has_pending()) dispatch();
+
+        if (obd_now_us() - last_stats >= STATS_SEC * 1000000ull) {
+            printf("broker: %d clients, %lu requests, %lu bus commands, %lu cache hits, %lu coalesced\n",
+                   nclients, stat_requests, stat_bus, stat_cache_hits, stat_coalesced);
+            fflush(stdout);
+            last_stats = obd_now_us();
+        }
+    }
+
+    for (int i = nclients - 1; i >= 0; --i) client_close(i);
+    close(srv);
+    unlink(socket_path);
+    if (adapter_up) close(adapter.fd);
+    printf("Broker stopped.\n");
+    return 0;
+}
@@ -0,0 +1,551 @@
+/*
+ * obd_bt.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/hci.h>
+#include <bluetooth/hci_lib.h>
+#include <bluetooth/rfcomm.h>
+#include <bluetooth/sdp.h>
+#include <bluetooth/sdp_lib.h>
+
+#include "obd_bt.h"
+#include "obd_device.h"
+#include "obd_session.h"
+
+// BlueZ
+// =====
+
+static int bluez_connect(void* ctx, const bdaddr_t* addr, int channel, int timeout_ms) {
+    struct sockaddr_rc sa = { 0 };
+    (void)ctx;
+
+    int sock = socket(AF_BLUETOOTH, SOCK_STREAM, BTPROTO_RFCOMM);
+    if (sock < 0) {
+        perror("socket");
+        return -1;
+    }
+    sa.rc_family = AF_BLUETOOTH;
+    sa.rc_channel = (uint8_t)channel;
+    sa.rc_bdaddr = *addr;
+
+    // Non-blocking, so an adapter out of range costs timeout_ms and not the
+    // stack's page timeout
+    int flags = fcntl(sock, F_GETFL, 0);
+    fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+    int rc = connect(sock, (struct sockaddr*)&sa, sizeof(sa));
+    if (rc < 0 && errno == EINPROGRESS) {
+        struct pollfd pfd = { sock, POLLOUT, 0 };
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if (poll(&pfd, 1, timeout_ms) == 1 && getsockopt(sock, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0)
+            rc = 0;
+    }
+    if (rc < 0) {
+        close(sock);
+        return -1;
+    }
+    fcntl(sock, F_SETFL, flags);
+    return sock;
+}
+
+static int bluez_inquiry(void* ctx, int len, bdaddr_t* out, int max) {
+    inquiry_info* ii = NULL;
+    (void)ctx;
+
+    int dev_id = hci_get_route(NULL);
+    if (dev_id < 0) {
+        perror("hci_get_route");
+        return -1;
+    }
+    // No IREQ_CACHE_FLUSH: devices seen recently are reported right away
+    int n = hci_inquiry(dev_id, len, max, NULL, &ii, 0);
+    if (n < 0) {
+        perror("hci_inquiry");
+        free(ii);
+        return -1;
+    }
+    for (int i = 0; i < n; ++i) out[i] = ii[i].bdaddr;
+    free(ii);
+    return n;
+}
+
+static int bluez_remote_name(void* ctx, const bdaddr_t* addr, char* name, int maxlen, int timeout_ms) {
+    (void)ctx;
+
+    // A descriptor per request, the threads do not share one
+    int dd = hci_open_dev(hci_get_route(NULL));
+    if (dd < 0) return -1;
+    memset(name, 0, maxlen);
+    int rc = hci_read_remote_name(dd, addr, maxlen, name, timeout_ms);
+    hci_close_dev(dd);
+    return rc < 0 ? -1 : 0;
+}
+
+static int bluez_rfcomm_channel(void* ctx, const bdaddr_t* addr) {
+    uuid_t uuid;
+    uint32_t range = 0x0000ffff;
+    sdp_list_t* rsp = NULL;
+    int channel = -1;
+    (void)ctx;
+
+    sdp_session_t* session = sdp_connect(BDADDR_ANY, addr, SDP_RETRY_IF_BUSY);
+    if (!session) return -1;
+
+    sdp_uuid16_create(&uuid, SERIAL_PORT_SVCLASS_ID);
+    sdp_list_t* search = sdp_list_append(NULL, &uuid);
+    sdp_list_t* attrs = sdp_list_append(NULL, &range);
+    if (sdp_service_search_attr_req(session, search, SDP_ATTR_REQ_RANGE, attrs, &rsp) == 0) {
+        for (sdp_list_t* r = rsp; r; r = r->next) {
+            sdp_record_t* rec = (sdp_record_t*)r->data;
+            sdp_list_t* protos = NULL;
+            if (channel < 0 && sdp_get_access_protos(rec, &protos) == 0) {
+                int port = sdp_get_proto_port(protos, RFCOMM_UUID);
+                if (port > 0) channel = port;
+                sdp_list_foreach(protos, (sdp_list_func_t)sdp_list_free, NULL);
+                sdp_list_free(protos, NULL);
+            }
+            sdp_record_free(rec);
+        }
+    }
+    sdp_list_free(rsp, NULL);
+    sdp_list_free(search, NULL);
+    sdp_list_free(attrs, NULL);
+    sdp_close(session);
+    return channel;
+}
+
+const obd_bt_ops_t OBD_BT_BLUEZ = { "bluez", bluez_connect, bluez_inquiry, bluez_remote_name, bluez_rfcomm_channel,
+                                    NULL, NULL };
+
+// Fake
+// ====
+
+typedef struct {
+    bdaddr_t addr;
+    int channel, name_ms, connect_ms;
+    char link[128];
+    char name[OBD_BT_NAME_LEN];
+} fake_device_t;
+
+typedef struct {
+    int inquiry_ms;
+    int n;
+    fake_device_t devices[OBD_BT_MAX_DEVICES];
+    int refs;                       // the caller's and a running name job's
+    pthread_mutex_t lock;
+} fake_t;
+
+static void sleep_ms(int ms) {
+    if (ms > 0) usleep((useconds_t)ms * 1000);
+}
+
+static const fake_device_t* fake_find(const fake_t* f, const bdaddr_t* addr) {
+    for (int i = 0; i < f->n; ++i) {
+        if (bacmp(&f->devices[i].addr, addr) == 0) return &f->devices[i];
+    }
+    return NULL;
+}
+
+void* obd_bt_fake_load(const char* path) {
+    char line[512], addr[32];
+
+    FILE* in = fopen(path, "r");
+    if (!in) {
+        perror(path);
+        return NULL;
+    }
+    fake_t* f = (fake_t*)calloc(1, sizeof(*f));
+    if (f) {
+        f->refs = 1;
+        pthread_mutex_init(&f->lock, NULL);
+    }
+    while (f && fgets(line, sizeof(line), in)) {
+        fake_device_t* d = &f->devices[f->n];
+        int used = 0;
+
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '#' || line[0] == '\0') continue;
+        if (sscanf(line, "inquiry %d", &f->inquiry_ms) == 1) continue;
+        if (f->n == OBD_BT_MAX_DEVICES) break;
+        if (sscanf(line, "%31s %d %d %d %127s %n", addr, &d->channel, &d->name_ms, &d->connect_ms, d->link, &used) < 5 ||
+            used == 0) {
+            fprintf(stderr, "%s: bad line: %s\n", path, line);
+            continue;
+        }
+        str2ba(addr, &d->addr);
+        snprintf(d->name, sizeof(d->name), "%s", line + used);
+        f->n++;
+    }
+    fclose(in);
+    return f;
+}
+
+static void fake_hold(void* ctx) {
+    fake_t* f = (fake_t*)ctx;
+    pthread_mutex_lock(&f->lock);
+    f->refs++;
+    pthread_mutex_unlock(&f->lock);
+}
+
+static void fake_release(void* ctx) {
+    fake_t* f = (fake_t*)ctx;
+    pthread_mutex_lock(&f->lock);
+    int last = --f->refs == 0;
+    pthread_mutex_unlock(&f->lock);
+    if (last) {
+        pthread_mutex_destroy(&f->lock);
+        free(f);
+    }
+}
+
+void obd_bt_fake_free(void* fake) {
+    if (fake) fake_release(fake);
+}
+
+static int fake_connect(void* ctx, const bdaddr_t* addr, int channel, int timeout_ms) {
+    const fake_device_t* d = fake_find((const fake_t*)ctx, addr);
+
+    if (!d || d->connect_ms > timeout_ms) {
+        sleep_ms(timeout_ms);
+        return -1;
+    }
+    sleep_ms(d->connect_ms);
+    // Nothing listens on any other channel: refused at once
+    if (channel != d->channel || strcmp(d->link, "-") == 0) return -1;
+    return obd_device_open(d->link);
+}
+
+static int fake_inquiry(void* ctx, int len, bdaddr_t* out, int max) {
+    const fake_t* f = (const fake_t*)ctx;
+    (void)len;
+
+    sleep_ms(f->inquiry_ms);
+    int n = f->n < max ? f->n : max;
+    for (int i = 0; i < n; ++i) out[i] = f->devices[i].addr;
+    return n;
+}
+
+static int fake_remote_name(void* ctx, const bdaddr_t* addr, char* name, int maxlen, int timeout_ms) {
+    const fake_device_t* d = fake_find((const fake_t*)ctx, addr);
+
+    if (!d || d->name_ms > timeout_ms) {
+        sleep_ms(timeout_ms);
+        return -1;
+    }
+    sleep_ms(d->name_ms);
+    snprintf(name, maxlen, "%s", d->name);
+    return 0;
+}
+
+static int fake_rfcomm_channel(void* ctx, const bdaddr_t* addr) {
+    const fake_device_t* d = fake_find((const fake_t*)ctx, addr);
+    return d ? d->channel : -1;
+}
+
+const obd_bt_ops_t OBD_BT_FAKE = { "fake", fake_connect, fake_inquiry, fake_remote_name, fake_rfcomm_channel,
+                                   fake_hold, fake_release };
+
+// Cache
+// =====
+
+typedef struct {
+    char addr[19];
+    int channel;
+    char name[OBD_BT_NAME_LEN];
+    long long updated;
+} entry_t;
+
+static int load_cache(const char* path, entry_t* entries) {
+    char line[512];
+    int n = 0;
+
+    FILE* f = fopen(path, "r");
+    if (!f) return 0;
+    while (n < OBD_BT_CACHE_MAX && fgets(line, sizeof(line), f)) {
+        const char* field[4];
+        int nfields = 0;
+        char* p = line;
+
+        line[strcspn(line, "\r\n")] = '\0';
+        while (nfields < 4) {
+            field[nfields++] = p;
+            p = strchr(p, '\t');
+            if (!p) break;
+            *p++ = '\0';
+        }
+        if (nfields < 4 || !field[0][0]) continue;
+
+        entry_t* e = &entries[n++];
+        snprintf(e->addr, sizeof(e->addr), "%s", field[0]);
+        e->channel = atoi(field[1]);
+        snprintf(e->name, sizeof(e->name), "%s", field[2]);
+        e->updated = atoll(field[3]);
+    }
+    fclose(f);
+    return n;
+}
+
+static void save_cache(const char* path, const entry_t* entries, int n) {
+    char tmp[520];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+    FILE* f = fopen(tmp, "w");
+    if (!f) {
+        perror(tmp);
+        return;
+    }
+    for (int i = 0; i < n; ++i)
+        fprintf(f, "%s\t%d\t%s\t%lld\n", entries[i].addr, entries[i].channel, entries[i].name, entries[i].updated);
+    if (fclose(f) != 0 || rename(tmp, path) != 0) {
+        perror(path);
+        remove(tmp);
+    }
+}
+
+// Names come from the radio: no tabs or line breaks in the cache
+static void clean_name(char* name) {
+    for (char* p = name; *p; ++p) {
+        if (*p == '\t' || *p == '\r' || *p == '\n') *p = ' ';
+    }
+}
+
+static void remember(const char* path, const obd_bt_result_t* r) {
+    entry_t entries[OBD_BT_CACHE_MAX];
+    entry_t* e = NULL;
+    char addr[19];
+    int n = load_cache(path, entries);
+
+    ba2str(&r->addr, addr);
+    for (int i = 0; i < n && !e; ++i) {
+        if (strcmp(entries[i].addr, addr) == 0) e = &entries[i];
+    }
+    if (!e && n < OBD_BT_CACHE_MAX) {
+        e = &entries[n++];
+    } else if (!e) {
+        // Full: the entry updated longest ago makes room
+        e = &entries[0];
+        for (int i = 1; i < n; ++i) {
+            if (entries[i].updated < e->updated) e = &entries[i];
+        }
+    }
+    snprintf(e->addr, sizeof(e->addr), "%s", addr);
+    e->channel = r->channel;
+    snprintf(e->name, sizeof(e->name), "%s", r->name);
+    clean_name(e->name);
+    e->updated = (long long)time(NULL);
+    save_cache(path, entries, n);
+}
+
+static int most_recent_first(const void* a, const void* b) {
+    long long ua = ((const entry_t*)a)->updated, ub = ((const entry_t*)b)->updated;
+    return ua < ub ? 1 : ua > ub ? -1 : 0;
+}
+
+// Name resolution
+// ===============
+
+// Shared by the caller and the name threads. The caller stops waiting at
+// the first match, threads still inside a remote name request hold a
+// reference until it returns, and whoever lets go last frees the job and
+// drops its reference to ctx.
+typedef struct {
+    const obd_bt_ops_t* ops;
+    void* ctx;
+    int n, next, refs, stop;
+    bdaddr_t addr[OBD_BT_MAX_DEVICES];
+    char name[OBD_BT_MAX_DEVICES][OBD_BT_NAME_LEN];
+    int state[OBD_BT_MAX_DEVICES];  // NAME_*
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+} name_job_t;
+
+enum { NAME_PENDING, NAME_RUNNING, NAME_DONE, NAME_FAILED, NAME_SEEN };
+
+static void job_release(name_job_t* job) {
+    pthread_mutex_lock(&job->lock);
+    int last = --job->refs == 0;
+    pthread_mutex_unlock(&job->lock);
+    if (last) {
+        if (job->ops->release) job->ops->release(job->ctx);
+        pthread_mutex_destroy(&job->lock);
+        pthread_cond_destroy(&job->changed);
+        free(job);
+    }
+}
+
+static void* name_thread(void* arg) {
+    name_job_t* job = (name_job_t*)arg;
+    char name[OBD_BT_NAME_LEN];
+
+    pthread_mutex_lock(&job->lock);
+    while (!job->stop && job->next < job->n) {
+        int i = job->next++;
+        job->state[i] = NAME_RUNNING;
+        pthread_mutex_unlock(&job->lock);
+
+        int rc = job->ops->remote_name(job->ctx, &job->addr[i], name, sizeof(name), OBD_BT_NAME_TIMEOUT_MS);
+
+        pthread_mutex_lock(&job->lock);
+        if (rc == 0) snprintf(job->name[i], sizeof(job->name[i]), "%s", name);
+        job->state[i] = rc == 0 ? NAME_DONE : NAME_FAILED;
+        pthread_cond_broadcast(&job->changed);
+    }
+    pthread_mutex_unlock(&job->lock);
+    job_release(job);
+    return NULL;
+}
+
+static int name_matches(const char* name, const char* const* names) {
+    for (int k = 0; names[k]; ++k) {
+        if (strstr(name, names[k])) return 1;
+    }
+    return 0;
+}
+
+// Starts the name threads; NULL when not even one could be started
+static name_job_t* start_names(const obd_bt_ops_t* ops, void* ctx, const bdaddr_t* addr, int n) {
+    name_job_t* job = (name_job_t*)calloc(1, sizeof(*job));
+    if (!job) return NULL;
+    job->ops = ops;
+    job->ctx = ctx;
+    if (ops->hold) ops->hold(ctx);
+    job->n = n;
+    memcpy(job->addr, addr, n * sizeof(*addr));
+    pthread_mutex_init(&job->lock, NULL);
+    pthread_cond_init(&job->changed, NULL);
+
+    job->refs = 1;
+    int threads = n < OBD_BT_NAME_THREADS ? n : OBD_BT_NAME_THREADS;
+    for (int i = 0; i < threads; ++i) {
+        pthread_t tid;
+        pthread_mutex_lock(&job->lock);
+        job->refs++;
+        pthread_mutex_unlock(&job->lock);
+        if (pthread_create(&tid, NULL, name_thread, job) != 0) {
+            perror("pthread_create");
+            job_release(job);
+            break;
+        }
+        pthread_detach(tid);
+    }
+    if (job->refs == 1) {
+        job_release(job);
+        return NULL;
+    }
+    return job;
+}
+
+// Discovery
+// =========
+
+static void print_device(const char* what, const bdaddr_t* addr, const char* name) {
+    char text[19];
+    ba2str(addr, text);
+    printf("%s %s - %s\n", what, text, name);
+}
+
+// Connects to an adapter found by the inquiry, the channel from SDP
+static int connect_found(obd_bt_result_t* r, const obd_bt_ops_t* ops, void* ctx) {
+    int channel = ops->rfcomm_channel(ctx, &r->addr);
+    r->sdp = channel > 0;
+    r->channel = r->sdp ? channel : OBD_BT_DEFAULT_CHANNEL;
+    return ops->connect(ctx, &r->addr, r->channel, OBD_BT_CONNECT_MS);
+}
+
+int obd_bt_discover(obd_bt_result_t* r, const obd_bt_ops_t* ops, void* ctx, const char* const* names,
+                    const char* cache_path) {
+    entry_t entries[OBD_BT_CACHE_MAX];
+    bdaddr_t found[OBD_BT_MAX_DEVICES];
+    uint64_t start = obd_now_us();
+    int fd = -1;
+
+    memset(r, 0, sizeof(*r));
+
+    // 1. Remembered adapters, no radio search at all
+    int ncached = cache_path ? load_cache(cache_path, entries) : 0;
+    qsort(entries, ncached, sizeof(*entries), most_recent_first);
+    for (int i = 0; i < ncached && fd < 0; ++i) {
+        printf("Trying %s - %s (channel %d)...\n", entries[i].addr, entries[i].name, entries[i].channel);
+        r->tried++;
+        str2ba(entries[i].addr, &r->addr);
+        fd = ops->connect(ctx, &r->addr, entries[i].channel, OBD_BT_CACHED_CONNECT_MS);
+        if (fd >= 0) {
+            r->channel = entries[i].channel;
+            snprintf(r->name, sizeof(r->name), "%s", entries[i].name);
+            r->cached = 1;
+        }
+    }
+
+    // 2. Inquiry
+    if (fd < 0) {
+        printf("Scanning for devices...\n");
+        r->found = ops->inquiry(ctx, OBD_BT_INQUIRY_LEN, found, OBD_BT_MAX_DEVICES);
+        if (r->found < 0) r->found = 0;
+    }
+
+    // 3. Names, in parallel, the first match wins
+    name_job_t* job = r->found > 0 ? start_names(ops, ctx, found, r->found) : NULL;
+    if (job) {
+        pthread_mutex_lock(&job->lock);
+        for (;;) {
+            int pending = 0, match = -1;
+            for (int i = 0; i < job->n && match < 0; ++i) {
+                if (job->state[i] == NAME_PENDING || job->state[i] == NAME_RUNNING) pending++;
+                if (job->state[i] != NAME_DONE && job->state[i] != NAME_FAILED) continue;
+                r->named += job->state[i] == NAME_DONE;
+                print_device("Found", &job->addr[i], job->state[i] == NAME_DONE ? job->name[i] : "[unknown]");
+                if (job->state[i] == NAME_DONE && name_matches(job->name[i], names)) match = i;
+                job->state[i] = NAME_SEEN;
+            }
+            if (match >= 0) {
+                r->addr = job->addr[match];
+                snprintf(r->name, sizeof(r->name), "%s", job->name[match]);
+                // The remaining names keep resolving while we connect, in
+                // case this one does not take the connection
+                pthread_mutex_unlock(&job->lock);
+                fd = connect_found(r, ops, ctx);
+                pthread_mutex_lock(&job->lock);
+                if (fd >= 0) break;
+                continue;
+            }
+            if (pending == 0) break;
+            pthread_cond_wait(&job->changed, &job->lock);
+        }
+        job->stop = 1;
+        pthread_mutex_unlock(&job->lock);
+        job_release(job);
+    } else if (r->found > 0) {
+        // No threads: one name at a time
+        for (int i = 0; i < r->found && fd < 0; ++i) {
+            char name[OBD_BT_NAME_LEN];
+            if (ops->remote_name(ctx, &found[i], name, sizeof(name), OBD_BT_NAME_TIMEOUT_MS) < 0)
+                strcpy(name, "[unknown]");
+            else
+                r->named++;
+            print_device("Found", &found[i], name);
+            if (!name_matches(name, names)) continue;
+            r->addr = found[i];
+            snprintf(r->name, sizeof(r->name), "%s", name);
+            fd = connect_found(r, ops, ctx);
+        }
+    }
+
+    // 4. Remember it, first in line next time
+    if (fd >= 0 && cache_path) remember(cache_path, r);
+    r->elapsed_us = obd_now_us() - start;
+    return fd;
+}
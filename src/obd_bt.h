@@ -0,0 +1,113 @@
+/*
+ * obd_bt.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+#ifndef OBD_BT_H
+#define OBD_BT_H
+
+//
+// Finding and connecting to a Bluetooth ELM327 (V-LINK, OBDLink, ...).
+//
+// A full discovery is slow: an inquiry runs for about 10 s, and every
+// device it finds costs a remote name request of up to a few seconds. Most
+// of the time the adapter is one we have talked to before, so
+// obd_bt_discover() goes from cheap to expensive and stops at the first
+// adapter that answers:
+//
+//    1. cached      connect to every remembered adapter, the one used most
+//                   recently first, with a short timeout each
+//    2. inquiry     without a cache flush, so devices the controller saw
+//                   recently are reported without waiting for them again
+//    3. names       resolved OBD_BT_NAME_THREADS at a time; the first name
+//                   that matches ends the search, requests still running
+//                   finish in the background, holding a reference to ctx
+//    4. channel     the RFCOMM channel of the Serial Port service via SDP,
+//                   channel 1 only when SDP does not answer
+//
+// Adapters that worked are remembered in obd_bt.cache, one line each:
+//
+//    <address>\t<channel>\t<name>\t<updated unix time>
+//
+// All radio access goes through obd_bt_ops_t. OBD_BT_BLUEZ is the real
+// thing; OBD_BT_FAKE plays a list of devices from a file, with their name
+// and connect delays, so the search order can be tried without a car (see
+// obd_bt_fake_load()).
+//
+
+#include <stdint.h>
+
+#include <bluetooth/bluetooth.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OBD_BT_CACHE_FILE "obd_bt.cache"
+#define OBD_BT_CACHE_MAX 16
+#define OBD_BT_CACHED_CONNECT_MS 2000   // per remembered adapter
+#define OBD_BT_CONNECT_MS 10000         // first connection, may include pairing
+#define OBD_BT_INQUIRY_LEN 8            // * 1.28 s
+#define OBD_BT_MAX_DEVICES 64
+#define OBD_BT_NAME_THREADS 4
+#define OBD_BT_NAME_TIMEOUT_MS 5000
+#define OBD_BT_DEFAULT_CHANNEL 1
+#define OBD_BT_NAME_LEN 248
+
+typedef struct {
+    const char* name;
+    // RFCOMM connection within timeout_ms: a descriptor, -1 when it failed
+    int (*connect)(void* ctx, const bdaddr_t* addr, int channel, int timeout_ms);
+    // Addresses of devices in range, at most max; -1 on error
+    int (*inquiry)(void* ctx, int len, bdaddr_t* out, int max);
+    // 0 with the name in name, -1 when the device did not answer; called
+    // from several threads at once
+    int (*remote_name)(void* ctx, const bdaddr_t* addr, char* name, int maxlen, int timeout_ms);
+    // RFCOMM channel of the Serial Port service, -1 when not found
+    int (*rfcomm_channel)(void* ctx, const bdaddr_t* addr);
+    // A reference to ctx for the name threads, which may outlive
+    // obd_bt_discover(); NULL when ctx lives as long as the process
+    void (*hold)(void* ctx);
+    void (*release)(void* ctx);
+} obd_bt_ops_t;
+
+extern const obd_bt_ops_t OBD_BT_BLUEZ;   // ctx NULL: the default HCI device
+extern const obd_bt_ops_t OBD_BT_FAKE;    // ctx from obd_bt_fake_load()
+
+typedef struct {
+    bdaddr_t addr;
+    int channel;
+    char name[OBD_BT_NAME_LEN];
+    int cached;                     // connected to a remembered adapter, no inquiry
+    int sdp;                        // channel from SDP rather than the default
+    int tried, found, named;        // cached connects, devices in the inquiry, names resolved
+    uint64_t elapsed_us;
+} obd_bt_result_t;
+
+// Finds an adapter whose name contains one of names (NULL terminated) and
+// connects to it; the connected descriptor, -1 when none was found.
+// cache_path may be NULL.
+int obd_bt_discover(obd_bt_result_t* r, const obd_bt_ops_t* ops, void* ctx, const char* const* names,
+                    const char* cache_path);
+
+// Fake devices from a file, one per line:
+//
+//    <address> <channel> <name ms> <connect ms> <link device spec|-> <name>
+//
+// The inquiry returns them all; a remote name request waits name ms, a
+// connect waits connect ms and then opens the link device spec
+// (obd_device_open(), e.g. the emulator socket) or fails for "-". An
+// address not in the file times out. An "inquiry <ms>" line makes the
+// inquiry take that long. NULL when the file cannot be read.
+void* obd_bt_fake_load(const char* path);
+// Drops the caller's reference; name requests still running after
+// obd_bt_discover() returned free the devices when they finish
+void obd_bt_fake_free(void* fake);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
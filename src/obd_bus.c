@@ -0,0 +1,210 @@
+/*
+ * obd_bus.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "obd_bus.h"
+#include "obd_trace.h"
+
+void obd_bus_init(obd_bus_t* bus, const obd_pid_t* channels, int nchannels, obd_metrics_t* metrics) {
+    memset(bus, 0, sizeof(*bus));
+    bus->channels = channels;
+    bus->nchannels = nchannels > OBD_MAX_CHANNELS ? OBD_MAX_CHANNELS : nchannels;
+    bus->metrics = metrics;
+}
+
+void obd_bus_set_info(obd_bus_t* bus, const char* info) {
+    snprintf(bus->info, sizeof(bus->info), "%s", info ? info : "");
+}
+
+int obd_bus_add_sink(obd_bus_t* bus, const obd_sink_ops_t* ops, void* ctx,
+                     int capacity, obd_bus_policy_t policy, int block_ms) {
+    if (bus->started || bus->nsinks >= OBD_BUS_MAX_SINKS) {
+        fprintf(stderr, "bus: cannot add sink %s\n", ops->name);
+        return -1;
+    }
+    if (capacity < 1) capacity = 1;
+
+    obd_sink_t* s = &bus->sinks[bus->nsinks];
+    memset(s, 0, sizeof(*s));
+    s->queue = calloc(capacity, sizeof(obd_batch_t*));
+    if (!s->queue) {
+        perror("calloc");
+        return -1;
+    }
+    s->ops = ops;
+    s->ctx = ctx;
+    s->capacity = capacity;
+    s->policy = policy;
+    s->block_ms = block_ms;
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->not_empty, NULL);
+    pthread_cond_init(&s->not_full, NULL);
+    return bus->nsinks++;
+}
+
+obd_batch_t* obd_batch_new(int count) {
+    obd_batch_t* b = malloc(sizeof(obd_batch_t) + count * sizeof(obd_sample_t));
+    if (!b) return NULL;
+    b->refs = 1;
+    b->count = count;
+    for (int i = 0; i < count; ++i) {
+        b->samples[i].t_us = 0;
+        b->samples[i].valid = 0;
+        b->samples[i].trip = 0;
+    }
+    return b;
+}
+
+static void batch_release(obd_batch_t* b) {
+    if (__atomic_sub_fetch(&b->refs, 1, __ATOMIC_ACQ_REL) == 0) free(b);
+}
+
+typedef struct {
+    obd_bus_t* bus;
+    obd_sink_t* sink;
+} sink_thread_arg_t;
+
+static void* sink_thread(void* arg) {
+    obd_bus_t* bus = ((sink_thread_arg_t*)arg)->bus;
+    obd_sink_t* s = ((sink_thread_arg_t*)arg)->sink;
+    free(arg);
+
+    char name[16];
+    snprintf(name, sizeof(name), "sink-%s", s->ops->name);
+    trace_thread_name(name);
+
+    pthread_mutex_lock(&s->lock);
+    for (;;) {
+        while (s->count == 0 && !s->stopping) {
+            if (s->ops->idle) {
+                pthread_mutex_unlock(&s->lock);
+                uint64_t span = TRACE_BEGIN();
+                s->ops->idle(s->ctx);
+                TRACE_END("disk_flush", span, s->ops->name);
+                pthread_mutex_lock(&s->lock);
+                if (s->count > 0 || s->stopping) break;
+            }
+            pthread_cond_wait(&s->not_empty, &s->lock);
+        }
+        if (s->count == 0 && s->stopping) break;
+
+        obd_batch_t* b = s->queue[s->head];
+        s->head = (s->head + 1) % s->capacity;
+        s->count--;
+        pthread_cond_signal(&s->not_full);
+        pthread_mutex_unlock(&s->lock);
+
+        uint64_t span = TRACE_BEGIN();
+        s->ops->write(s->ctx, bus, b);
+        TRACE_END("sink_write", span, s->ops->name);
+        batch_release(b);
+
+        pthread_mutex_lock(&s->lock);
+        s->delivered++;
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    if (s->ops->idle) s->ops->idle(s->ctx);
+    if (s->ops->close) s->ops->close(s->ctx);
+    return NULL;
+}
+
+int obd_bus_start(obd_bus_t* bus) {
+    for (int i = 0; i < bus->nsinks; ++i) {
+        sink_thread_arg_t* arg = malloc(sizeof(*arg));
+        if (!arg) return -1;
+        arg->bus = bus;
+        arg->sink = &bus->sinks[i];
+        if (pthread_create(&bus->sinks[i].thread, NULL, sink_thread, arg) != 0) {
+            perror("pthread_create");
+            free(arg);
+            return -1;
+        }
+    }
+    bus->started = 1;
+    return 0;
+}
+
+static int wait_for_room(obd_sink_t* s) {
+    if (s->policy != OBD_BUS_BLOCK || s->block_ms <= 0) return 0;
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += s->block_ms / 1000;
+    deadline.tv_nsec += (long)(s->block_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    while (s->count == s->capacity) {
+        if (pthread_cond_timedwait(&s->not_full, &s->lock, &deadline) == ETIMEDOUT) break;
+    }
+    return s->count < s->capacity;
+}
+
+void obd_bus_publish(obd_bus_t* bus, obd_batch_t* batch) {
+    // One reference per sink, plus ours until the loop is done
+    __atomic_add_fetch(&batch->refs, bus->nsinks, __ATOMIC_RELAXED);
+
+    for (int i = 0; i < bus->nsinks; ++i) {
+        obd_sink_t* s = &bus->sinks[i];
+        int queued = 0;
+
+        pthread_mutex_lock(&s->lock);
+        if (s->count < s->capacity || wait_for_room(s)) {
+            s->queue[(s->head + s->count) % s->capacity] = batch;
+            s->count++;
+            queued = 1;
+            pthread_cond_signal(&s->not_empty);
+        } else {
+            s->dropped++;
+        }
+        pthread_mutex_unlock(&s->lock);
+
+        if (!queued) {
+            metrics_add(bus->metrics, M_RING_OVERFLOW, 1);
+            batch_release(batch);
+        }
+    }
+    batch_release(batch);
+}
+
+void obd_bus_stop(obd_bus_t* bus) {
+    if (!bus->started) return;
+
+    for (int i = 0; i < bus->nsinks; ++i) {
+        obd_sink_t* s = &bus->sinks[i];
+        pthread_mutex_lock(&s->lock);
+        s->stopping = 1;
+        pthread_cond_signal(&s->not_empty);
+        pthread_mutex_unlock(&s->lock);
+    }
+    for (int i = 0; i < bus->nsinks; ++i) {
+        pthread_join(bus->sinks[i].thread, NULL);
+        free(bus->sinks[i].queue);
+        bus->sinks[i].queue = NULL;
+    }
+    bus->started = 0;
+}
+
+void obd_bus_summary(const obd_bus_t* bus, char* out, int maxlen) {
+    int pos = snprintf(out, maxlen, "bus:");
+    for (int i = 0; i < bus->nsinks && pos < maxlen; ++i) {
+        obd_sink_t* s = (obd_sink_t*)&bus->sinks[i];
+        pthread_mutex_lock(&s->lock);
+        pos += snprintf(out + pos, maxlen - pos, " %s %llu ok %llu dropped %d/%d queued;",
+                        s->ops->name, (unsigned long long)s->delivered,
+                        (unsigned long long)s->dropped, s->count, s->capacity);
+        pthread_mutex_unlock(&s->lock);
+    }
+}
@@ -0,0 +1,130 @@
+/*
+ * obd_bus.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+#ifndef OBD_BUS_H
+#define OBD_BUS_H
+
+//
+// In-process publish/subscribe bus for decoded samples.
+//
+// The acquisition loop fills an obd_batch_t (one or more polling rounds)
+// and publishes it. Every registered sink receives a pointer to the same
+// immutable batch; the batch is reference counted and freed by whichever
+// sink finishes with it last, so there are no per-sink copies.
+//
+// Each sink has its own thread and a bounded queue. When the queue is full
+// the policy decides:
+//
+//    OBD_BUS_DROP    the batch is dropped for that sink only
+//    OBD_BUS_BLOCK   publish waits up to block_ms for room, then drops
+//
+// so a slow SD card or a stuck HTTP client can never stall acquisition for
+// longer than the sink allows. Drops are counted per sink and in the
+// M_RING_OVERFLOW counter.
+//
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "obd_pids.h"
+#include "obd_metrics.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OBD_BUS_MAX_SINKS 8
+
+typedef struct {
+    int64_t t_us;               // unix time, microseconds
+    uint32_t valid;             // bit i set when channel i answered
+    uint32_t trip;              // trip start, unix seconds, 0 outside trips (obd_trip.h)
+    double values[OBD_MAX_CHANNELS];
+} obd_sample_t;
+
+typedef struct {
+    int refs;
+    int count;
+    obd_sample_t samples[];
+} obd_batch_t;
+
+typedef enum {
+    OBD_BUS_DROP,
+    OBD_BUS_BLOCK
+} obd_bus_policy_t;
+
+typedef struct obd_bus obd_bus_t;
+
+typedef struct {
+    const char* name;
+    // Called on the sink thread, one batch at a time, in publish order.
+    void (*write)(void* ctx, const obd_bus_t* bus, const obd_batch_t* batch);
+    // Optional: called when the queue runs empty, e.g. to fflush().
+    void (*idle)(void* ctx);
+    // Optional: called on the sink thread after the last batch.
+    void (*close)(void* ctx);
+} obd_sink_ops_t;
+
+typedef struct {
+    const obd_sink_ops_t* ops;
+    void* ctx;
+    obd_bus_policy_t policy;
+    int block_ms;
+    int capacity;
+    obd_batch_t** queue;
+    int head, count;
+    int stopping;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    pthread_t thread;
+    uint64_t delivered;
+    uint64_t dropped;
+} obd_sink_t;
+
+struct obd_bus {
+    const obd_pid_t* channels;  // schema shared by every batch
+    int nchannels;
+    obd_metrics_t* metrics;
+    char info[256];             // stamped on every file the sinks start, see obd_bus_set_info()
+    obd_sink_t sinks[OBD_BUS_MAX_SINKS];
+    int nsinks;
+    int started;
+};
+
+void obd_bus_init(obd_bus_t* bus, const obd_pid_t* channels, int nchannels, obd_metrics_t* metrics);
+
+// A line for the header of every log segment, e.g. the vehicle identity
+// (obd_vehicle.h). Set it before registering the sinks.
+void obd_bus_set_info(obd_bus_t* bus, const char* info);
+
+// Register before obd_bus_start(). Returns the sink index or -1.
+int obd_bus_add_sink(obd_bus_t* bus, const obd_sink_ops_t* ops, void* ctx,
+                     int capacity, obd_bus_policy_t policy, int block_ms);
+int obd_bus_start(obd_bus_t* bus);
+
+// Allocates a batch of `count` samples with nothing valid yet.
+obd_batch_t* obd_batch_new(int count);
+static inline void obd_sample_set(obd_sample_t* s, int channel, double value) {
+    s->values[channel] = value;
+    s->valid |= 1u << channel;
+}
+
+// Hands the batch to every sink; the caller must not touch it afterwards.
+void obd_bus_publish(obd_bus_t* bus, obd_batch_t* batch);
+
+// Lets every sink drain its queue, calls close and joins the threads.
+void obd_bus_stop(obd_bus_t* bus);
+
+// One line for the journal: delivered/dropped per sink.
+void obd_bus_summary(const obd_bus_t* bus, char* out, int maxlen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,256 @@
+/*
+ * obd_capture.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "obd_capture.h"
+#include "obd_time.h"
+
+// Writer
+// ======
+
+int obd_capture_create(obd_capture_t* c, const char* path, const char* device) {
+    obd_capture_header_t h;
+
+    c->f = fopen(path, "wb");
+    if (!c->f) {
+        perror(path);
+        return -1;
+    }
+    setvbuf(c->f, c->buffer, _IOFBF, sizeof(c->buffer));
+
+    memset(&h, 0, sizeof(h));
+    h.magic = OBD_CAPTURE_MAGIC;
+    h.version = OBD_CAPTURE_VERSION;
+    h.header_size = sizeof(h);
+    h.start_unix_us = obd_unix_now_us();
+    snprintf(h.device, sizeof(h.device), "%s", device ? device : "");
+
+    c->last_us = obd_now_us();
+    c->records = 0;
+    if (fwrite(&h, sizeof(h), 1, c->f) != 1) {
+        perror("capture write");
+        fclose(c->f);
+        c->f = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+void obd_capture_record(obd_capture_t* c, int dir, const void* data, int len) {
+    if (!c || !c->f || len < 0) return;
+
+    obd_capture_record_t rec = { 0, 0, (uint8_t)dir, 0 };
+    uint64_t now = obd_now_us();
+    uint64_t dt = now - c->last_us;
+    c->last_us = now;
+
+    // Gaps over 71 minutes are bridged with empty records
+    while (dt > UINT32_MAX) {
+        rec.dt_us = UINT32_MAX;
+        fwrite(&rec, sizeof(rec), 1, c->f);
+        dt -= UINT32_MAX;
+    }
+
+    const char* p = data;
+    rec.dt_us = (uint32_t)dt;
+    do {
+        int n = len > UINT16_MAX ? UINT16_MAX : len;
+        rec.len = (uint16_t)n;
+        fwrite(&rec, sizeof(rec), 1, c->f);
+        fwrite(p, 1, n, c->f);
+        rec.dt_us = 0;
+        p += n;
+        len -= n;
+        c->records++;
+    } while (len > 0);
+}
+
+void obd_capture_flush(obd_capture_t* c) {
+    if (c && c->f) fflush(c->f);
+}
+
+void obd_capture_close(obd_capture_t* c) {
+    if (c->f) fclose(c->f);
+    c->f = NULL;
+}
+
+// Replay
+// ======
+
+static const char REPLY_NO_DATA[] = "NO DATA\r\r>";
+
+// The record at pos, NULL at the end of the file or at a torn record
+static const obd_capture_record_t* record_at(const obd_replay_t* r, size_t pos) {
+    if (pos + sizeof(obd_capture_record_t) > r->size) return NULL;
+    const obd_capture_record_t* rec = (const obd_capture_record_t*)(r->base + pos);
+    if (pos + sizeof(*rec) + rec->len > r->size) return NULL;
+    return rec;
+}
+
+// Moves *pos past its record; *t_us becomes the time of the next one
+static void next_record(const obd_replay_t* r, size_t* pos, uint64_t* t_us) {
+    const obd_capture_record_t* rec = record_at(r, *pos);
+    if (!rec) return;
+    *pos += sizeof(*rec) + rec->len;
+    const obd_capture_record_t* next = record_at(r, *pos);
+    if (next) *t_us += next->dt_us;
+}
+
+static int64_t scaled_us(const obd_replay_t* r, uint64_t t_us) {
+    return (int64_t)(t_us / r->speed);
+}
+
+int obd_replay_open(obd_replay_t* r, const char* path, double speed) {
+    struct stat st;
+
+    memset(r, 0, sizeof(*r));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(obd_capture_header_t)) {
+        fprintf(stderr, "%s: not a capture file\n", path);
+        close(fd);
+        return -1;
+    }
+
+    void* p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+    }
+
+    const obd_capture_header_t* h = p;
+    if (h->magic != OBD_CAPTURE_MAGIC || h->version != OBD_CAPTURE_VERSION ||
+        h->header_size < sizeof(*h) || (size_t)st.st_size < h->header_size) {
+        fprintf(stderr, "%s: not a capture file or unsupported version\n", path);
+        munmap(p, st.st_size);
+        return -1;
+    }
+
+    r->base = p;
+    r->size = st.st_size;
+    r->hdr = h;
+    r->speed = speed > 0 ? speed : 0;
+    r->pos = h->header_size;
+    const obd_capture_record_t* first = record_at(r, r->pos);
+    r->pos_us = first ? first->dt_us : 0;
+
+    madvise(p, st.st_size, MADV_SEQUENTIAL);
+    return 0;
+}
+
+void obd_replay_close(obd_replay_t* r) {
+    if (r->base) munmap((void*)r->base, r->size);
+    r->base = NULL;
+}
+
+int64_t obd_replay_unix_us(const obd_replay_t* r) {
+    return r->hdr->start_unix_us + (int64_t)r->offset_us;
+}
+
+static int replay_write(void* ctx, const char* buf, int len) {
+    obd_replay_t* r = ctx;
+    size_t pos = r->pos;
+    uint64_t t_us = r->pos_us;
+    const obd_capture_record_t* rec;
+    int seen = 0, found = 0;
+
+    r->commands++;
+    r->pending = NULL;
+    r->in_off = 0;
+
+    // Leftovers of the previous reply are skipped along with the search
+    for (; (rec = record_at(r, pos)) != NULL && seen < OBD_REPLAY_WINDOW; next_record(r, &pos, &t_us)) {
+        if (rec->dir != OBD_CAPTURE_OUT) continue;
+        if (rec->len == len && memcmp(rec + 1, buf, len) == 0) {
+            found = 1;
+            break;
+        }
+        seen++;
+    }
+
+    if (!found && !rec && seen == 0) {
+        r->finished = 1;
+        return -1;
+    }
+    if (!found) {
+        // Not in the capture: answer like a car that does not support it
+        r->missed++;
+        r->pending = REPLY_NO_DATA;
+        return len;
+    }
+
+    r->matched++;
+    r->offset_us = t_us;
+    next_record(r, &pos, &t_us);
+    r->pos = pos;
+    r->pos_us = t_us;
+
+    // Anchor the capture timeline to the wall clock; when we fall behind
+    // (slow sinks, a debugger) re-anchor instead of rushing to catch up
+    if (r->speed > 0) {
+        int64_t now = (int64_t)obd_now_us();
+        if (!r->started || now > scaled_us(r, r->offset_us) + r->skew_us) {
+            r->skew_us = now - scaled_us(r, r->offset_us);
+            r->started = 1;
+        }
+    }
+    return len;
+}
+
+static int replay_read(void* ctx, char* buf, int len, int timeout_ms) {
+    obd_replay_t* r = ctx;
+    const obd_capture_record_t* rec;
+
+    if (r->pending) {
+        int n = (int)strlen(r->pending);
+        if (n > len) n = len;
+        memcpy(buf, r->pending, n);
+        r->pending = NULL;
+        return n;
+    }
+
+    while ((rec = record_at(r, r->pos)) != NULL && rec->dir == OBD_CAPTURE_IN && rec->len == 0)
+        next_record(r, &r->pos, &r->pos_us);
+
+    if (!rec || rec->dir != OBD_CAPTURE_IN) {
+        // Nothing more was said after this command, e.g. a recorded timeout
+        if (r->speed > 0 && timeout_ms > 0) usleep(timeout_ms * 1000);
+        return 0;
+    }
+
+    if (r->speed > 0) {
+        int64_t wait = scaled_us(r, r->pos_us) + r->skew_us - (int64_t)obd_now_us();
+        if (wait > (int64_t)timeout_ms * 1000) {
+            if (timeout_ms > 0) usleep(timeout_ms * 1000);
+            return 0;
+        }
+        if (wait > 0) usleep((useconds_t)wait);
+    }
+
+    int n = rec->len - r->in_off;
+    if (n > len) n = len;
+    memcpy(buf, (const char*)(rec + 1) + r->in_off, n);
+    r->in_off += n;
+    if (r->in_off == rec->len) {
+        r->in_off = 0;
+        next_record(r, &r->pos, &r->pos_us);
+    }
+    return n;
+}
+
+const obd_transport_ops_t OBD_REPLAY_TRANSPORT = { "replay", replay_read, replay_write };
@@ -0,0 +1,120 @@
+/*
+ * obd_capture.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+#ifndef OBD_CAPTURE_H
+#define OBD_CAPTURE_H
+
+//
+// Raw adapter traffic capture and replay.
+//
+// A capture file holds every byte exchanged with the adapter, so a car that
+// misbehaves on the road can be reproduced at a desk. A header is followed by
+// variable-length records:
+//
+//    uint32_t dt_us      CLOCK_MONOTONIC delta to the previous record
+//    uint16_t len        payload bytes
+//    uint8_t  dir        OBD_CAPTURE_OUT (to the adapter) or OBD_CAPTURE_IN
+//    uint8_t  reserved
+//    uint8_t  data[len]
+//
+// Writing is an fwrite() into a 64 KiB stdio buffer, cheap enough to leave
+// on in the car. A torn record at the end (power cut) is ignored on replay.
+//
+// The replay is an obd_session transport: each command the session writes is
+// matched against the next commands in the capture and the recorded reply is
+// handed back with its recorded timing, scaled by the speed factor (1 = real
+// time, 10 = ten times faster, 0 = as fast as possible). Replies are also held
+// back until their place on the capture timeline, so a logger polling back to
+// back is paced like the original run.
+//
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "obd_session.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OBD_CAPTURE_MAGIC 0x3150414344424f00ull   // "\0OBDCAP1"
+#define OBD_CAPTURE_VERSION 1
+
+// Commands looked at when matching a write; anything further away is a
+// command the capture does not have (NO DATA is replied)
+#define OBD_REPLAY_WINDOW 64
+
+enum {
+    OBD_CAPTURE_OUT = 0,
+    OBD_CAPTURE_IN = 1
+};
+
+typedef struct {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    int64_t start_unix_us;  // wall clock at the first record
+    char device[64];
+} obd_capture_header_t;
+
+typedef struct {
+    uint32_t dt_us;
+    uint16_t len;
+    uint8_t dir;
+    uint8_t reserved;
+} obd_capture_record_t;
+
+// Writer
+// ======
+
+typedef struct obd_capture {
+    FILE* f;
+    uint64_t last_us;
+    uint64_t records;
+    char buffer[65536];
+} obd_capture_t;
+
+int obd_capture_create(obd_capture_t* c, const char* path, const char* device);
+// Does nothing when c is NULL
+void obd_capture_record(obd_capture_t* c, int dir, const void* data, int len);
+void obd_capture_flush(obd_capture_t* c);
+void obd_capture_close(obd_capture_t* c);
+
+// Replay transport
+// ================
+
+typedef struct {
+    const uint8_t* base;
+    size_t size;
+    const obd_capture_header_t* hdr;
+    double speed;           // 0 = as fast as possible
+
+    size_t pos;             // next unread record
+    uint64_t pos_us;        // its capture time
+    int in_off;             // bytes of the current IN record already delivered
+    uint64_t offset_us;     // capture time of the last matched command
+    int64_t skew_us;        // wall minus scaled capture time
+    int started;
+    int finished;
+
+    const char* pending;    // canned reply for a command not in the capture
+    uint64_t commands, matched, missed;
+} obd_replay_t;
+
+extern const obd_transport_ops_t OBD_REPLAY_TRANSPORT;
+
+int obd_replay_open(obd_replay_t* r, const char* path, double speed);
+void obd_replay_close(obd_replay_t* r);
+
+// Wall clock of the original run at the last matched command, microseconds
+int64_t obd_replay_unix_us(const obd_replay_t* r);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,366 @@
+/*
+ * obd_convert.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+//
+// Converts the CSV archive into the binary store (obd_store.h).
+//
+// Features
+// ========
+//
+// One schema for every header variant the loggers ever wrote (obd_csv.h):
+// the PID table first, then every other column found in the inputs (derived
+// channels) in the order first seen. All .bin files of a run share it, so
+// obd_history-style readers see the same channels everywhere.
+//
+// Fast path:
+//
+//    - each CSV is mapped read-only with MADV_SEQUENTIAL and parsed in place,
+//      numbers by hand and timestamps with one mktime() per hour
+//    - records go out through a 64 KiB stdio buffer
+//    - files are converted in parallel, largest first, one file per thread
+//
+// Output goes next to the CSV (or to -o dir) with the same name and .bin,
+// through a .tmp file and a rename, and keeps the CSV's modification time so
+// the logger's retention treats both alike. A .bin newer than its CSV is
+// skipped unless -f is given, so an interrupted migration just runs again.
+// The "# vin=..." stamp of newer CSVs goes into the .bin header (info).
+// Rows with a broken timestamp are skipped and counted; rows where nothing
+// answered are kept (valid mask 0), like the logger's store sink does.
+//
+// Compile & Run
+// =============
+//
+// gcc -O2 obd_convert.c obd_csv.c obd_store.c obd_pids.c -o obd_convert -lpthread -lm
+//
+// ./obd_convert                                   /home/pi/obd_logs in place
+// ./obd_convert -j 4 -o /mnt/archive/bin /media/pi/OBD_USB
+// ./obd_convert -f obd_log_20251011_153320.csv
+//
+// Options: -o out_dir, -j threads (all cores by default), -f overwrite,
+// -v one line per file.
+//
+// Example Output
+// ==============
+//
+// ./obd_convert -o /tmp/bin /tmp/archive     (obd_analyze -G 96 archive, one core, page cache)
+//
+// Schema: RPM,Speed,Coolant,Intake,Throttle,MAP,Load,FuelPress,Timing,MAF
+// 2 converted, 0 skipped, 0 failed: 2415577 rows (0 bad), 134.2 MB in 0.66 s (202 MB/s, 1 threads)
+//
+
+#define _GNU_SOURCE
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "obd_pids.h"
+#include "obd_csv.h"
+#include "obd_store.h"
+
+#define DEFAULT_DIR "/home/pi/obd_logs"
+#define MAX_THREADS 64
+
+typedef struct {
+    char* path;
+    off_t size;
+} input_t;
+
+typedef struct {
+    uint64_t converted, skipped, failed;
+    uint64_t rows, bad_rows, bytes;
+} totals_t;
+
+static char names[OBD_MAX_CHANNELS][24];
+static obd_pid_t schema[OBD_MAX_CHANNELS];
+static int nschema;
+
+static input_t* inputs;
+static int ninputs;
+static int next_input;
+
+static const char* out_dir;
+static int force, verbose;
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Schema
+// ======
+
+static int schema_find(const char* name) {
+    for (int i = 0; i < nschema; ++i) {
+        if (strcasecmp(names[i], name) == 0) return i;
+    }
+    return -1;
+}
+
+static void schema_add(const char* name) {
+    if (schema_find(name) >= 0) return;
+    if (nschema == OBD_MAX_CHANNELS) {
+        fprintf(stderr, "More than %d channels, %s dropped\n", OBD_MAX_CHANNELS, name);
+        return;
+    }
+    snprintf(names[nschema], sizeof(names[0]), "%.23s", name);
+    schema[nschema] = (obd_pid_t){ .name = names[nschema], .unit = "", .decimals = 2 };
+    nschema++;
+}
+
+// Reads the header only; -1 when the file is not an obd_log CSV
+static int read_header(const char* path, char columns[][24]) {
+    char header[OBD_CSV_MAX_LINE];
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    ssize_t n = pread(fd, header, sizeof(header) - 1, 0);
+    close(fd);
+    if (n <= 0) return -1;
+    header[n] = '\0';
+
+    const char* line = obd_csv_comments(header, header + n, NULL, 0);
+    const char* eol = strchr(line, '\n');
+    return eol ? obd_csv_columns(line, eol, columns, OBD_MAX_CHANNELS) : -1;
+}
+
+// Inputs
+// ======
+
+static void add_input(const char* path, off_t size) {
+    char columns[OBD_MAX_CHANNELS][24];
+
+    int n = read_header(path, columns);
+    if (n < 0) {
+        fprintf(stderr, "%s: not an obd_log CSV, skipped\n", path);
+        return;
+    }
+    for (int i = 0; i < n; ++i) schema_add(columns[i]);
+
+    if (ninputs % 256 == 0) {
+        input_t* grown = realloc(inputs, (ninputs + 256) * sizeof(*inputs));
+        if (!grown) return;
+        inputs = grown;
+    }
+    inputs[ninputs].path = strdup(path);
+    inputs[ninputs].size = size;
+    ninputs++;
+}
+
+static void add_path(const char* path) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        perror(path);
+        return;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        add_input(path, st.st_size);
+        return;
+    }
+
+    DIR* d = opendir(path);
+    if (!d) {
+        perror(path);
+        return;
+    }
+    struct dirent* e;
+    while ((e = readdir(d)) != NULL) {
+        const char* dot = strrchr(e->d_name, '.');
+        char full[1024];
+        if (strncmp(e->d_name, "obd_log_", 8) != 0 || !dot || strcmp(dot, ".csv") != 0) continue;
+        snprintf(full, sizeof(full), "%s/%s", path, e->d_name);
+        if (stat(full, &st) == 0 && S_ISREG(st.st_mode)) add_input(full, st.st_size);
+    }
+    closedir(d);
+}
+
+static int largest_first(const void* a, const void* b) {
+    off_t x = ((const input_t*)a)->size, y = ((const input_t*)b)->size;
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+// Conversion
+// ==========
+
+static void output_path(const char* csv, char* out, int maxlen) {
+    const char* base = strrchr(csv, '/');
+    const char* name = base ? base + 1 : csv;
+    int dirlen = base ? (int)(base - csv) : 1;
+    const char* dir = base ? csv : ".";
+
+    if (out_dir) {
+        dir = out_dir;
+        dirlen = (int)strlen(out_dir);
+    }
+    snprintf(out, maxlen, "%.*s/%.*s.bin", dirlen, dir, (int)(strrchr(name, '.') - name), name);
+}
+
+static int convert(const input_t* in, totals_t* t) {
+    char columns[OBD_MAX_CHANNELS][24];
+    int8_t column[OBD_MAX_CHANNELS];
+    double values[OBD_MAX_CHANNELS];
+    char path[1024], tmp[1040];
+    struct stat st, bin;
+
+    output_path(in->path, path, sizeof(path));
+    if (stat(in->path, &st) != 0) {
+        perror(in->path);
+        return -1;
+    }
+    if (!force && stat(path, &bin) == 0 && bin.st_mtime >= st.st_mtime && bin.st_size > 0) {
+        t->skipped++;
+        return 0;
+    }
+
+    int fd = open(in->path, O_RDONLY);
+    if (fd < 0) {
+        perror(in->path);
+        return -1;
+    }
+    char* map = st.st_size > 0 ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror(in->path);
+        return -1;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    const char* end = map + st.st_size;
+
+    // The vehicle stamp goes along into the store header
+    char info[OBD_STORE_MAX_INFO];
+    const char* header = obd_csv_comments(map, end, info, sizeof(info));
+    const char* eol = memchr(header, '\n', end - header);
+    int ncolumns = eol ? obd_csv_columns(header, eol, columns, OBD_MAX_CHANNELS) : -1;
+    for (int i = 0; i < ncolumns; ++i) column[i] = (int8_t)schema_find(columns[i]);
+
+    obd_store_writer_t w;
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    if (ncolumns < 0 || obd_store_create_info(&w, tmp, schema, nschema, info) != 0) {
+        munmap(map, st.st_size);
+        return -1;
+    }
+
+    obd_csv_clock_t clock = { { 0 }, 0 };
+    uint64_t rows = 0, bad = 0;
+    for (const char* p = eol + 1; p < end;) {
+        const char* next = memchr(p, '\n', end - p);
+        const char* line_end = next ? next : end;
+        int64_t t_us;
+
+        if (line_end > p && obd_csv_time(&clock, p, line_end, &t_us) == 0) {
+            uint32_t valid = obd_csv_fields(p, line_end, column, ncolumns, values);
+            obd_store_append(&w, t_us, valid, values);
+            rows++;
+        } else if (line_end > p && *p != '\r') {
+            bad++;
+        }
+        p = line_end + 1;
+    }
+    munmap(map, st.st_size);
+
+    int failed = ferror(w.f);
+    obd_store_close(&w);
+    if (failed || rename(tmp, path) != 0) {
+        perror(path);
+        remove(tmp);
+        return -1;
+    }
+
+    // Same age as the CSV for the retention cleanup
+    struct timespec times[2] = { st.st_atim, st.st_mtim };
+    utimensat(AT_FDCWD, path, times, 0);
+
+    t->converted++;
+    t->rows += rows;
+    t->bad_rows += bad;
+    t->bytes += st.st_size;
+    if (verbose) printf("%s: %llu rows, %llu bad\n", path, (unsigned long long)rows, (unsigned long long)bad);
+    return 0;
+}
+
+static void* worker(void* arg) {
+    totals_t* t = arg;
+    int i;
+
+    while ((i = __atomic_fetch_add(&next_input, 1, __ATOMIC_RELAXED)) < ninputs) {
+        if (convert(&inputs[i], t) != 0) t->failed++;
+    }
+    return NULL;
+}
+
+int main(int argc, char** argv) {
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int opt;
+
+    while ((opt = getopt(argc, argv, "fj:o:v")) != -1) {
+        switch (opt) {
+            case 'f': force = 1; break;
+            case 'j': threads = atoi(optarg); break;
+            case 'o': out_dir = optarg; break;
+            case 'v': verbose = 1; break;
+            default:
+                fprintf(stderr, "Usage: %s [-o out_dir] [-j threads] [-f] [-v] [dir|file.csv]...\n", argv[0]);
+                return 1;
+        }
+    }
+    if (threads < 1) threads = 1;
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+    if (out_dir) mkdir(out_dir, 0755);
+
+    // The PID table comes first, so converted and live .bin files line up
+    for (int i = 0; i < OBD_PID_COUNT; ++i) {
+        snprintf(names[i], sizeof(names[0]), "%s", OBD_PIDS[i].name);
+        schema[i] = OBD_PIDS[i];
+    }
+    nschema = OBD_PID_COUNT;
+
+    if (optind == argc) add_path(DEFAULT_DIR);
+    for (int i = optind; i < argc; ++i) add_path(argv[i]);
+    if (ninputs == 0) {
+        fprintf(stderr, "No obd_log_*.csv files found\n");
+        return 1;
+    }
+    qsort(inputs, ninputs, sizeof(*inputs), largest_first);
+
+    printf("Schema: ");
+    for (int i = 0; i < nschema; ++i) printf("%s%s", i ? "," : "", names[i]);
+    printf("\n");
+
+    pthread_t tid[MAX_THREADS];
+    totals_t per_thread[MAX_THREADS], sum = { 0 };
+    memset(per_thread, 0, sizeof(per_thread));
+
+    double t0 = now_s();
+    for (int i = 1; i < threads; ++i) pthread_create(&tid[i], NULL, worker, &per_thread[i]);
+    worker(&per_thread[0]);
+    for (int i = 1; i < threads; ++i) pthread_join(tid[i], NULL);
+    double seconds = now_s() - t0;
+
+    for (int i = 0; i < threads; ++i) {
+        sum.converted += per_thread[i].converted;
+        sum.skipped += per_thread[i].skipped;
+        sum.failed += per_thread[i].failed;
+        sum.rows += per_thread[i].rows;
+        sum.bad_rows += per_thread[i].bad_rows;
+        sum.bytes += per_thread[i].bytes;
+    }
+    printf("%llu converted, %llu skipped, %llu failed: %llu rows (%llu bad), %.1f MB in %.2f s (%.0f MB/s, %d threads)\n",
+           (unsigned long long)sum.converted, (unsigned long long)sum.skipped, (unsigned long long)sum.failed,
+           (unsigned long long)sum.rows, (unsigned long long)sum.bad_rows, sum.bytes / 1e6, seconds,
+           sum.bytes / 1e6 / seconds, threads);
+    return sum.failed ? 1 : 0;
+}
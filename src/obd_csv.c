@@ -0,0 +1,155 @@
+/*
+ * obd_csv.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include "obd_csv.h"
+
+// Names used by obd_background_logger*.c and obd_live_logger.c
+static const struct {
+    const char* legacy;
+    const char* name;
+} ALIASES[] = {
+    { "CoolantTemp",   "Coolant" },
+    { "IntakeTemp",    "Intake" },
+    { "FuelPressure",  "FuelPress" },
+    { "TimingAdvance", "Timing" },
+};
+
+const char* obd_csv_comments(const char* p, const char* end, char* info, size_t maxlen) {
+    if (info && maxlen) info[0] = '\0';
+    while (p < end && *p == '#') {
+        const char* eol = memchr(p, '\n', end - p);
+        const char* text = p + 1;
+        if (!eol) eol = end;
+        if (text < eol && *text == ' ') ++text;
+        if (info && maxlen && !info[0]) {
+            int len = (int)(eol - text);
+            if (len > 0 && eol[-1] == '\r') --len;
+            snprintf(info, maxlen, "%.*s", len, text);
+        }
+        p = eol < end ? eol + 1 : end;
+    }
+    return p;
+}
+
+int obd_csv_columns(const char* header, const char* eol, char names[][24], int max) {
+    if (eol - header < 9 || strncmp(header, "Timestamp", 9) != 0) return -1;
+
+    int n = 0;
+    const char* p = memchr(header, ',', eol - header);
+    while (p && n < max) {
+        const char* f = p + 1;
+        p = memchr(f, ',', eol - f);
+        const char* fend = p ? p : eol;
+
+        // "Speed(km/h)" -> "Speed"
+        const char* unit = memchr(f, '(', fend - f);
+        if (unit) fend = unit;
+        while (fend > f && (fend[-1] == ' ' || fend[-1] == '\r')) --fend;
+        snprintf(names[n], 24, "%.*s", (int)(fend - f), f);
+
+        for (size_t a = 0; a < sizeof(ALIASES) / sizeof(ALIASES[0]); ++a) {
+            if (strcasecmp(names[n], ALIASES[a].legacy) == 0) snprintf(names[n], 24, "%s", ALIASES[a].name);
+        }
+        n++;
+    }
+    return n;
+}
+
+static const double POW10[] = { 1, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+                                1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18 };
+
+const char* obd_csv_number(const char* p, const char* end, double* out) {
+    uint64_t m = 0;
+    int digits = 0, frac = 0, neg = 0;
+
+    if (p < end && *p == '-') {
+        neg = 1;
+        ++p;
+    }
+    for (; p < end && (unsigned)(*p - '0') < 10; ++p, ++digits) {
+        if (digits < 18) m = m * 10 + (*p - '0');
+        else frac--;
+    }
+    if (p < end && *p == '.') {
+        for (++p; p < end && (unsigned)(*p - '0') < 10; ++p, ++digits) {
+            if (digits < 18) {
+                m = m * 10 + (*p - '0');
+                frac++;
+            }
+        }
+    }
+    if (digits == 0) return NULL;
+    double v = frac >= 0 ? m / POW10[frac] : m * POW10[-frac];
+    *out = neg ? -v : v;
+    return p;
+}
+
+int obd_csv_missing(const char* p, const char* end) {
+    if (end - p < 2 || p[0] != '-' || p[1] != '1') return 0;
+    p += 2;
+    if (p < end && *p == '.') {
+        for (++p; p < end && *p == '0'; ++p) {}
+    }
+    return p == end || *p == '\r';
+}
+
+uint32_t obd_csv_fields(const char* line, const char* eol, const int8_t* column, int ncolumns, double* values) {
+    const char* q = memchr(line, ',', eol - line);
+    uint32_t valid = 0;
+
+    for (int col = 0; q && col < ncolumns; ++col) {
+        const char* f = q + 1;
+        const char* next = memchr(f, ',', eol - f);
+        const char* fend = next ? next : eol;
+        int c = column[col];
+        double v;
+
+        if (c >= 0 && !obd_csv_missing(f, fend) && obd_csv_number(f, fend, &v)) {
+            values[c] = v;
+            valid |= 1u << c;
+        }
+        q = next;
+    }
+    return valid;
+}
+
+static int two_digits(const char* p) {
+    if ((unsigned)(p[0] - '0') > 9 || (unsigned)(p[1] - '0') > 9) return -1;
+    return (p[0] - '0') * 10 + (p[1] - '0');
+}
+
+int obd_csv_time(obd_csv_clock_t* c, const char* p, const char* end, int64_t* t_us) {
+    if (end - p < 19 || p[4] != '-' || p[10] != ' ' || p[13] != ':' || p[16] != ':') return -1;
+
+    // mktime() per hour keeps DST changes right without paying for it per row
+    if (memcmp(p, c->hour, sizeof(c->hour)) != 0) {
+        // sscanf() runs strlen() first, which must not walk the rest of a mapped file
+        char key[sizeof(c->hour) + 1];
+        struct tm tm;
+        memcpy(key, p, sizeof(c->hour));
+        key[sizeof(c->hour)] = '\0';
+        memset(&tm, 0, sizeof(tm));
+        if (sscanf(key, "%4d-%2d-%2d %2d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &tm.tm_hour) != 4) return -1;
+        tm.tm_year -= 1900;
+        tm.tm_mon -= 1;
+        tm.tm_isdst = -1;
+        time_t t = mktime(&tm);
+        if (t == (time_t)-1) return -1;
+        memcpy(c->hour, p, sizeof(c->hour));
+        c->hour_us = (int64_t)t * 1000000;
+    }
+
+    int mm = two_digits(p + 14), ss = two_digits(p + 17);
+    if (mm < 0 || ss < 0) return -1;
+    *t_us = c->hour_us + (int64_t)(mm * 60 + ss) * 1000000;
+    return 0;
+}
@@ -0,0 +1,75 @@
+/*
+ * obd_csv.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+#ifndef OBD_CSV_H
+#define OBD_CSV_H
+
+//
+// Fast reading of obd_log_*.csv files for the offline tools (obd_analyze,
+// obd_convert).
+//
+// The loggers wrote three header variants over time:
+//
+//    Timestamp,RPM,Speed,Coolant,Intake,Throttle,MAP,Load,FuelPress,Timing,MAF[,derived...]
+//    Timestamp,RPM,Speed(km/h),Coolant(C),Intake(C),Throttle(%),MAP(kPa),Load(%),
+//              FuelPressure(kPa),TimingAdvance(deg),MAF(g/s)
+//    Timestamp,RPM,Speed(km/h),CoolantTemp(C),Throttle(%),IntakeTemp(C),MAF(g/s)
+//
+// Files since the vehicle stamp (obd_vehicle.h) start with "# vin=... ",
+// skipped by obd_csv_comments() before the header.
+//
+// obd_csv_columns() strips the units and maps the old names onto the PID
+// table names, so every variant reads as the same channels. -1 (or -1.00)
+// is a missing value in all of them.
+//
+// Rows are parsed in place from a mapped file: numbers by hand (the fields
+// are short plain decimals, which strtod() handles 5-10x slower) and the
+// local-time timestamp with one mktime() per hour instead of per row.
+//
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "obd_pids.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OBD_CSV_MAX_LINE 4096
+
+// Skips the leading "# ..." lines; the header line. The text of the first
+// one goes to info (without "# ") when info is not NULL, "" without one.
+const char* obd_csv_comments(const char* p, const char* end, char* info, size_t maxlen);
+
+// Channel names of a header line (after Timestamp), canonical. Returns how
+// many, or -1 when the line is not an obd_log header.
+int obd_csv_columns(const char* header, const char* eol, char names[][24], int max);
+
+// A plain decimal ("-40", "3.25"); the end of the number, NULL without digits
+const char* obd_csv_number(const char* p, const char* end, double* out);
+
+// The logger's missing value: -1, -1.0, -1.00
+int obd_csv_missing(const char* p, const char* end);
+
+// The fields after the timestamp of one line. column[i] is the channel of
+// CSV column i + 1, -1 to skip it. Returns the valid mask.
+uint32_t obd_csv_fields(const char* line, const char* eol, const int8_t* column, int ncolumns, double* values);
+
+// "YYYY-mm-dd HH:MM:SS" in local time, unix microseconds; -1 when malformed
+typedef struct {
+    char hour[13];          // "YYYY-mm-dd HH" of the cached hour
+    int64_t hour_us;
+} obd_csv_clock_t;
+
+int obd_csv_time(obd_csv_clock_t* c, const char* p, const char* end, int64_t* t_us);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
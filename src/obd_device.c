@@ -0,0 +1,164 @@
+/*
+ * obd_device.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/rfcomm.h>
+
+#include "obd_device.h"
+
+static speed_t baud_constant(int baud) {
+    switch (baud) {
+        case 9600:   return B9600;
+        case 19200:  return B19200;
+        case 38400:  return B38400;
+        case 57600:  return B57600;
+        case 115200: return B115200;
+        case 230400: return B230400;
+        case 500000: return B500000;
+    }
+    return 0;
+}
+
+int obd_device_configure_tty(int fd, int baud) {
+    struct termios tty;
+    speed_t speed = baud_constant(baud);
+
+    if (!speed) {
+        fprintf(stderr, "Unsupported baud rate %d\n", baud);
+        return -1;
+    }
+    if (tcgetattr(fd, &tty) != 0) {
+        perror("tcgetattr");
+        return -1;
+    }
+
+    cfmakeraw(&tty);
+    cfsetospeed(&tty, speed);
+    cfsetispeed(&tty, speed);
+    tty.c_cflag |= (CLOCAL | CREAD);
+    tty.c_cflag &= ~(PARENB | PARODD | CSTOPB | CRTSCTS);
+    tty.c_iflag &= ~(IXON | IXOFF | IXANY);
+    tty.c_cc[VMIN] = 0;
+    tty.c_cc[VTIME] = 0;
+
+    if (tcsetattr(fd, TCSANOW, &tty) != 0) {
+        perror("tcsetattr");
+        return -1;
+    }
+    tcflush(fd, TCIOFLUSH);
+    return 0;
+}
+
+// /dev/rfcomm*: a tty, but its line rate is a setting nobody reads, the
+// radio link runs at its own speed whatever AT BRD says
+#define RFCOMM_TTY_MAJOR 216
+
+int obd_device_baud(int fd) {
+    static const int RATES[] = { 9600, 19200, 38400, 57600, 115200, 230400, 500000 };
+    struct termios tty;
+    struct stat st;
+
+    if (fd < 0 || tcgetattr(fd, &tty) != 0) return 0;
+    if (fstat(fd, &st) == 0 && S_ISCHR(st.st_mode) && major(st.st_rdev) == RFCOMM_TTY_MAJOR) return 0;
+    for (size_t i = 0; i < sizeof(RATES) / sizeof(RATES[0]); ++i) {
+        if (cfgetospeed(&tty) == baud_constant(RATES[i])) return RATES[i];
+    }
+    return 0;
+}
+
+static int open_unix(const char* path) {
+    struct sockaddr_un addr = { 0 };
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror("connect");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int open_tty(const char* spec) {
+    char path[256];
+    int baud = OBD_DEFAULT_BAUD;
+
+    snprintf(path, sizeof(path), "%s", spec);
+    char* at = strchr(path, '@');
+    if (at) {
+        *at = '\0';
+        baud = atoi(at + 1);
+    }
+
+    int fd = open(path, O_RDWR | O_NOCTTY);
+    if (fd < 0) {
+        perror("open");
+        return -1;
+    }
+    if (obd_device_configure_tty(fd, baud) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int open_rfcomm(const char* spec) {
+    struct sockaddr_rc addr = { 0 };
+    char bt_addr[32];
+    int channel = 1;
+
+    snprintf(bt_addr, sizeof(bt_addr), "%s", spec);
+    char* at = strchr(bt_addr, '@');
+    if (at) {
+        *at = '\0';
+        channel = atoi(at + 1);
+    }
+
+    int sock = socket(AF_BLUETOOTH, SOCK_STREAM, BTPROTO_RFCOMM);
+    if (sock < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    addr.rc_family = AF_BLUETOOTH;
+    addr.rc_channel = (uint8_t)channel;
+    str2ba(bt_addr, &addr.rc_bdaddr);
+
+    if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror("connect");
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+int obd_device_open(const char* spec) {
+    struct stat st;
+
+    if (strncmp(spec, "unix:", 5) == 0) return open_unix(spec + 5);
+    if (spec[0] == '/') {
+        if (stat(spec, &st) == 0 && S_ISSOCK(st.st_mode)) return open_unix(spec);
+        return open_tty(spec);
+    }
+    return open_rfcomm(spec);
+}
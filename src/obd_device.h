@@ -0,0 +1,40 @@
+/*
+ * obd_device.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+#ifndef OBD_DEVICE_H
+#define OBD_DEVICE_H
+
+//
+// Opens the link to an ELM327 (or something speaking its protocol) from a
+// device spec string and returns a plain read/write file descriptor:
+//
+//    00:1D:A5:68:98:8B[@channel]   RFCOMM socket (channel 1 by default)
+//    /dev/rfcomm0, /dev/ttyUSB0[@baud]  serial port in raw mode (38400 by default)
+//    unix:/tmp/obd_broker.sock     Unix socket, e.g. the shared obd_broker
+//
+// A path that points at a Unix socket is treated like "unix:".
+//
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OBD_DEFAULT_BAUD 38400
+
+int obd_device_open(const char* spec);
+
+// Raw 8N1, no flow control, non-canonical; read() returns what is there.
+int obd_device_configure_tty(int fd, int baud);
+// Current rate of a wired serial port; 0 for sockets and for RFCOMM ttys
+// (/dev/rfcomm*), whose rate setting does not reach the adapter
+int obd_device_baud(int fd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
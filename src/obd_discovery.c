@@ -21,29 +21,45 @@
 //
 // Automatically tries to connect to the first matching device with V-LINK in its name.
 //
+// Known adapters from obd_bt.cache are tried first with a short connect
+// timeout, so a second run usually connects without any scan.
+//
+// The scan skips the inquiry cache flush, resolves device names four at a
+// time and stops at the first match.
+//
+// The RFCOMM channel comes from SDP (Serial Port service) and is cached
+// along with the address, instead of assuming channel 1.
+//
+// All Bluetooth calls go through obd_bt_ops_t; -F plays fake devices from a
+// file instead (see obd_bt.h), e.g. to try the search order against the
+// emulator.
+//
 // Compilation
 // ===========
 //
-// gcc obd_discovery.c -o obd_discovery -lbluetooth
+// gcc obd_discovery.c obd_bt.c obd_device.c obd_session.c obd_metrics.c obd_trace.c obd_capture.c -o obd_discovery -lbluetooth -lpthread
+// ./obd_discovery [-c cache|none] [-n name]... [-F fake_devices]
+//
+// -n replaces the default names to look for (V-LINK, OBD).
 //
 // Optional Output Example
 // =======================
 //
-// Found 00:1D:A5:68:98:8B - V-LINK OBD
-// Connecting to V-LINK at 00:1D:A5:68:98:8B...
-// Response: V-LINK 1.5 ELM327 compatible
+// First run:
 //
-// Command: 010C -> Response: 41 0C 1A F8
-// Command: 010D -> Response: 41 0D 28
-// Command: 03   -> Response: 43 01 33 00 00
+// Scanning for devices...
+// Found 5C:F3:70:12:34:56 - Pixel 7
+// Found 00:1D:A5:68:98:8B - V-LINK OBD
+// Connected to V-LINK OBD at 00:1D:A5:68:98:8B@1 (SDP channel, 2 of 2 names resolved) in 11740 ms
+// Response: ELM327 v1.5
 //
+// Next run:
 //
-// OBD-II Decoder Example (optional)
-// =================================
+// Trying 00:1D:A5:68:98:8B - V-LINK OBD (channel 1)...
+// Connected to V-LINK OBD at 00:1D:A5:68:98:8B@1 (cached) in 412 ms
+// Response: ELM327 v1.5
 //
-// RPM = ((A * 256) + B) / 4
-// Speed = A (in km/h)
-// DTCs = Each pair of bytes decoded per SAE J1979
+// The "addr@channel" spec works as the device of the other tools.
 //
 
 
@@ -53,98 +69,68 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
-#include <errno.h>
 
-#include <sys/socket.h>
 #include <bluetooth/bluetooth.h>
-#include <bluetooth/hci.h>
-#include <bluetooth/hci_lib.h>
-#include <bluetooth/rfcomm.h>
-
-#define CMD "AT I\r"
-#define RFCOMM_CHANNEL 1
-
-int discover_vlink_device(bdaddr_t *bdaddr_out) {
-    inquiry_info *ii = NULL;
-    int max_rsp, num_rsp;
-    int dev_id, sock, len, flags;
-    char addr[19] = { 0 };
-    char name[248] = { 0 };
-
-    dev_id = hci_get_route(NULL);
-    sock = hci_open_dev(dev_id);
-    if (dev_id < 0 || sock < 0) {
-        perror("opening socket");
-        return -1;
-    }
-
-    len = 8;  // ~10 seconds
-    max_rsp = 255;
-    flags = IREQ_CACHE_FLUSH;
-    ii = (inquiry_info*)malloc(max_rsp * sizeof(inquiry_info));
-
-    printf("Scanning for devices...\n");
-    num_rsp = hci_inquiry(dev_id, len, max_rsp, NULL, &ii, flags);
-    if (num_rsp < 0) {
-        perror("hci_inquiry");
-        free(ii);
-        close(sock);
-        return -1;
-    }
-
-    for (int i = 0; i < num_rsp; i++) {
-        ba2str(&(ii+i)->bdaddr, addr);
-        memset(name, 0, sizeof(name));
-        if (hci_read_remote_name(sock, &(ii+i)->bdaddr, sizeof(name), name, 0) < 0)
-            strcpy(name, "[unknown]");
 
-        printf("Found %s - %s\n", addr, name);
-
-        if (strstr(name, "V-LINK") != NULL || strstr(name, "OBD") != NULL) {
-            *bdaddr_out = (ii+i)->bdaddr;
-            free(ii);
-            close(sock);
-            return 0;
+#include "obd_bt.h"
+#include "obd_session.h"
+
+#define MAX_NAMES 8
+
+int main(int argc, char* argv[]) {
+    const char* names[MAX_NAMES + 1] = { "V-LINK", "OBD", NULL };
+    const char* cache_path = OBD_BT_CACHE_FILE;
+    const obd_bt_ops_t* ops = &OBD_BT_BLUEZ;
+    void* ctx = NULL;
+    int nnames = 0, opt;
+
+    while ((opt = getopt(argc, argv, "c:n:F:")) != -1) {
+        switch (opt) {
+            case 'c': cache_path = strcmp(optarg, "none") == 0 ? NULL : optarg; break;
+            case 'n':
+                if (nnames < MAX_NAMES) {
+                    names[nnames++] = optarg;
+                    names[nnames] = NULL;
+                }
+                break;
+            case 'F':
+                ctx = obd_bt_fake_load(optarg);
+                if (!ctx) return 1;
+                ops = &OBD_BT_FAKE;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-c cache|none] [-n name]... [-F fake_devices]\n", argv[0]);
+                return 1;
         }
     }
 
-    free(ii);
-    close(sock);
-    return -1;
-}
-
-int main() {
-    struct sockaddr_rc addr = { 0 };
-    int sock, status;
-    char buf[1024] = { 0 };
-    bdaddr_t target_bdaddr;
-
-    if (discover_vlink_device(&target_bdaddr) != 0) {
+    obd_bt_result_t found;
+    int fd = obd_bt_discover(&found, ops, ctx, names, cache_path);
+    if (fd < 0) {
         fprintf(stderr, "V-LINK device not found.\n");
+        obd_bt_fake_free(ctx);
         return 1;
     }
 
     char bt_addr_str[19] = {0};
-    ba2str(&target_bdaddr, bt_addr_str);
-    printf("Connecting to V-LINK at %s...\n", bt_addr_str);
-
-    sock = socket(AF_BLUETOOTH, SOCK_STREAM, BTPROTO_RFCOMM);
-    addr.rc_family = AF_BLUETOOTH;
-    addr.rc_channel = RFCOMM_CHANNEL;
-    addr.rc_bdaddr = target_bdaddr;
-
-    status = connect(sock, (struct sockaddr *)&addr, sizeof(addr));
-    if (status < 0) {
-        perror("connect");
-        return 1;
-    }
-
-    write(sock, CMD, strlen(CMD));
-    usleep(500000);  // wait
-    read(sock, buf, sizeof(buf));
-    printf("Response: %s\n", buf);
-
-    close(sock);
+    ba2str(&found.addr, bt_addr_str);
+    if (found.cached)
+        printf("Connected to %s at %s@%d (cached) in %.0f ms\n", found.name, bt_addr_str, found.channel,
+               found.elapsed_us / 1000.0);
+    else
+        printf("Connected to %s at %s@%d (%s channel, %d of %d names resolved) in %.0f ms\n", found.name,
+               bt_addr_str, found.channel, found.sdp ? "SDP" : "default", found.named, found.found,
+               found.elapsed_us / 1000.0);
+
+    // Up to the prompt instead of a fixed wait
+    obd_session_t session;
+    char response[256];
+    obd_session_init(&session, fd, NULL);
+    obd_session_command(&session, "AT E0", response, sizeof(response));
+    obd_session_command(&session, "AT I", response, sizeof(response));
+    printf("Response: %s\n", response);
+
+    close(fd);
+    obd_bt_fake_free(ctx);
     return 0;
 }
-
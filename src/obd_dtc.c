@@ -0,0 +1,366 @@
+/*
+ * obd_dtc.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "obd_dtc.h"
+#include "obd_time.h"
+
+const char* const OBD_DTC_KIND_NAMES[OBD_DTC_KINDS] = { "stored", "pending", "permanent" };
+
+static const char* const MODE_COMMANDS[OBD_DTC_KINDS] = { "03", "07", "0A" };
+static const int MODES[OBD_DTC_KINDS] = { 0x03, 0x07, 0x0A };
+
+// Codes are formatted and replies parsed through tables, no printf / scanf
+static const char LETTERS[] = "PCBU";
+static const char HEX_CHARS[] = "0123456789ABCDEF";
+
+// 0x10 | value for the hex digits, 0 for anything else
+static const uint8_t HEX_DIGITS[256] = {
+    ['0'] = 0x10, ['1'] = 0x11, ['2'] = 0x12, ['3'] = 0x13, ['4'] = 0x14,
+    ['5'] = 0x15, ['6'] = 0x16, ['7'] = 0x17, ['8'] = 0x18, ['9'] = 0x19,
+    ['A'] = 0x1A, ['B'] = 0x1B, ['C'] = 0x1C, ['D'] = 0x1D, ['E'] = 0x1E, ['F'] = 0x1F,
+    ['a'] = 0x1A, ['b'] = 0x1B, ['c'] = 0x1C, ['d'] = 0x1D, ['e'] = 0x1E, ['f'] = 0x1F,
+};
+
+void obd_dtc_format(uint16_t code, char out[6]) {
+    out[0] = LETTERS[code >> 14];
+    out[1] = (char)('0' + ((code >> 12) & 0x3));
+    out[2] = HEX_CHARS[(code >> 8) & 0xF];
+    out[3] = HEX_CHARS[(code >> 4) & 0xF];
+    out[4] = HEX_CHARS[code & 0xF];
+    out[5] = '\0';
+}
+
+int obd_dtc_parse(const char* text, uint16_t* code) {
+    const char* letter = text[0] ? strchr(LETTERS, text[0] & ~0x20) : NULL;
+    if (!letter || text[1] < '0' || text[1] > '3' || text[5] != '\0') return -1;
+
+    uint16_t c = (uint16_t)((letter - LETTERS) << 14 | (text[1] - '0') << 12);
+    for (int i = 2; i < 5; ++i) {
+        uint8_t h = HEX_DIGITS[(unsigned char)text[i]];
+        if (!h) return -1;
+        c |= (uint16_t)((h & 0xF) << (4 * (4 - i)));
+    }
+    *code = c;
+    return 0;
+}
+
+// Reply parsing
+// =============
+
+typedef struct {
+    unsigned char b[2 * OBD_DTC_MAX + 8];
+    int len;
+    int multi;                  // joined from ISO-TP "0:", "1:", ... lines
+} message_t;
+
+static int hex_digit(char c) {
+    uint8_t h = HEX_DIGITS[(unsigned char)c];
+    return h ? h & 0xF : -1;
+}
+
+// Hex bytes with or without spaces until anything else
+static void append_bytes(message_t* m, const char* p, const char* end) {
+    while (m->len < (int)sizeof(m->b)) {
+        while (p < end && *p == ' ') ++p;
+        if (end - p < 2 || hex_digit(p[0]) < 0 || hex_digit(p[1]) < 0) return;
+        m->b[m->len++] = (unsigned char)(hex_digit(p[0]) * 16 + hex_digit(p[1]));
+        p += 2;
+    }
+}
+
+// One message per line, except multi-frame CAN answers ("00A", "0: 43 04 ...",
+// "1: ...") which are joined back into one
+static int reply_messages(const char* response, message_t* msgs, int max) {
+    int n = 0;
+    message_t* cur = NULL;
+    const char* p = response;
+
+    while (*p && n < max) {
+        const char* eol = p + strcspn(p, "\r\n");
+        const char* colon = memchr(p, ':', eol - p);
+
+        if (colon && colon - p == 1 && hex_digit(p[0]) >= 0) {
+            if (hex_digit(p[0]) == 0 || !cur || !cur->multi) {
+                cur = &msgs[n++];
+                cur->len = 0;
+                cur->multi = 1;
+            }
+            append_bytes(cur, colon + 1, eol);
+        } else if (!colon && eol - p != 3) {
+            // A three digit line is the byte count of a multi-frame answer
+            cur = &msgs[n];
+            cur->len = 0;
+            cur->multi = 0;
+            append_bytes(cur, p, eol);
+            if (cur->len > 0) n++;
+            cur = NULL;
+        }
+
+        p = eol;
+        while (*p == '\r' || *p == '\n') ++p;
+    }
+    return n;
+}
+
+int obd_dtc_decode(int mode, const char* response, uint16_t* codes, int max) {
+    message_t msgs[8];
+    int nmsgs = reply_messages(response, msgs, 8);
+    int answered = 0, n = 0;
+
+    for (int i = 0; i < nmsgs; ++i) {
+        const message_t* m = &msgs[i];
+        if (m->len < 1 || m->b[0] != mode + 0x40) continue;
+        answered = 1;
+
+        // CAN: 43 <count> <codes>; ISO 9141: 43 and always three codes, 0000 padded
+        int first = 1, ncodes = 3;
+        if (m->multi || m->len != 7) {
+            first = 2;
+            ncodes = m->len >= 2 ? m->b[1] : 0;
+        }
+        for (int k = 0; k < ncodes && first + 2 * k + 1 < m->len && n < max; ++k) {
+            uint16_t code = (uint16_t)(m->b[first + 2 * k] << 8 | m->b[first + 2 * k + 1]);
+            if (code != 0) codes[n++] = code;
+        }
+    }
+    return answered ? n : -1;
+}
+
+// 0101 byte A: MIL in bit 7, stored code count below; -1 when not answered
+static int status_byte(const char* response) {
+    message_t msgs[8];
+    int nmsgs = reply_messages(response, msgs, 8);
+
+    for (int i = 0; i < nmsgs; ++i) {
+        if (msgs[i].len >= 3 && msgs[i].b[0] == 0x41 && msgs[i].b[1] == 0x01) return msgs[i].b[2];
+    }
+    return -1;
+}
+
+// Tracking
+// ========
+
+void obd_dtc_init(obd_dtc_t* d, obd_dtc_event_fn event, void* ctx) {
+    memset(d, 0, sizeof(*d));
+    d->event = event;
+    d->ctx = ctx;
+    d->status = -1;
+}
+
+static int contains(const uint16_t* codes, int n, uint16_t code) {
+    for (int i = 0; i < n; ++i) {
+        if (codes[i] == code) return 1;
+    }
+    return 0;
+}
+
+static obd_dtc_record_t* history_record(obd_dtc_history_t* h, uint16_t code, int kind, int64_t now_us);
+
+// Replaces the set of one kind, with an event per code that came or went
+static int merge(obd_dtc_t* d, int kind, const uint16_t* codes, int n, int64_t now_us) {
+    uint16_t* known = d->codes[kind];
+    uint16_t next[OBD_DTC_MAX];
+    int nnext = 0, events = 0;
+    char text[6];
+
+    // Several ECUs may report the same code
+    for (int i = 0; i < n && nnext < OBD_DTC_MAX; ++i) {
+        if (!contains(next, nnext, codes[i])) next[nnext++] = codes[i];
+    }
+
+    for (int i = 0; i < nnext; ++i) {
+        obd_dtc_record_t* r = d->history ? history_record(d->history, next[i], kind, now_us) : NULL;
+        if (r) {
+            r->last_us = now_us;
+            r->active |= 1u << kind;
+        }
+        if (contains(known, d->ncodes[kind], next[i])) continue;
+        if (r) r->count++;
+        obd_dtc_format(next[i], text);
+        if (d->event) d->event(d->ctx, text, kind, 0);
+        d->appeared++;
+        events++;
+    }
+    for (int i = 0; i < d->ncodes[kind]; ++i) {
+        if (contains(next, nnext, known[i])) continue;
+        obd_dtc_record_t* r = d->history ? history_record(d->history, known[i], kind, now_us) : NULL;
+        if (r) r->active &= ~(1u << kind);
+        obd_dtc_format(known[i], text);
+        if (d->event) d->event(d->ctx, text, kind, 1);
+        d->cleared++;
+        events++;
+    }
+
+    memcpy(known, next, nnext * sizeof(next[0]));
+    d->ncodes[kind] = nnext;
+    return events;
+}
+
+// Reads all three kinds; the stored codes must answer for the read to count
+static int scan(obd_dtc_t* d, obd_session_t* s, int* events) {
+    char response[512];
+    uint16_t codes[OBD_DTC_MAX];
+    int stored_ok = 0;
+    int64_t now_us = obd_unix_now_us();
+
+    d->scans++;
+    for (int k = 0; k < OBD_DTC_KINDS; ++k) {
+        obd_session_query(s, MODE_COMMANDS[k], response, sizeof(response));
+        int n = obd_dtc_decode(MODES[k], response, codes, OBD_DTC_MAX);
+        // Not answered (many ECUs have no mode 0A): keep what we knew
+        if (n < 0) continue;
+        if (k == OBD_DTC_STORED) stored_ok = 1;
+        *events += merge(d, k, codes, n, now_us);
+    }
+    if (d->history) obd_dtc_history_save(d->history);
+    return stored_ok;
+}
+
+int obd_dtc_poll(obd_dtc_t* d, obd_session_t* s, uint64_t now_us) {
+    char response[256];
+    int events = 0;
+
+    if (now_us - d->last_status_us < OBD_DTC_STATUS_S * 1000000ull) return 0;
+    d->last_status_us = now_us;
+    d->status_polls++;
+
+    // Unanswered: the ECU is asleep or gone, and so would be 03
+    obd_session_query(s, "0101", response, sizeof(response));
+    int a = status_byte(response);
+    if (a < 0) return 0;
+
+    int rescan = d->last_scan_us == 0 || now_us - d->last_scan_us >= OBD_DTC_RESCAN_S * 1000000ull;
+    if (a == d->status && !rescan) return 0;
+
+    // The status is only taken once the codes behind it were read
+    if (scan(d, s, &events)) {
+        d->status = a;
+        d->last_scan_us = now_us;
+    }
+    return events;
+}
+
+int obd_dtc_mil(const obd_dtc_t* d) {
+    return d->status < 0 ? -1 : (d->status & 0x80) != 0;
+}
+
+int obd_dtc_count(const obd_dtc_t* d) {
+    return d->status < 0 ? -1 : d->status & 0x7F;
+}
+
+// History
+// =======
+
+static int compare_record(const void* key, const void* r) {
+    return (int)*(const uint16_t*)key - (int)((const obd_dtc_record_t*)r)->code;
+}
+
+const obd_dtc_record_t* obd_dtc_history_find(const obd_dtc_history_t* h, uint16_t code) {
+    return h->count ? bsearch(&code, h->records, h->count, sizeof(h->records[0]), compare_record) : NULL;
+}
+
+// The record of code, inserted in order when it is new; NULL without memory
+static obd_dtc_record_t* history_record(obd_dtc_history_t* h, uint16_t code, int kind, int64_t now_us) {
+    int lo = 0, hi = h->count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (h->records[mid].code < code) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo < h->count && h->records[lo].code == code) return &h->records[lo];
+
+    if (h->count == h->capacity) {
+        int capacity = h->capacity ? h->capacity * 2 : 64;
+        obd_dtc_record_t* grown = realloc(h->records, capacity * sizeof(h->records[0]));
+        if (!grown) return NULL;
+        h->records = grown;
+        h->capacity = capacity;
+    }
+    memmove(h->records + lo + 1, h->records + lo, (h->count - lo) * sizeof(h->records[0]));
+    h->count++;
+
+    obd_dtc_record_t* r = &h->records[lo];
+    memset(r, 0, sizeof(*r));
+    r->code = code;
+    r->state = (uint8_t)kind;
+    r->first_us = r->last_us = now_us;
+    return r;
+}
+
+int obd_dtc_history_open(obd_dtc_history_t* h, const char* path) {
+    memset(h, 0, sizeof(*h));
+    snprintf(h->path, sizeof(h->path), "%s", path);
+
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        if (errno == ENOENT) return 0;
+        perror(path);
+        return -1;
+    }
+
+    obd_dtc_history_header_t hdr;
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1 || hdr.magic != OBD_DTC_HISTORY_MAGIC ||
+        hdr.version != OBD_DTC_HISTORY_VERSION) {
+        fprintf(stderr, "%s: not a DTC history\n", path);
+        fclose(f);
+        return -1;
+    }
+    h->records = malloc((hdr.count ? hdr.count : 1) * sizeof(h->records[0]));
+    if (!h->records || fread(h->records, sizeof(h->records[0]), hdr.count, f) != hdr.count) {
+        fprintf(stderr, "%s: truncated\n", path);
+        fclose(f);
+        obd_dtc_history_close(h);
+        return -1;
+    }
+    h->count = h->capacity = (int)hdr.count;
+    fclose(f);
+    return 0;
+}
+
+int obd_dtc_history_save(obd_dtc_history_t* h) {
+    char tmp[520];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", h->path);
+
+    FILE* f = fopen(tmp, "wb");
+    if (!f) {
+        perror(tmp);
+        return -1;
+    }
+    obd_dtc_history_header_t hdr = { OBD_DTC_HISTORY_MAGIC, OBD_DTC_HISTORY_VERSION, (uint32_t)h->count };
+    fwrite(&hdr, sizeof(hdr), 1, f);
+    fwrite(h->records, sizeof(h->records[0]), h->count, f);
+    if (fclose(f) != 0 || rename(tmp, h->path) != 0) {
+        perror(h->path);
+        remove(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+void obd_dtc_history_close(obd_dtc_history_t* h) {
+    free(h->records);
+    h->records = NULL;
+    h->count = h->capacity = 0;
+}
+
+void obd_dtc_set_history(obd_dtc_t* d, obd_dtc_history_t* h) {
+    d->history = h;
+    for (int k = 0; k < OBD_DTC_KINDS; ++k) d->ncodes[k] = 0;
+
+    for (int i = 0; i < h->count; ++i) {
+        for (int k = 0; k < OBD_DTC_KINDS; ++k) {
+            if ((h->records[i].active & (1u << k)) && d->ncodes[k] < OBD_DTC_MAX)
+                d->codes[k][d->ncodes[k]++] = h->records[i].code;
+        }
+    }
+}
@@ -0,0 +1,130 @@
+/*
+ * obd_dtc.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+#ifndef OBD_DTC_H
+#define OBD_DTC_H
+
+//
+// DTC tracking, gated on 0101.
+//
+// Reading the codes every minute costs three requests (03 stored, 07
+// pending, 0A permanent) whose answer is nearly always "none". 0101 answers
+// in one frame with the MIL bit and the number of stored codes, so it is
+// polled every OBD_DTC_STATUS_S seconds and the full reads are only sent
+// when the MIL or the count changes:
+//
+//    0101  41 01 82 07 E5 00   MIL on, 2 stored codes -> read 03, 07, 0A
+//    0101  41 01 82 07 E5 00   same                   -> nothing
+//
+// Pending and permanent codes do not show in 0101, so all three are still
+// read every OBD_DTC_RESCAN_S. Nothing is sent past 0101 while it goes
+// unanswered (ignition off, ECU asleep), since 03 would not answer either.
+//
+// The codes seen by the last read are kept per kind; the event callback only
+// runs for codes that appeared or went away, so the dtc_log stays empty
+// while the set does not change.
+//
+// History: with obd_dtc_set_history() every read also updates
+// dtc_history.bin, one 24 byte record per code ever reported, sorted by code
+// so a lookup is a bsearch() instead of a scan of every dtc_log_*.csv:
+//
+//    header   magic "\0OBDDTC1", version, count
+//    records  obd_dtc_record_t, ascending code
+//
+// The file is rewritten (.tmp and rename) after each read, which the 0101
+// gating keeps to a few per drive. Codes marked active there seed the sets
+// at startup, so a logger restart does not report them as new again.
+//
+
+#include <stdint.h>
+
+#include "obd_session.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OBD_DTC_MAX 64
+#define OBD_DTC_STATUS_S 10
+#define OBD_DTC_RESCAN_S 600
+
+#define OBD_DTC_HISTORY_MAGIC 0x3143544444424f00ull   // "\0OBDDTC1"
+#define OBD_DTC_HISTORY_VERSION 1
+
+enum { OBD_DTC_STORED, OBD_DTC_PENDING, OBD_DTC_PERMANENT, OBD_DTC_KINDS };
+
+extern const char* const OBD_DTC_KIND_NAMES[OBD_DTC_KINDS];
+
+// "P0133" from the two bytes of a reply, and back (-1 when malformed)
+void obd_dtc_format(uint16_t code, char out[6]);
+int obd_dtc_parse(const char* text, uint16_t* code);
+
+// The codes in the reply to mode 03, 07 or 0A, single frame, multi-frame
+// CAN or ISO 9141 (three codes per message, zero padded). -1 when no
+// message of that mode is in the reply.
+int obd_dtc_decode(int mode, const char* response, uint16_t* codes, int max);
+
+typedef struct {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t count;
+} obd_dtc_history_header_t;
+
+typedef struct {
+    uint16_t code;
+    uint8_t state;              // kind it was first reported as
+    uint8_t active;             // 1 << kind for each kind set at the last read
+    uint32_t count;             // times it was reported new
+    int64_t first_us;           // unix time of the first report
+    int64_t last_us;            // unix time of the last read that had it
+} obd_dtc_record_t;
+
+typedef struct {
+    char path[512];
+    obd_dtc_record_t* records;
+    int count, capacity;
+} obd_dtc_history_t;
+
+// A missing file is an empty history; -1 when it cannot be read
+int obd_dtc_history_open(obd_dtc_history_t* h, const char* path);
+const obd_dtc_record_t* obd_dtc_history_find(const obd_dtc_history_t* h, uint16_t code);
+int obd_dtc_history_save(obd_dtc_history_t* h);
+void obd_dtc_history_close(obd_dtc_history_t* h);
+
+// code went away when cleared is 1
+typedef void (*obd_dtc_event_fn)(void* ctx, const char* code, int kind, int cleared);
+
+typedef struct {
+    obd_dtc_event_fn event;
+    void* ctx;
+    obd_dtc_history_t* history;
+
+    int status;                 // 0101 byte A behind the last read, -1 before it
+    uint64_t last_status_us, last_scan_us;
+
+    uint16_t codes[OBD_DTC_KINDS][OBD_DTC_MAX];
+    int ncodes[OBD_DTC_KINDS];
+
+    uint64_t status_polls, scans, appeared, cleared;
+} obd_dtc_t;
+
+void obd_dtc_init(obd_dtc_t* d, obd_dtc_event_fn event, void* ctx);
+// Records every read in h from now on; the active codes in h become the known sets
+void obd_dtc_set_history(obd_dtc_t* d, obd_dtc_history_t* h);
+
+// Sends whatever is due at now_us; returns how many events ran
+int obd_dtc_poll(obd_dtc_t* d, obd_session_t* s, uint64_t now_us);
+
+// MIL state and stored-code count of the last 0101 answer; -1 when unknown
+int obd_dtc_mil(const obd_dtc_t* d);
+int obd_dtc_count(const obd_dtc_t* d);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -17,22 +17,54 @@
 //
 // Dynamic DTC Decoding
 //
-// This version connects to the OBD-II adapter, sends mode 03 to read stored Diagnostic Trouble Codes,
-// and decodes them according to SAE J2012 / ISO 15031-6.
+// This version connects to the OBD-II adapter, reads the stored (mode 03), pending (07) and
+// permanent (0A) Diagnostic Trouble Codes and decodes them according to SAE J2012 / ISO 15031-6.
+//
+// The replies are decoded by obd_dtc.c, the same decoder the logger uses: single frame CAN
+// ("43 02 01 33 02 10"), multi-frame CAN and ISO 9141 (three codes per message, 0000 padded).
+// The reply is ASCII hex text, not binary, and the trailing 0000 padding does not end the list
+// early.
+//
+// -H reads the DTC history the logger keeps (dtc_history.bin, see obd_dtc.h) instead of the
+// car: every code ever reported with first / last seen, count and the kind it was first
+// reported as, or just the given codes (binary search).
+//
+// -M also reads the mode 06 on-board monitor results (obd_monitor.h): every supported MID,
+// its tests decoded with the SAE J1979 unit and scaling table, and pass / fail against the
+// limits the ECU reports.
 //
 // Build and Run
 // =============
 //
-// gcc obd_dtc_decoder.c -o obd_dtc_decoder -lbluetooth
-// ./obd_dtc_decoder
+// gcc obd_dtc_decoder.c obd_dtc.c obd_monitor.c obd_pids.c obd_device.c obd_session.c obd_capture.c obd_metrics.c obd_trace.c -o obd_dtc_decoder -lbluetooth -lpthread -lm
+// ./obd_dtc_decoder [-M] [device]
+// ./obd_dtc_decoder -H /home/pi/obd_logs/dtc_history.bin [code...]
+//
+// device defaults to BT_ADDR; unix:/tmp/obd_broker.sock goes through obd_broker.
 //
 // Example Output
 // ==============
 //
-// Raw DTC response: 43 01 33 02 10 00 00
-// DTCs:
-//  P0133
-//  P0210
+// stored (03): 43 02 01 33 02 10
+//   P0133
+//   P0210
+// pending (07): 47 00
+//   none
+// permanent (0A): NO DATA
+//   not supported
+//
+// $ ./obd_dtc_decoder -H /home/pi/obd_logs/dtc_history.bin
+// Code   First seen           Last seen            Count  First as   Active
+// P0133  2026-10-02 07:41:10  2026-10-18 20:14:03      3  pending    stored
+// P0420  2026-09-12 17:02:55  2026-09-14 08:30:12      1  stored     -
+//
+// $ ./obd_dtc_decoder -M
+// ...
+// Monitors (mode 06): 6 tests in 5 MIDs, 1 failed
+//   MID Monitor              TID        Value          Min          Max Unit
+//   01  O2 Sensor B1S1       01        455.06            0      7995.27 mV
+//   21  Catalyst Bank 1      80      0.249997            0     0.499994
+//   A3  Misfire Cylinder     0B           130            0          100 counts  FAIL
 //
 
 
@@ -41,83 +73,121 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <time.h>
 
-#include <sys/socket.h>
-#include <bluetooth/bluetooth.h>
-#include <bluetooth/rfcomm.h>
+#include "obd_device.h"
+#include "obd_session.h"
+#include "obd_dtc.h"
+#include "obd_monitor.h"
+#include "obd_time.h"
 
 #define BT_ADDR "00:1D:A5:68:98:8B"  // Replace with your adapter MAC
-#define RFCOMM_CHANNEL 1
 
-void decode_dtc(const unsigned char* data, int len) {
-    int i = 0;
-    if (len < 3 || data[0] != 0x43) {
-        printf("Unexpected response or no DTCs.\n");
-        return;
+static const char* const COMMANDS[OBD_DTC_KINDS] = { "03", "07", "0A" };
+static const char* const SETUP[] = { "AT E0", "AT L0", "AT SP 0", NULL };
+
+static void print_record(const obd_dtc_record_t* r) {
+    char code[6], first[32], last[32], active[32] = "";
+    obd_dtc_format(r->code, code);
+    obd_format_time(first, sizeof(first), r->first_us);
+    obd_format_time(last, sizeof(last), r->last_us);
+    for (int k = 0; k < OBD_DTC_KINDS; ++k) {
+        if (!(r->active & (1u << k))) continue;
+        if (active[0]) strcat(active, ",");
+        strcat(active, OBD_DTC_KIND_NAMES[k]);
     }
+    printf("%-6s %-20s %-20s %5u  %-10s %s\n", code, first, last, r->count,
+           r->state < OBD_DTC_KINDS ? OBD_DTC_KIND_NAMES[r->state] : "?", active[0] ? active : "-");
+}
 
-    printf("DTCs:\n");
-
-    for (i = 1; i+1 < len && data[i] != 0x00 && data[i+1] != 0x00; i += 2) {
-        unsigned char A = data[i];
-        unsigned char B = data[i+1];
-
-        char dtc[6];
-        char first_char;
-
-        switch ((A & 0xC0) >> 6) {
-            case 0: first_char = 'P'; break;
-            case 1: first_char = 'C'; break;
-            case 2: first_char = 'B'; break;
-            case 3: first_char = 'U'; break;
-        }
+static int show_history(const char* path, char** codes, int ncodes) {
+    obd_dtc_history_t h;
+    if (obd_dtc_history_open(&h, path) < 0) return 1;
+
+    printf("%-6s %-20s %-20s %5s  %-10s %s\n", "Code", "First seen", "Last seen", "Count", "First as", "Active");
+    for (int i = 0; ncodes == 0 && i < h.count; ++i) print_record(&h.records[i]);
+    for (int i = 0; i < ncodes; ++i) {
+        uint16_t code;
+        const obd_dtc_record_t* r = obd_dtc_parse(codes[i], &code) == 0 ? obd_dtc_history_find(&h, code) : NULL;
+        if (r) print_record(r);
+        else printf("%-6s never reported\n", codes[i]);
+    }
+    obd_dtc_history_close(&h);
+    return 0;
+}
 
-        snprintf(dtc, sizeof(dtc), "%c%01X%02X", first_char, (A & 0x3F) >> 4, ((A & 0x0F) << 4) | (B >> 4));
-        printf("  %s\n", dtc);
+static void print_monitors(obd_session_t* session) {
+    static obd_monitor_t m;
+    obd_monitor_init(&m, 0);
+    if (obd_monitor_read_all(&m, session) < 0) {
+        printf("Monitors (mode 06): not supported\n");
+        return;
     }
 
-    if (i == 1) {
-        printf("  No DTCs found.\n");
+    int failed = 0;
+    for (int i = 0; i < m.nresults; ++i) failed += !m.results[i].passed;
+    printf("Monitors (mode 06): %d tests in %d MIDs, %d failed\n", m.nresults, m.nmids, failed);
+    printf("  %-3s %-20s %-3s %12s %12s %12s %s\n", "MID", "Monitor", "TID", "Value", "Min", "Max", "Unit");
+    for (int i = 0; i < m.nresults; ++i) {
+        const obd_monitor_result_t* r = &m.results[i];
+        const char* name = obd_monitor_mid_name(r->mid);
+        printf("  %02X  %-20s %02X  %12g %12g %12g %s%s\n", r->mid, name ? name : "", r->tid, r->value, r->min,
+               r->max, r->unit, r->passed ? "" : "  FAIL");
     }
 }
 
-int main() {
-    struct sockaddr_rc addr = { 0 };
-    int sock, status;
-    char buf[1024] = { 0 };
-    unsigned char response[1024] = { 0 };
-
-    sock = socket(AF_BLUETOOTH, SOCK_STREAM, BTPROTO_RFCOMM);
-    addr.rc_family = AF_BLUETOOTH;
-    addr.rc_channel = RFCOMM_CHANNEL;
-    str2ba(BT_ADDR, &addr.rc_bdaddr);
+int main(int argc, char** argv) {
+    const char* history = NULL;
+    int monitors = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "H:M")) != -1) {
+        if (opt == 'H') {
+            history = optarg;
+        } else if (opt == 'M') {
+            monitors = 1;
+        } else {
+            fprintf(stderr, "Usage: %s [-M] [device] | -H dtc_history.bin [code...]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (history) return show_history(history, argv + optind, argc - optind);
 
-    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
-        perror("connect");
+    int sock = obd_device_open(optind < argc ? argv[optind] : BT_ADDR);
+    if (sock < 0) {
         return 1;
     }
 
-    write(sock, "AT E0\r", 6); usleep(300000);
-    read(sock, buf, sizeof(buf));
-    write(sock, "03\r", 3); // Request DTCs
-    usleep(500000);
+    obd_metrics_t metrics;
+    obd_session_t session;
+    metrics_init(&metrics);
+    obd_session_init(&session, sock, &metrics);
+    obd_session_set_recovery(&session, SETUP, NULL, NULL);
+    obd_session_setup(&session);
+
+    for (int k = 0; k < OBD_DTC_KINDS; ++k) {
+        char response[1024];
+        uint16_t codes[OBD_DTC_MAX];
 
-    int len = read(sock, response, sizeof(response));
-    if (len > 0) {
-        printf("Raw DTC response: ");
-        for (int i = 0; i < len; i++) printf("%02X ", response[i]);
-        printf("\n");
+        obd_session_query(&session, COMMANDS[k], response, sizeof(response));
+        int n = obd_dtc_decode(strtol(COMMANDS[k], NULL, 16), response, codes, OBD_DTC_MAX);
 
-        decode_dtc(response, len);
-    } else {
-        printf("No data received.\n");
+        // All messages on one line
+        for (char* p = response; *p; ++p) {
+            if (*p == '\r' || *p == '\n') *p = ' ';
+        }
+        printf("%s (%s): %s\n", OBD_DTC_KIND_NAMES[k], COMMANDS[k], response);
+        if (n < 0) printf("  not supported\n");
+        else if (n == 0) printf("  none\n");
+        for (int i = 0; i < n; ++i) {
+            char code[6];
+            obd_dtc_format(codes[i], code);
+            printf("  %s\n", code);
+        }
     }
 
+    if (monitors) print_monitors(&session);
+
     close(sock);
     return 0;
 }
-
-
-
-
-
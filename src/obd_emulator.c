@@ -0,0 +1,1311 @@
+/*
+ * obd_emulator.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+//
+// ELM327 emulator
+//
+// A stand-in for the V-LINK and the car, so the loggers, the broker and the
+// benchmarks can run on a desk or in CI with reproducible timing.
+//
+// Features
+// ========
+//
+// Transport: a Unix socket standing in for RFCOMM (default), or a
+// pseudo-terminal with -p, which shows up as a serial port (a symlink to the
+// /dev/pts node is created at the given path).
+//
+// AT commands used by the tools: Z, WS, D, I, @1, E0/E1, L0/L1, S0/S1, H0/H1,
+// SP/TP, DP, DPN, RV, SH, ST, AT, CAF, M0, AL; anything else gets "?".
+// An empty line repeats the last command, like the real chip.
+//
+// OBD modes:
+//
+//    01  every PID in obd_pids.c, the support bitmaps (00/20/40/...) and
+//        0101 (MIL and DTC count); up to 6 PIDs per request
+//    02  freeze frame 0 while stored DTCs exist: the mode 01 PIDs as they were
+//        at "freeze" seconds after start, 02 the first stored DTC
+//    03  stored DTCs, 07 pending, 0A permanent, 04 clears stored and pending
+//    09  00 support, 02 VIN, 04 CALID, 06 CVN, 0A ECU name
+//    06  monitor test results: O2 B1S1, catalyst B1, EVAP, misfire cylinder 1-2
+//        (the cylinder 2 counts over the limit), bitmaps in one request or several
+//    22  manufacturer DIDs given with "did" in the script
+//
+// Protocols: ISO 15765-4 CAN 11/500 (6, default) with ISO-TP multi-frame
+// output ("014" / "0: ..." lines, or raw 10/21/22 frames with headers on),
+// or ISO 9141-2 (3) with the old fixed-size messages.
+//
+// Multiple ECUs (-e): the engine ECU (7E8) answers everything, the others
+// (7E9, ...) answer the support bitmaps, speed and their ECU name. AT SH 7E0,
+// 7E1, ... addresses a single ECU, 7DF all of them.
+//
+// Timing: per-command latency with longest-prefix rules, random jitter, a
+// reset delay, a one-off protocol search delay, and the serial link speed
+// (-b), which paces every byte as 10 bits at that baud rate.
+//
+// Link speed: on a pseudo-terminal with -b, AT BRD hh switches to 4 MHz / hh
+// with the ELM327 handshake (OK at the old rate, "ELM327 v1.5" at the new
+// one, the client's CR within the AT BRT time, else back to the old rate).
+// -B caps the rate the "UART" manages, faster ones come out as garbage. The
+// emulator reads the client's line speed off the pseudo-terminal, so a client
+// at the wrong rate gets garbage back and its commands are not understood.
+// AT Z goes back to the -b rate, AT WS and AT D keep the current one.
+// Without -b there is no AT BRD ("?", like a v1.1 clone).
+//
+// Scripted signals: channel values are functions of time since start,
+// given on the command line or in a script file:
+//
+//    # channel  shape   min   max   period_s
+//    signal RPM      sine   800   3000  30
+//    signal Speed    ramp   0     120   60
+//    signal Coolant  const  88
+//    signal Throttle square 10    60    8
+//    signal MAF      noise  3     25
+//    signal Speed    points 0:0 10:50 40:50 50:0     (t:value, linear, repeats)
+//    dtc P0133 P0210
+//    pending P0300
+//    permanent P0420
+//    freeze 12
+//    vin 1D4GP00R55B123456
+//    cvn 2A01C3F0                                    (a reflashed ECU)
+//    did 7E0 114F 0C80 0052                          (ECU, DID, reply data)
+//    ecus 2
+//    latency 010C 80
+//    latency ATZ 800
+//
+// Compile & Run
+// =============
+//
+// gcc obd_emulator.c obd_pids.c -o obd_emulator -lm
+//
+// ./obd_emulator                                  Unix socket /tmp/obd_emulator.sock
+// ./obd_emulator -p /tmp/obd_pty -b 38400         serial port at /tmp/obd_pty
+// ./obd_emulator -p /tmp/obd_pty -b 38400 -B 230400    ... whose AT BRD tops out at 230400
+// ./obd_emulator -f car.script -e 2 -l 40 -j 10 -r 7
+//
+// ./obd_logger_merged -d unix:/tmp/obd_emulator.sock
+// ./obd_logger_merged -d /tmp/obd_pty@38400
+//
+// Options: -u socket, -p pty_link, -f script, -e ecus, -l latency_ms (OBD
+// requests), -j jitter_ms, -b baud (0 = unthrottled), -B max_baud, -S search_ms,
+// -P protocol (6 or 3), -r seed, -L cmd=ms (repeatable), -s "signal line".
+//
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <math.h>
+#include <poll.h>
+#include <termios.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "obd_pids.h"
+
+#define DEFAULT_SOCKET "/tmp/obd_emulator.sock"
+#define ELM_VERSION "ELM327 v1.5"
+#define MAX_ECUS 8
+#define MAX_SIGNALS 64
+#define MAX_POINTS 32
+#define MAX_DTCS 32
+#define MAX_LATENCY_RULES 32
+#define MAX_MESSAGES 16
+#define MAX_PAYLOAD 64
+
+typedef enum { SHAPE_CONST, SHAPE_SINE, SHAPE_RAMP, SHAPE_SQUARE, SHAPE_NOISE, SHAPE_POINTS } shape_t;
+
+typedef struct {
+    int channel;            // index into OBD_PIDS
+    shape_t shape;
+    double min, max, period;
+    int npoints;
+    double pt_t[MAX_POINTS];
+    double pt_v[MAX_POINTS];
+} signal_t;
+
+typedef struct {
+    char prefix[16];
+    int ms;
+} latency_rule_t;
+
+typedef struct {
+    int n;
+    uint16_t codes[MAX_DTCS];
+} dtc_list_t;
+
+typedef struct {
+    int ecu;
+    int len;
+    uint8_t data[MAX_PAYLOAD];
+} message_t;
+
+// Emulator configuration, filled from options and the script
+static int nsignals;
+static signal_t signals[MAX_SIGNALS];
+static int nrules;
+static latency_rule_t rules[MAX_LATENCY_RULES];
+static dtc_list_t stored, pending, permanent;
+static char vin[18] = "1D4GP00R55B123456";
+static char calid[17] = "OBDEMU0000000001";
+static uint32_t cvn = 0x1791BC82;
+static double freeze_t;
+
+typedef struct {
+    uint8_t mid, tid, uasid;
+    uint16_t value, min, max;
+} monitor_test_t;
+
+static const monitor_test_t MONITOR_TESTS[] = {
+    { 0x01, 0x01, 0x0A, 0x0E92, 0x0000, 0xFFFF },   // O2 rich/lean threshold, 455 mV
+    { 0x01, 0x05, 0x10, 0x0050, 0x0000, 0x00C8 },   // switch time, 80 ms
+    { 0x21, 0x80, 0x20, 0x0040, 0x0000, 0x0080 },   // catalyst oxygen storage ratio
+    { 0x3C, 0x80, 0x30, 0x0120, 0x0000, 0x0400 },   // EVAP 0.020" leak
+    { 0xA2, 0x0B, 0x24, 0x0000, 0x0000, 0x0064 },   // misfire counts cylinder 1
+    { 0xA3, 0x0B, 0x24, 0x0082, 0x0000, 0x0064 },   // cylinder 2, over the limit
+};
+
+#define MAX_DIDS 16
+
+typedef struct {
+    int ecu;
+    unsigned int did;
+    uint8_t data[16];
+    int len;
+} did_t;
+
+static did_t dids[MAX_DIDS];
+static int ndids;
+static int necus = 1;
+static int protocol = 6;
+static int obd_latency_ms = 25;
+static int at_latency_ms = 1;
+static int reset_ms = 500;
+static int search_ms = 0;
+static int jitter_ms = 0;
+static int baud = 0;
+static int max_baud = 0;
+static unsigned int seed = 1;
+
+static double start_s;
+static volatile sig_atomic_t keep_running = 1;
+
+// Per-connection adapter state, reset by AT Z / AT D
+typedef struct {
+    int echo, linefeeds, spaces, headers;
+    int protocol;           // 0 = automatic
+    int searched;
+    int target;             // -1 = functional (7DF), else ECU index
+    int baud;               // current line speed, 0 = unthrottled
+    int brt_ms;             // AT BRT
+    char last[64];
+} elm_t;
+
+static void int_handler(int dummy) {
+    keep_running = 0;
+}
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void sleep_ms(double ms) {
+    if (ms <= 0) return;
+    struct timespec ts = { (time_t)(ms / 1000), (long)(fmod(ms, 1000) * 1e6) };
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR && keep_running) {}
+}
+
+// Signals
+// =======
+
+static double signal_value(const signal_t* s, double t) {
+    double span = s->max - s->min;
+    double phase = s->period > 0 ? fmod(t, s->period) / s->period : 0;
+
+    switch (s->shape) {
+        case SHAPE_CONST:  return s->min;
+        case SHAPE_SINE:   return s->min + span * (0.5 - 0.5 * cos(2 * M_PI * phase));
+        case SHAPE_RAMP:   return s->min + span * phase;
+        case SHAPE_SQUARE: return phase < 0.5 ? s->min : s->max;
+        case SHAPE_NOISE:  return s->min + span * (rand_r(&seed) / (double)RAND_MAX);
+        case SHAPE_POINTS: {
+            double end = s->pt_t[s->npoints - 1];
+            double x = end > 0 ? fmod(t, end) : 0;
+            for (int i = 1; i < s->npoints; ++i) {
+                if (x <= s->pt_t[i]) {
+                    double dt = s->pt_t[i] - s->pt_t[i - 1];
+                    double f = dt > 0 ? (x - s->pt_t[i - 1]) / dt : 1;
+                    return s->pt_v[i - 1] + f * (s->pt_v[i] - s->pt_v[i - 1]);
+                }
+            }
+            return s->pt_v[s->npoints - 1];
+        }
+    }
+    return 0;
+}
+
+static double channel_value(int channel, double t) {
+    for (int i = nsignals - 1; i >= 0; --i) {
+        if (signals[i].channel == channel) return signal_value(&signals[i], t);
+    }
+    return 0;
+}
+
+static int parse_signal(char* line) {
+    char* name = strtok(line, " \t");
+    char* shape = strtok(NULL, " \t");
+    if (!name || !shape) return -1;
+
+    int ch = obd_pid_find(name);
+    if (ch < 0 || nsignals >= MAX_SIGNALS) {
+        fprintf(stderr, "Unknown channel %s\n", name);
+        return -1;
+    }
+
+    signal_t* s = &signals[nsignals];
+    memset(s, 0, sizeof(*s));
+    s->channel = ch;
+
+    if (strcmp(shape, "points") == 0) {
+        s->shape = SHAPE_POINTS;
+        char* tok;
+        while ((tok = strtok(NULL, " \t")) && s->npoints < MAX_POINTS) {
+            if (sscanf(tok, "%lf:%lf", &s->pt_t[s->npoints], &s->pt_v[s->npoints]) == 2) s->npoints++;
+        }
+        if (s->npoints == 0) return -1;
+        nsignals++;
+        return 0;
+    }
+
+    static const char* const SHAPES[] = { "const", "sine", "ramp", "square", "noise" };
+    s->shape = (shape_t)-1;
+    for (int i = 0; i < 5; ++i) {
+        if (strcmp(shape, SHAPES[i]) == 0) s->shape = (shape_t)i;
+    }
+    if ((int)s->shape < 0) {
+        fprintf(stderr, "Unknown signal shape %s\n", shape);
+        return -1;
+    }
+
+    char* a = strtok(NULL, " \t");
+    char* b = strtok(NULL, " \t");
+    char* c = strtok(NULL, " \t");
+    s->min = a ? atof(a) : 0;
+    s->max = b ? atof(b) : s->min;
+    s->period = c ? atof(c) : 60;
+    nsignals++;
+    return 0;
+}
+
+static void default_signals(void) {
+    static const char* const DEFAULTS[] = {
+        "RPM sine 800 3000 30",
+        "Speed ramp 0 120 60",
+        "Coolant const 88",
+        "Intake const 32",
+        "Throttle sine 12 60 30",
+        "MAP sine 30 95 30",
+        "Load sine 20 75 30",
+        "FuelPress const 300",
+        "Timing sine 4 24 30",
+        "MAF sine 3 28 30",
+    };
+    for (size_t i = 0; i < sizeof(DEFAULTS) / sizeof(DEFAULTS[0]); ++i) {
+        char line[64];
+        snprintf(line, sizeof(line), "%s", DEFAULTS[i]);
+        parse_signal(line);
+    }
+}
+
+// DTCs
+// ====
+
+static int parse_dtc(const char* s, uint16_t* code) {
+    static const char LETTERS[] = "PCBU";
+    const char* l = strchr(LETTERS, toupper((unsigned char)s[0]));
+    unsigned int digits;
+
+    if (!l || !*l || strlen(s) != 5 || sscanf(s + 1, "%4x", &digits) != 1) return -1;
+    *code = (uint16_t)(((l - LETTERS) << 14) | (digits & 0x3FFF));
+    return 0;
+}
+
+static void parse_dtc_list(dtc_list_t* list, char* rest) {
+    char* tok;
+    while ((tok = strtok(rest, " \t")) && list->n < MAX_DTCS) {
+        rest = NULL;
+        if (parse_dtc(tok, &list->codes[list->n]) == 0) list->n++;
+        else fprintf(stderr, "Bad DTC %s\n", tok);
+    }
+}
+
+// Configuration
+// =============
+
+static void add_latency_rule(const char* prefix, int ms) {
+    if (nrules >= MAX_LATENCY_RULES) return;
+    int k = 0;
+    for (const char* p = prefix; *p && k < (int)sizeof(rules[0].prefix) - 1; ++p) {
+        if (*p != ' ') rules[nrules].prefix[k++] = (char)toupper((unsigned char)*p);
+    }
+    rules[nrules].prefix[k] = '\0';
+    rules[nrules].ms = ms;
+    nrules++;
+}
+
+static int config_line(char* line) {
+    char* hash = strchr(line, '#');
+    if (hash) *hash = '\0';
+    line[strcspn(line, "\r\n")] = '\0';
+
+    char* key = line + strspn(line, " \t");
+    if (!*key) return 0;
+    char* rest = key + strcspn(key, " \t");
+    if (*rest) *rest++ = '\0';
+
+    if (strcmp(key, "signal") == 0) return parse_signal(rest);
+    if (strcmp(key, "dtc") == 0) { parse_dtc_list(&stored, rest); return 0; }
+    if (strcmp(key, "pending") == 0) { parse_dtc_list(&pending, rest); return 0; }
+    if (strcmp(key, "permanent") == 0) { parse_dtc_list(&permanent, rest); return 0; }
+    if (strcmp(key, "vin") == 0) { sscanf(rest, "%17s", vin); return 0; }
+    if (strcmp(key, "calid") == 0) { sscanf(rest, "%16s", calid); return 0; }
+    if (strcmp(key, "cvn") == 0) { cvn = (uint32_t)strtoul(rest, NULL, 16); return 0; }
+    if (strcmp(key, "ecus") == 0) { necus = atoi(rest); return 0; }
+    if (strcmp(key, "freeze") == 0) { freeze_t = atof(rest); return 0; }
+    if (strcmp(key, "did") == 0) {
+        unsigned int header, b;
+        int used;
+        if (ndids == MAX_DIDS) return -1;
+        did_t* d = &dids[ndids];
+        if (sscanf(rest, "%x %x%n", &header, &d->did, &used) != 2 || header < 0x7E0) return -1;
+        d->ecu = (int)(header - 0x7E0);
+        d->len = 0;
+        for (char* p = rest + used; d->len < (int)sizeof(d->data);) {
+            p += strspn(p, " \t");
+            if (sscanf(p, "%2x", &b) != 1) break;
+            d->data[d->len++] = (uint8_t)b;
+            p += 2;
+        }
+        ndids++;
+        return 0;
+    }
+    if (strcmp(key, "latency") == 0) {
+        char* cmd = strtok(rest, " \t");
+        char* ms = strtok(NULL, " \t");
+        if (!cmd || !ms) return -1;
+        add_latency_rule(cmd, atoi(ms));
+        return 0;
+    }
+
+    fprintf(stderr, "Unknown script keyword %s\n", key);
+    return -1;
+}
+
+static int load_script(const char* path) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+
+    char line[512];
+    int lineno = 0, errors = 0;
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        if (config_line(line) != 0) {
+            fprintf(stderr, "%s:%d: ignored\n", path, lineno);
+            errors++;
+        }
+    }
+    fclose(f);
+    return errors ? -1 : 0;
+}
+
+static int command_latency(const char* cmd) {
+    int best = -1, best_len = -1;
+    for (int i = 0; i < nrules; ++i) {
+        int n = (int)strlen(rules[i].prefix);
+        if (n > best_len && strncmp(cmd, rules[i].prefix, n) == 0) {
+            best = rules[i].ms;
+            best_len = n;
+        }
+    }
+    if (best >= 0) return best;
+    if (strncmp(cmd, "ATZ", 3) == 0) return reset_ms;
+    return strncmp(cmd, "AT", 2) == 0 ? at_latency_ms : obd_latency_ms;
+}
+
+// ECUs
+// ====
+
+static int pid_number(const obd_pid_t* pid) {
+    unsigned int mode, n;
+    if (sscanf(pid->command, "%2x%2x", &mode, &n) != 2 || mode != 0x01) return -1;
+    return (int)n;
+}
+
+static int ecu_supports_pid(int ecu, int pid) {
+    if (pid == 0x00) return 1;
+    if (ecu == 0 && pid == 0x01) return 1;
+    for (int i = 0; i < OBD_PID_COUNT; ++i) {
+        if (pid_number(&OBD_PIDS[i]) != pid) continue;
+        return ecu == 0 || pid == 0x0D;
+    }
+    return 0;
+}
+
+static int any_supported_above(int ecu, int pid) {
+    for (int p = pid + 1; p < 256; ++p) {
+        if (ecu_supports_pid(ecu, p)) return 1;
+    }
+    return 0;
+}
+
+static int support_bitmap(int ecu, int base, uint8_t* out) {
+    uint32_t bits = 0;
+
+    // A range is only answered when the previous bitmap announced it
+    if (base > 0 && !any_supported_above(ecu, base)) return 0;
+
+    for (int p = base + 1; p < base + 32; ++p) {
+        if (ecu_supports_pid(ecu, p)) bits |= 1u << (32 - (p - base));
+    }
+    // The last bit says "the next range has PIDs"
+    if (any_supported_above(ecu, base + 32)) bits |= 1u;
+
+    out[0] = bits >> 24;
+    out[1] = bits >> 16;
+    out[2] = bits >> 8;
+    out[3] = bits;
+    return 4;
+}
+
+// Appends the mode 01 data bytes of one PID, or returns 0 if not supported
+static int mode01_pid(int ecu, int pid, double t, uint8_t* out) {
+    if (pid % 0x20 == 0) return support_bitmap(ecu, pid, out);
+    if (!ecu_supports_pid(ecu, pid)) return 0;
+
+    if (pid == 0x01) {
+        out[0] = (uint8_t)((stored.n ? 0x80 : 0) | (stored.n & 0x7F));
+        out[1] = 0x07;
+        out[2] = 0xE5;
+        out[3] = 0x00;
+        return 4;
+    }
+
+    for (int i = 0; i < OBD_PID_COUNT; ++i) {
+        const obd_pid_t* p = &OBD_PIDS[i];
+        if (pid_number(p) != pid) continue;
+
+        double raw = (channel_value(i, t) - p->offset) * p->div / p->mul;
+        double top = p->nbytes == 2 ? 65535 : 255;
+        raw = raw < 0 ? 0 : raw > top ? top : floor(raw + 0.5);
+
+        unsigned int r = (unsigned int)raw;
+        if (p->nbytes == 2) {
+            out[0] = r >> 8;
+            out[1] = r & 0xFF;
+        } else {
+            out[0] = r;
+        }
+        return p->nbytes;
+    }
+    return 0;
+}
+
+static void put_ascii(uint8_t* out, const char* s, int len) {
+    int n = (int)strlen(s);
+    for (int i = 0; i < len; ++i) out[i] = i < n ? (uint8_t)s[i] : 0;
+}
+
+// Builds the messages of one ECU for a request; returns how many
+static int ecu_answer(int ecu, const uint8_t* req, int reqlen, double t, message_t* out, int max) {
+    int mode = req[0];
+    int n = 0;
+    message_t* m = &out[0];
+
+    m->ecu = ecu;
+    m->len = 0;
+
+    if (mode == 0x01 && reqlen >= 2) {
+        m->data[m->len++] = 0x41;
+        for (int i = 1; i < reqlen && i <= 6; ++i) {
+            uint8_t tmp[8];
+            int k = mode01_pid(ecu, req[i], t, tmp);
+            if (k == 0) continue;
+            m->data[m->len++] = req[i];
+            memcpy(m->data + m->len, tmp, k);
+            m->len += k;
+        }
+        return m->len > 1 ? 1 : 0;
+    }
+
+    // 02 <pid> <frame>; only frame 0, and only while a stored DTC holds it
+    if (mode == 0x02 && reqlen == 3) {
+        uint8_t tmp[8];
+        int k;
+        if (ecu != 0 || stored.n == 0 || req[2] != 0) return 0;
+        if (req[1] == 0x02) {
+            tmp[0] = stored.codes[0] >> 8;
+            tmp[1] = stored.codes[0] & 0xFF;
+            k = 2;
+        } else {
+            k = mode01_pid(ecu, req[1], freeze_t, tmp);
+        }
+        if (k == 0) return 0;
+        m->data[m->len++] = 0x42;
+        m->data[m->len++] = req[1];
+        m->data[m->len++] = 0x00;
+        memcpy(m->data + m->len, tmp, k);
+        m->len += k;
+        return 1;
+    }
+
+    if ((mode == 0x03 || mode == 0x07 || mode == 0x0A) && reqlen == 1) {
+        const dtc_list_t* list = mode == 0x03 ? &stored : mode == 0x07 ? &pending : &permanent;
+        if (ecu != 0) return 0;
+
+        if (protocol == 6) {
+            m->data[m->len++] = (uint8_t)(mode + 0x40);
+            m->data[m->len++] = (uint8_t)list->n;
+            for (int i = 0; i < list->n; ++i) {
+                m->data[m->len++] = list->codes[i] >> 8;
+                m->data[m->len++] = list->codes[i] & 0xFF;
+            }
+            return 1;
+        }
+
+        // ISO 9141: three codes per message, padded with 0000
+        int i = 0;
+        do {
+            m = &out[n++];
+            m->ecu = ecu;
+            m->len = 0;
+            m->data[m->len++] = (uint8_t)(mode + 0x40);
+            for (int k = 0; k < 3; ++k, ++i) {
+                uint16_t c = i < list->n ? list->codes[i] : 0;
+                m->data[m->len++] = c >> 8;
+                m->data[m->len++] = c & 0xFF;
+            }
+        } while (i < list->n && n < max);
+        return n;
+    }
+
+    if (mode == 0x04 && reqlen == 1) {
+        if (ecu != 0) return 0;
+        stored.n = 0;
+        pending.n = 0;
+        m->data[m->len++] = 0x44;
+        return 1;
+    }
+
+    // Bitmap MIDs may come six at a time; a data MID only alone
+    if (mode == 0x06 && reqlen >= 2) {
+        if (ecu != 0) return 0;
+        m->data[m->len++] = 0x46;
+        for (int i = 1; i < reqlen; ++i) {
+            int mid = req[i];
+            if (mid % 0x20 == 0) {
+                uint32_t bits = 0;
+                for (size_t k = 0; k < sizeof(MONITOR_TESTS) / sizeof(MONITOR_TESTS[0]); ++k) {
+                    int t = MONITOR_TESTS[k].mid;
+                    if (t > mid && t <= mid + 0x20) bits |= 0x80000000u >> (t - mid - 1);
+                    if (t > mid + 0x20) bits |= 1;
+                }
+                if (!bits && mid != 0) continue;
+                m->data[m->len++] = (uint8_t)mid;
+                for (int b = 3; b >= 0; --b) m->data[m->len++] = (uint8_t)(bits >> (8 * b));
+            } else if (reqlen == 2) {
+                for (size_t k = 0; k < sizeof(MONITOR_TESTS) / sizeof(MONITOR_TESTS[0]); ++k) {
+                    const monitor_test_t* t = &MONITOR_TESTS[k];
+                    if (t->mid != mid || m->len + 9 > MAX_PAYLOAD) continue;
+                    const uint16_t v[3] = { t->value, t->min, t->max };
+                    m->data[m->len++] = t->mid;
+                    m->data[m->len++] = t->tid;
+                    m->data[m->len++] = t->uasid;
+                    for (int j = 0; j < 3; ++j) {
+                        m->data[m->len++] = (uint8_t)(v[j] >> 8);
+                        m->data[m->len++] = (uint8_t)v[j];
+                    }
+                }
+            }
+        }
+        return m->len > 1 ? 1 : 0;
+    }
+
+    if (mode == 0x22 && reqlen == 3) {
+        unsigned int did = (unsigned int)(req[1] << 8 | req[2]);
+        for (int i = 0; i < ndids; ++i) {
+            if (dids[i].ecu != ecu || dids[i].did != did) continue;
+            m->data[0] = 0x62;
+            m->data[1] = req[1];
+            m->data[2] = req[2];
+            memcpy(m->data + 3, dids[i].data, dids[i].len);
+            m->len = 3 + dids[i].len;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (mode == 0x09 && reqlen == 2) {
+        uint8_t item[MAX_PAYLOAD];
+        int ilen = 0;
+        int pid = req[1];
+
+        switch (pid) {
+            case 0x00:
+                m->data[0] = 0x49; m->data[1] = 0x00;
+                m->data[2] = ecu == 0 ? 0x54 : 0x00;   // 02, 04, 06
+                m->data[3] = 0x40;                     // 0A
+                m->data[4] = 0x00; m->data[5] = 0x00;
+                m->len = 6;
+                return 1;
+            case 0x02:
+                if (ecu != 0) return 0;
+                put_ascii(item, vin, 17);
+                ilen = 17;
+                break;
+            case 0x04:
+                if (ecu != 0) return 0;
+                put_ascii(item, calid, 16);
+                ilen = 16;
+                break;
+            case 0x06:
+                if (ecu != 0) return 0;
+                item[0] = cvn >> 24; item[1] = cvn >> 16; item[2] = cvn >> 8; item[3] = cvn;
+                ilen = 4;
+                break;
+            case 0x0A:
+                if (ecu == 0) memcpy(item, "ECM\0-EngineControl\0\0", 20);
+                else memcpy(item, "TCM\0-TransmissionCtl", 20);
+                ilen = 20;
+                break;
+            default:
+                return 0;
+        }
+
+        if (protocol == 6) {
+            m->data[0] = 0x49;
+            m->data[1] = (uint8_t)pid;
+            m->data[2] = 0x01;
+            memcpy(m->data + 3, item, ilen);
+            m->len = 3 + ilen;
+            return 1;
+        }
+
+        // ISO 9141: 4 data bytes per numbered message, VIN padded in front
+        int pad = (4 - ilen % 4) % 4;
+        uint8_t padded[MAX_PAYLOAD] = { 0 };
+        memcpy(padded + pad, item, ilen);
+        for (int k = 0; k < (ilen + pad) / 4 && n < max; ++k) {
+            m = &out[n++];
+            m->ecu = ecu;
+            m->data[0] = 0x49;
+            m->data[1] = (uint8_t)pid;
+            m->data[2] = (uint8_t)(k + 1);
+            memcpy(m->data + 3, padded + 4 * k, 4);
+            m->len = 7;
+        }
+        return n;
+    }
+
+    return 0;
+}
+
+// Output formatting
+// =================
+
+typedef struct {
+    char buf[4096];
+    int len;
+} out_t;
+
+static void out_str(out_t* o, const char* s) {
+    int n = (int)strlen(s);
+    if (o->len + n >= (int)sizeof(o->buf)) n = (int)sizeof(o->buf) - 1 - o->len;
+    memcpy(o->buf + o->len, s, n);
+    o->len += n;
+    o->buf[o->len] = '\0';
+}
+
+static void out_eol(out_t* o, const elm_t* e) {
+    out_str(o, e->linefeeds ? "\r\n" : "\r");
+}
+
+static void out_bytes(out_t* o, const elm_t* e, const uint8_t* data, int len) {
+    char hex[4];
+    for (int i = 0; i < len; ++i) {
+        snprintf(hex, sizeof(hex), (e->spaces && i > 0) ? " %02X" : "%02X", data[i]);
+        out_str(o, hex);
+    }
+}
+
+static void out_line(out_t* o, const elm_t* e, const char* s) {
+    out_str(o, s);
+    out_eol(o, e);
+}
+
+static void format_message(out_t* o, const elm_t* e, const message_t* m) {
+    char hdr[16];
+
+    if (protocol == 3) {
+        // 48 6B <addr> data... <checksum>
+        uint8_t frame[MAX_PAYLOAD + 4];
+        int n = 0;
+        frame[n++] = 0x48;
+        frame[n++] = 0x6B;
+        frame[n++] = (uint8_t)(0x10 + m->ecu);
+        memcpy(frame + n, m->data, m->len);
+        n += m->len;
+        uint8_t sum = 0;
+        for (int i = 0; i < n; ++i) sum += frame[i];
+        frame[n++] = sum;
+
+        if (e->headers) out_bytes(o, e, frame, n);
+        else out_bytes(o, e, m->data, m->len);
+        out_eol(o, e);
+        return;
+    }
+
+    snprintf(hdr, sizeof(hdr), e->spaces ? "%03X " : "%03X", 0x7E8 + m->ecu);
+
+    if (m->len <= 7) {
+        if (e->headers) {
+            uint8_t pci = (uint8_t)m->len;
+            out_str(o, hdr);
+            out_bytes(o, e, &pci, 1);
+            if (e->spaces) out_str(o, " ");
+        }
+        out_bytes(o, e, m->data, m->len);
+        out_eol(o, e);
+        return;
+    }
+
+    // ISO-TP: first frame with 6 data bytes, consecutive frames with 7
+    if (e->headers) {
+        uint8_t frame[8];
+        frame[0] = (uint8_t)(0x10 | (m->len >> 8));
+        frame[1] = (uint8_t)(m->len & 0xFF);
+        memcpy(frame + 2, m->data, 6);
+        out_str(o, hdr);
+        out_bytes(o, e, frame, 8);
+        out_eol(o, e);
+        for (int off = 6, sn = 1; off < m->len; off += 7, ++sn) {
+            memset(frame, 0, sizeof(frame));
+            frame[0] = (uint8_t)(0x20 | (sn & 0x0F));
+            memcpy(frame + 1, m->data + off, m->len - off < 7 ? m->len - off : 7);
+            out_str(o, hdr);
+            out_bytes(o, e, frame, 8);
+            out_eol(o, e);
+        }
+        return;
+    }
+
+    char line[16];
+    snprintf(line, sizeof(line), "%03X", m->len);
+    out_line(o, e, line);
+    for (int off = 0, sn = 0; off < m->len; off += (sn == 0 ? 6 : 7), ++sn) {
+        int n = sn == 0 ? 6 : 7;
+        if (m->len - off < n) n = m->len - off;
+        snprintf(line, sizeof(line), e->spaces ? "%X: " : "%X:", sn & 0x0F);
+        out_str(o, line);
+        out_bytes(o, e, m->data + off, n);
+        out_eol(o, e);
+    }
+}
+
+// Command handling
+// ================
+
+static void elm_reset(elm_t* e) {
+    e->echo = 1;
+    e->linefeeds = 0;
+    e->spaces = 1;
+    e->headers = 0;
+    e->protocol = 0;
+    e->searched = 0;
+    e->target = -1;
+    e->brt_ms = 75;
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static void handle_at(elm_t* e, const char* cmd, out_t* o) {
+    const char* a = cmd + 2;
+
+    if (strcmp(a, "Z") == 0 || strcmp(a, "WS") == 0) {
+        elm_reset(e);
+        if (a[0] == 'Z') {
+            e->baud = baud;
+            out_eol(o, e);
+        }
+        out_line(o, e, ELM_VERSION);
+        return;
+    }
+    if (strcmp(a, "D") == 0) {
+        int echo = e->echo;
+        elm_reset(e);
+        e->echo = echo;
+        out_line(o, e, "OK");
+        return;
+    }
+    if (strcmp(a, "I") == 0) { out_line(o, e, ELM_VERSION); return; }
+    if (strcmp(a, "@1") == 0) { out_line(o, e, "OBDII to RS232 Interpreter"); return; }
+    if (strcmp(a, "RV") == 0) {
+        // Charging while the engine turns, resting battery otherwise
+        out_line(o, e, channel_value(obd_pid_find("RPM"), now_s() - start_s) > 0 ? "14.1V" : "12.4V");
+        return;
+    }
+
+    if (strcmp(a, "DP") == 0) {
+        const char* name = protocol == 6 ? "ISO 15765-4 (CAN 11/500)" : "ISO 9141-2";
+        char line[64];
+        if (e->protocol == 0 && !e->searched) snprintf(line, sizeof(line), "AUTO");
+        else snprintf(line, sizeof(line), "%s%s", e->protocol == 0 ? "AUTO, " : "", name);
+        out_line(o, e, line);
+        return;
+    }
+    if (strcmp(a, "DPN") == 0) {
+        char line[8];
+        if (e->protocol == 0 && !e->searched) snprintf(line, sizeof(line), "A0");
+        else snprintf(line, sizeof(line), "%s%X", e->protocol == 0 ? "A" : "", protocol);
+        out_line(o, e, line);
+        return;
+    }
+
+    if ((a[0] == 'E' || a[0] == 'L' || a[0] == 'S' || a[0] == 'H') && (a[1] == '0' || a[1] == '1') && !a[2]) {
+        int on = a[1] == '1';
+        switch (a[0]) {
+            case 'E': e->echo = on; break;
+            case 'L': e->linefeeds = on; break;
+            case 'S': e->spaces = on; break;
+            case 'H': e->headers = on; break;
+        }
+        out_line(o, e, "OK");
+        return;
+    }
+
+    if ((strncmp(a, "SP", 2) == 0 || strncmp(a, "TP", 2) == 0) && a[2]) {
+        const char* p = a + 2;
+        if (*p == 'A') p++;
+        int n = hex_value(*p);
+        if (n < 0 || p[1]) {
+            out_line(o, e, "?");
+            return;
+        }
+        e->protocol = n;
+        e->searched = 0;
+        out_line(o, e, "OK");
+        return;
+    }
+
+    if (strncmp(a, "BRT", 3) == 0 && strlen(a) == 5 && hex_value(a[3]) >= 0 && hex_value(a[4]) >= 0) {
+        int t = hex_value(a[3]) * 16 + hex_value(a[4]);
+        e->brt_ms = (t ? t : 256) * 5;
+        out_line(o, e, baud > 0 ? "OK" : "?");
+        return;
+    }
+
+    if (strncmp(a, "SH", 2) == 0) {
+        unsigned int h;
+        int n = (int)strlen(a + 2);
+        if ((n != 3 && n != 6) || sscanf(a + 2, "%x", &h) != 1) {
+            out_line(o, e, "?");
+            return;
+        }
+        h &= 0x7FF;
+        e->target = (h >= 0x7E0 && h < 0x7E0 + (unsigned)necus) ? (int)(h - 0x7E0) : -1;
+        out_line(o, e, "OK");
+        return;
+    }
+
+    static const char* const OK_PREFIXES[] = { "ST", "AT", "CAF", "M0", "M1", "AL", "NL", "R0", "R1", "CRA", "FC", "MA" };
+    for (size_t i = 0; i < sizeof(OK_PREFIXES) / sizeof(OK_PREFIXES[0]); ++i) {
+        if (strncmp(a, OK_PREFIXES[i], strlen(OK_PREFIXES[i])) == 0) {
+            out_line(o, e, "OK");
+            return;
+        }
+    }
+
+    out_line(o, e, "?");
+}
+
+static int handle_obd(elm_t* e, const char* cmd, out_t* o) {
+    uint8_t req[8];
+    int n = (int)strlen(cmd);
+    int extra_ms = 0;
+
+    // A trailing odd digit is the "number of responses" hint, ignore it
+    if (n % 2) n--;
+    if (n < 2 || n > 16) {
+        out_line(o, e, "?");
+        return 0;
+    }
+    for (int i = 0; i < n; i += 2) {
+        int hi = hex_value(cmd[i]), lo = hex_value(cmd[i + 1]);
+        if (hi < 0 || lo < 0) {
+            out_line(o, e, "?");
+            return 0;
+        }
+        req[i / 2] = (uint8_t)(hi * 16 + lo);
+    }
+
+    if (e->protocol != 0 && e->protocol != protocol) {
+        out_line(o, e, "UNABLE TO CONNECT");
+        return 0;
+    }
+    if (e->protocol == 0 && !e->searched) {
+        if (search_ms > 0) {
+            out_line(o, e, "SEARCHING...");
+            extra_ms = search_ms;
+        }
+        e->searched = 1;
+    }
+
+    double t = now_s() - start_s;
+    message_t msgs[MAX_MESSAGES];
+    int count = 0;
+    for (int ecu = 0; ecu < necus && count < MAX_MESSAGES; ++ecu) {
+        if (e->target >= 0 && e->target != ecu) continue;
+        count += ecu_answer(ecu, req, n / 2, t, msgs + count, MAX_MESSAGES - count);
+    }
+
+    if (count == 0) out_line(o, e, "NO DATA");
+    for (int i = 0; i < count; ++i) format_message(o, e, &msgs[i]);
+    return extra_ms;
+}
+
+// Strips spaces and control characters and uppercases, like the ELM does
+static void normalize(const char* in, char* out, int maxlen) {
+    int k = 0;
+    for (const char* p = in; *p && k < maxlen - 1; ++p) {
+        if (*p == ' ' || iscntrl((unsigned char)*p)) continue;
+        out[k++] = (char)toupper((unsigned char)*p);
+    }
+    out[k] = '\0';
+}
+
+// Writes the reply paced like a serial line at `rate`
+static int send_paced(int fd, const char* buf, int len, int rate) {
+    const int chunk = 32;
+    for (int off = 0; off < len; ) {
+        int n = len - off < chunk ? len - off : chunk;
+        ssize_t w = write(fd, buf + off, n);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return -1;
+        off += (int)w;
+        if (rate > 0) sleep_ms(w * 10.0 * 1000.0 / rate);
+    }
+    return 0;
+}
+
+// Link speed
+// ==========
+
+// Whether the client's end of the pseudo-terminal is within 3% of rate
+static int line_matches(int fd, int rate) {
+    static const struct { speed_t speed; int rate; } SPEEDS[] = {
+        { B9600, 9600 }, { B19200, 19200 }, { B38400, 38400 }, { B57600, 57600 },
+        { B115200, 115200 }, { B230400, 230400 }, { B500000, 500000 },
+    };
+    struct termios tty;
+
+    if (rate <= 0 || tcgetattr(fd, &tty) != 0) return 1;
+    for (size_t i = 0; i < sizeof(SPEEDS) / sizeof(SPEEDS[0]); ++i) {
+        if (cfgetospeed(&tty) == SPEEDS[i].speed) return abs(SPEEDS[i].rate - rate) <= rate * 0.03;
+    }
+    return 0;
+}
+
+// What the client sees of len bytes sent at the wrong rate
+static void send_garbage(int fd, int len, int rate) {
+    char junk[64];
+    if (len > (int)sizeof(junk)) len = sizeof(junk);
+    for (int i = 0; i < len; ++i) junk[i] = (char)(0x80 | (rand_r(&seed) & 0x7F));
+    send_paced(fd, junk, len, rate);
+}
+
+// Waits up to ms for a CR from the client
+static int wait_cr(int fd, int ms) {
+    double deadline = now_s() + ms / 1000.0;
+    while (keep_running) {
+        int left = (int)((deadline - now_s()) * 1000);
+        struct pollfd p = { fd, POLLIN, 0 };
+        if (left <= 0 || poll(&p, 1, left) <= 0) return 0;
+        char c;
+        if (read(fd, &c, 1) == 1 && c == '\r') return 1;
+    }
+    return 0;
+}
+
+// AT BRD hh: OK at the old rate, the AT I string at the new one, kept when
+// the client confirms with a CR at the new rate within the AT BRT time
+static void switch_baud(elm_t* e, int fd, const char* cmd) {
+    out_t o = { .len = 0 };
+    int hi = hex_value(cmd[5]), lo = hex_value(cmd[6]);
+    int old = e->baud;
+
+    if (baud <= 0 || strlen(cmd) != 7 || hi < 0 || lo < 0 || hi * 16 + lo == 0) {
+        out_line(&o, e, "?");
+        out_eol(&o, e);
+        out_str(&o, ">");
+        send_paced(fd, o.buf, o.len, old);
+        return;
+    }
+    int rate = 4000000 / (hi * 16 + lo);
+
+    out_line(&o, e, "OK");
+    send_paced(fd, o.buf, o.len, old);
+
+    if (max_baud > 0 && rate > max_baud * 1.03) {
+        send_garbage(fd, (int)strlen(ELM_VERSION) + 1, old);
+    } else {
+        e->baud = rate;
+        send_paced(fd, ELM_VERSION "\r", (int)strlen(ELM_VERSION) + 1, rate);
+        if (wait_cr(fd, e->brt_ms) && line_matches(fd, rate)) {
+            send_paced(fd, ">", 1, rate);
+            printf("Switched to %d baud\n", rate);
+            fflush(stdout);
+            return;
+        }
+    }
+    sleep_ms(e->brt_ms);
+    e->baud = old;
+    send_paced(fd, ">", 1, old);
+}
+
+static void process_command(elm_t* e, int fd, const char* raw, long* commands, long* bytes_out) {
+    char cmd[64];
+    out_t o = { .len = 0 };
+
+    // A client at another rate: neither side understands the other
+    if (!line_matches(fd, e->baud)) {
+        send_garbage(fd, 4, e->baud);
+        return;
+    }
+
+    normalize(raw, cmd, sizeof(cmd));
+    if (strncmp(cmd, "ATBRD", 5) == 0) {
+        switch_baud(e, fd, cmd);
+        (*commands)++;
+        return;
+    }
+    if (cmd[0] == '\0') snprintf(cmd, sizeof(cmd), "%s", e->last);
+    else snprintf(e->last, sizeof(e->last), "%s", cmd);
+
+    if (e->echo) {
+        out_str(&o, raw);
+        out_eol(&o, e);
+    }
+
+    double latency = command_latency(cmd);
+    if (jitter_ms > 0) latency += jitter_ms * (rand_r(&seed) / (double)RAND_MAX);
+
+    if (strncmp(cmd, "AT", 2) == 0) handle_at(e, cmd, &o);
+    else if (cmd[0]) latency += handle_obd(e, cmd, &o);
+    else out_line(&o, e, "?");
+
+    out_eol(&o, e);
+    out_str(&o, ">");
+
+    sleep_ms(latency);
+    send_paced(fd, o.buf, o.len, e->baud);
+    (*commands)++;
+    *bytes_out += o.len;
+}
+
+static void serve(int fd) {
+    elm_t e;
+    char line[256];
+    int len = 0;
+    long commands = 0, bytes_out = 0;
+
+    elm_reset(&e);
+    e.baud = baud;
+    e.last[0] = '\0';
+
+    while (keep_running) {
+        struct pollfd p = { fd, POLLIN, 0 };
+        int r = poll(&p, 1, 500);
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0) break;
+        if (r == 0) continue;
+
+        char buf[256];
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+        if (n <= 0) break;
+
+        for (ssize_t i = 0; i < n; ++i) {
+            if (buf[i] == '\r') {
+                line[len] = '\0';
+                process_command(&e, fd, line, &commands, &bytes_out);
+                len = 0;
+            } else if (buf[i] != '\n' && len < (int)sizeof(line) - 1) {
+                line[len++] = buf[i];
+            }
+        }
+    }
+
+    printf("Client done: %ld commands, %ld bytes out\n", commands, bytes_out);
+    fflush(stdout);
+}
+
+// Transports
+// ==========
+
+static int open_pty(const char* link_path, int* slave_keep) {
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+        perror("posix_openpt");
+        return -1;
+    }
+
+    const char* slave = ptsname(master);
+    printf("Pseudo-terminal %s\n", slave);
+
+    // Keep the slave open ourselves so the master does not see a hangup
+    // every time a client closes it, and make it raw for the clients.
+    *slave_keep = open(slave, O_RDWR | O_NOCTTY);
+    if (*slave_keep >= 0) {
+        struct termios tty;
+        if (tcgetattr(*slave_keep, &tty) == 0) {
+            cfmakeraw(&tty);
+            tcsetattr(*slave_keep, TCSANOW, &tty);
+        }
+    }
+
+    if (link_path) {
+        unlink(link_path);
+        if (symlink(slave, link_path) != 0) perror("symlink");
+        else printf("Linked %s -> %s\n", link_path, slave);
+    }
+    fflush(stdout);
+    return master;
+}
+
+static int open_listener(const char* path) {
+    struct sockaddr_un addr = { 0 };
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    unlink(path);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 8) < 0) {
+        perror("bind");
+        close(fd);
+        return -1;
+    }
+    printf("Emulator listening on %s\n", path);
+    fflush(stdout);
+    return fd;
+}
+
+int main(int argc, char** argv) {
+    const char* socket_path = DEFAULT_SOCKET;
+    const char* pty_link = NULL;
+    int use_pty = 0;
+    int opt;
+
+    default_signals();
+
+    while ((opt = getopt(argc, argv, "u:p:f:e:l:j:b:B:S:P:r:L:s:")) != -1) {
+        switch (opt) {
+            case 'u': socket_path = optarg; break;
+            case 'p': use_pty = 1; pty_link = optarg; break;
+            case 'f': if (load_script(optarg) != 0) return 1; break;
+            case 'e': necus = atoi(optarg); break;
+            case 'l': obd_latency_ms = atoi(optarg); break;
+            case 'j': jitter_ms = atoi(optarg); break;
+            case 'b': baud = atoi(optarg); break;
+            case 'B': max_baud = atoi(optarg); break;
+            case 'S': search_ms = atoi(optarg); break;
+            case 'P': protocol = atoi(optarg); break;
+            case 'r': seed = (unsigned int)atoi(optarg); break;
+            case 'L': {
+                char rule[64];
+                snprintf(rule, sizeof(rule), "%s", optarg);
+                char* eq = strchr(rule, '=');
+                if (!eq) return 1;
+                *eq = '\0';
+                add_latency_rule(rule, atoi(eq + 1));
+                break;
+            }
+            case 's': {
+                char line[256];
+                snprintf(line, sizeof(line), "%s", optarg);
+                if (parse_signal(line) != 0) return 1;
+                break;
+            }
+            default:
+                fprintf(stderr, "Usage: %s [-u socket | -p pty_link] [-f script] [-e ecus] [-l latency_ms] [-j jitter_ms] "
+                                "[-b baud] [-B max_baud] [-S search_ms] [-P 6|3] [-r seed] [-L cmd=ms] [-s \"channel shape min max period\"]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (necus < 1) necus = 1;
+    if (necus > MAX_ECUS) necus = MAX_ECUS;
+    if (protocol != 6 && protocol != 3) {
+        fprintf(stderr, "Protocol must be 6 (CAN 11/500) or 3 (ISO 9141-2)\n");
+        return 1;
+    }
+
+    struct sigaction sa = { 0 };
+    sa.sa_handler = int_handler;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    start_s = now_s();
+
+    if (use_pty) {
+        int slave_keep = -1;
+        int master = open_pty(pty_link, &slave_keep);
+        if (master < 0) return 1;
+        serve(master);
+        close(master);
+        if (slave_keep >= 0) close(slave_keep);
+        if (pty_link) unlink(pty_link);
+        return 0;
+    }
+
+    int listener = open_listener(socket_path);
+    if (listener < 0) return 1;
+
+    // One client at a time, like the real serial link; others wait in the backlog
+    while (keep_running) {
+        struct pollfd p = { listener, POLLIN, 0 };
+        if (poll(&p, 1, 500) <= 0) continue;
+        int client = accept(listener, NULL, NULL);
+        if (client < 0) continue;
+        serve(client);
+        close(client);
+    }
+
+    close(listener);
+    unlink(socket_path);
+    return 0;
+}
@@ -0,0 +1,444 @@
+/*
+ * obd_expr.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <math.h>
+
+#include "obd_expr.h"
+
+enum {
+    OP_CONST, OP_CHANNEL,
+    OP_NEG, OP_NOT,
+    OP_ADD, OP_SUB, OP_MUL, OP_DIV,
+    OP_LT, OP_GT, OP_LE, OP_GE, OP_EQ, OP_NE,
+    OP_AND, OP_OR,
+    OP_MIN, OP_MAX, OP_ABS, OP_SQRT, OP_IF,
+    OP_INTEGRATE, OP_DDT, OP_EMA
+};
+
+static const struct {
+    const char* name;
+    int op;
+    int nargs;
+    int stateful;
+} FUNCTIONS[] = {
+    { "min",       OP_MIN,       2, 0 },
+    { "max",       OP_MAX,       2, 0 },
+    { "abs",       OP_ABS,       1, 0 },
+    { "sqrt",      OP_SQRT,      1, 0 },
+    { "if",        OP_IF,        3, 0 },
+    { "integrate", OP_INTEGRATE, 1, 1 },
+    { "ddt",       OP_DDT,       1, 1 },
+    { "ema",       OP_EMA,       2, 1 },
+};
+
+// Compiler
+// ========
+
+typedef struct {
+    const char* text;
+    const char* p;
+    obd_expr_t* e;
+    const obd_pid_t* channels;
+    int nchannels;
+    char* err;
+    int errlen;
+    int failed;
+} parser_t;
+
+static void fail(parser_t* ps, const char* what) {
+    if (ps->failed) return;
+    ps->failed = 1;
+    snprintf(ps->err, ps->errlen, "%s at column %d", what, (int)(ps->p - ps->text) + 1);
+}
+
+static void emit(parser_t* ps, int op, int arg, double k) {
+    if (ps->e->nops >= OBD_EXPR_MAX_OPS) {
+        fail(ps, "expression too long");
+        return;
+    }
+    obd_expr_op_t* o = &ps->e->ops[ps->e->nops++];
+    o->op = (uint8_t)op;
+    o->arg = (int16_t)arg;
+    o->k = k;
+}
+
+static void skip_space(parser_t* ps) {
+    while (isspace((unsigned char)*ps->p)) ++ps->p;
+}
+
+// Consumes tok when it comes next
+static int accept(parser_t* ps, const char* tok) {
+    skip_space(ps);
+    size_t n = strlen(tok);
+    if (strncmp(ps->p, tok, n) != 0) return 0;
+    // "<" must not eat the start of "<="
+    if (n == 1 && strchr("<>=!", tok[0]) && ps->p[1] == '=') return 0;
+    ps->p += n;
+    return 1;
+}
+
+// "and", "or", "not" as whole words, so "notch" stays a name
+static int accept_word(parser_t* ps, const char* word) {
+    skip_space(ps);
+    size_t n = strlen(word);
+    if (strncasecmp(ps->p, word, n) != 0 || isalnum((unsigned char)ps->p[n]) || ps->p[n] == '_') return 0;
+    ps->p += n;
+    return 1;
+}
+
+static void parse_or(parser_t* ps);
+
+static void parse_call(parser_t* ps, const char* name, int len) {
+    for (size_t f = 0; f < sizeof(FUNCTIONS) / sizeof(FUNCTIONS[0]); ++f) {
+        if ((int)strlen(FUNCTIONS[f].name) != len || strncmp(FUNCTIONS[f].name, name, len) != 0) continue;
+
+        for (int a = 0; a < FUNCTIONS[f].nargs; ++a) {
+            if (a > 0 && !accept(ps, ",")) {
+                fail(ps, "expected ,");
+                return;
+            }
+            parse_or(ps);
+        }
+        if (!accept(ps, ")")) {
+            fail(ps, "expected )");
+            return;
+        }
+
+        int slot = 0;
+        if (FUNCTIONS[f].stateful) {
+            if (ps->e->nstate >= OBD_EXPR_MAX_STATE) {
+                fail(ps, "too many integrate/ddt/ema");
+                return;
+            }
+            slot = ps->e->nstate++;
+        }
+        emit(ps, FUNCTIONS[f].op, slot, 0);
+        return;
+    }
+    fail(ps, "unknown function");
+}
+
+static void parse_primary(parser_t* ps) {
+    skip_space(ps);
+
+    if (accept(ps, "(")) {
+        parse_or(ps);
+        if (!accept(ps, ")")) fail(ps, "expected )");
+        return;
+    }
+
+    if (isdigit((unsigned char)*ps->p) || *ps->p == '.') {
+        char* end;
+        double k = strtod(ps->p, &end);
+        ps->p = end;
+        emit(ps, OP_CONST, 0, k);
+        return;
+    }
+
+    if (isalpha((unsigned char)*ps->p) || *ps->p == '_') {
+        const char* name = ps->p;
+        while (isalnum((unsigned char)*ps->p) || *ps->p == '_') ++ps->p;
+        int len = (int)(ps->p - name);
+
+        if (accept(ps, "(")) {
+            parse_call(ps, name, len);
+            return;
+        }
+        for (int i = 0; i < ps->nchannels; ++i) {
+            if ((int)strlen(ps->channels[i].name) == len && strncasecmp(ps->channels[i].name, name, len) == 0) {
+                emit(ps, OP_CHANNEL, i, 0);
+                ps->e->inputs |= 1u << i;
+                return;
+            }
+        }
+        ps->p = name;
+        fail(ps, "unknown channel");
+        return;
+    }
+
+    fail(ps, "expected a number, channel or (");
+}
+
+static void parse_unary(parser_t* ps) {
+    if (accept(ps, "-")) {
+        parse_unary(ps);
+        emit(ps, OP_NEG, 0, 0);
+    } else if (accept(ps, "!")) {
+        parse_unary(ps);
+        emit(ps, OP_NOT, 0, 0);
+    } else {
+        parse_primary(ps);
+    }
+}
+
+static void parse_mul(parser_t* ps) {
+    parse_unary(ps);
+    for (;;) {
+        if (accept(ps, "*")) { parse_unary(ps); emit(ps, OP_MUL, 0, 0); }
+        else if (accept(ps, "/")) { parse_unary(ps); emit(ps, OP_DIV, 0, 0); }
+        else return;
+    }
+}
+
+static void parse_add(parser_t* ps) {
+    parse_mul(ps);
+    for (;;) {
+        if (accept(ps, "+")) { parse_mul(ps); emit(ps, OP_ADD, 0, 0); }
+        else if (accept(ps, "-")) { parse_mul(ps); emit(ps, OP_SUB, 0, 0); }
+        else return;
+    }
+}
+
+static void parse_compare(parser_t* ps) {
+    static const struct { const char* tok; int op; } CMP[] = {
+        { "<=", OP_LE }, { ">=", OP_GE }, { "==", OP_EQ }, { "!=", OP_NE }, { "<", OP_LT }, { ">", OP_GT },
+    };
+
+    parse_add(ps);
+    for (size_t i = 0; i < sizeof(CMP) / sizeof(CMP[0]); ++i) {
+        if (accept(ps, CMP[i].tok)) {
+            parse_add(ps);
+            emit(ps, CMP[i].op, 0, 0);
+            return;
+        }
+    }
+}
+
+// "not" binds looser than comparisons: not rpm > 4000 is !(rpm > 4000)
+static void parse_not(parser_t* ps) {
+    if (accept_word(ps, "not")) {
+        parse_not(ps);
+        emit(ps, OP_NOT, 0, 0);
+    } else {
+        parse_compare(ps);
+    }
+}
+
+static void parse_and(parser_t* ps) {
+    parse_not(ps);
+    while (accept(ps, "&&") || accept_word(ps, "and")) {
+        parse_not(ps);
+        emit(ps, OP_AND, 0, 0);
+    }
+}
+
+static void parse_or(parser_t* ps) {
+    parse_and(ps);
+    while (accept(ps, "||") || accept_word(ps, "or")) {
+        parse_and(ps);
+        emit(ps, OP_OR, 0, 0);
+    }
+}
+
+int obd_expr_compile(obd_expr_t* e, const char* text, const obd_pid_t* channels, int nchannels,
+                     char* err, int errlen) {
+    parser_t ps = { text, text, e, channels, nchannels, err, errlen, 0 };
+
+    memset(e, 0, sizeof(*e));
+    if (nchannels > OBD_MAX_CHANNELS) ps.nchannels = OBD_MAX_CHANNELS;
+
+    parse_or(&ps);
+    skip_space(&ps);
+    if (*ps.p) fail(&ps, "unexpected text");
+    return ps.failed ? -1 : 0;
+}
+
+// Evaluation
+// ==========
+
+static double time_function(int op, obd_expr_state_t* st, double t, double x, double tau) {
+    double dt = t - st->t;
+    int continuous = st->primed && dt > 0 && dt <= OBD_EXPR_MAX_GAP_S;
+    double result;
+
+    switch (op) {
+        case OP_INTEGRATE:
+            if (continuous) st->acc += (x + st->x) / 2 * dt;
+            result = st->acc;
+            break;
+        case OP_DDT:
+            result = continuous ? (x - st->x) / dt : NAN;
+            break;
+        default:  // OP_EMA
+            if (!st->primed) st->acc = x;
+            else if (dt > 0) st->acc += (1 - exp(-dt / (tau > 0 ? tau : 1e-9))) * (x - st->acc);
+            result = st->acc;
+            break;
+    }
+
+    st->primed = 1;
+    st->t = t;
+    st->x = x;
+    return result;
+}
+
+int obd_expr_eval(const obd_expr_t* e, obd_expr_state_t* state, double t, const double* values,
+                  uint32_t valid, double* out) {
+    double s[OBD_EXPR_MAX_OPS];
+    int sp = 0;
+
+    if ((e->inputs & valid) != e->inputs || e->nops == 0) return -1;
+
+    for (int i = 0; i < e->nops; ++i) {
+        const obd_expr_op_t* o = &e->ops[i];
+        double b;
+
+        switch (o->op) {
+            case OP_CONST:   s[sp++] = o->k; break;
+            case OP_CHANNEL: s[sp++] = values[o->arg]; break;
+            case OP_NEG:     s[sp - 1] = -s[sp - 1]; break;
+            case OP_NOT:     s[sp - 1] = s[sp - 1] == 0; break;
+            case OP_ABS:     s[sp - 1] = fabs(s[sp - 1]); break;
+            case OP_SQRT:    s[sp - 1] = sqrt(s[sp - 1]); break;
+            case OP_INTEGRATE:
+            case OP_DDT:
+                s[sp - 1] = time_function(o->op, &state[o->arg], t, s[sp - 1], 0);
+                break;
+            case OP_EMA:
+                b = s[--sp];
+                s[sp - 1] = time_function(o->op, &state[o->arg], t, s[sp - 1], b);
+                break;
+            case OP_IF:
+                sp -= 2;
+                s[sp - 1] = s[sp - 1] != 0 ? s[sp] : s[sp + 1];
+                break;
+            default:
+                b = s[--sp];
+                switch (o->op) {
+                    case OP_ADD: s[sp - 1] += b; break;
+                    case OP_SUB: s[sp - 1] -= b; break;
+                    case OP_MUL: s[sp - 1] *= b; break;
+                    case OP_DIV: s[sp - 1] /= b; break;
+                    case OP_LT:  s[sp - 1] = s[sp - 1] < b; break;
+                    case OP_GT:  s[sp - 1] = s[sp - 1] > b; break;
+                    case OP_LE:  s[sp - 1] = s[sp - 1] <= b; break;
+                    case OP_GE:  s[sp - 1] = s[sp - 1] >= b; break;
+                    case OP_EQ:  s[sp - 1] = s[sp - 1] == b; break;
+                    case OP_NE:  s[sp - 1] = s[sp - 1] != b; break;
+                    case OP_AND: s[sp - 1] = s[sp - 1] != 0 && b != 0; break;
+                    case OP_OR:  s[sp - 1] = s[sp - 1] != 0 || b != 0; break;
+                    case OP_MIN: s[sp - 1] = fmin(s[sp - 1], b); break;
+                    case OP_MAX: s[sp - 1] = fmax(s[sp - 1], b); break;
+                }
+                break;
+        }
+    }
+
+    if (sp != 1 || !isfinite(s[0])) return -1;
+    *out = s[0];
+    return 0;
+}
+
+// Derived channel sets
+// ====================
+
+void obd_derived_init(obd_derived_set_t* set, const obd_pid_t* base, int nbase) {
+    memset(set, 0, sizeof(*set));
+    if (nbase > OBD_MAX_CHANNELS) nbase = OBD_MAX_CHANNELS;
+    memcpy(set->channels, base, nbase * sizeof(obd_pid_t));
+    set->nchannels = nbase;
+    set->first = nbase;
+}
+
+int obd_derived_add(obd_derived_set_t* set, const char* definition) {
+    char head[128], err[128];
+    const char* eq = strchr(definition, '=');
+
+    if (!eq || eq - definition >= (int)sizeof(head)) {
+        fprintf(stderr, "derived: expected \"name [unit] [decimals] = expression\": %s\n", definition);
+        return -1;
+    }
+    if (set->nchannels >= OBD_MAX_CHANNELS) {
+        fprintf(stderr, "derived: no room for more than %d channels\n", OBD_MAX_CHANNELS);
+        return -1;
+    }
+
+    obd_derived_t* d = &set->derived[set->nderived];
+    int decimals = 2;
+    memset(d, 0, sizeof(*d));
+    snprintf(head, sizeof(head), "%.*s", (int)(eq - definition), definition);
+
+    char* tok = strtok(head, " \t");
+    if (!tok) {
+        fprintf(stderr, "derived: missing name: %s\n", definition);
+        return -1;
+    }
+    snprintf(d->name, sizeof(d->name), "%s", tok);
+    if ((tok = strtok(NULL, " \t")) != NULL) {
+        snprintf(d->unit, sizeof(d->unit), "%s", tok);
+        if ((tok = strtok(NULL, " \t")) != NULL) decimals = atoi(tok);
+    }
+
+    for (int i = 0; i < set->nchannels; ++i) {
+        if (strcasecmp(set->channels[i].name, d->name) == 0) {
+            fprintf(stderr, "derived: %s is already a channel\n", d->name);
+            return -1;
+        }
+    }
+    if (obd_expr_compile(&d->expr, eq + 1, set->channels, set->nchannels, err, sizeof(err)) != 0) {
+        fprintf(stderr, "derived: %s: %s\n", d->name, err);
+        return -1;
+    }
+
+    // Only name, unit and decimals matter to the sinks
+    obd_pid_t* ch = &set->channels[set->nchannels++];
+    memset(ch, 0, sizeof(*ch));
+    ch->name = d->name;
+    ch->unit = d->unit;
+    ch->decimals = decimals;
+    set->nderived++;
+    return 0;
+}
+
+int obd_derived_load(obd_derived_set_t* set, const char* path) {
+    char line[512];
+    int added = 0;
+
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        char* p = line;
+        while (isspace((unsigned char)*p)) ++p;
+        char* hash = strchr(p, '#');
+        if (hash) *hash = '\0';
+        p[strcspn(p, "\r\n")] = '\0';
+        if (!*p) continue;
+
+        if (obd_derived_add(set, p) != 0) {
+            fclose(f);
+            return -1;
+        }
+        added++;
+    }
+    fclose(f);
+    return added;
+}
+
+void obd_derived_apply(obd_derived_set_t* set, int64_t t_us, double* values, uint32_t* valid) {
+    double t = t_us / 1e6;
+
+    for (int k = 0; k < set->nderived; ++k) {
+        obd_derived_t* d = &set->derived[k];
+        int idx = set->first + k;
+        double v;
+
+        if (obd_expr_eval(&d->expr, d->state, t, values, *valid, &v) == 0) {
+            values[idx] = v;
+            *valid |= 1u << idx;
+        } else {
+            *valid &= ~(1u << idx);
+        }
+    }
+}
@@ -0,0 +1,110 @@
+/*
+ * obd_expr.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+#ifndef OBD_EXPR_H
+#define OBD_EXPR_H
+
+//
+// Derived channels: expressions over decoded channels, evaluated per sample.
+//
+// An expression is compiled once into a flat RPN program and evaluated with
+// a small stack for every polling round, so a derived channel costs a few
+// dozen floating point operations and O(1) state:
+//
+//    FuelRate  L/h      2 = MAF / 14.7 / 745 * 3600
+//    Distance  km       3 = integrate(Speed) / 3600
+//    Economy   L/100km  1 = if(Speed > 5, FuelRate / Speed * 100, 0)
+//
+// Operators, lowest precedence first: || && (== != < > <= >=) (+ -) (* /)
+// and unary - !. "and" and "or" work as && and ||, "not" as a ! that binds
+// looser than comparisons. Comparisons and logic give 1 or 0. Functions:
+//
+//    min(a, b) max(a, b) abs(x) sqrt(x) if(cond, a, b)
+//    integrate(x)    trapezoid integral over time in seconds
+//    ddt(x)          change per second since the previous sample
+//    ema(x, tau)     exponential moving average, time constant tau seconds
+//
+// Names refer to the channel table given to the compiler (OBD_PIDS plus the
+// derived channels defined before). A derived value is missing when one of
+// its inputs is missing or the result is not finite (e.g. a division by 0).
+// The time functions do not integrate across gaps over OBD_EXPR_MAX_GAP_S.
+//
+
+#include <stdint.h>
+
+#include "obd_pids.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OBD_EXPR_MAX_OPS 64
+#define OBD_EXPR_MAX_STATE 4
+#define OBD_EXPR_MAX_GAP_S 5.0
+
+typedef struct {
+    uint8_t op;
+    int16_t arg;            // channel index or state slot
+    double k;               // constant
+} obd_expr_op_t;
+
+typedef struct {
+    obd_expr_op_t ops[OBD_EXPR_MAX_OPS];
+    int nops;
+    int nstate;
+    uint32_t inputs;        // channels read, as a valid-bit mask
+} obd_expr_t;
+
+typedef struct {
+    int primed;
+    double t, x, acc;
+} obd_expr_state_t;
+
+// 0 on success; on failure err says what and where
+int obd_expr_compile(obd_expr_t* e, const char* text, const obd_pid_t* channels, int nchannels,
+                     char* err, int errlen);
+
+// t in seconds; 0 and *out set, or -1 when an input is missing or the
+// result is not finite. State is only touched when all inputs are there.
+int obd_expr_eval(const obd_expr_t* e, obd_expr_state_t* state, double t, const double* values,
+                  uint32_t valid, double* out);
+
+// Derived channel sets
+// ====================
+//
+// The channel table starts with the polled PIDs and the derived channels
+// follow, so the bus, the CSV header, the binary log and the rollups pick
+// them up like any other channel.
+
+typedef struct {
+    char name[24];
+    char unit[12];
+    obd_expr_t expr;
+    obd_expr_state_t state[OBD_EXPR_MAX_STATE];
+} obd_derived_t;
+
+typedef struct {
+    obd_pid_t channels[OBD_MAX_CHANNELS];
+    int nchannels;
+    int first;              // index of the first derived channel
+    obd_derived_t derived[OBD_MAX_CHANNELS];
+    int nderived;
+} obd_derived_set_t;
+
+void obd_derived_init(obd_derived_set_t* set, const obd_pid_t* base, int nbase);
+// "name [unit] [decimals] = expression", 0 on success
+int obd_derived_add(obd_derived_set_t* set, const char* definition);
+// One definition per line, # starts a comment; returns the number added or -1
+int obd_derived_load(obd_derived_set_t* set, const char* path);
+// Fills the derived channels of one sample
+void obd_derived_apply(obd_derived_set_t* set, int64_t t_us, double* values, uint32_t* valid);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
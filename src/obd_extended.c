@@ -25,7 +25,12 @@
 // Compilation
 // ===========
 //
-// gcc obd_extended.c -o obd_extended -lbluetooth
+// gcc obd_extended.c obd_device.c -o obd_extended -lbluetooth
+//
+// ./obd_extended [device]
+//
+// device defaults to BT_ADDR; pass unix:/tmp/obd_broker.sock to share the
+// adapter with a running logger through obd_broker.
 //
 //
 // Optional Output Example
@@ -58,12 +63,9 @@
 #include <string.h>
 #include <errno.h>
 
-#include <sys/socket.h>
-#include <bluetooth/bluetooth.h>
-#include <bluetooth/rfcomm.h>
+#include "obd_device.h"
 
 #define BT_ADDR "00:1D:A5:68:98:8B"  // Replace with your V-LINK address
-#define RFCOMM_CHANNEL 1
 
 void send_obd_command(int sock, const char* cmd) {
     char full_cmd[64];
@@ -81,18 +83,9 @@ void send_obd_command(int sock, const char* cmd) {
     }
 }
 
-int main() {
-    struct sockaddr_rc addr = { 0 };
-    int sock, status;
-
-    sock = socket(AF_BLUETOOTH, SOCK_STREAM, BTPROTO_RFCOMM);
-    addr.rc_family = AF_BLUETOOTH;
-    addr.rc_channel = RFCOMM_CHANNEL;
-    str2ba(BT_ADDR, &addr.rc_bdaddr);
-
-    status = connect(sock, (struct sockaddr *)&addr, sizeof(addr));
-    if (status < 0) {
-        perror("connect");
+int main(int argc, char** argv) {
+    int sock = obd_device_open(argc > 1 ? argv[1] : BT_ADDR);
+    if (sock < 0) {
         return 1;
     }
 
@@ -0,0 +1,243 @@
+/*
+ * obd_fault.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "obd_fault.h"
+#include "obd_time.h"
+
+const char* const OBD_FAULT_NAMES[OBD_FAULT_TYPES] = {
+    [OBD_FAULT_DELAY]      = "delay",
+    [OBD_FAULT_TRUNCATE]   = "truncate",
+    [OBD_FAULT_CORRUPT]    = "corrupt",
+    [OBD_FAULT_DROP]       = "drop",
+    [OBD_FAULT_SEARCHING]  = "searching",
+    [OBD_FAULT_DISCONNECT] = "disconnect",
+    [OBD_FAULT_RESET]      = "reset",
+};
+
+static const int DEFAULT_PARAM_MS[OBD_FAULT_TYPES] = {
+    [OBD_FAULT_DELAY]      = 2000,
+    [OBD_FAULT_DISCONNECT] = 3000,
+};
+
+static const char BANNER[] = "\r\rELM327 v1.5\r\r>";
+
+int obd_fault_init(obd_fault_t* f, const char* spec, const obd_transport_ops_t* inner, void* inner_ctx) {
+    char buf[256];
+
+    memset(f, 0, sizeof(*f));
+    f->inner = inner;
+    f->inner_ctx = inner_ctx;
+    f->fault = -1;
+    f->complete = 1;
+    f->seed = (unsigned int)time(NULL);
+    memcpy(f->param_ms, DEFAULT_PARAM_MS, sizeof(f->param_ms));
+
+    snprintf(buf, sizeof(buf), "%s", spec);
+    for (char* item = strtok(buf, ","); item; item = strtok(NULL, ",")) {
+        char* value = strchr(item, '=');
+        if (!value) {
+            fprintf(stderr, "fault spec: expected name=value, got %s\n", item);
+            return -1;
+        }
+        *value++ = '\0';
+
+        if (strcmp(item, "seed") == 0) {
+            f->seed = (unsigned int)strtoul(value, NULL, 10);
+        } else if (strcmp(item, "gap") == 0) {
+            f->gap_ms = atoi(value);
+        } else if (strcmp(item, "log") == 0) {
+            f->log = fopen(value, "w");
+            if (!f->log) {
+                perror(value);
+                return -1;
+            }
+        } else {
+            int t = 0;
+            while (t < OBD_FAULT_TYPES && strcmp(item, OBD_FAULT_NAMES[t]) != 0) ++t;
+            if (t == OBD_FAULT_TYPES) {
+                fprintf(stderr, "fault spec: unknown fault %s\n", item);
+                return -1;
+            }
+            f->prob[t] = atof(value);
+            char* ms = strchr(value, ':');
+            if (ms) f->param_ms[t] = atoi(ms + 1);
+        }
+    }
+    return 0;
+}
+
+void obd_fault_close(obd_fault_t* f) {
+    if (f->log) fclose(f->log);
+    f->log = NULL;
+}
+
+int obd_fault_reconnect(obd_fault_t* f) {
+    if (!f->down) return 0;
+    if (obd_now_us() < f->down_until_us) return -1;
+    f->down = 0;
+    return 0;
+}
+
+static double uniform(obd_fault_t* f) {
+    return rand_r(&f->seed) / ((double)RAND_MAX + 1);
+}
+
+static int pick_fault(obd_fault_t* f) {
+    uint64_t now = obd_now_us();
+    if (f->last_fault_us && now - f->last_fault_us < (uint64_t)f->gap_ms * 1000) return -1;
+
+    double r = uniform(f), acc = 0;
+    for (int t = 0; t < OBD_FAULT_TYPES; ++t) {
+        acc += f->prob[t];
+        if (r < acc) return t;
+    }
+    return -1;
+}
+
+static void log_fault(obd_fault_t* f, int t) {
+    f->injected[t]++;
+    f->last_fault_us = obd_now_us();
+    if (!f->log) return;
+    fprintf(f->log, "%lld,%s\n", (long long)obd_unix_now_us(), OBD_FAULT_NAMES[t]);
+    fflush(f->log);
+}
+
+// "at e 0\r" -> "ATE0": upper case, no spaces, up to the CR
+static void normalize_at(const char* in, char* out, int maxlen) {
+    int n = 0;
+    for (; *in && *in != '\r' && n < maxlen - 1; ++in) {
+        if (*in != ' ') out[n++] = (char)toupper((unsigned char)*in);
+    }
+    out[n] = '\0';
+}
+
+static int fault_write(void* ctx, const char* buf, int len) {
+    obd_fault_t* f = ctx;
+
+    if (f->down) return len;
+
+    f->fault = -1;
+    f->len = f->served = 0;
+    f->complete = 0;
+    f->ready_us = 0;
+    snprintf(f->cmd, sizeof(f->cmd), "%.*s", len, buf);
+
+    if (strncmp(buf, "AT", 2) == 0) {
+        // Only the echo command itself, not "AT SH 7E0"
+        char at[sizeof(f->cmd)];
+        normalize_at(f->cmd, at, sizeof(at));
+        if (strcmp(at, "ATE0") == 0) f->echo = 0;
+        else if (strcmp(at, "ATE1") == 0) f->echo = 1;
+    } else {
+        f->fault = pick_fault(f);
+        if (f->fault >= 0) log_fault(f, f->fault);
+        if (f->fault == OBD_FAULT_DISCONNECT) {
+            f->down = 1;
+            f->down_until_us = obd_now_us() + (uint64_t)f->param_ms[OBD_FAULT_DISCONNECT] * 1000;
+            return len;
+        }
+    }
+    return f->inner->write(f->inner_ctx, buf, len);
+}
+
+// Index of a random character before the prompt
+static int random_pos(obd_fault_t* f) {
+    int n = f->len - 1;
+    return n > 0 ? (int)(uniform(f) * n) : -1;
+}
+
+static void spoil_reply(obd_fault_t* f) {
+    if (f->echo) {
+        // The echo is the command as written, CR included
+        int n = (int)strlen(f->cmd);
+        if (n + f->len < (int)sizeof(f->reply)) {
+            memmove(f->reply + n, f->reply, f->len);
+            memcpy(f->reply, f->cmd, n);
+            f->len += n;
+        }
+    }
+
+    int count = 1 + (int)(uniform(f) * 3);
+    switch (f->fault) {
+        case OBD_FAULT_DELAY:
+            f->ready_us = obd_now_us() + (uint64_t)f->param_ms[OBD_FAULT_DELAY] * 1000;
+            break;
+        case OBD_FAULT_TRUNCATE:
+            f->len = f->len > 1 ? (int)(uniform(f) * (f->len - 1)) : 0;
+            break;
+        case OBD_FAULT_CORRUPT:
+            for (int i = 0; i < count; ++i) {
+                int p = random_pos(f);
+                if (p < 0) break;
+                char c = (char)(0x21 + (int)(uniform(f) * 94));
+                f->reply[p] = c == '>' ? '~' : c;
+            }
+            break;
+        case OBD_FAULT_DROP:
+            for (int i = 0; i < count; ++i) {
+                int p = random_pos(f);
+                if (p < 0) break;
+                memmove(f->reply + p, f->reply + p + 1, f->len - p - 1);
+                f->len--;
+            }
+            break;
+        case OBD_FAULT_SEARCHING:
+            f->len = snprintf(f->reply, sizeof(f->reply), "SEARCHING...\r");
+            break;
+        case OBD_FAULT_RESET:
+            f->len = snprintf(f->reply, sizeof(f->reply), "%s", BANNER);
+            f->echo = 1;
+            break;
+    }
+}
+
+static int fault_read(void* ctx, char* buf, int len, int timeout_ms) {
+    obd_fault_t* f = ctx;
+    uint64_t deadline = obd_now_us() + (uint64_t)timeout_ms * 1000;
+
+    if (f->down) {
+        if (timeout_ms > 0) usleep(timeout_ms * 1000);
+        return 0;
+    }
+
+    // The whole reply is collected before it is spoiled
+    while (!f->complete) {
+        char tmp[256];
+        uint64_t now = obd_now_us();
+        int wait = now < deadline ? (int)((deadline - now + 999) / 1000) : 0;
+        int n = f->inner->read(f->inner_ctx, tmp, sizeof(tmp), wait);
+        if (n <= 0) return n;
+
+        for (int i = 0; i < n && f->len < (int)sizeof(f->reply); ++i) f->reply[f->len++] = tmp[i];
+        if (memchr(tmp, '>', n)) {
+            f->complete = 1;
+            spoil_reply(f);
+        }
+    }
+
+    uint64_t now = obd_now_us();
+    if (f->served == f->len || now + 1000 < f->ready_us) {
+        uint64_t until = f->served == f->len || f->ready_us > deadline ? deadline : f->ready_us;
+        if (until > now) usleep((useconds_t)(until - now));
+        if (f->served == f->len || obd_now_us() < f->ready_us) return 0;
+    }
+
+    int n = f->len - f->served;
+    if (n > len) n = len;
+    memcpy(buf, f->reply + f->served, n);
+    f->served += n;
+    return n;
+}
+
+const obd_transport_ops_t OBD_FAULT_TRANSPORT = { "fault", fault_read, fault_write };
@@ -0,0 +1,90 @@
+/*
+ * obd_fault.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+#ifndef OBD_FAULT_H
+#define OBD_FAULT_H
+
+//
+// Fault-injection transport.
+//
+// Wraps another obd_session transport and spoils the replies to OBD commands
+// (AT commands pass untouched, so recovery probes are measured, not faulted).
+// The spec is a comma separated list of fault=probability[:ms] per command:
+//
+//    delay=0.05:2000       reply held back for 2000 ms
+//    truncate=0.02         reply cut short, the prompt never comes
+//    corrupt=0.02          1-3 characters replaced with line noise
+//    drop=0.02             1-3 characters lost
+//    searching=0.01        "SEARCHING..." and then nothing
+//    disconnect=0.01:3000  link silent until reconnected, which fails for 3000 ms
+//    reset=0.01            adapter reboots: banner, echo on until "AT E0"
+//
+// plus seed=N (rand_r seed), gap=ms (no fault within ms of the previous one,
+// so gap=5000 with probability 1 is one fault every 5 s) and log=path, a CSV
+// of unix_us,fault for every fault injected (read by obd_bench -R).
+//
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "obd_session.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    OBD_FAULT_DELAY,
+    OBD_FAULT_TRUNCATE,
+    OBD_FAULT_CORRUPT,
+    OBD_FAULT_DROP,
+    OBD_FAULT_SEARCHING,
+    OBD_FAULT_DISCONNECT,
+    OBD_FAULT_RESET,
+    OBD_FAULT_TYPES
+} obd_fault_type_t;
+
+extern const char* const OBD_FAULT_NAMES[OBD_FAULT_TYPES];
+
+typedef struct {
+    const obd_transport_ops_t* inner;
+    void* inner_ctx;
+
+    double prob[OBD_FAULT_TYPES];
+    int param_ms[OBD_FAULT_TYPES];
+    int gap_ms;
+    unsigned int seed;
+    FILE* log;
+
+    // Reply to the command in flight
+    int fault;              // -1 when the reply is left alone
+    char cmd[64];
+    char reply[1024];
+    int len, served, complete;
+    uint64_t ready_us;
+
+    int echo;               // after a reset, until "AT E0"
+    int down;
+    uint64_t down_until_us;
+    uint64_t last_fault_us;
+
+    uint64_t injected[OBD_FAULT_TYPES];
+} obd_fault_t;
+
+extern const obd_transport_ops_t OBD_FAULT_TRANSPORT;
+
+// 0 on success, -1 on a bad spec
+int obd_fault_init(obd_fault_t* f, const char* spec, const obd_transport_ops_t* inner, void* inner_ctx);
+// Reconnect callback for a simulated link: fails while a disconnect lasts
+int obd_fault_reconnect(obd_fault_t* f);
+void obd_fault_close(obd_fault_t* f);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
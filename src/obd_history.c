@@ -0,0 +1,153 @@
+/*
+ * obd_history.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+//
+// Historical range queries over the rollup tiers written by obd_logger_merged.
+//
+// Answers questions like "average coolant per day this month" or "max RPM per
+// hour" from the pre-aggregated 1 s / 1 min / 1 h buckets instead of
+// rescanning the raw obd_log_*.csv files. The coarsest tier whose bucket size
+// divides the requested resolution is used, so month-long queries read a few
+// hundred records.
+//
+// Compile & Run
+// =============
+//
+// gcc obd_history.c obd_rollup.c obd_pids.c -o obd_history -lm
+//
+// ./obd_history Coolant 2026-10-01 2026-11-01 1d
+// ./obd_history -d /media/pi/OBD_USB/rollup RPM "2026-10-18 08:00:00" "2026-10-18 09:00:00" 1m
+//
+// Resolution accepts seconds or a suffix: 30s, 5m, 1h, 1d.
+//
+// Example Output
+// ==============
+//
+// Start,Count,Min,Max,Avg
+// 2026-10-01 00:00:00,3542,21.00,92.00,84.31
+// 2026-10-02 00:00:00,1210,18.00,90.00,79.02
+// 31 buckets from tier 1h in 0.412 ms
+//
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "obd_rollup.h"
+
+#define DEFAULT_DIR "/home/pi/obd_logs/rollup"
+#define MAX_BUCKETS 100000
+
+static int parse_time(const char* s, time_t* out) {
+    struct tm tm;
+    const char* formats[] = { "%Y-%m-%d %H:%M:%S", "%Y-%m-%d %H:%M", "%Y-%m-%d" };
+
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); ++i) {
+        memset(&tm, 0, sizeof(tm));
+        const char* end = strptime(s, formats[i], &tm);
+        if (end && *end == '\0') {
+            tm.tm_isdst = -1;
+            *out = mktime(&tm);
+            return 0;
+        }
+    }
+
+    char* end;
+    long long epoch = strtoll(s, &end, 10);
+    if (*s && *end == '\0') {
+        *out = (time_t)epoch;
+        return 0;
+    }
+    return -1;
+}
+
+static int parse_resolution(const char* s) {
+    char* end;
+    long v = strtol(s, &end, 10);
+    switch (*end) {
+        case '\0':
+        case 's': return (int)v;
+        case 'm': return (int)(v * 60);
+        case 'h': return (int)(v * 3600);
+        case 'd': return (int)(v * 86400);
+    }
+    return -1;
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [-d rollup_dir] <channel> <from> <to> [resolution]\n", prog);
+    fprintf(stderr, "Channels:");
+    for (int i = 0; i < OBD_PID_COUNT; ++i) fprintf(stderr, " %s", OBD_PIDS[i].name);
+    fprintf(stderr, "\n");
+}
+
+int main(int argc, char** argv) {
+    const char* dir = DEFAULT_DIR;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "d:")) != -1) {
+        switch (opt) {
+            case 'd': dir = optarg; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+
+    if (argc - optind < 3) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    const char* channel = argv[optind];
+    time_t from, to;
+    int resolution = 3600;
+
+    if (parse_time(argv[optind + 1], &from) != 0 || parse_time(argv[optind + 2], &to) != 0) {
+        fprintf(stderr, "Bad time, use YYYY-MM-DD[ HH:MM[:SS]] or unix seconds.\n");
+        return 1;
+    }
+    if (argc - optind > 3 && (resolution = parse_resolution(argv[optind + 3])) <= 0) {
+        fprintf(stderr, "Bad resolution: %s\n", argv[optind + 3]);
+        return 1;
+    }
+
+    rollup_bucket_t* buckets = malloc(MAX_BUCKETS * sizeof(rollup_bucket_t));
+    if (!buckets) {
+        perror("malloc");
+        return 1;
+    }
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    int n = rollup_query(dir, channel, from, to, resolution, buckets, MAX_BUCKETS);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    if (n < 0) {
+        fprintf(stderr, "No rollups for %s in %s\n", channel, dir);
+        free(buckets);
+        return 1;
+    }
+
+    printf("Start,Count,Min,Max,Avg\n");
+    for (int i = 0; i < n; ++i) {
+        char ts[64];
+        time_t start = (time_t)buckets[i].start;
+        strftime(ts, sizeof(ts), "%Y-%m-%d %H:%M:%S", localtime(&start));
+        printf("%s,%u,%.2f,%.2f,%.2f\n", ts, buckets[i].count, buckets[i].min, buckets[i].max,
+               buckets[i].sum / buckets[i].count);
+    }
+
+    double ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+    fprintf(stderr, "%d buckets from tier %s in %.3f ms\n", n,
+            ROLLUP_TIER_NAMES[rollup_pick_tier(resolution)], ms);
+
+    free(buckets);
+    return 0;
+}
@@ -0,0 +1,143 @@
+/*
+ * obd_http.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+
+#include "obd_http.h"
+
+typedef struct {
+    const char* path;
+    const char* content_type;
+    http_handler_fn fn;
+    void* ctx;
+} http_route_t;
+
+static http_route_t routes[HTTP_MAX_ROUTES];
+static int nroutes;
+
+int http_route(const char* path, const char* content_type, http_handler_fn fn, void* ctx) {
+    if (nroutes >= HTTP_MAX_ROUTES) return -1;
+    routes[nroutes].path = path;
+    routes[nroutes].content_type = content_type;
+    routes[nroutes].fn = fn;
+    routes[nroutes].ctx = ctx;
+    nroutes++;
+    return 0;
+}
+
+static void send_all(int fd, const char* buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, buf, len, MSG_NOSIGNAL);
+        if (n <= 0) return;
+        buf += n;
+        len -= n;
+    }
+}
+
+static void reply(int fd, const char* status, const char* content_type, const char* body, size_t len) {
+    char head[256];
+    int n = snprintf(head, sizeof(head),
+                     "HTTP/1.0 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+                     status, content_type, len);
+    send_all(fd, head, n);
+    send_all(fd, body, len);
+}
+
+static void serve(int fd) {
+    char req[2048];
+    int len = 0;
+
+    // Only the request line matters, stop at the end of the headers
+    while (len < (int)sizeof(req) - 1) {
+        ssize_t n = recv(fd, req + len, sizeof(req) - 1 - len, 0);
+        if (n <= 0) break;
+        len += n;
+        req[len] = '\0';
+        if (strstr(req, "\r\n\r\n") || strstr(req, "\n\n")) break;
+    }
+    req[len] = '\0';
+
+    char method[8], target[512];
+    if (sscanf(req, "%7s %511s", method, target) != 2 || strcmp(method, "GET") != 0) {
+        reply(fd, "400 Bad Request", "text/plain", "bad request\n", 12);
+        return;
+    }
+
+    char* query = strchr(target, '?');
+    if (query) *query++ = '\0';
+    else query = "";
+
+    for (int i = 0; i < nroutes; ++i) {
+        if (strcmp(routes[i].path, target) != 0) continue;
+
+        char* body = NULL;
+        size_t body_len = 0;
+        FILE* out = open_memstream(&body, &body_len);
+        if (!out) break;
+        routes[i].fn(out, query, routes[i].ctx);
+        fclose(out);
+        reply(fd, "200 OK", routes[i].content_type, body, body_len);
+        free(body);
+        return;
+    }
+
+    reply(fd, "404 Not Found", "text/plain", "not found\n", 10);
+}
+
+static void* http_thread(void* arg) {
+    int srv = (int)(long)arg;
+
+    for (;;) {
+        int fd = accept(srv, NULL, NULL);
+        if (fd < 0) continue;
+
+        struct timeval tv = { 2, 0 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        serve(fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+int http_start(int port) {
+    int srv = socket(AF_INET, SOCK_STREAM, 0);
+    if (srv < 0) {
+        perror("http socket");
+        return -1;
+    }
+
+    int one = 1;
+    setsockopt(srv, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr = { 0 };
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+
+    if (bind(srv, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(srv, 8) < 0) {
+        perror("http bind");
+        close(srv);
+        return -1;
+    }
+
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, http_thread, (void*)(long)srv) != 0) {
+        perror("http thread");
+        close(srv);
+        return -1;
+    }
+    pthread_detach(tid);
+    return 0;
+}
@@ -0,0 +1,36 @@
+/*
+ * obd_http.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+#ifndef OBD_HTTP_H
+#define OBD_HTTP_H
+
+//
+// Minimal HTTP/1.0 GET server for local status endpoints (/metrics, ...).
+//
+// One background thread serves requests one at a time; handlers write the
+// body into a FILE* and the server adds the headers.
+//
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HTTP_MAX_ROUTES 16
+
+// query is the part after '?', or "" when there is none
+typedef void (*http_handler_fn)(FILE* out, const char* query, void* ctx);
+
+int http_route(const char* path, const char* content_type, http_handler_fn fn, void* ctx);
+int http_start(int port);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
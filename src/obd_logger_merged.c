@@ -25,21 +25,147 @@
 //
 // OBD-II live sensor logging (RPM, speed, coolant temp, MAF, etc.)
 //
-// DTC scan every 60 seconds
+// DTC check every 10 seconds (0101), full reads of stored, pending and permanent codes
+// only when the MIL or the code count changes
 //
 // Runs continuously as a background logger
 //
 // Organized log files:
 //
-//    Sensor data: obd_log_YYYYMMDD_HHMMSS.csv
+//    Sensor data: obd_log_YYYYMMDD_HHMMSS.csv (and/or .bin with -f bin|both)
 //
 //    DTCs: dtc_log_YYYYMMDD_HHMMSS.csv
 //
+//    Monitor results (mode 06): monitor_log_YYYYMMDD_HHMMSS.csv
+//
+//    Rollups: rollup/{1s,1m,1h}/<channel>*.bin (count/min/max/sum per bucket)
+//
+// Rollups: every decoded value also updates 1 s / 1 min / 1 h buckets per channel
+// (obd_rollup.c). Query them with obd_history instead of rescanning the CSVs.
+// The 1 s tier is split per day and follows the same retention as the CSVs.
+//
 // Compile & Run
 // =============
 //
-// gcc obd_logger_merged.c -o obd_logger_merged -lbluetooth
-// ./obd_logger_merged
+// gcc obd_logger_merged.c obd_device.c obd_pids.c obd_rollup.c obd_session.c obd_metrics.c obd_http.c obd_trace.c obd_shm.c obd_store.c obd_bus.c obd_sinks.c obd_capture.c obd_fault.c obd_expr.c obd_alert.c obd_trip.c obd_dtc.c obd_snapshot.c obd_vehicle.c obd_monitor.c obd_baud.c -o obd_logger_merged -lbluetooth -lpthread -lrt -lm
+// ./obd_logger_merged [-d device] [-o log_dir] [-f csv|bin|both] [-i interval_ms] [-B pids_per_request]
+//                     [-m metrics_port] [-t trace.json] [-s shm_name] [-c capture.cap | -r capture.cap[@speed]]
+//                     [-T command_timeout_ms] [-F fault_spec] [-x derived.conf|none] [-a alerts.conf|none]
+//                     [-g trip[:end_s]|run] [-E pre_s:burst_s|none] [-p pids.conf] [-M monitor_s|none]
+//                     [-b max_baud|none] [-w compact|spaced]
+//
+// Polling: one round of all PIDs every -i milliseconds (1000 by default, 0 = back to
+// back). -B 6 asks for up to six PIDs per request ("010C0D05..."), which CAN ECUs
+// answer in one multi-frame reply; the default is one PID per request.
+// -p pids.conf adds manufacturer PIDs (mode 22: DPF soot, transmission temperature, ...)
+// with header, request, bytes and scaling per line (obd_pids.h). They are compiled into
+// the PID table after the mode 01 ones and polled at the end of each round, one AT SH
+// per header and one request per DID, and logged like any other channel.
+// -o writes to the given directory instead of the USB stick / home fallback.
+//
+// Trips: a trip starts when the engine runs (RPM or speed above 0, or the battery at
+// charging voltage from AT RV) and ends 30 s after it stopped (-g trip:60 for 60 s).
+// Each trip gets its own obd_log_<start>.csv / .bin and, when it closes, a summary
+// obd_trip_<start>.json: duration, distance, moving and idle time, min / max / average
+// per channel and the DTCs seen (obd_trip.h). Rounds between trips and rounds where
+// nothing answered are left out. -g run writes one file per logger run instead.
+//
+// Device: Bluetooth address (default 00:1D:A5:68:98:8B), a serial port such as
+// /dev/rfcomm0, or unix:/tmp/obd_broker.sock to share the adapter through obd_broker.
+// A wired adapter (/dev/ttyUSB0, 38400 baud unless given as /dev/ttyUSB0@baud) is
+// switched to 500000, 230400 or 115200 baud with the ELM327 AT BRD handshake, the
+// fastest that works; -b 115200 caps it, -b none keeps the start rate. The rate that
+// worked is kept per device in obd_baud.cache in the log directory, so later runs and
+// reconnects go straight to it (obd_baud.h). Bytes/s and samples/s of "0100" are
+// printed before and after the switch:
+//
+//    Baud: 38400 -> 500000 (1 handshake), 1785 -> 5610 bytes/s, 89.3 -> 280.6 samples/s
+//
+// Capture and replay: -c trip.cap records every byte exchanged with the adapter, with
+// monotonic timestamps (obd_capture.c). -r trip.cap replays it instead of opening a
+// device: the recorded replies go through the same parser, decoder and sinks, paced
+// like the original run (@1, the default), N times faster (@10) or as fast as
+// possible (@0). Samples keep the timestamps of the original run. Replay with the
+// same -B as the capture; commands the capture does not have read NO DATA.
+//
+// Derived channels: FuelRate (L/h from MAF, AFR 14.7), FuelUsed, Distance (integrated
+// speed), Economy and an estimated Power are computed per round (obd_expr.c) and logged
+// next to the raw PIDs. -x file replaces them with "name [unit] [decimals] = expression"
+// lines, -x none turns them off.
+//
+// Alerts: threshold, hysteresis, debounce and rate-of-change rules (obd_alert.h) are
+// checked as soon as each value is decoded. By default Coolant over 105 C for 5 s and
+// RPM over 6000; -a file replaces them, -a none turns them off. Alerts go to
+// alert_log_*.csv, stdout and the datagram socket /tmp/obd_alerts.sock
+// (socat UNIX-RECVFROM:/tmp/obd_alerts.sock,fork -), delivery latency from the ECU
+// reply to obd_alert_latency_seconds.
+//
+// DTCs: 0101 (MIL and stored code count) is polled every 10 s; 03, 07 and 0A are only
+// read when it changes, and every 10 minutes for the pending and permanent codes 0101
+// does not count (obd_dtc.h). dtc_log_*.csv gets one line per code that appeared or
+// was cleared, "2026-10-18 20:14:03,new,P0133,stored", not the whole list per scan.
+// dtc_history.bin keeps first / last seen, count and kind per code across runs and is
+// exempt from the rotation; list it with obd_dtc_decoder -H <log_dir>/dtc_history.bin.
+//
+// Snapshots: a new stored or pending DTC, or a fired alert, reads the mode 02 freeze
+// frame at once and polls the involved PIDs back to back for 5 s in the idle time
+// between rounds. Together with the rounds of the 30 s before the trigger, kept in
+// memory, that goes to one obd_snapshot_<time>.json (obd_snapshot.h). -E 60:10 keeps
+// 60 s and bursts for 10 s, -E none turns snapshots off.
+//
+// Monitors: the mode 06 on-board monitor results (catalyst, O2 sensors, EVAP, misfire
+// counts, ...) are read every 30 minutes (-M 600 for 10, -M none off), one request at a
+// time in the idle time between rounds, so they never delay the polling. Each readout
+// appends "time,mid,monitor,tid,value,min,max,unit,pass|fail" lines to monitor_log_*.csv
+// (obd_monitor.h). With -i 0 there is no idle time and nothing is read.
+//
+// Vehicle: VIN, CALID, CVN and ECU name (mode 09) are read at connect and stamped on
+// every log segment, "# vin=... calid=... cvn=... ecu=... protocol=6 adapter=..." above
+// the CSV header and in the .bin header. obd_vehicle.cache in the log directory keeps
+// them per adapter and protocol, so later connects only ask for the single-frame CVN
+// and skip the multi-frame reads while it matches (obd_vehicle.h).
+//
+// Recovery: garbled replies, adapter resets (banner or echo), timeouts and a link
+// that goes silent are handled by obd_session_query(): resync probe, setup replay,
+// and after 3 failures in a row a reconnect (obd_reconnects_total). -T sets the
+// command timeout (5000 ms by default), which bounds how long a dead link goes
+// unnoticed. -F injects faults for testing, e.g. -F corrupt=0.01,reset=0.001
+// (obd_fault.h); obd_bench -R measures the recovery time per fault type.
+//
+// Startup: no AT Z reboot. AT D restores the defaults, AT DPN shows echo, line ends
+// and protocol, and only the setup commands that are not in effect yet go out, each
+// waiting for the prompt (obd_session_init_adapter()). The time from start to the first
+// sample logged is printed:
+//
+//    Adapter init: 38 ms (AT D, 4 commands, 3 already set)
+//    First sample 512 ms after start
+//
+// Wire format: the adapter is set to AT S0 and AT H0, so "010C" comes back as
+// "410C1AF8" instead of "41 0C 1A F8", a third fewer bytes per reply on the serial or
+// Bluetooth link. Replies are parsed as hex bytes with or without spaces
+// (obd_pid_reply_bytes()), so a capture or a broker link with spaces reads the same.
+// -w spaced keeps AT S1, e.g. to compare with obd_bench.
+//
+// Metrics: every adapter command goes through obd_session.c, which waits for the '>'
+// prompt instead of sleeping 300 ms, and records per-command latency histograms and
+// counters for NO DATA, ?, BUFFER FULL, CAN ERROR, timeouts, reconnects and bytes in/out.
+// Scrape them from http://<pi>:9101/metrics (-m 0 disables the endpoint); a summary
+// line goes to the journal every 60 seconds.
+//
+// Tracing: -t /tmp/obd_trace.json records spans (write, wait_prompt, parse (with decode),
+// sink_enqueue, disk_flush) per thread with no locking. The Chrome trace JSON is
+// written on exit or on "kill -USR1 <pid>"; open it in https://ui.perfetto.dev
+//
+// Outputs: the polling loop only fills one sample per round and publishes it on the
+// sample bus (obd_bus.c). CSV, binary log, rollups, shared memory and the /samples
+// HTTP ring are sinks (obd_sinks.c), each with its own thread and bounded queue, and
+// all of them read the same batch. A slow sink drops rounds (counted in
+// obd_ring_overflows_total and the bus summary line) instead of stalling the adapter.
+//
+// Live samples: every decoded value is also published to /dev/shm/obd_samples
+// (obd_shm.c), a seqlock-protected ring with the channel schema in its header.
+// Local readers map it with obd_shm_attach() and never touch the disk; see
+// obd_shm_tail.c. -s picks another name, -s none turns it off.
 //
 // Summary:
 // ========
@@ -47,8 +173,11 @@
 //
 // USB support    Logs to USB at /media/pi/OBD_USB if present
 // Rotation       Automatically removes log files older than 7 days
-// DTCs           Scans and logs DTCs every 60 seconds
+// DTCs           Checks 0101 every 10 s, logs codes as they appear or clear
 // Directory      Stores logs in timestamped CSV files
+// Rollups        1 s / 1 min / 1 h aggregates per channel for fast history queries
+// Metrics        Prometheus endpoint with command latency histograms and adapter counters
+// Live samples   Shared memory ring for local readers, no disk I/O
 // Background     Suitable for systemd service setup
 //
 //
@@ -128,22 +257,52 @@
 #include <signal.h>
 #include <errno.h>
 #include <sys/stat.h>
-#include <sys/socket.h>
-#include <bluetooth/bluetooth.h>
-#include <bluetooth/rfcomm.h>
+
+#include "obd_device.h"
+#include "obd_pids.h"
+#include "obd_rollup.h"
+#include "obd_bus.h"
+#include "obd_sinks.h"
+#include "obd_session.h"
+#include "obd_metrics.h"
+#include "obd_http.h"
+#include "obd_trace.h"
+#include "obd_shm.h"
+#include "obd_capture.h"
+#include "obd_fault.h"
+#include "obd_expr.h"
+#include "obd_alert.h"
+#include "obd_trip.h"
+#include "obd_dtc.h"
+#include "obd_snapshot.h"
+#include "obd_vehicle.h"
+#include "obd_monitor.h"
+#include "obd_baud.h"
+#include "obd_time.h"
 
 #define BT_ADDR "00:1D:A5:68:98:8B"
-#define RFCOMM_CHANNEL 1
 #define DEFAULT_DIR "/home/pi/obd_logs"
 #define USB_DIR "/media/pi/OBD_USB"
 #define RETENTION_DAYS 7
+#define DTC_HISTORY_FILE "dtc_history.bin"
+#define METRICS_PORT 9101
+#define METRICS_SUMMARY_SEC 60
+#define HTTP_SAMPLES 600
+#define POLL_INTERVAL_MS 1000
+#define MAX_PIDS_PER_REQUEST 6
 
 volatile sig_atomic_t keep_running = 1;
 
+volatile sig_atomic_t trace_dump_requested = 0;
+
 void int_handler(int dummy) {
     keep_running = 0;
 }
 
+void usr1_handler(int dummy) {
+    trace_dump_requested = 1;
+}
+
 int usb_available() {
     struct stat st;
     return (stat(USB_DIR, &st) == 0 && S_ISDIR(st.st_mode));
@@ -168,13 +327,15 @@ void cleanup_old_logs(const char* dir, int days) {
     time_t now = time(NULL);
 
     while ((entry = readdir(d)) != NULL) {
-        if (entry->d_name[0] == '.') continue;
+        if (entry->d_name[0] == '.' || strcmp(entry->d_name, DTC_HISTORY_FILE) == 0 ||
+            strcmp(entry->d_name, OBD_VEHICLE_CACHE_FILE) == 0 || strcmp(entry->d_name, OBD_BAUD_CACHE_FILE) == 0)
+            continue;
 
         char fullpath[512];
         snprintf(fullpath, sizeof(fullpath), "%s/%s", dir, entry->d_name);
 
         struct stat st;
-        if (stat(fullpath, &st) == 0) {
+        if (stat(fullpath, &st) == 0 && S_ISREG(st.st_mode)) {
             double age_days = difftime(now, st.st_mtime) / (60 * 60 * 24);
             if (age_days > days) {
                 remove(fullpath);
@@ -194,126 +355,562 @@ char* make_log_path(const char* dir, const char* prefix, const char* ext) {
     return path;
 }
 
-void send_obd_command(int sock, const char* cmd, char* response, int maxlen) {
-    char full_cmd[64];
-    snprintf(full_cmd, sizeof(full_cmd), "%s\r", cmd);
-    write(sock, full_cmd, strlen(full_cmd));
-    usleep(300000);
-    memset(response, 0, maxlen);
-    read(sock, response, maxlen);
+void print_metrics(FILE* out, const char* query, void* ctx) {
+    metrics_write_prometheus((obd_metrics_t*)ctx, out);
 }
 
-int parse_response(const char* response, const char* expected_pid, int* bytes, unsigned char* out) {
-    const char* p = strstr(response, expected_pid);
-    if (!p) return -1;
-    int hex_vals[8];
-    int n = sscanf(p + strlen(expected_pid), "%x %x %x %x %x %x %x %x",
-                   &hex_vals[0], &hex_vals[1], &hex_vals[2], &hex_vals[3],
-                   &hex_vals[4], &hex_vals[5], &hex_vals[6], &hex_vals[7]);
-    *bytes = n;
-    for (int i = 0; i < n; ++i) out[i] = (unsigned char)hex_vals[i];
-    return 0;
+static obd_pid_table_t pid_table;
+static obd_trip_t trips;
+
+static obd_dtc_t dtcs;
+static obd_dtc_history_t dtc_history;
+static obd_snapshot_t snapshots;
+static obd_monitor_t monitors;
+
+// Serial link speed-up, see obd_baud.h; 0 = off
+static int max_baud = OBD_BAUD_MAX;
+static char baud_cache[512];
+
+void log_dtc(void* ctx, const char* code, int kind, int cleared) {
+    FILE* dtc_log = ctx;
+    time_t now = time(NULL);
+    char ts[64];
+    strftime(ts, sizeof(ts), "%Y-%m-%d %H:%M:%S", localtime(&now));
+    fprintf(dtc_log, "%s,%s,%s,%s\n", ts, cleared ? "cleared" : "new", code, OBD_DTC_KIND_NAMES[kind]);
+    printf("DTC %s %s (%s)\n", code, cleared ? "cleared" : "set", OBD_DTC_KIND_NAMES[kind]);
+    if (!cleared && kind == OBD_DTC_STORED) obd_trip_dtc(&trips, code);
+
+    if (!cleared && kind != OBD_DTC_PERMANENT) {
+        char event[48];
+        snprintf(event, sizeof(event), "dtc %s %s", code, OBD_DTC_KIND_NAMES[kind]);
+        obd_snapshot_trigger(&snapshots, event, -1, obd_snapshot_now(&snapshots));
+    }
+}
+
+void snapshot_alert(void* ctx, const obd_alert_rule_t* rule, double value, int64_t t_us) {
+    char event[48];
+    snprintf(event, sizeof(event), "alert %s", rule->name);
+    obd_snapshot_trigger(ctx, event, rule->channel, t_us);
 }
 
-void decode_dtc(const unsigned char* data, int len, FILE* dtc_log, const char* timestamp) {
-    if (len < 3 || data[0] != 0x43) return;
+static obd_metrics_t metrics;
+static obd_bus_t bus;
+static obd_derived_set_t derived;
+
+// Gasoline: stoichiometric AFR 14.7, 745 g/L, ~250 g/kWh at the crank
+static const char* const DEFAULT_DERIVED[] = {
+    "FuelRate L/h 2 = MAF / 14.7 / 745 * 3600",
+    "FuelUsed L 3 = integrate(FuelRate) / 3600",
+    "Distance km 3 = integrate(Speed) / 3600",
+    "Economy L/100km 1 = FuelRate * 100 / Speed",
+    "Power kW 1 = MAF / 14.7 * 3600 / 250",
+    NULL
+};
+static obd_alerts_t alerts;
+
+static const char* const DEFAULT_ALERTS[] = {
+    "Overheat: Coolant > 105 clear 100 for 5s",
+    "Overrev: RPM > 6000 clear 5500",
+    NULL
+};
+static obd_capture_t capture;
+static obd_replay_t replay;
+
+static int64_t replay_clock(void* arg) {
+    return obd_replay_unix_us(arg);
+}
+static obd_fault_t fault;
+static int fault_injection;
+
+// Replayed after an adapter reset and after every reconnect; no spaces and
+// no headers in the replies unless -w spaced
+static const char* const ADAPTER_SETUP[] = { "AT E0", "AT L0", "AT S0", "AT H0", "AT SP 0", NULL };
+static const char* const ADAPTER_SETUP_SPACED[] = { "AT E0", "AT L0", "AT S1", "AT H0", "AT SP 0", NULL };
+
+static int reconnect_adapter(obd_session_t* s, void* arg) {
+    const char* device = arg;
+
+    if (fault_injection) return obd_fault_reconnect(&fault);
+    if (!device) return -1;
 
-    for (int i = 1; i + 1 < len && (data[i] != 0x00 || data[i+1] != 0x00); i += 2) {
-        char dtc[6];
-        char first = 'P';
-        switch ((data[i] & 0xC0) >> 6) {
-            case 1: first = 'C'; break;
-            case 2: first = 'B'; break;
-            case 3: first = 'U'; break;
+    fprintf(stderr, "Adapter link lost, reconnecting to %s...\n", device);
+    if (s->fd >= 0) close(s->fd);
+    obd_session_set_fd(s, obd_device_open(device));
+    if (s->fd < 0) return -1;
+
+    // The adapter may still be at the negotiated rate, or back at the start one
+    obd_baud_t baud;
+    if (max_baud > 0) obd_baud_negotiate(&baud, s, max_baud, 0, device, baud_cache);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    uint64_t started_us = obd_now_us();
+    const char* device = BT_ADDR;
+    const char* shm_name = OBD_SHM_DEFAULT_NAME;
+    const char* format = "csv";
+    const char* log_dir = NULL;
+    int metrics_port = METRICS_PORT;
+    int interval_ms = POLL_INTERVAL_MS;
+    int per_request = 1;
+    const char* capture_path = NULL;
+    char* replay_path = NULL;
+    double replay_speed = 1;
+    const char* fault_spec = NULL;
+    int timeout_ms = OBD_DEFAULT_TIMEOUT_MS;
+    const char* derived_path = NULL;
+    const char* alerts_path = NULL;
+    const char* segments = "trip";
+    const char* snapshot_spec = "30:5";
+    const char* pids_path = NULL;
+    int monitor_s = OBD_MONITOR_INTERVAL_S;
+    const char* wire = "compact";
+    int opt;
+
+    while ((opt = getopt(argc, argv, "a:B:b:c:d:E:F:f:g:i:M:m:o:p:r:s:T:t:w:x:")) != -1) {
+        switch (opt) {
+            case 'B': per_request = atoi(optarg); break;
+            case 'b': max_baud = strcmp(optarg, "none") == 0 ? 0 : atoi(optarg); break;
+            case 'c': capture_path = optarg; break;
+            case 'r': replay_path = optarg; break;
+            case 'd': device = optarg; break;
+            case 'F': fault_spec = optarg; break;
+            case 'f': format = optarg; break;
+            case 'i': interval_ms = atoi(optarg); break;
+            case 'o': log_dir = optarg; break;
+            case 'm': metrics_port = atoi(optarg); break;
+            case 's': shm_name = optarg; break;
+            case 'T': timeout_ms = atoi(optarg); break;
+            case 't': trace_init(optarg); break;
+            case 'x': derived_path = optarg; break;
+            case 'a': alerts_path = optarg; break;
+            case 'g': segments = optarg; break;
+            case 'E': snapshot_spec = optarg; break;
+            case 'p': pids_path = optarg; break;
+            case 'M': monitor_s = strcmp(optarg, "none") == 0 ? 0 : atoi(optarg); break;
+            case 'w': wire = optarg; break;
+            default:
+                fprintf(stderr, "Usage: %s [-d device] [-o log_dir] [-f csv|bin|both] [-i interval_ms] [-B pids_per_request] [-m metrics_port (0 = off)] [-t trace.json] [-s shm_name|none] [-c capture.cap | -r capture.cap[@speed]] [-T command_timeout_ms] [-F fault_spec] [-x derived.conf|none] [-a alerts.conf|none] [-g trip[:end_s]|run] [-E pre_s:burst_s|none] [-p pids.conf] [-M monitor_s|none] [-b max_baud|none] [-w compact|spaced]\n", argv[0]);
+                return 1;
         }
-        snprintf(dtc, sizeof(dtc), "%c%01X%02X", first, (data[i] & 0x3F) >> 4,
-                 ((data[i] & 0x0F) << 4) | (data[i+1] >> 4));
-        fprintf(dtc_log, "%s,DTC,%s\n", timestamp, dtc);
     }
-}
 
-int main() {
     signal(SIGINT, int_handler);
+    signal(SIGTERM, int_handler);
+    signal(SIGUSR1, usr1_handler);
+    trace_thread_name("acquisition");
+
+    if (replay_path) {
+        char* at = strrchr(replay_path, '@');
+        if (at) {
+            *at = '\0';
+            replay_speed = atof(at + 1);
+        }
+        // The capture sets the pace
+        interval_ms = 0;
+    }
+    if (per_request < 1) per_request = 1;
+    if (per_request > MAX_PIDS_PER_REQUEST) per_request = MAX_PIDS_PER_REQUEST;
+
+    metrics_init(&metrics);
+
+    // Manufacturer PIDs join the table after the mode 01 ones
+    obd_pid_table_init(&pid_table);
+    if (pids_path) {
+        int added = obd_pid_table_load(&pid_table, pids_path);
+        if (added < 0) return 1;
+        printf("Extended PIDs: %d from %s, %d requests per round\n", added, pids_path, pid_table.nrequests);
+    }
 
-    const char* log_dir = get_log_dir();
+    if (!log_dir) log_dir = get_log_dir();
+    else mkdir(log_dir, 0755);
     cleanup_old_logs(log_dir, RETENTION_DAYS);
 
-    struct sockaddr_rc addr = { 0 };
-    int sock, dtc_timer = 0;
+    int sock;
     char response[256];
-    unsigned char data[8];
-    int len;
 
-    char* obd_path = make_log_path(log_dir, "obd_log", "csv");
-    char* dtc_path = make_log_path(log_dir, "dtc_log", "csv");
+    // make_log_path() returns a static buffer, keep our own copies
+    char obd_path[512], bin_path[512], dtc_path[512], alert_path[512], monitor_path[512];
+    snprintf(obd_path, sizeof(obd_path), "%s", make_log_path(log_dir, "obd_log", "csv"));
+    snprintf(bin_path, sizeof(bin_path), "%s", make_log_path(log_dir, "obd_log", "bin"));
+    snprintf(dtc_path, sizeof(dtc_path), "%s", make_log_path(log_dir, "dtc_log", "csv"));
+    snprintf(alert_path, sizeof(alert_path), "%s", make_log_path(log_dir, "alert_log", "csv"));
+    snprintf(monitor_path, sizeof(monitor_path), "%s", make_log_path(log_dir, "monitor_log", "csv"));
+    FILE* monitor_log = NULL;       // opened with the first readout
+    obd_monitor_init(&monitors, monitor_s);
 
-    FILE* log = fopen(obd_path, "w");
     FILE* dtc_log = fopen(dtc_path, "w");
-
-    if (!log || !dtc_log) {
+    if (!dtc_log) {
         perror("fopen");
         return 1;
     }
 
-    fprintf(log, "Timestamp,RPM,Speed,Coolant,Intake,Throttle,MAP,Load,FuelPress,Timing,MAF\n");
+    obd_session_t session;
+    if (replay_path) {
+        if (obd_replay_open(&replay, replay_path, replay_speed) != 0) {
+            fclose(dtc_log);
+            return 1;
+        }
+        obd_session_init_transport(&session, &OBD_REPLAY_TRANSPORT, &replay, &metrics);
+        printf("Replaying %s (%s) at %s\n", replay_path, replay.hdr->device,
+               replay_speed > 0 ? "recorded pace" : "full speed");
+    } else {
+        sock = obd_device_open(device);
+        if (sock < 0) {
+            fclose(dtc_log);
+            return 1;
+        }
+        obd_session_init(&session, sock, &metrics);
+    }
+    session.timeout_ms = timeout_ms;
+    obd_session_set_recovery(&session, strcmp(wire, "spaced") == 0 ? ADAPTER_SETUP_SPACED : ADAPTER_SETUP,
+                             reconnect_adapter, replay_path ? NULL : (void*)device);
+
+    if (fault_spec) {
+        if (obd_fault_init(&fault, fault_spec, session.ops, session.ctx) != 0) return 1;
+        session.ops = &OBD_FAULT_TRANSPORT;
+        session.ctx = &fault;
+        fault_injection = 1;
+        printf("Injecting faults: %s\n", fault_spec);
+    }
 
-    sock = socket(AF_BLUETOOTH, SOCK_STREAM, BTPROTO_RFCOMM);
-    addr.rc_family = AF_BLUETOOTH;
-    addr.rc_channel = RFCOMM_CHANNEL;
-    str2ba(BT_ADDR, &addr.rc_bdaddr);
+    if (capture_path && !replay_path && obd_capture_create(&capture, capture_path, device) == 0) {
+        obd_session_set_capture(&session, &capture);
+        printf("Capturing adapter traffic to %s\n", capture_path);
+    }
 
-    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
-        perror("connect");
-        fclose(log); fclose(dtc_log);
+    // Wired adapters only, before the reset: one left at a faster rate by an
+    // earlier run would not understand it
+    snprintf(baud_cache, sizeof(baud_cache), "%s/%s", log_dir, OBD_BAUD_CACHE_FILE);
+    obd_baud_t baud;
+    if (!replay_path && max_baud > 0 && obd_baud_negotiate(&baud, &session, max_baud, OBD_BAUD_MEASURE, device,
+                                                           baud_cache) > 0) {
+        if (baud.resumed) {
+            printf("Baud: %d (still set from an earlier run)\n", baud.baud);
+        } else if (baud.baud != baud.from) {
+            printf("Baud: %d -> %d (%d handshake%s%s), %.0f -> %.0f bytes/s, %.1f -> %.1f samples/s\n",
+                   baud.from, baud.baud, baud.attempts, baud.attempts == 1 ? "" : "s", baud.cached ? ", cached" : "",
+                   baud.bytes_per_s[0], baud.bytes_per_s[1], baud.samples_per_s[0], baud.samples_per_s[1]);
+        } else {
+            printf("Baud: %d, no faster rate%s\n", baud.baud, baud.cached ? " (cached)" : "");
+        }
+    }
+
+    // No AT Z: it takes a second, and would put the adapter back at its power-on rate
+    obd_init_t init;
+    obd_session_init_adapter(&session, &init);
+    printf("Adapter init: %.0f ms (%s, %d commands, %d already set%s)\n", init.elapsed_us / 1000.0, init.reset,
+           init.commands, init.skipped, init.failed ? ", some failed" : "");
+
+    // Stamped on every log segment; the slow multi-frame reads only for a new vehicle
+    obd_vehicle_t vehicle;
+    char vehicle_cache[512], vehicle_info[256] = "";
+    snprintf(vehicle_cache, sizeof(vehicle_cache), "%s/%s", log_dir, OBD_VEHICLE_CACHE_FILE);
+    if (obd_vehicle_read(&vehicle, &session, replay_path ? replay.hdr->device : device, vehicle_cache) == 0) {
+        obd_vehicle_format(&vehicle, vehicle_info, sizeof(vehicle_info));
+        printf("Vehicle: %s%s\n", vehicle_info, vehicle.cached ? " (cached)" : "");
+    }
+
+    // Every output is a sink on the sample bus with its own thread and queue
+    obd_derived_init(&derived, pid_table.pids, pid_table.count);
+    if (!derived_path) {
+        for (int i = 0; DEFAULT_DERIVED[i]; ++i) obd_derived_add(&derived, DEFAULT_DERIVED[i]);
+    } else if (strcmp(derived_path, "none") != 0 && obd_derived_load(&derived, derived_path) < 0) {
+        fclose(dtc_log);
+        return 1;
+    }
+    obd_bus_init(&bus, derived.channels, derived.nchannels, &metrics);
+    obd_bus_set_info(&bus, vehicle_info);
+
+    int by_trip = strncmp(segments, "trip", 4) == 0;
+    obd_trip_init(&trips, derived.channels, derived.nchannels,
+                  segments[4] == ':' ? atoi(segments + 5) : OBD_TRIP_END_S);
+    obd_dtc_init(&dtcs, log_dtc, dtc_log);
+    char history_path[512];
+    snprintf(history_path, sizeof(history_path), "%s/%s", log_dir, DTC_HISTORY_FILE);
+    if (obd_dtc_history_open(&dtc_history, history_path) == 0) obd_dtc_set_history(&dtcs, &dtc_history);
+    else fprintf(stderr, "DTC history disabled\n");
+
+    // Alert rules may watch derived channels too
+    obd_alerts_init(&alerts, derived.channels, derived.nchannels);
+    if (!alerts_path) {
+        for (int i = 0; DEFAULT_ALERTS[i]; ++i) obd_alert_add(&alerts, DEFAULT_ALERTS[i]);
+    } else if (strcmp(alerts_path, "none") != 0 && obd_alerts_load(&alerts, alerts_path) < 0) {
+        fclose(dtc_log);
+        return 1;
+    }
+    if (alerts.nrules > 0 && obd_alerts_start(&alerts, alert_path, OBD_ALERT_SOCKET, &metrics) != 0) {
+        fclose(dtc_log);
         return 1;
     }
 
-    send_obd_command(sock, "AT Z", response, sizeof(response));
-    send_obd_command(sock, "AT E0", response, sizeof(response));
-    send_obd_command(sock, "AT L0", response, sizeof(response));
-    send_obd_command(sock, "AT SP 0", response, sizeof(response));
+    if (strcmp(snapshot_spec, "none") != 0) {
+        int pre_s = OBD_SNAPSHOT_PRE_S, burst_s = OBD_SNAPSHOT_BURST_S;
+        sscanf(snapshot_spec, "%d:%d", &pre_s, &burst_s);
+        if (obd_snapshot_init(&snapshots, derived.channels, derived.nchannels, OBD_PID_COUNT, log_dir,
+                              pre_s, burst_s) == 0) {
+            if (replay_path) obd_snapshot_set_clock(&snapshots, replay_clock, &replay);
+            alerts.on_fire = snapshot_alert;
+            alerts.on_fire_ctx = &snapshots;
+        }
+    }
+
+    if (by_trip) {
+        if (strcmp(format, "bin") != 0) obd_sink_csv_trips(&bus, log_dir);
+        if (strcmp(format, "csv") != 0) obd_sink_store_trips(&bus, log_dir);
+        obd_sink_trip_summary(&bus, &trips, log_dir);
+    } else {
+        if (strcmp(format, "bin") != 0 && obd_sink_csv(&bus, obd_path) < 0) {
+            fclose(dtc_log);
+            return 1;
+        }
+        if (strcmp(format, "csv") != 0 && obd_sink_store(&bus, bin_path) < 0) {
+            fclose(dtc_log);
+            return 1;
+        }
+    }
+
+    // Rollup tiers live next to the raw segments, 1 s buckets follow retention
+    char rollup_dir[512];
+    snprintf(rollup_dir, sizeof(rollup_dir), "%s/rollup", log_dir);
+    obd_sink_rollup(&bus, rollup_dir);
+
+    char rollup_1s_dir[600];
+    snprintf(rollup_1s_dir, sizeof(rollup_1s_dir), "%s/%s", rollup_dir, ROLLUP_TIER_NAMES[0]);
+    cleanup_old_logs(rollup_1s_dir, RETENTION_DAYS);
+
+    // Live sample ring for local readers; logging goes on without it
+    if (strcmp(shm_name, "none") != 0 && obd_sink_shm(&bus, shm_name, OBD_SHM_DEFAULT_ROWS) >= 0)
+        printf("Live samples in /dev/shm%s\n", shm_name);
+
+    if (metrics_port > 0) {
+        http_route("/metrics", "text/plain; version=0.0.4", print_metrics, &metrics);
+        obd_sink_http_ring(&bus, "/samples", HTTP_SAMPLES);
+        if (http_start(metrics_port) == 0)
+            printf("Metrics on http://0.0.0.0:%d/metrics, samples on /samples\n", metrics_port);
+    }
+
+    if (obd_bus_start(&bus) != 0) {
+        fclose(dtc_log);
+        return 1;
+    }
 
     printf("Logging OBD-II data. Press Ctrl+C to stop.\n");
 
+    metrics_hist_t* loop_hist = metrics_histogram(&metrics, "obd_loop_duration_seconds",
+                                                  "Time to poll all PIDs and publish one round.", NULL, NULL);
+    uint64_t last_summary = obd_now_us();
+    uint64_t last_voltage = 0;
+    int first_sample = 1;
+
     while (keep_running) {
-        time_t now = time(NULL);
+        uint64_t loop_start = obd_now_us();
+        uint64_t loop_span = TRACE_BEGIN();
+        int64_t now_us = obd_unix_now_us();
         char ts[64];
-        strftime(ts, sizeof(ts), "%Y-%m-%d %H:%M:%S", localtime(&now));
-
-        int rpm = -1, spd = -1, cool = -1, intake = -1, thr = -1;
-        int map = -1, load = -1, fuel = -1, timing = -1;
-        float maf = -1.0f;
-
-        send_obd_command(sock, "010C", response, sizeof(response)); if (parse_response(response, "41 0C", &len, data)==0&&len>=2) rpm=((data[0]<<8)+data[1])/4;
-        send_obd_command(sock, "010D", response, sizeof(response)); if (parse_response(response, "41 0D", &len, data)==0) spd=data[0];
-        send_obd_command(sock, "0105", response, sizeof(response)); if (parse_response(response, "41 05", &len, data)==0) cool=data[0]-40;
-        send_obd_command(sock, "010F", response, sizeof(response)); if (parse_response(response, "41 0F", &len, data)==0) intake=data[0]-40;
-        send_obd_command(sock, "0111", response, sizeof(response)); if (parse_response(response, "41 11", &len, data)==0) thr=(int)(data[0]*100.0/255.0);
-        send_obd_command(sock, "010B", response, sizeof(response)); if (parse_response(response, "41 0B", &len, data)==0) map=data[0];
-        send_obd_command(sock, "0104", response, sizeof(response)); if (parse_response(response, "41 04", &len, data)==0) load=(int)(data[0]*100.0/255.0);
-        send_obd_command(sock, "010A", response, sizeof(response)); if (parse_response(response, "41 0A", &len, data)==0) fuel=data[0]*3;
-        send_obd_command(sock, "010E", response, sizeof(response)); if (parse_response(response, "41 0E", &len, data)==0) timing=(int)(data[0]/2)-64;
-        send_obd_command(sock, "0110", response, sizeof(response)); if (parse_response(response, "41 10", &len, data)==0&&len>=2) maf=((data[0]<<8)+data[1])/100.0f;
-
-        fprintf(log, "%s,%d,%d,%d,%d,%d,%d,%d,%d,%d,%.2f\n", ts, rpm, spd, cool, intake, thr, map, load, fuel, timing, maf);
-        fflush(log);
-
-        if (++dtc_timer >= 60) {
-            dtc_timer = 0;
-            send_obd_command(sock, "03", response, sizeof(response));
-            if (parse_response(response, "43", &len, data)==0 && len > 1) {
-                decode_dtc(data, len, dtc_log, ts);
-                fflush(dtc_log);
+        obd_format_time(ts, sizeof(ts), now_us);
+
+        obd_batch_t* batch = obd_batch_new(1);
+        if (!batch) {
+            perror("malloc");
+            break;
+        }
+        obd_sample_t* sample = &batch->samples[0];
+        sample->t_us = now_us;
+        int64_t* replay_t_us = replay_path ? &sample->t_us : NULL;
+        uint64_t reply_us = obd_now_us();
+
+        // Channels the ECU did not answer stay invalid (-1 in the CSV)
+        for (int i = 0; per_request > 1 && i < OBD_PID_COUNT; i += per_request) {
+            int channels[MAX_PIDS_PER_REQUEST], found[MAX_PIDS_PER_REQUEST];
+            double values[MAX_PIDS_PER_REQUEST];
+            char cmd[3 + 2 * MAX_PIDS_PER_REQUEST] = "01";
+            int n = 0;
+
+            for (; n < per_request && i + n < OBD_PID_COUNT; ++n) {
+                channels[n] = i + n;
+                strcat(cmd, OBD_PIDS[i + n].command + 2);
+            }
+
+            obd_session_query(&session, cmd, response, sizeof(response));
+            reply_us = obd_now_us();
+            if (replay_t_us && i == 0) *replay_t_us = obd_replay_unix_us(&replay);
+
+            uint64_t span = TRACE_BEGIN();
+            obd_pid_parse_multi(response, channels, n, values, found);
+            for (int k = 0; k < n; ++k) {
+                if (!found[k]) continue;
+                obd_sample_set(sample, channels[k], values[k]);
+                obd_alerts_update(&alerts, channels[k], values[k], sample->t_us, reply_us);
+            }
+            TRACE_END("parse", span, cmd);
+        }
+
+        for (int i = 0; per_request == 1 && i < OBD_PID_COUNT; ++i) {
+            const obd_pid_t* pid = &OBD_PIDS[i];
+
+            obd_session_query(&session, pid->command, response, sizeof(response));
+            reply_us = obd_now_us();
+            if (replay_t_us && i == 0) *replay_t_us = obd_replay_unix_us(&replay);
+
+            uint64_t span = TRACE_BEGIN();
+            double value;
+            int found;
+            int parsed = obd_pid_parse_multi(response, &i, 1, &value, &found) == 1;
+            TRACE_END("parse", span, pid->command);
+
+            if (parsed) {
+                obd_sample_set(sample, i, value);
+                obd_alerts_update(&alerts, i, value, sample->t_us, reply_us);
+            }
+        }
+
+        // Extended PIDs: the compiled request list, AT SH only where the header changes
+        for (int r = 0; r < pid_table.nrequests; ++r) {
+            const obd_pid_request_t* req = &pid_table.requests[r];
+            const obd_pid_t* pids = &pid_table.pids[req->first];
+            int found[OBD_MAX_CHANNELS];
+            double values[OBD_MAX_CHANNELS];
+
+            if (req->set_header) obd_session_query(&session, req->set_header, response, sizeof(response));
+            obd_session_query(&session, pids->command, response, sizeof(response));
+            reply_us = obd_now_us();
+
+            uint64_t span = TRACE_BEGIN();
+            obd_pid_parse_extended(response, pids, req->count, values, found);
+            TRACE_END("parse", span, pids->command);
+            for (int k = 0; k < req->count; ++k) {
+                if (!found[k]) continue;
+                obd_sample_set(sample, req->first + k, values[k]);
+                obd_alerts_update(&alerts, req->first + k, values[k], sample->t_us, reply_us);
             }
         }
+        if (pid_table.nrequests > 0) obd_session_query(&session, pid_table.restore_header, response, sizeof(response));
 
-        sleep(1);
+        if (replay_path && replay.finished) {
+            free(batch);
+            break;
+        }
+
+        uint64_t span = TRACE_BEGIN();
+        obd_derived_apply(&derived, sample->t_us, sample->values, &sample->valid);
+        for (int c = derived.first; c < derived.nchannels; ++c) {
+            if (sample->valid & (1u << c)) obd_alerts_update(&alerts, c, sample->values[c], sample->t_us, reply_us);
+        }
+        TRACE_END("derive", span, NULL);
+
+        // The adapter answers AT RV with the ECU asleep, so voltage tells a parked car
+        if (by_trip && obd_now_us() - last_voltage >= OBD_TRIP_VOLTAGE_S * 1000000ull) {
+            last_voltage = obd_now_us();
+            obd_session_query(&session, "AT RV", response, sizeof(response));
+            obd_trip_voltage(&trips, response);
+        }
+        if (by_trip && obd_trip_update(&trips, sample)) {
+            printf("Trip started (%s)\n", ts);
+            // Codes still set are part of the new trip too
+            char code[6];
+            for (int k = 0; k < dtcs.ncodes[OBD_DTC_STORED]; ++k) {
+                obd_dtc_format(dtcs.codes[OBD_DTC_STORED][k], code);
+                obd_trip_dtc(&trips, code);
+            }
+            fflush(stdout);
+        }
+
+        if (first_sample && sample->valid) {
+            printf("First sample %.0f ms after start\n", (obd_now_us() - started_us) / 1000.0);
+            fflush(stdout);
+            first_sample = 0;
+        }
+
+        obd_snapshot_record(&snapshots, sample);
+        span = TRACE_BEGIN();
+        obd_bus_publish(&bus, batch);
+        TRACE_END("sink_enqueue", span, "bus");
+
+        if (obd_dtc_poll(&dtcs, &session, obd_now_us()) > 0) {
+            fflush(dtc_log);
+            fflush(stdout);
+        }
+
+        metrics_observe(loop_hist, obd_now_us() - loop_start);
+        TRACE_END("loop", loop_span, NULL);
+
+        if (trace_dump_requested) {
+            trace_dump_requested = 0;
+            trace_dump();
+        }
+        if (obd_now_us() - last_summary >= METRICS_SUMMARY_SEC * 1000000ull) {
+            char summary[512];
+            metrics_summary(&metrics, summary, sizeof(summary));
+            printf("%s\n", summary);
+            obd_bus_summary(&bus, summary, sizeof(summary));
+            printf("%s\n", summary);
+            fflush(stdout);
+            obd_capture_flush(session.capture);
+            last_summary = obd_now_us();
+        }
+
+        // Fixed rate: the next round starts interval_ms after this one did; a snapshot
+        // burst polls its PIDs in the time between, mode 06 gets what is left
+        obd_snapshot_run(&snapshots, &session, loop_start + interval_ms * 1000ull);
+        if (obd_monitor_run(&monitors, &session, loop_start + interval_ms * 1000ull)) {
+            int failed = 0;
+            for (int k = 0; k < monitors.nresults; ++k) failed += !monitors.results[k].passed;
+            printf("Monitors: %d tests in %d MIDs, %d failed\n", monitors.nresults, monitors.nmids, failed);
+            if (!monitor_log) monitor_log = fopen(monitor_path, "w");
+            if (monitor_log) {
+                obd_monitor_write_csv(&monitors, monitor_log);
+                fflush(monitor_log);
+            } else {
+                perror(monitor_path);
+            }
+            fflush(stdout);
+        }
+        uint64_t elapsed = obd_now_us() - loop_start;
+        if (interval_ms > 0 && elapsed < interval_ms * 1000ull)
+            usleep((useconds_t)(interval_ms * 1000ull - elapsed));
     }
 
-    fclose(log);
+    obd_bus_stop(&bus);
     fclose(dtc_log);
-    close(sock);
+    if (by_trip) printf("Trips: %llu\n", (unsigned long long)trips.trips);
+    printf("DTCs: %llu status polls, %llu reads, %llu set, %llu cleared\n", (unsigned long long)dtcs.status_polls,
+           (unsigned long long)dtcs.scans, (unsigned long long)dtcs.appeared, (unsigned long long)dtcs.cleared);
+    obd_dtc_history_close(&dtc_history);
+    if (monitor_log) fclose(monitor_log);
+    if (monitor_s > 0)
+        printf("Monitors: %llu readouts, %llu requests\n", (unsigned long long)monitors.readouts,
+               (unsigned long long)monitors.requests);
+    if (snapshots.ring) {
+        obd_snapshot_close(&snapshots);
+        printf("Snapshots: %llu written, %llu suppressed\n", (unsigned long long)snapshots.written,
+               (unsigned long long)snapshots.suppressed);
+    }
+    if (alerts.nrules > 0) {
+        obd_alerts_stop(&alerts);
+        printf("Alerts: %llu fired, %llu dropped\n", (unsigned long long)alerts.fired,
+               (unsigned long long)alerts.dropped);
+    }
+    if (session.capture) {
+        printf("Captured %llu records\n", (unsigned long long)capture.records);
+        obd_capture_close(&capture);
+    }
+    if (replay_path) {
+        printf("Replay: %llu commands, %llu matched, %llu not in the capture\n",
+               (unsigned long long)replay.commands, (unsigned long long)replay.matched,
+               (unsigned long long)replay.missed);
+        obd_replay_close(&replay);
+    } else if (session.fd >= 0) {
+        close(session.fd);
+    }
+    if (fault_injection) {
+        printf("Faults injected:");
+        for (int t = 0; t < OBD_FAULT_TYPES; ++t)
+            printf(" %s=%llu", OBD_FAULT_NAMES[t], (unsigned long long)fault.injected[t]);
+        printf("\n");
+        obd_fault_close(&fault);
+    }
+    trace_dump();
     printf("Logger stopped.\n");
     return 0;
 }
-
@@ -0,0 +1,202 @@
+/*
+ * obd_metrics.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+//
+// Metrics for the OBD session layer.
+//
+// Exposed two ways:
+//
+//    Prometheus text on http://<pi>:9101/metrics (see obd_http.c)
+//
+//    A summary line for the journal, e.g.
+//
+//    metrics: 620 cmds p50<=50ms p99<=250ms timeouts=0 no_data=3 ?=0 buffer_full=0 can_error=0 reconnects=0 garbled=0 resets=0 in=12480B out=3100B overflows=0 folded=0
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "obd_metrics.h"
+
+#define COMMAND_FAMILY "obd_command_latency_seconds"
+
+const uint64_t METRICS_BUCKET_US[METRICS_BUCKETS] = {
+    500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000,
+    1000000, 2500000, 5000000, 10000000, UINT64_MAX
+};
+
+static const struct {
+    const char* name;
+    const char* help;
+    const char* short_name;
+} COUNTERS[M_COUNTERS] = {
+    [M_NO_DATA]       = { "obd_no_data_total",         "Replies reading NO DATA.",               "no_data" },
+    [M_UNKNOWN]       = { "obd_unknown_command_total", "Replies reading ? (command not understood).", "?" },
+    [M_BUFFER_FULL]   = { "obd_buffer_full_total",     "Replies reading BUFFER FULL.",           "buffer_full" },
+    [M_CAN_ERROR]     = { "obd_can_error_total",       "Replies reading CAN ERROR.",             "can_error" },
+    [M_TIMEOUT]       = { "obd_timeouts_total",        "Commands that got no prompt in time.",   "timeouts" },
+    [M_RECONNECT]     = { "obd_reconnects_total",      "Adapter link reconnects.",               "reconnects" },
+    [M_GARBLED]       = { "obd_garbled_replies_total", "OBD replies that failed the format check.", "garbled" },
+    [M_ADAPTER_RESET] = { "obd_adapter_resets_total",  "Adapter resets detected in replies.",    "resets" },
+    [M_BYTES_IN]      = { "obd_bytes_in_total",        "Bytes read from the adapter.",           "in" },
+    [M_BYTES_OUT]     = { "obd_bytes_out_total",       "Bytes written to the adapter.",          "out" },
+    [M_RING_OVERFLOW] = { "obd_ring_overflows_total",  "Samples dropped by full ring buffers.",   "overflows" },
+    [M_FOLDED]        = { "obd_metrics_folded_total",  "Histogram lookups folded into a label=\"other\" series.", "folded" },
+};
+
+static pthread_mutex_t register_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void metrics_init(obd_metrics_t* m) {
+    memset(m, 0, sizeof(*m));
+}
+
+static metrics_hist_t* find(obd_metrics_t* m, int n, const char* family, const char* label) {
+    for (int i = 0; i < n; ++i) {
+        metrics_hist_t* h = &m->hist[i];
+        if (strcmp(h->family, family) == 0 && strcmp(h->label, label) == 0) return h;
+    }
+    return NULL;
+}
+
+metrics_hist_t* metrics_histogram(obd_metrics_t* m, const char* family, const char* help,
+                                  const char* label_name, const char* label) {
+    if (!m) return NULL;
+    if (!label) label = "";
+
+    int n = __atomic_load_n(&m->nhist, __ATOMIC_ACQUIRE);
+    metrics_hist_t* h = find(m, n, family, label);
+    if (h) return h;
+    // Table full for labels: no lock for a label folded before
+    if (label_name && n >= METRICS_MAX_HISTOGRAMS - METRICS_RESERVED &&
+        (h = find(m, n, family, METRICS_OTHER_LABEL))) {
+        metrics_add(m, M_FOLDED, 1);
+        return h;
+    }
+
+    pthread_mutex_lock(&register_lock);
+    n = m->nhist;
+    h = find(m, n, family, label);
+    if (!h && label_name && n >= METRICS_MAX_HISTOGRAMS - METRICS_RESERVED) {
+        label = METRICS_OTHER_LABEL;
+        h = find(m, n, family, label);
+        metrics_add(m, M_FOLDED, 1);
+    }
+    if (!h && n < METRICS_MAX_HISTOGRAMS) {
+        h = &m->hist[n];
+        h->family = family;
+        h->help = help;
+        h->label_name = label_name;
+        snprintf(h->label, sizeof(h->label), "%s", label);
+        __atomic_store_n(&m->nhist, n + 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&register_lock);
+    return h;
+}
+
+void metrics_observe(metrics_hist_t* h, uint64_t usec) {
+    if (!h) return;
+    int b = 0;
+    while (usec > METRICS_BUCKET_US[b]) ++b;
+    __atomic_fetch_add(&h->buckets[b], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->sum_us, usec, __ATOMIC_RELAXED);
+}
+
+void metrics_command(obd_metrics_t* m, const char* command, uint64_t usec) {
+    metrics_observe(metrics_histogram(m, COMMAND_FAMILY, "Time from command write to adapter prompt.",
+                                      "command", command), usec);
+}
+
+static uint64_t load(const uint64_t* p) {
+    return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+
+void metrics_write_prometheus(obd_metrics_t* m, FILE* out) {
+    for (int c = 0; c < M_COUNTERS; ++c) {
+        fprintf(out, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n",
+                COUNTERS[c].name, COUNTERS[c].help, COUNTERS[c].name, COUNTERS[c].name,
+                (unsigned long long)load(&m->counters[c]));
+    }
+
+    int n = __atomic_load_n(&m->nhist, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < n; ++i) {
+        const char* family = m->hist[i].family;
+
+        // Emit each family once, at its first histogram
+        int seen = 0;
+        for (int j = 0; j < i && !seen; ++j) seen = (strcmp(m->hist[j].family, family) == 0);
+        if (seen) continue;
+
+        fprintf(out, "# HELP %s %s\n# TYPE %s histogram\n", family, m->hist[i].help, family);
+
+        for (int j = i; j < n; ++j) {
+            metrics_hist_t* h = &m->hist[j];
+            if (strcmp(h->family, family) != 0) continue;
+
+            char sep[64] = "";
+            if (h->label_name) snprintf(sep, sizeof(sep), "%s=\"%s\",", h->label_name, h->label);
+
+            uint64_t cumulative = 0;
+            for (int b = 0; b < METRICS_BUCKETS; ++b) {
+                cumulative += load(&h->buckets[b]);
+                if (b == METRICS_BUCKETS - 1)
+                    fprintf(out, "%s_bucket{%sle=\"+Inf\"} %llu\n", family, sep, (unsigned long long)cumulative);
+                else
+                    fprintf(out, "%s_bucket{%sle=\"%g\"} %llu\n", family, sep,
+                            METRICS_BUCKET_US[b] / 1e6, (unsigned long long)cumulative);
+            }
+
+            if (h->label_name) snprintf(sep, sizeof(sep), "{%s=\"%s\"}", h->label_name, h->label);
+            fprintf(out, "%s_sum%s %.6f\n", family, sep, load(&h->sum_us) / 1e6);
+            fprintf(out, "%s_count%s %llu\n", family, sep, (unsigned long long)load(&h->count));
+        }
+    }
+}
+
+// Upper bound (ms) of the bucket holding the q-quantile, -1 if empty.
+static double quantile_ms(const uint64_t* buckets, uint64_t total, double q) {
+    if (total == 0) return -1;
+    uint64_t rank = (uint64_t)(q * total + 0.5), seen = 0;
+    if (rank == 0) rank = 1;
+    for (int b = 0; b < METRICS_BUCKETS - 1; ++b) {
+        seen += buckets[b];
+        if (seen >= rank) return METRICS_BUCKET_US[b] / 1000.0;
+    }
+    return METRICS_BUCKET_US[METRICS_BUCKETS - 2] / 1000.0 + 1;
+}
+
+void metrics_summary(obd_metrics_t* m, char* out, int maxlen) {
+    uint64_t buckets[METRICS_BUCKETS] = { 0 };
+    uint64_t commands = 0;
+
+    int n = __atomic_load_n(&m->nhist, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < n; ++i) {
+        if (strcmp(m->hist[i].family, COMMAND_FAMILY) != 0) continue;
+        for (int b = 0; b < METRICS_BUCKETS; ++b) buckets[b] += load(&m->hist[i].buckets[b]);
+    }
+
+    uint64_t delta[METRICS_BUCKETS];
+    for (int b = 0; b < METRICS_BUCKETS; ++b) {
+        delta[b] = buckets[b] - m->last_buckets[b];
+        m->last_buckets[b] = buckets[b];
+        commands += buckets[b];
+    }
+    uint64_t ncmd = commands - m->last_commands;
+    m->last_commands = commands;
+
+    int pos = snprintf(out, maxlen, "metrics: %llu cmds p50<=%gms p99<=%gms",
+                       (unsigned long long)ncmd, quantile_ms(delta, ncmd, 0.50), quantile_ms(delta, ncmd, 0.99));
+
+    for (int c = 0; c < M_COUNTERS && pos < maxlen; ++c) {
+        uint64_t v = load(&m->counters[c]);
+        uint64_t d = v - m->last_counters[c];
+        m->last_counters[c] = v;
+        const char* unit = (c == M_BYTES_IN || c == M_BYTES_OUT) ? "B" : "";
+        pos += snprintf(out + pos, maxlen - pos, " %s=%llu%s", COUNTERS[c].short_name, (unsigned long long)d, unit);
+    }
+}
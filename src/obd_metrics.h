@@ -0,0 +1,101 @@
+/*
+ * obd_metrics.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+#ifndef OBD_METRICS_H
+#define OBD_METRICS_H
+
+//
+// Latency histograms and adapter health counters.
+//
+// Updates are relaxed atomic adds on preallocated slots, so the hot path
+// never locks or allocates and the whole thing can stay on in production.
+// Histograms are registered once (first use of a name/label) and looked up
+// by a short linear scan afterwards.
+//
+// Labels come from whatever is sent (mode 06 MIDs, broker clients, ...), so
+// the last METRICS_RESERVED slots are kept back: once the others are taken,
+// a new label is folded into its family's label="other" series and counted
+// in obd_metrics_folded_total, rather than dropped.
+//
+
+#include <stdio.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define METRICS_BUCKETS 15
+#define METRICS_MAX_HISTOGRAMS 64
+#define METRICS_RESERVED 8      // unlabelled families and "other" series
+#define METRICS_OTHER_LABEL "other"
+
+// Upper bounds of the histogram buckets in microseconds, the last is +Inf.
+extern const uint64_t METRICS_BUCKET_US[METRICS_BUCKETS];
+
+enum metrics_counter {
+    M_NO_DATA,
+    M_UNKNOWN,           // "?" from the adapter
+    M_BUFFER_FULL,
+    M_CAN_ERROR,
+    M_TIMEOUT,
+    M_RECONNECT,
+    M_GARBLED,           // OBD replies with characters or lengths that cannot be right
+    M_ADAPTER_RESET,     // banner or command echo in a reply: the adapter rebooted
+    M_BYTES_IN,
+    M_BYTES_OUT,
+    M_RING_OVERFLOW,
+    M_FOLDED,            // histogram lookups that went to a label="other" series
+    M_COUNTERS
+};
+
+typedef struct {
+    const char* family;  // e.g. "obd_command_latency_seconds"
+    const char* help;
+    const char* label_name;  // e.g. "command", NULL for unlabelled families
+    char label[24];          // e.g. "010C"
+    uint64_t buckets[METRICS_BUCKETS];
+    uint64_t count;
+    uint64_t sum_us;
+} metrics_hist_t;
+
+typedef struct obd_metrics {
+    uint64_t counters[M_COUNTERS];
+    metrics_hist_t hist[METRICS_MAX_HISTOGRAMS];
+    int nhist;
+
+    // Previous totals, only touched by metrics_summary()
+    uint64_t last_counters[M_COUNTERS];
+    uint64_t last_buckets[METRICS_BUCKETS];
+    uint64_t last_commands;
+} obd_metrics_t;
+
+void metrics_init(obd_metrics_t* m);
+
+static inline void metrics_add(obd_metrics_t* m, enum metrics_counter c, uint64_t n) {
+    if (m) __atomic_fetch_add(&m->counters[c], n, __ATOMIC_RELAXED);
+}
+
+// Family, help and label_name must be string literals; label is copied.
+metrics_hist_t* metrics_histogram(obd_metrics_t* m, const char* family, const char* help,
+                                  const char* label_name, const char* label);
+void metrics_observe(metrics_hist_t* h, uint64_t usec);
+
+// Per-command latency, the family used by the session layer.
+void metrics_command(obd_metrics_t* m, const char* command, uint64_t usec);
+
+// Prometheus text exposition format.
+void metrics_write_prometheus(obd_metrics_t* m, FILE* out);
+
+// One line for the journal with the deltas since the previous call.
+void metrics_summary(obd_metrics_t* m, char* out, int maxlen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,280 @@
+/*
+ * obd_monitor.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "obd_monitor.h"
+#include "obd_pids.h"
+#include "obd_time.h"
+
+// Readout steps
+enum { IDLE, BITMAPS, BITMAPS_MORE, TESTS };
+
+// Unit and scaling
+// ================
+
+typedef struct {
+    double scale;
+    double offset;
+    uint8_t is_signed;
+    const char* unit;
+} uasid_t;
+
+// SAE J1979 appendix E; 0x01-0x3F unsigned, 0x81-0xFE signed. Unknown ones
+// are decoded as raw counts.
+static const uasid_t UASIDS[256] = {
+    [0x01] = { 1, 0, 0, "" },            [0x02] = { 0.1, 0, 0, "" },
+    [0x03] = { 0.01, 0, 0, "" },         [0x04] = { 0.001, 0, 0, "" },
+    [0x05] = { 0.0000305, 0, 0, "" },    [0x06] = { 0.000305, 0, 0, "" },
+    [0x07] = { 0.25, 0, 0, "rpm" },      [0x08] = { 0.01, 0, 0, "km/h" },
+    [0x09] = { 1, 0, 0, "km/h" },        [0x0A] = { 0.122, 0, 0, "mV" },
+    [0x0B] = { 0.001, 0, 0, "V" },       [0x0C] = { 0.01, 0, 0, "V" },
+    [0x0D] = { 0.00390625, 0, 0, "mA" }, [0x0E] = { 0.001, 0, 0, "A" },
+    [0x0F] = { 0.01, 0, 0, "A" },        [0x10] = { 1, 0, 0, "ms" },
+    [0x11] = { 100, 0, 0, "ms" },        [0x12] = { 1, 0, 0, "s" },
+    [0x13] = { 1, 0, 0, "mOhm" },        [0x14] = { 1, 0, 0, "Ohm" },
+    [0x15] = { 1, 0, 0, "kOhm" },        [0x16] = { 0.1, -40, 0, "C" },
+    [0x17] = { 0.01, 0, 0, "kPa" },      [0x18] = { 0.0117, 0, 0, "kPa" },
+    [0x19] = { 0.079, 0, 0, "kPa" },     [0x1A] = { 1, 0, 0, "kPa" },
+    [0x1B] = { 10, 0, 0, "kPa" },        [0x1C] = { 0.01, 0, 0, "deg" },
+    [0x1D] = { 0.5, 0, 0, "deg" },       [0x1E] = { 0.0000305, 0, 0, "lambda" },
+    [0x1F] = { 0.05, 0, 0, "AFR" },      [0x20] = { 0.0039062, 0, 0, "" },
+    [0x21] = { 1, 0, 0, "mHz" },         [0x22] = { 1, 0, 0, "Hz" },
+    [0x23] = { 1, 0, 0, "kHz" },         [0x24] = { 1, 0, 0, "counts" },
+    [0x25] = { 1, 0, 0, "km" },          [0x26] = { 0.1, 0, 0, "mV/ms" },
+    [0x27] = { 0.01, 0, 0, "g/s" },      [0x28] = { 1, 0, 0, "g/s" },
+    [0x29] = { 0.25, 0, 0, "Pa/s" },     [0x2A] = { 0.001, 0, 0, "kg/h" },
+    [0x2B] = { 1, 0, 0, "switches" },    [0x2C] = { 0.01, 0, 0, "g/cyl" },
+    [0x2D] = { 0.01, 0, 0, "mg/stroke" }, [0x2E] = { 1, 0, 0, "" },
+    [0x2F] = { 0.01, 0, 0, "%" },        [0x30] = { 0.001526, 0, 0, "%" },
+    [0x31] = { 0.001, 0, 0, "L" },       [0x33] = { 0.00024414, 0, 0, "lambda" },
+    [0x34] = { 1, 0, 0, "min" },         [0x35] = { 10, 0, 0, "ms" },
+    [0x36] = { 0.01, 0, 0, "g" },        [0x37] = { 0.1, 0, 0, "g" },
+    [0x38] = { 1, 0, 0, "g" },           [0x39] = { 0.01, -327.68, 0, "%" },
+    [0x3A] = { 0.001, 0, 0, "g" },       [0x3B] = { 0.0001, 0, 0, "g" },
+    [0x3C] = { 0.1, 0, 0, "us" },        [0x3D] = { 0.01, 0, 0, "mA" },
+    [0x3F] = { 0.01, 0, 0, "Pa" },
+
+    [0x81] = { 1, 0, 1, "" },            [0x82] = { 0.1, 0, 1, "" },
+    [0x83] = { 0.01, 0, 1, "" },         [0x84] = { 0.001, 0, 1, "" },
+    [0x85] = { 0.0000305, 0, 1, "" },    [0x86] = { 0.000305, 0, 1, "" },
+    [0x8A] = { 0.122, 0, 1, "mV" },      [0x8B] = { 0.001, 0, 1, "V" },
+    [0x8C] = { 0.01, 0, 1, "V" },        [0x8D] = { 0.00390625, 0, 1, "mA" },
+    [0x8E] = { 0.001, 0, 1, "A" },       [0x90] = { 1, 0, 1, "ms" },
+    [0x96] = { 0.1, 0, 1, "C" },         [0x9C] = { 0.01, 0, 1, "deg" },
+    [0x9D] = { 0.5, 0, 1, "deg" },       [0xA8] = { 1, 0, 1, "g/s" },
+    [0xA9] = { 0.25, 0, 1, "Pa/s" },     [0xAD] = { 0.01, 0, 1, "mg/stroke" },
+    [0xAE] = { 0.1, 0, 1, "mg/stroke" }, [0xAF] = { 0.01, 0, 1, "%" },
+    [0xB0] = { 0.003052, 0, 1, "%" },    [0xB1] = { 2, 0, 1, "mV/s" },
+    [0xFC] = { 0.01, 0, 1, "kPa" },      [0xFD] = { 0.001, 0, 1, "kPa" },
+    [0xFE] = { 0.25, 0, 1, "Pa" },
+};
+
+double obd_monitor_scale(int uasid, unsigned int raw, const char** unit) {
+    const uasid_t* u = &UASIDS[uasid & 0xFF];
+    double scale = u->scale != 0 ? u->scale : 1;
+    double x = u->is_signed ? (double)(int16_t)raw : (double)raw;
+
+    if (unit) *unit = u->unit ? u->unit : "";
+    return x * scale + u->offset;
+}
+
+static const struct {
+    uint8_t first, last;
+    const char* name;
+} MID_NAMES[] = {
+    { 0x01, 0x01, "O2 Sensor B1S1" },       { 0x02, 0x02, "O2 Sensor B1S2" },
+    { 0x03, 0x03, "O2 Sensor B1S3" },       { 0x04, 0x04, "O2 Sensor B1S4" },
+    { 0x05, 0x05, "O2 Sensor B2S1" },       { 0x06, 0x06, "O2 Sensor B2S2" },
+    { 0x07, 0x07, "O2 Sensor B2S3" },       { 0x08, 0x08, "O2 Sensor B2S4" },
+    { 0x21, 0x21, "Catalyst Bank 1" },      { 0x22, 0x22, "Catalyst Bank 2" },
+    { 0x31, 0x31, "EGR Bank 1" },           { 0x32, 0x32, "EGR Bank 2" },
+    { 0x35, 0x35, "VVT Bank 1" },           { 0x36, 0x36, "VVT Bank 2" },
+    { 0x39, 0x39, "EVAP 0.150 in" },        { 0x3A, 0x3A, "EVAP 0.090 in" },
+    { 0x3B, 0x3B, "EVAP 0.040 in" },        { 0x3C, 0x3C, "EVAP 0.020 in" },
+    { 0x3D, 0x3D, "Purge Flow" },           { 0x41, 0x48, "O2 Sensor Heater" },
+    { 0x61, 0x64, "Heated Catalyst" },      { 0x71, 0x74, "Secondary Air" },
+    { 0x81, 0x81, "Fuel System Bank 1" },   { 0x82, 0x82, "Fuel System Bank 2" },
+    { 0x85, 0x86, "Boost Pressure" },       { 0x90, 0x91, "NOx Adsorber" },
+    { 0x98, 0x99, "NOx Catalyst" },         { 0xA1, 0xA1, "Misfire General" },
+    { 0xA2, 0xAD, "Misfire Cylinder" },     { 0xB0, 0xB1, "PM Filter" },
+};
+
+const char* obd_monitor_mid_name(int mid) {
+    for (size_t i = 0; i < sizeof(MID_NAMES) / sizeof(MID_NAMES[0]); ++i) {
+        if (mid >= MID_NAMES[i].first && mid <= MID_NAMES[i].last) return MID_NAMES[i].name;
+    }
+    return NULL;
+}
+
+// Replies
+// =======
+
+int obd_monitor_parse_bitmaps(const char* response, uint8_t supported[32]) {
+    unsigned char bytes[256];
+    int len = obd_pid_reply_bytes(response, bytes, sizeof(bytes));
+    int found = 0;
+
+    for (int i = 0; i < len; ) {
+        if (bytes[i++] != 0x46) continue;
+
+        // "46 00 xx xx xx xx 20 xx xx xx xx ...", several ECUs one after another
+        while (i + 5 <= len && bytes[i] % 0x20 == 0) {
+            int base = bytes[i];
+            for (int bit = 0; bit < 32; ++bit) {
+                if (!(bytes[i + 1 + bit / 8] & (0x80 >> (bit % 8)))) continue;
+                int mid = base + 1 + bit;
+                if (mid < 256) supported[mid / 8] |= (uint8_t)(1 << (mid % 8));
+            }
+            found++;
+            i += 5;
+        }
+    }
+    return found;
+}
+
+int obd_monitor_parse_results(const char* response, int mid, obd_monitor_result_t* out, int max) {
+    unsigned char bytes[512];
+    int len = obd_pid_reply_bytes(response, bytes, sizeof(bytes));
+    int n = 0, any = 0;
+
+    for (int i = 0; i < len; ) {
+        if (bytes[i++] != 0x46) continue;
+
+        // MID TID UASID value(2) min(2) max(2), repeated
+        while (i + 9 <= len && bytes[i] == mid) {
+            const unsigned char* b = bytes + i;
+            any = 1;
+            if (n < max) {
+                obd_monitor_result_t* r = &out[n++];
+                r->mid = b[0];
+                r->tid = b[1];
+                r->uasid = b[2];
+                r->value = obd_monitor_scale(b[2], (unsigned)(b[3] << 8 | b[4]), &r->unit);
+                r->min = obd_monitor_scale(b[2], (unsigned)(b[5] << 8 | b[6]), NULL);
+                r->max = obd_monitor_scale(b[2], (unsigned)(b[7] << 8 | b[8]), NULL);
+                r->passed = r->value >= r->min && r->value <= r->max;
+            }
+            i += 9;
+        }
+    }
+    return any ? n : -1;
+}
+
+// Readout
+// =======
+
+static int is_supported(const obd_monitor_t* m, int mid) {
+    return (m->supported[mid / 8] >> (mid % 8)) & 1;
+}
+
+// The first supported data MID from mid on, -1 past the last
+static int data_mid_from(const obd_monitor_t* m, int mid) {
+    for (; mid < 256; ++mid) {
+        if (mid % 0x20 != 0 && is_supported(m, mid)) return mid;
+    }
+    return -1;
+}
+
+static void query(obd_monitor_t* m, obd_session_t* session, const char* cmd, char* response, int maxlen) {
+    uint64_t start = obd_now_us();
+    obd_session_query(session, cmd, response, maxlen);
+    uint64_t took = obd_now_us() - start;
+    if (took > m->request_us) m->request_us = took;
+    m->requests++;
+}
+
+// One request of the readout; 1 when it completed
+static int step(obd_monitor_t* m, obd_session_t* session) {
+    char response[1024], cmd[16];
+
+    switch (m->state) {
+        case BITMAPS:
+            memset(m->supported, 0, sizeof(m->supported));
+            query(m, session, "060020406080A0", response, sizeof(response));
+            if (obd_monitor_parse_bitmaps(response, m->supported) == 0) {
+                // ECU asleep or no mode 06
+                m->state = IDLE;
+                m->next_us = obd_now_us() + OBD_MONITOR_RETRY_S * 1000000ull;
+                return 0;
+            }
+            m->state = is_supported(m, 0xC0) ? BITMAPS_MORE : TESTS;
+            m->next_mid = 1;
+            m->nresults = m->nmids = 0;
+            return 0;
+
+        case BITMAPS_MORE:
+            query(m, session, "06C0E0", response, sizeof(response));
+            obd_monitor_parse_bitmaps(response, m->supported);
+            m->state = TESTS;
+            return 0;
+
+        case TESTS: {
+            int mid = data_mid_from(m, m->next_mid);
+            if (mid >= 0) {
+                snprintf(cmd, sizeof(cmd), "06%02X", mid);
+                query(m, session, cmd, response, sizeof(response));
+                int n = obd_monitor_parse_results(response, mid, m->results + m->nresults,
+                                                  OBD_MONITOR_MAX_RESULTS - m->nresults);
+                if (n > 0) {
+                    m->nresults += n;
+                    m->nmids++;
+                }
+                m->next_mid = mid + 1;
+                if (data_mid_from(m, m->next_mid) >= 0) return 0;
+            }
+            m->state = IDLE;
+            m->t_us = obd_unix_now_us();
+            m->readouts++;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void obd_monitor_init(obd_monitor_t* m, int interval_s) {
+    memset(m, 0, sizeof(*m));
+    m->interval_us = (uint64_t)interval_s * 1000000;
+    m->request_us = 100000;     // a guess until the first request
+    m->state = IDLE;
+}
+
+int obd_monitor_run(obd_monitor_t* m, obd_session_t* session, uint64_t until_us) {
+    if (m->interval_us == 0) return 0;
+    if (m->state == IDLE) {
+        if (obd_now_us() < m->next_us) return 0;
+        m->state = BITMAPS;
+        m->next_us = obd_now_us() + m->interval_us;
+    }
+    while (obd_now_us() + m->request_us <= until_us) {
+        if (step(m, session)) return 1;
+        if (m->state == IDLE) return 0;
+    }
+    return 0;
+}
+
+int obd_monitor_read_all(obd_monitor_t* m, obd_session_t* session) {
+    m->state = BITMAPS;
+    while (!step(m, session)) {
+        if (m->state == IDLE) return -1;
+    }
+    return m->nresults;
+}
+
+void obd_monitor_write_csv(const obd_monitor_t* m, FILE* f) {
+    char ts[32];
+    obd_format_time(ts, sizeof(ts), m->t_us);
+
+    for (int i = 0; i < m->nresults; ++i) {
+        const obd_monitor_result_t* r = &m->results[i];
+        const char* name = obd_monitor_mid_name(r->mid);
+        fprintf(f, "%s,%02X,%s,%02X,%g,%g,%g,%s,%s\n", ts, r->mid, name ? name : "", r->tid, r->value, r->min,
+                r->max, r->unit, r->passed ? "pass" : "fail");
+    }
+}
@@ -0,0 +1,99 @@
+/*
+ * obd_monitor.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+#ifndef OBD_MONITOR_H
+#define OBD_MONITOR_H
+
+//
+// Mode 06: on-board monitor test results (catalyst, O2 sensors, EGR,
+// EVAP, misfire, ...), ISO 15765-4 CAN layout.
+//
+// A readout takes as few requests as the protocol allows:
+//
+//    060020406080A0    the six support bitmaps in one request; 06C0E0 as a
+//                      second one only when A0 says there is more
+//    0621              one request per supported MID, the ECU answers every
+//                      test of the MID in one (multi-frame) reply:
+//
+//    46 21 80 20 00 40 00 00 00 80   MID 21 TID 80 UASID 20 value min max
+//       21 81 24 00 02 00 00 00 0A   MID 21 TID 81 ...
+//
+// Values are decoded through the UASID table of SAE J1979 appendix E
+// (unit, scaling, offset, signed or not) into obd_monitor_result_t, one
+// record per test, passed when min <= value <= max. The bitmap MIDs
+// (00, 20, ...) are never data.
+//
+// Monitor results only change once per drive cycle, so a readout runs every
+// interval_s and only in the idle time between two polling rounds:
+// obd_monitor_run() sends one request at a time while the slowest request
+// seen so far still fits before the next round, and picks the readout up
+// again in the next gap. With no idle time (-i 0) nothing is sent.
+//
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "obd_session.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OBD_MONITOR_INTERVAL_S 1800
+#define OBD_MONITOR_RETRY_S 60          // after an unanswered bitmap request
+#define OBD_MONITOR_MAX_RESULTS 256
+
+typedef struct {
+    uint8_t mid, tid, uasid;
+    double value, min, max;
+    const char* unit;
+    int passed;
+} obd_monitor_result_t;
+
+// Name of a MID ("Catalyst Bank 1"), NULL when not in the table
+const char* obd_monitor_mid_name(int mid);
+
+// Decodes a two byte UASID value; unit may be NULL
+double obd_monitor_scale(int uasid, unsigned int raw, const char** unit);
+
+// Support bits from the reply to a bitmap request; returns how many bitmaps were in it
+int obd_monitor_parse_bitmaps(const char* response, uint8_t supported[32]);
+// The test records of mid in a reply; returns how many were added, -1 without any
+int obd_monitor_parse_results(const char* response, int mid, obd_monitor_result_t* out, int max);
+
+typedef struct {
+    uint64_t interval_us;
+    uint64_t next_us;               // CLOCK_MONOTONIC of the next readout
+    uint64_t request_us;            // slowest request so far
+
+    int state;                      // see obd_monitor.c
+    uint8_t supported[32];          // bit per MID
+    int next_mid;
+
+    obd_monitor_result_t results[OBD_MONITOR_MAX_RESULTS];
+    int nresults;
+    int nmids;                      // MIDs with results in the last readout
+    int64_t t_us;                   // unix time the last readout completed
+
+    uint64_t readouts, requests;
+} obd_monitor_t;
+
+void obd_monitor_init(obd_monitor_t* m, int interval_s);
+// Sends what fits before until_us (CLOCK_MONOTONIC); 1 when a readout
+// completed, its records in results
+int obd_monitor_run(obd_monitor_t* m, obd_session_t* session, uint64_t until_us);
+// Reads everything at once, for the command line tools; the number of records
+int obd_monitor_read_all(obd_monitor_t* m, obd_session_t* session);
+
+// "time,mid,monitor,tid,value,min,max,unit,result" lines of the last readout
+void obd_monitor_write_csv(const obd_monitor_t* m, FILE* f);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
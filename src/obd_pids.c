@@ -0,0 +1,335 @@
+/*
+ * obd_pids.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+//
+// Standard PID table shared by the logger, the rollup store and the
+// history tools. Column order matches the CSV header written by
+// obd_logger_merged.c:
+//
+// Timestamp,RPM,Speed,Coolant,Intake,Throttle,MAP,Load,FuelPress,Timing,MAF
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <math.h>
+
+#include "obd_pids.h"
+
+// Mode 01 entry; designated, so the extended-only fields are plainly NULL / 0
+#define STANDARD_PID(name_, unit_, command_, prefix_, nbytes_, mul_, div_, offset_, decimals_)                     \
+    { .name = name_, .unit = unit_, .command = command_, .prefix = prefix_, .nbytes = nbytes_, .mul = mul_,       \
+      .div = div_, .offset = offset_, .decimals = decimals_, .header = NULL, .start = 0, .reply = {0}, .nreply = 0 }
+
+const obd_pid_t OBD_PIDS[] = {
+    //           name         unit    cmd     prefix   n  mul  div     offset  dec
+    STANDARD_PID("RPM",       "rpm",  "010C", "41 0C", 2, 1,   4,      0,      0),
+    STANDARD_PID("Speed",     "km/h", "010D", "41 0D", 1, 1,   1,      0,      0),
+    STANDARD_PID("Coolant",   "C",    "0105", "41 05", 1, 1,   1,      -40,    0),
+    STANDARD_PID("Intake",    "C",    "010F", "41 0F", 1, 1,   1,      -40,    0),
+    STANDARD_PID("Throttle",  "%",    "0111", "41 11", 1, 100, 255,    0,      0),
+    STANDARD_PID("MAP",       "kPa",  "010B", "41 0B", 1, 1,   1,      0,      0),
+    STANDARD_PID("Load",      "%",    "0104", "41 04", 1, 100, 255,    0,      0),
+    STANDARD_PID("FuelPress", "kPa",  "010A", "41 0A", 1, 3,   1,      0,      0),
+    STANDARD_PID("Timing",    "deg",  "010E", "41 0E", 1, 1,   2,      -64,    0),
+    STANDARD_PID("MAF",       "g/s",  "0110", "41 10", 2, 1,   100,    0,      2),
+};
+
+const int OBD_PID_COUNT = sizeof(OBD_PIDS) / sizeof(OBD_PIDS[0]);
+
+int obd_pid_find(const char* name) {
+    return obd_pid_index(OBD_PIDS, OBD_PID_COUNT, name);
+}
+
+int obd_pid_index(const obd_pid_t* pids, int n, const char* name) {
+    for (int i = 0; i < n; ++i) {
+        if (strcasecmp(pids[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+double obd_pid_decode(const obd_pid_t* pid, const unsigned char* data) {
+    double raw = data[0];
+    for (int i = 1; i < pid->nbytes; ++i) raw = raw * 256 + data[i];
+    double value = raw * pid->mul / pid->div + pid->offset;
+    return pid->decimals == 0 ? floor(value) : value;
+}
+
+void obd_pid_format(const obd_pid_t* pid, double value, char* out, int maxlen) {
+    if (pid->decimals == 0)
+        snprintf(out, maxlen, "%d", (int)value);
+    else
+        snprintf(out, maxlen, "%.*f", pid->decimals, value);
+}
+
+// Hex bytes of a reply, without the ISO-TP byte count line ("008") and the
+// frame numbers ("0:", "1:") the adapter adds to multi-frame answers.
+int obd_pid_reply_bytes(const char* response, unsigned char* out, int max) {
+    int n = 0;
+    const char* p = response;
+
+    while (*p && n < max) {
+        const char* eol = p + strcspn(p, "\r\n");
+        const char* q = p;
+
+        // A line holding only three hex digits is the byte count
+        if (eol - p == 3 && isxdigit((unsigned char)p[0]) && isxdigit((unsigned char)p[1]) &&
+            isxdigit((unsigned char)p[2])) q = eol;
+
+        const char* colon = memchr(p, ':', eol - p);
+        if (colon) q = colon + 1;
+
+        while (q < eol && n < max) {
+            unsigned int b;
+            int used;
+            while (q < eol && *q == ' ') ++q;
+            if (q >= eol || sscanf(q, "%2x%n", &b, &used) != 1 || used != 2) break;
+            out[n++] = (unsigned char)b;
+            q += 2;
+        }
+
+        p = eol;
+        while (*p == '\r' || *p == '\n') ++p;
+    }
+    return n;
+}
+
+int obd_pid_number(const obd_pid_t* pid) {
+    unsigned int mode, number;
+    if (!pid->command || sscanf(pid->command, "%2x%2x", &mode, &number) != 2 || mode != 0x01) return -1;
+    return (int)number;
+}
+
+int obd_pid_parse_multi(const char* response, const int* channels, int n, double* values, int* found) {
+    unsigned char bytes[128];
+    int len = obd_pid_reply_bytes(response, bytes, sizeof(bytes));
+    int decoded = 0;
+
+    for (int k = 0; k < n; ++k) found[k] = 0;
+
+    for (int i = 0; i < len; ) {
+        if (bytes[i++] != 0x41) continue;
+
+        // PID / data pairs follow until a byte that is none of ours
+        while (i < len) {
+            int k = 0;
+            while (k < n && obd_pid_number(&OBD_PIDS[channels[k]]) != bytes[i]) ++k;
+            if (k == n) break;
+
+            const obd_pid_t* pid = &OBD_PIDS[channels[k]];
+            if (i + 1 + pid->nbytes > len) return decoded;
+            if (!found[k]) {
+                values[k] = obd_pid_decode(pid, bytes + i + 1);
+                found[k] = 1;
+                decoded++;
+            }
+            i += 1 + pid->nbytes;
+        }
+    }
+    return decoded;
+}
+
+// Extended PIDs
+// =============
+
+int obd_pid_parse_extended(const char* response, const obd_pid_t* pids, int n, double* values, int* found) {
+    unsigned char bytes[256];
+    int len = obd_pid_reply_bytes(response, bytes, sizeof(bytes));
+    int nreply = pids[0].nreply, decoded = 0;
+
+    for (int k = 0; k < n; ++k) found[k] = 0;
+
+    for (int i = 0; i + nreply <= len; ++i) {
+        if (memcmp(bytes + i, pids[0].reply, nreply) != 0) continue;
+
+        const unsigned char* data = bytes + i + nreply;
+        for (int k = 0; k < n; ++k) {
+            if (data + pids[k].start + pids[k].nbytes > bytes + len) continue;
+            values[k] = obd_pid_decode(&pids[k], data + pids[k].start);
+            found[k] = 1;
+            decoded++;
+        }
+        break;
+    }
+    return decoded;
+}
+
+void obd_pid_table_init(obd_pid_table_t* t) {
+    memset(t, 0, sizeof(*t));
+    memcpy(t->pids, OBD_PIDS, OBD_PID_COUNT * sizeof(obd_pid_t));
+    t->count = t->first = OBD_PID_COUNT;
+}
+
+static int hex_text(const char* s, int min, int max) {
+    int n = (int)strlen(s);
+    if (n < min || n > max) return 0;
+    for (int i = 0; i < n; ++i) {
+        if (!isxdigit((unsigned char)s[i])) return 0;
+    }
+    return 1;
+}
+
+int obd_pid_table_add(obd_pid_table_t* t, const char* definition) {
+    char name[32], unit[16], header[16], request[16], bytes[8];
+    double mul, div, offset;
+    int decimals;
+
+    if (sscanf(definition, "%31s %15s %d %15s %15s %7s %lf %lf %lf", name, unit, &decimals, header, request,
+               bytes, &mul, &div, &offset) != 9) {
+        fprintf(stderr, "PID definition: expected \"name unit decimals header request bytes mul div offset\": %s\n",
+                definition);
+        return -1;
+    }
+    if (t->count >= OBD_MAX_CHANNELS) {
+        fprintf(stderr, "PID definition: more than %d channels: %s\n", OBD_MAX_CHANNELS, name);
+        return -1;
+    }
+    if (strlen(name) >= sizeof(t->text[0].name) || strlen(unit) >= sizeof(t->text[0].unit)) {
+        fprintf(stderr, "PID definition: name or unit too long: %s\n", name);
+        return -1;
+    }
+    for (int i = 0; i < t->count; ++i) {
+        if (strcasecmp(t->pids[i].name, name) == 0) {
+            fprintf(stderr, "PID definition: %s defined twice\n", name);
+            return -1;
+        }
+    }
+    // 11 bit CAN "7E0", 29 bit "18DA10F1", ISO / J1850 "686AF1"
+    int hlen = (int)strlen(header);
+    if (!hex_text(header, 3, 8) || (hlen != 3 && hlen != 6 && hlen != 8)) {
+        fprintf(stderr, "PID definition: %s: header must be 3, 6 or 8 hex digits\n", name);
+        return -1;
+    }
+    // The adapter talks one bus format, and the address restored after the
+    // extended requests is the functional address of that format
+    if (t->count > t->first && strlen(t->pids[t->first].header) != (size_t)hlen) {
+        fprintf(stderr, "PID definition: %s: header %s is not the bus format of %s (%s)\n", name, header,
+                t->pids[t->first].name, t->pids[t->first].header);
+        return -1;
+    }
+    int rlen = (int)strlen(request);
+    if (!hex_text(request, 4, 8) || rlen % 2 != 0) {
+        fprintf(stderr, "PID definition: %s: request must be 2 to 4 hex bytes\n", name);
+        return -1;
+    }
+    // "A", "AB", "CD": consecutive letters
+    int nbytes = (int)strlen(bytes);
+    int start = toupper((unsigned char)bytes[0]) - 'A';
+    int ok = nbytes <= OBD_PID_MAX_BYTES && start >= 0 && start < 26;
+    for (int i = 1; ok && i < nbytes; ++i) ok = toupper((unsigned char)bytes[i]) - 'A' == start + i;
+    if (!ok || div == 0 || decimals < 0 || decimals > 6) {
+        fprintf(stderr, "PID definition: %s: bad bytes, div or decimals\n", name);
+        return -1;
+    }
+
+    obd_pid_text_t* text = &t->text[t->count - t->first];
+    obd_pid_t* pid = &t->pids[t->count];
+    memset(pid, 0, sizeof(*pid));
+    // Lengths checked above
+    memcpy(text->name, name, strlen(name) + 1);
+    memcpy(text->unit, unit, strlen(unit) + 1);
+    memcpy(text->header, header, hlen + 1);
+    memcpy(text->command, request, rlen + 1);
+    for (int i = 0; i < rlen; ++i) text->command[i] = (char)toupper((unsigned char)text->command[i]);
+
+    // Reply prefix: service + 0x40 and the rest of the request, "62 11 4F"
+    pid->nreply = rlen / 2;
+    int pos = 0;
+    for (int i = 0; i < pid->nreply; ++i) {
+        unsigned int b;
+        sscanf(text->command + 2 * i, "%2x", &b);
+        pid->reply[i] = (unsigned char)(i == 0 ? b + 0x40 : b);
+        pos += snprintf(text->prefix + pos, sizeof(text->prefix) - pos, "%s%02X", i ? " " : "", pid->reply[i]);
+    }
+
+    pid->name = text->name;
+    pid->unit = text->unit;
+    pid->command = text->command;
+    pid->prefix = text->prefix;
+    pid->header = text->header;
+    pid->nbytes = nbytes;
+    pid->start = start;
+    pid->mul = mul;
+    pid->div = div;
+    pid->offset = offset;
+    pid->decimals = decimals;
+    t->count++;
+    return 0;
+}
+
+static int by_header_request(const obd_pid_t* a, const obd_pid_t* b) {
+    int c = strcmp(a->header, b->header);
+    return c ? c : strcmp(a->command, b->command);
+}
+
+void obd_pid_table_compile(obd_pid_table_t* t) {
+    // Insertion sort, stable, so channels of one DID keep the file order
+    for (int i = t->first + 1; i < t->count; ++i) {
+        obd_pid_t pid = t->pids[i];
+        int j = i;
+        for (; j > t->first && by_header_request(&t->pids[j - 1], &pid) > 0; --j) t->pids[j] = t->pids[j - 1];
+        t->pids[j] = pid;
+    }
+
+    t->nrequests = 0;
+    t->restore_header[0] = '\0';
+    for (int i = t->first; i < t->count;) {
+        obd_pid_request_t* r = &t->requests[t->nrequests];
+        const obd_pid_t* pid = &t->pids[i];
+
+        r->first = i;
+        r->count = 0;
+        while (i < t->count && by_header_request(&t->pids[i], pid) == 0) {
+            ++i;
+            ++r->count;
+        }
+        r->set_header = NULL;
+        if (t->nrequests == 0 || strcmp(t->pids[t->requests[t->nrequests - 1].first].header, pid->header) != 0) {
+            snprintf(t->set_header[t->nrequests], sizeof(t->set_header[0]), "AT SH %s", pid->header);
+            r->set_header = t->set_header[t->nrequests];
+        }
+        t->nrequests++;
+    }
+
+    // Back to the functional (broadcast) address of the same format for mode
+    // 01; obd_pid_table_add() keeps every header in one format
+    if (t->nrequests > 0) {
+        size_t hlen = strlen(t->pids[t->first].header);
+        snprintf(t->restore_header, sizeof(t->restore_header), "AT SH %s",
+                 hlen == 3 ? "7DF" : hlen == 8 ? "18DB33F1" : "686AF1");
+    }
+}
+
+int obd_pid_table_load(obd_pid_table_t* t, const char* path) {
+    char line[512];
+    int added = 0;
+
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        char* p = line;
+        while (isspace((unsigned char)*p)) ++p;
+        char* hash = strchr(p, '#');
+        if (hash) *hash = '\0';
+        p[strcspn(p, "\r\n")] = '\0';
+        if (!*p) continue;
+
+        if (obd_pid_table_add(t, p) != 0) {
+            fclose(f);
+            return -1;
+        }
+        added++;
+    }
+    fclose(f);
+    obd_pid_table_compile(t);
+    return added;
+}
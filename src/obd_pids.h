@@ -0,0 +1,127 @@
+/*
+ * obd_pids.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+#ifndef OBD_PIDS_H
+#define OBD_PIDS_H
+
+//
+// Flat decode table for the mode 01 PIDs polled by the loggers.
+//
+// Every channel is decoded the same way:
+//
+//    raw   = A            (nbytes == 1)
+//    raw   = A * 256 + B  (nbytes == 2, up to 4 bytes big endian)
+//    value = raw * mul / div + offset
+//
+// Channels with decimals == 0 are floored, so the CSV output keeps the
+// integer values the hand-written decoders used to produce.
+//
+// Extended PIDs
+// =============
+//
+// Manufacturer PIDs (mode 22 and the like) come from a definition file,
+// one per line, # starts a comment:
+//
+//    # name     unit  dec  header  request  bytes  mul  div  offset
+//    DPFSoot    g     2    7E0     22114F   AB     1    100  0
+//    DPFDiff    kPa   1    7E0     22114F   CD     1    10   0
+//    TransTemp  C     0    7E1     221E1C   A      1    1    -40
+//
+// header is sent with AT SH before the request, all headers in a file are
+// of one format (the bus the adapter is on); bytes names the value in
+// the data after the reply prefix ("62 11 4F"), A the first byte, "CD" the
+// third and fourth. obd_pid_table_load() compiles the file into the same
+// obd_pid_t entries as OBD_PIDS, after them, sorted by header and request,
+// plus a request list: one AT SH per header, one request per DID however
+// many channels it holds, and AT SH back to the functional address at the
+// end. Polling walks that list and decodes with obd_pid_parse_extended(),
+// nothing is looked up per sample.
+//
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OBD_MAX_CHANNELS 32
+#define OBD_PID_MAX_BYTES 4
+
+typedef struct {
+    const char* name;      // channel / CSV column name
+    const char* unit;
+    const char* command;   // request sent to the adapter, e.g. "010C"
+    const char* prefix;    // expected reply prefix, e.g. "41 0C"
+    int nbytes;
+    double mul;
+    double div;
+    double offset;
+    int decimals;
+
+    // Extended PIDs only, NULL / 0 in OBD_PIDS
+    const char* header;    // AT SH address, e.g. "7E0"
+    int start;             // first value byte after the reply prefix, A = 0
+    unsigned char reply[4];    // reply prefix, e.g. 62 11 4F
+    int nreply;
+} obd_pid_t;
+
+extern const obd_pid_t OBD_PIDS[];
+extern const int OBD_PID_COUNT;
+
+int obd_pid_find(const char* name);
+// Index of the entry called name (any case) in pids[0 .. n), -1 when none
+int obd_pid_index(const obd_pid_t* pids, int n, const char* name);
+double obd_pid_decode(const obd_pid_t* pid, const unsigned char* data);
+void obd_pid_format(const obd_pid_t* pid, double value, char* out, int maxlen);
+
+// PID number of a mode 01 entry, e.g. 0x0C for "010C"; -1 for other modes
+int obd_pid_number(const obd_pid_t* pid);
+
+// Decodes the reply to a request for several PIDs at once ("010C0D05"),
+// including multi-frame CAN answers. values[k] / found[k] are filled for
+// OBD_PIDS[channels[k]]; returns how many were found.
+int obd_pid_parse_multi(const char* response, const int* channels, int n, double* values, int* found);
+
+// The data bytes of a reply, frame numbers and the multi-frame byte count
+// left out; returns how many
+int obd_pid_reply_bytes(const char* response, unsigned char* out, int max);
+
+// Decodes pids[0 .. n), which share one request, from its reply; returns
+// how many were found
+int obd_pid_parse_extended(const char* response, const obd_pid_t* pids, int n, double* values, int* found);
+
+typedef struct {
+    char name[24], unit[12], command[16], prefix[24], header[12];
+} obd_pid_text_t;
+
+typedef struct {
+    const char* set_header;    // "AT SH 7E0" to send first, NULL when already set
+    int first, count;          // table entries decoded from the reply
+} obd_pid_request_t;
+
+typedef struct {
+    obd_pid_t pids[OBD_MAX_CHANNELS];   // OBD_PIDS, then the extended PIDs
+    int count;
+    int first;                          // first extended PID, OBD_PID_COUNT
+    obd_pid_request_t requests[OBD_MAX_CHANNELS];
+    int nrequests;
+    char set_header[OBD_MAX_CHANNELS][16];
+    char restore_header[16];            // "AT SH 7DF" after the last request, "" without any
+    obd_pid_text_t text[OBD_MAX_CHANNELS];
+} obd_pid_table_t;
+
+void obd_pid_table_init(obd_pid_table_t* t);
+// One definition line as above, 0 on success; call obd_pid_table_compile() after the last
+int obd_pid_table_add(obd_pid_table_t* t, const char* definition);
+// Sorts the extended PIDs and builds the request list
+void obd_pid_table_compile(obd_pid_table_t* t);
+// add() for every line of the file, then compile(); the number added or -1
+int obd_pid_table_load(obd_pid_table_t* t, const char* path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
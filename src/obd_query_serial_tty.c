@@ -27,21 +27,26 @@
 // Compile and Run
 // ===============
 //
-// gcc obd_query.c -o obd_query
-// ./obd_query
+// gcc obd_query_serial_tty.c obd_baud.c obd_device.c obd_session.c obd_capture.c obd_metrics.c obd_trace.c -o obd_query -lbluetooth -lpthread
+// ./obd_query [port[@baud]] [max_baud, 0 = keep the start rate]
 //
 // You should see output like:
 //
+// Baud: 38400 -> 500000, 1785 -> 5610 bytes/s, 89.3 -> 280.6 samples/s
 // Response: V-LINK XYZ Model 1.2
 //
+// The rate that worked is kept in obd_baud.cache in the current directory, so
+// the next run goes straight to it.
+//
 // Troubleshooting
 // ===============
 //
 // If you get no response:
 //
-// Check the baud rate (some adapters use 38400 or 115200).
+// Check the baud rate (some adapters start at 9600 or 115200: /dev/ttyUSB0@9600),
+// and run with max_baud 0 if the adapter misbehaves after AT BRD.
 //
-// Try increasing VTIME to 20 (2 seconds timeout).
+// Try increasing the poll() timeout to 2000 (2 seconds).
 //
 // Make sure you're sending \r (carriage return) and not newline \n.
 //
@@ -55,54 +60,43 @@
 #include <fcntl.h>
 #include <termios.h>
 #include <errno.h>
+#include <poll.h>
+
+#include "obd_device.h"
+#include "obd_baud.h"
 
 #define SERIAL_PORT "/dev/rfcomm0"  // Change if your device uses another port
 #define CMD "AT I\r"                // AT command with carriage return
 
-int configure_serial_port(int fd) {
-    struct termios tty;
-
-    if (tcgetattr(fd, &tty) != 0) {
-        perror("tcgetattr");
-        return -1;
-    }
-
-    cfsetospeed(&tty, B9600);  // V-LINK typically uses 9600 or 38400 baud
-    cfsetispeed(&tty, B9600);
-
-    tty.c_cflag = (tty.c_cflag & ~CSIZE) | CS8;  // 8-bit chars
-    tty.c_iflag &= ~IGNBRK;         // disable break processing
-    tty.c_lflag = 0;                // no signaling chars, no echo, no canonical processing
-    tty.c_oflag = 0;                // no remapping, no delays
-    tty.c_cc[VMIN]  = 0;            // read doesn't block
-    tty.c_cc[VTIME] = 10;           // 1 second read timeout
-
-    tty.c_iflag &= ~(IXON | IXOFF | IXANY); // shut off xon/xoff ctrl
-
-    tty.c_cflag |= (CLOCAL | CREAD);    // ignore modem controls, enable reading
-    tty.c_cflag &= ~(PARENB | PARODD);  // shut off parity
-    tty.c_cflag &= ~CSTOPB;
-    tty.c_cflag &= ~CRTSCTS;
-
-    if (tcsetattr(fd, TCSANOW, &tty) != 0) {
-        perror("tcsetattr");
-        return -1;
+// The ELM327 starts at 38400 (9600 with pin 6 low); obd_device_open() takes
+// "port@baud" for another start rate. Wired adapters are then switched to the
+// fastest rate that works with AT BRD (obd_baud.h); over Bluetooth
+// (/dev/rfcomm0) the tty rate means nothing and negotiation is skipped.
+void configure_serial_port(int fd, int max_baud, const char* port) {
+    obd_session_t session;
+    obd_baud_t baud;
+
+    obd_session_init(&session, fd, NULL);
+    if (obd_baud_negotiate(&baud, &session, max_baud, OBD_BAUD_MEASURE, port, OBD_BAUD_CACHE_FILE) < 0) return;
+
+    if (baud.resumed) {
+        printf("Baud: %d (still set from an earlier run)\n", baud.baud);
+    } else if (baud.baud != baud.from) {
+        printf("Baud: %d -> %d, %.0f -> %.0f bytes/s, %.1f -> %.1f samples/s\n", baud.from, baud.baud,
+               baud.bytes_per_s[0], baud.bytes_per_s[1], baud.samples_per_s[0], baud.samples_per_s[1]);
+    } else {
+        printf("Baud: %d\n", baud.baud);
     }
-
-    return 0;
 }
 
-int main() {
-    int serial_fd = open(SERIAL_PORT, O_RDWR | O_NOCTTY | O_SYNC);
-    if (serial_fd < 0) {
-        perror("open");
-        return 1;
-    }
+int main(int argc, char** argv) {
+    const char* port = argc > 1 ? argv[1] : SERIAL_PORT;
+    int max_baud = argc > 2 ? atoi(argv[2]) : OBD_BAUD_MAX;
 
-    if (configure_serial_port(serial_fd) != 0) {
-        close(serial_fd);
-        return 1;
-    }
+    int serial_fd = obd_device_open(port);
+    if (serial_fd < 0) return 1;
+
+    if (max_baud > 0) configure_serial_port(serial_fd, max_baud, port);
 
     // Write command
     int n_written = write(serial_fd, CMD, strlen(CMD));
@@ -112,12 +106,19 @@ int main() {
         return 1;
     }
 
-    // Read response
+    // Read response, up to the prompt
     char buf[256];
+    int n_read = 0;
     memset(buf, 0, sizeof(buf));
-    int n_read = read(serial_fd, buf, sizeof(buf) - 1);
-    if (n_read < 0) {
-        perror("read");
+    while (n_read < (int)sizeof(buf) - 1 && !strchr(buf, '>')) {
+        struct pollfd p = { serial_fd, POLLIN, 0 };
+        if (poll(&p, 1, 1000) <= 0) break;
+        int n = read(serial_fd, buf + n_read, sizeof(buf) - 1 - n_read);
+        if (n <= 0) break;
+        n_read += n;
+    }
+    if (n_read == 0) {
+        fprintf(stderr, "No response\n");
         close(serial_fd);
         return 1;
     }
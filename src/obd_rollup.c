@@ -0,0 +1,304 @@
+/*
+ * obd_rollup.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+//
+// Rollup tiers for historical range queries.
+//
+// The logger calls rollup_add() for every decoded value. Each tier keeps
+// one open bucket per channel (count/min/max/sum); when a sample falls into
+// the next bucket the finished one is appended to the tier file.
+//
+// Queries never touch the raw CSVs. A month of hourly buckets is ~720
+// records per channel, so "average coolant per day" is a couple of
+// preads instead of a rescan of every obd_log_*.csv.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "obd_rollup.h"
+
+const int ROLLUP_TIER_SECONDS[ROLLUP_TIERS] = { 1, 60, 3600 };
+const char* const ROLLUP_TIER_NAMES[ROLLUP_TIERS] = { "1s", "1m", "1h" };
+
+#define SECONDS_PER_DAY 86400
+#define QUERY_CHUNK 256
+
+static void tier_path(const char* dir, int tier, const char* name, int64_t day, char* out, int maxlen) {
+    if (tier == 0) {
+        time_t t = (time_t)(day * SECONDS_PER_DAY);
+        char ds[16];
+        strftime(ds, sizeof(ds), "%Y%m%d", gmtime(&t));
+        snprintf(out, maxlen, "%s/%s/%s_%s.bin", dir, ROLLUP_TIER_NAMES[tier], name, ds);
+    } else {
+        snprintf(out, maxlen, "%s/%s/%s.bin", dir, ROLLUP_TIER_NAMES[tier], name);
+    }
+}
+
+int rollup_open(rollup_t* r, const char* dir, const char* const* names, int nchannels) {
+    memset(r, 0, sizeof(*r));
+    if (nchannels > OBD_MAX_CHANNELS) nchannels = OBD_MAX_CHANNELS;
+
+    snprintf(r->dir, sizeof(r->dir), "%s", dir);
+    r->nchannels = nchannels;
+    for (int c = 0; c < nchannels; ++c) {
+        r->names[c] = names[c];
+        r->out_day[c] = -1;
+    }
+
+    mkdir(dir, 0755);
+    for (int t = 0; t < ROLLUP_TIERS; ++t) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s", dir, ROLLUP_TIER_NAMES[t]);
+        if (mkdir(path, 0755) != 0 && access(path, W_OK) != 0) {
+            perror("rollup mkdir");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static FILE* tier_file(rollup_t* r, int tier, int channel, int64_t start) {
+    int64_t day = start / SECONDS_PER_DAY;
+
+    if (r->out[tier][channel] && (tier != 0 || r->out_day[channel] == day))
+        return r->out[tier][channel];
+
+    if (r->out[tier][channel]) fclose(r->out[tier][channel]);
+
+    char path[512];
+    tier_path(r->dir, tier, r->names[channel], day, path, sizeof(path));
+    FILE* f = fopen(path, "a+b");
+    if (!f) {
+        perror("rollup fopen");
+        r->out[tier][channel] = NULL;
+        return NULL;
+    }
+
+    // Pick up where a previous run stopped so the file stays sorted.
+    rollup_bucket_t last;
+    if (fseek(f, -(long)sizeof(last), SEEK_END) == 0 && fread(&last, sizeof(last), 1, f) == 1) {
+        if (last.start > r->last_start[tier][channel])
+            r->last_start[tier][channel] = last.start;
+    }
+
+    r->out[tier][channel] = f;
+    if (tier == 0) r->out_day[channel] = day;
+    return f;
+}
+
+static void emit_bucket(rollup_t* r, int tier, int channel) {
+    rollup_bucket_t* b = &r->cur[tier][channel];
+    if (b->count == 0) return;
+
+    FILE* f = tier_file(r, tier, channel, b->start);
+    // A clock stepping backwards would break the sort order; drop the bucket.
+    if (f && b->start >= r->last_start[tier][channel]) {
+        fwrite(b, sizeof(*b), 1, f);
+        r->last_start[tier][channel] = b->start;
+    }
+    b->count = 0;
+}
+
+void rollup_add(rollup_t* r, int channel, time_t t, double value) {
+    if (channel < 0 || channel >= r->nchannels) return;
+
+    for (int tier = 0; tier < ROLLUP_TIERS; ++tier) {
+        int64_t start = (int64_t)t - (int64_t)t % ROLLUP_TIER_SECONDS[tier];
+        rollup_bucket_t* b = &r->cur[tier][channel];
+
+        if (b->count && b->start != start) emit_bucket(r, tier, channel);
+
+        if (b->count == 0) {
+            b->start = start;
+            b->min = b->max = (float)value;
+            b->sum = 0;
+        }
+        if (value < b->min) b->min = (float)value;
+        if (value > b->max) b->max = (float)value;
+        b->sum += value;
+        b->count++;
+    }
+}
+
+void rollup_flush(rollup_t* r) {
+    for (int tier = 0; tier < ROLLUP_TIERS; ++tier)
+        for (int c = 0; c < r->nchannels; ++c)
+            if (r->out[tier][c]) fflush(r->out[tier][c]);
+}
+
+void rollup_close(rollup_t* r) {
+    for (int tier = 0; tier < ROLLUP_TIERS; ++tier) {
+        for (int c = 0; c < r->nchannels; ++c) {
+            emit_bucket(r, tier, c);
+            if (r->out[tier][c]) fclose(r->out[tier][c]);
+            r->out[tier][c] = NULL;
+        }
+    }
+}
+
+int rollup_pick_tier(int resolution) {
+    for (int tier = ROLLUP_TIERS - 1; tier > 0; --tier) {
+        int s = ROLLUP_TIER_SECONDS[tier];
+        if (resolution >= s && resolution % s == 0) return tier;
+    }
+    return 0;
+}
+
+// Local UTC offset at t, looked up again only when t is in another hour
+// (offsets change on the hour), so a day of 1 s buckets is not 86400
+// localtime calls
+typedef struct {
+    int64_t hour;
+    long gmtoff;
+} offset_cache_t;
+
+static long offset_at(offset_cache_t* c, int64_t t) {
+    if (t / 3600 != c->hour) {
+        struct tm lt;
+        time_t tt = (time_t)t;
+        localtime_r(&tt, &lt);
+        c->hour = t / 3600;
+        c->gmtoff = lt.tm_gmtoff;
+    }
+    return c->gmtoff;
+}
+
+typedef struct {
+    int resolution;
+    rollup_bucket_t* out;
+    int nout, max_out;
+    int64_t local_start;            // of out[nout - 1], local seconds
+    offset_cache_t at_bucket, at_start;
+} query_t;
+
+// First record index with start >= key, or n.
+static long lower_bound(int fd, long n, int64_t key) {
+    long lo = 0, hi = n;
+    while (lo < hi) {
+        long mid = lo + (hi - lo) / 2;
+        rollup_bucket_t b;
+        if (pread(fd, &b, sizeof(b), (off_t)mid * sizeof(b)) != sizeof(b)) return n;
+        if (b.start < key) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static int query_file(const char* path, int64_t from, int64_t to, query_t* q) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return 0;
+    }
+
+    long n = st.st_size / sizeof(rollup_bucket_t);
+    long i = lower_bound(fd, n, from);
+    rollup_bucket_t chunk[QUERY_CHUNK];
+
+    while (i < n) {
+        long want = n - i < QUERY_CHUNK ? n - i : QUERY_CHUNK;
+        ssize_t got = pread(fd, chunk, want * sizeof(rollup_bucket_t), (off_t)i * sizeof(rollup_bucket_t));
+        if (got <= 0) break;
+        long k = got / sizeof(rollup_bucket_t);
+
+        for (long j = 0; j < k; ++j) {
+            const rollup_bucket_t* b = &chunk[j];
+            if (b->start >= to) {
+                close(fd);
+                return 1;
+            }
+            if (b->count == 0) continue;
+
+            // Aligned in local time with the offset at this bucket, so a
+            // day stays one bucket across a DST change in the range
+            long gmtoff = offset_at(&q->at_bucket, b->start);
+            int64_t local = b->start + gmtoff;
+            int64_t local_start = local - local % q->resolution;
+            rollup_bucket_t* o = (q->nout > 0) ? &q->out[q->nout - 1] : NULL;
+            if (!o || q->local_start != local_start) {
+                if (q->nout >= q->max_out) {
+                    close(fd);
+                    return 1;
+                }
+                o = &q->out[q->nout++];
+                memset(o, 0, sizeof(*o));
+                // The offset in force at the local start, which may differ
+                o->start = local_start - offset_at(&q->at_start, local_start - gmtoff);
+                q->local_start = local_start;
+                o->min = b->min;
+                o->max = b->max;
+            }
+            if (b->min < o->min) o->min = b->min;
+            if (b->max > o->max) o->max = b->max;
+            o->count += b->count;
+            o->sum += b->sum;
+        }
+        i += k;
+    }
+
+    close(fd);
+    return 0;
+}
+
+// Any tier file of the channel: the 1m / 1h files, or a 1s day file
+// ("<channel>_YYYYMMDD.bin") when the channel has less than a minute
+static int has_rollups(const char* dir, const char* channel) {
+    char path[512];
+    for (int tier = 1; tier < ROLLUP_TIERS; ++tier) {
+        tier_path(dir, tier, channel, 0, path, sizeof(path));
+        if (access(path, R_OK) == 0) return 1;
+    }
+
+    snprintf(path, sizeof(path), "%s/%s", dir, ROLLUP_TIER_NAMES[0]);
+    DIR* d = opendir(path);
+    if (!d) return 0;
+    size_t len = strlen(channel);
+    int found = 0;
+    struct dirent* e;
+    while (!found && (e = readdir(d))) {
+        found = strlen(e->d_name) == len + 13 && strncmp(e->d_name, channel, len) == 0 &&
+                e->d_name[len] == '_' && strcmp(e->d_name + len + 9, ".bin") == 0;
+    }
+    closedir(d);
+    return found;
+}
+
+int rollup_query(const char* dir, const char* channel, time_t from, time_t to,
+                 int resolution, rollup_bucket_t* out, int max_out) {
+    if (resolution < 1) resolution = 1;
+
+    int tier = rollup_pick_tier(resolution);
+    int sec = ROLLUP_TIER_SECONDS[tier];
+    int64_t first = (int64_t)from - (int64_t)from % sec;
+
+    query_t q = { resolution, out, 0, max_out, 0, { -1, 0 }, { -1, 0 } };
+    char path[512];
+
+    if (tier == 0) {
+        if (!has_rollups(dir, channel)) return -1;
+        for (int64_t day = first / SECONDS_PER_DAY; day * SECONDS_PER_DAY < (int64_t)to; ++day) {
+            tier_path(dir, tier, channel, day, path, sizeof(path));
+            if (query_file(path, first, to, &q) && q.nout >= max_out) break;
+        }
+    } else {
+        tier_path(dir, tier, channel, 0, path, sizeof(path));
+        if (access(path, R_OK) != 0) return -1;
+        query_file(path, first, to, &q);
+    }
+
+    return q.nout;
+}
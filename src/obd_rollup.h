@@ -0,0 +1,77 @@
+/*
+ * obd_rollup.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+#ifndef OBD_ROLLUP_H
+#define OBD_ROLLUP_H
+
+//
+// Multi-resolution rollups (1 s / 1 min / 1 h) kept next to the raw logs.
+//
+// Each channel gets one append-only file per tier holding fixed-size
+// rollup_bucket_t records in start order, so a range query is a binary
+// search plus a sequential read of the coarsest tier that fits.
+//
+// Layout under the rollup directory:
+//
+//    1s/<channel>_YYYYMMDD.bin   (one file per UTC day, pruned by retention)
+//    1m/<channel>.bin
+//    1h/<channel>.bin
+//
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "obd_pids.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ROLLUP_TIERS 3
+
+extern const int ROLLUP_TIER_SECONDS[ROLLUP_TIERS];
+extern const char* const ROLLUP_TIER_NAMES[ROLLUP_TIERS];
+
+typedef struct {
+    int64_t start;      // bucket start, unix seconds
+    uint32_t count;
+    float min;
+    float max;
+    uint32_t reserved;
+    double sum;
+} rollup_bucket_t;
+
+typedef struct {
+    char dir[256];
+    int nchannels;
+    const char* names[OBD_MAX_CHANNELS];
+    rollup_bucket_t cur[ROLLUP_TIERS][OBD_MAX_CHANNELS];
+    int64_t last_start[ROLLUP_TIERS][OBD_MAX_CHANNELS];
+    FILE* out[ROLLUP_TIERS][OBD_MAX_CHANNELS];
+    int64_t out_day[OBD_MAX_CHANNELS];
+} rollup_t;
+
+// Writer side, used by the logger.
+int rollup_open(rollup_t* r, const char* dir, const char* const* names, int nchannels);
+void rollup_add(rollup_t* r, int channel, time_t t, double value);
+void rollup_flush(rollup_t* r);
+void rollup_close(rollup_t* r);
+
+// Reader side. Returns buckets of `resolution` seconds (aligned to local
+// time) covering [from, to), read from the coarsest tier whose bucket size
+// divides the resolution. Returns the number of buckets written to `out`,
+// or -1 if the channel has no rollups.
+int rollup_pick_tier(int resolution);
+int rollup_query(const char* dir, const char* channel, time_t from, time_t to,
+                 int resolution, rollup_bucket_t* out, int max_out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
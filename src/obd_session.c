@@ -0,0 +1,427 @@
+/*
+ * obd_session.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+
+#include "obd_session.h"
+#include "obd_capture.h"
+#include "obd_trace.h"
+
+uint64_t obd_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+}
+
+// File descriptor transport
+// =========================
+
+static int fd_read(void* ctx, char* buf, int len, int timeout_ms) {
+    int fd = (int)(intptr_t)ctx;
+    struct pollfd p = { fd, POLLIN, 0 };
+
+    for (;;) {
+        int r = poll(&p, 1, timeout_ms);
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0) return -1;
+        if (r == 0) return 0;
+
+        ssize_t n = read(fd, buf, len);
+        if (n < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+        return n > 0 ? (int)n : -1;
+    }
+}
+
+static int fd_write(void* ctx, const char* buf, int len) {
+    return (int)write((int)(intptr_t)ctx, buf, len);
+}
+
+const obd_transport_ops_t OBD_FD_TRANSPORT = { "fd", fd_read, fd_write };
+
+void obd_session_init(obd_session_t* s, int fd, obd_metrics_t* metrics) {
+    obd_session_init_transport(s, &OBD_FD_TRANSPORT, (void*)(intptr_t)fd, metrics);
+    s->fd = fd;
+}
+
+void obd_session_init_transport(obd_session_t* s, const obd_transport_ops_t* ops, void* ctx,
+                                obd_metrics_t* metrics) {
+    s->fd = -1;
+    s->timeout_ms = OBD_DEFAULT_TIMEOUT_MS;
+    s->metrics = metrics;
+    s->ops = ops;
+    s->ctx = ctx;
+    s->capture = NULL;
+    s->setup = NULL;
+    s->reconnect = NULL;
+    s->reconnect_arg = NULL;
+    s->failures = 0;
+    s->next_reconnect_us = 0;
+}
+
+void obd_session_set_capture(obd_session_t* s, struct obd_capture* capture) {
+    s->capture = capture;
+}
+
+void obd_session_set_fd(obd_session_t* s, int fd) {
+    s->fd = fd;
+    s->ctx = (void*)(intptr_t)fd;
+}
+
+obd_reply_t obd_classify_reply(const char* response) {
+    if (strstr(response, "NO DATA")) return OBD_REPLY_NO_DATA;
+    if (strstr(response, "BUFFER FULL")) return OBD_REPLY_BUFFER_FULL;
+    if (strstr(response, "CAN ERROR")) return OBD_REPLY_CAN_ERROR;
+    if (strstr(response, "UNABLE TO CONNECT") || strstr(response, "STOPPED") ||
+        strstr(response, "ERROR")) return OBD_REPLY_ERROR;
+
+    // A lone "?" means the adapter did not understand the command
+    const char* p = response;
+    while (*p == ' ' || *p == '\r' || *p == '\n') ++p;
+    if (p[0] == '?' && (p[1] == '\0' || p[1] == '\r' || p[1] == '\n')) return OBD_REPLY_UNKNOWN;
+
+    return OBD_REPLY_OK;
+}
+
+const char* obd_reply_name(obd_reply_t r) {
+    switch (r) {
+        case OBD_REPLY_OK:          return "OK";
+        case OBD_REPLY_NO_DATA:     return "NO DATA";
+        case OBD_REPLY_UNKNOWN:     return "?";
+        case OBD_REPLY_BUFFER_FULL: return "BUFFER FULL";
+        case OBD_REPLY_CAN_ERROR:   return "CAN ERROR";
+        case OBD_REPLY_ERROR:       return "ERROR";
+        case OBD_REPLY_TIMEOUT:     return "TIMEOUT";
+        case OBD_REPLY_IO_ERROR:    return "I/O ERROR";
+        case OBD_REPLY_GARBLED:     return "GARBLED";
+    }
+    return "?";
+}
+
+// Throw away anything left over from an earlier command that timed out,
+// otherwise it would be read as the reply to the next one.
+static void drain_input(obd_session_t* s) {
+    char buf[256];
+    int n;
+
+    while ((n = s->ops->read(s->ctx, buf, sizeof(buf), 0)) > 0) {
+        metrics_add(s->metrics, M_BYTES_IN, n);
+        obd_capture_record(s->capture, OBD_CAPTURE_IN, buf, n);
+    }
+}
+
+static obd_reply_t read_until_prompt(obd_session_t* s, char* response, int maxlen) {
+    uint64_t deadline = obd_now_us() + (uint64_t)s->timeout_ms * 1000;
+    int len = 0;
+
+    for (;;) {
+        uint64_t now = obd_now_us();
+        if (now >= deadline) return OBD_REPLY_TIMEOUT;
+
+        char buf[256];
+        int n = s->ops->read(s->ctx, buf, sizeof(buf), (int)((deadline - now + 999) / 1000));
+        if (n < 0) return OBD_REPLY_IO_ERROR;
+        if (n == 0) return OBD_REPLY_TIMEOUT;
+        metrics_add(s->metrics, M_BYTES_IN, n);
+        obd_capture_record(s->capture, OBD_CAPTURE_IN, buf, n);
+
+        int prompt = 0;
+        for (int i = 0; i < n; ++i) {
+            if (buf[i] == '>') {
+                prompt = 1;
+                break;
+            }
+            if (buf[i] != '\0' && len < maxlen - 1) response[len++] = buf[i];
+        }
+        response[len] = '\0';
+        if (prompt) {
+            while (len > 0 && (response[len - 1] == '\r' || response[len - 1] == '\n' || response[len - 1] == ' '))
+                response[--len] = '\0';
+            return OBD_REPLY_OK;
+        }
+    }
+}
+
+obd_reply_t obd_session_command(obd_session_t* s, const char* cmd, char* response, int maxlen) {
+    char full_cmd[64];
+    int n = snprintf(full_cmd, sizeof(full_cmd), "%s\r", cmd);
+
+    memset(response, 0, maxlen);
+    drain_input(s);
+
+    uint64_t start = obd_now_us();
+    uint64_t span = TRACE_BEGIN();
+    obd_reply_t r;
+
+    int written = s->ops->write(s->ctx, full_cmd, n);
+    TRACE_END("write", span, cmd);
+
+    if (written != n) {
+        r = OBD_REPLY_IO_ERROR;
+    } else {
+        metrics_add(s->metrics, M_BYTES_OUT, n);
+        obd_capture_record(s->capture, OBD_CAPTURE_OUT, full_cmd, n);
+
+        span = TRACE_BEGIN();
+        r = read_until_prompt(s, response, maxlen);
+        TRACE_END("wait_prompt", span, cmd);
+        if (r == OBD_REPLY_OK) r = obd_classify_reply(response);
+    }
+
+    metrics_command(s->metrics, cmd, obd_now_us() - start);
+
+    switch (r) {
+        case OBD_REPLY_NO_DATA:     metrics_add(s->metrics, M_NO_DATA, 1); break;
+        case OBD_REPLY_UNKNOWN:     metrics_add(s->metrics, M_UNKNOWN, 1); break;
+        case OBD_REPLY_BUFFER_FULL: metrics_add(s->metrics, M_BUFFER_FULL, 1); break;
+        case OBD_REPLY_CAN_ERROR:   metrics_add(s->metrics, M_CAN_ERROR, 1); break;
+        case OBD_REPLY_TIMEOUT:     metrics_add(s->metrics, M_TIMEOUT, 1); break;
+        default: break;
+    }
+    return r;
+}
+
+// Recovery
+// ========
+
+void obd_session_set_recovery(obd_session_t* s, const char* const* setup, obd_reconnect_fn reconnect, void* arg) {
+    s->setup = setup;
+    s->reconnect = reconnect;
+    s->reconnect_arg = arg;
+}
+
+int obd_session_setup(obd_session_t* s) {
+    char response[64];
+    int failed = 0;
+
+    for (int i = 0; s->setup && s->setup[i]; ++i) {
+        if (obd_session_command(s, s->setup[i], response, sizeof(response)) != OBD_REPLY_OK) failed++;
+    }
+    return failed;
+}
+
+// Fast init
+// =========
+
+typedef struct {
+    int echo, linefeeds, spaces, headers;
+    int auto_protocol;
+} adapter_state_t;
+
+// "AT E0" -> 'E', 0; -1 for anything else
+static int flag_setting(const char* cmd, char* flag) {
+    char c[8];
+    int n = 0;
+    for (const char* p = cmd; *p && n < 7; ++p) {
+        if (*p != ' ') c[n++] = (char)toupper((unsigned char)*p);
+    }
+    c[n] = '\0';
+    if (n != 4 || strncmp(c, "AT", 2) != 0 || !strchr("ELSH", c[2]) || (c[3] != '0' && c[3] != '1')) return -1;
+    *flag = c[2];
+    return c[3] - '0';
+}
+
+static int is_auto_protocol(const char* cmd) {
+    char c[16];
+    int n = 0;
+    for (const char* p = cmd; *p && n < 15; ++p) {
+        if (*p != ' ') c[n++] = (char)toupper((unsigned char)*p);
+    }
+    c[n] = '\0';
+    return strcmp(c, "ATSP0") == 0 || strcmp(c, "ATSPA0") == 0;
+}
+
+int obd_session_init_adapter(obd_session_t* s, obd_init_t* init) {
+    char response[256];
+    adapter_state_t st;
+    uint64_t start = obd_now_us();
+    int timeout = s->timeout_ms;
+
+    memset(init, 0, sizeof(*init));
+
+    // AT D restores the defaults without a reboot and shows the adapter is there
+    s->timeout_ms = OBD_RESYNC_TIMEOUT_MS;
+    init->reset = "AT D";
+    obd_reply_t r = obd_session_command(s, init->reset, response, sizeof(response));
+    init->commands++;
+    if (r == OBD_REPLY_OK && !strstr(response, "OK") && strchr(response, '?')) {
+        init->reset = "AT WS";
+        r = obd_session_command(s, init->reset, response, sizeof(response));
+        init->commands++;
+    }
+    s->timeout_ms = timeout;
+    if (r != OBD_REPLY_OK || (!strstr(response, "OK") && !strstr(response, "ELM"))) {
+        init->reset = "AT Z";
+        r = obd_session_command(s, init->reset, response, sizeof(response));
+        init->commands++;
+        // A late answer to AT D may come before the banner
+        if (r == OBD_REPLY_OK && !strstr(response, "ELM")) read_until_prompt(s, response, sizeof(response));
+    }
+
+    // Echo and line ends show in any reply; "A6" or "0" is the automatic protocol
+    obd_session_command(s, "AT DPN", response, sizeof(response));
+    init->commands++;
+    st.echo = strncmp(response, "AT DPN", 6) == 0;
+    st.linefeeds = strchr(response, '\n') != NULL;
+    const char* p = response;
+    if (st.echo) p += strcspn(p, "\r\n");
+    p += strspn(p, "\r\n ");
+    st.auto_protocol = *p == 'A' || *p == '0';
+    st.spaces = 1;
+    st.headers = 0;
+
+    for (int i = 0; s->setup && s->setup[i]; ++i) {
+        const char* cmd = s->setup[i];
+        char flag = 0;
+        int on = flag_setting(cmd, &flag);
+
+        if ((flag == 'E' && on == st.echo) || (flag == 'L' && on == st.linefeeds) ||
+            (flag == 'S' && on == st.spaces) || (flag == 'H' && on == st.headers) ||
+            (on < 0 && is_auto_protocol(cmd) && st.auto_protocol)) {
+            init->skipped++;
+            continue;
+        }
+
+        r = obd_session_command(s, cmd, response, sizeof(response));
+        init->commands++;
+        if (r != OBD_REPLY_OK || !strstr(response, "OK")) {
+            init->failed++;
+            continue;
+        }
+        if (on >= 0) {
+            switch (flag) {
+                case 'E': st.echo = on; break;
+                case 'L': st.linefeeds = on; break;
+                case 'S': st.spaces = on; break;
+                case 'H': st.headers = on; break;
+            }
+        }
+    }
+
+    init->elapsed_us = obd_now_us() - start;
+    return init->failed;
+}
+
+static int is_status_line(const char* line) {
+    return strncmp(line, "SEARCHING", 9) == 0 || strncmp(line, "BUS INIT", 8) == 0;
+}
+
+int obd_reply_well_formed(const char* response) {
+    const char* p = response;
+
+    while (*p) {
+        const char* eol = p + strcspn(p, "\r\n");
+        int tokens = 0, digits = 0, bad = 0, two_digit = 1;
+
+        if (!is_status_line(p)) {
+            for (const char* q = p; q < eol; ) {
+                while (q < eol && *q == ' ') ++q;
+                if (q == eol) break;
+
+                int n = 0;
+                while (q + n < eol && isxdigit((unsigned char)q[n])) ++n;
+                if (q + n < eol && q[n] == ':') {
+                    // Frame number of a multi-frame reply, "0:" .. "F:"
+                    if (n != 1) bad = 1;
+                    q += n + 1;
+                    continue;
+                }
+                if (n == 0 || (q + n < eol && q[n] != ' ')) bad = 1;
+                // An 11-bit CAN header (AT H1) leads the line with three digits
+                if (n != 2 && !(tokens == 0 && n == 3)) two_digit = 0;
+                tokens++;
+                digits += n;
+                q += n ? n : 1;
+            }
+
+            // Spaced bytes are two digits each; without spaces (AT S0) the line
+            // must still hold whole bytes. A lone 3-digit token is the byte count
+            // that heads a multi-frame reply.
+            if (bad) return 0;
+            if (tokens > 1 && !two_digit) return 0;
+            if (tokens == 1 && digits % 2 != 0 && digits != 3) return 0;
+        }
+
+        p = eol;
+        while (*p == '\r' || *p == '\n') ++p;
+    }
+    return 1;
+}
+
+// A freshly reset ELM327 prints its banner and echoes commands again
+static int adapter_was_reset(const char* cmd, const char* response) {
+    size_t n = strlen(cmd);
+    if (strstr(response, "ELM327")) return 1;
+    return strncmp(response, cmd, n) == 0 && (response[n] == '\r' || response[n] == '\n');
+}
+
+static void try_reconnect(obd_session_t* s) {
+    uint64_t now = obd_now_us();
+    if (!s->reconnect || now < s->next_reconnect_us) return;
+
+    metrics_add(s->metrics, M_RECONNECT, 1);
+    uint64_t span = TRACE_BEGIN();
+    int rc = s->reconnect(s, s->reconnect_arg);
+    TRACE_END("reconnect", span, NULL);
+
+    if (rc == 0) {
+        s->failures = 0;
+        obd_session_setup(s);
+    } else {
+        s->next_reconnect_us = now + OBD_RECONNECT_BACKOFF_MS * 1000ull;
+    }
+}
+
+// After a timeout the adapter may still be busy or the prompt got lost; any
+// byte interrupts a running search, and a short probe shows when the prompt
+// is back
+static void resync(obd_session_t* s) {
+    char response[64];
+    int timeout = s->timeout_ms;
+
+    s->timeout_ms = OBD_RESYNC_TIMEOUT_MS;
+    uint64_t span = TRACE_BEGIN();
+    if (obd_session_command(s, "AT E0", response, sizeof(response)) != OBD_REPLY_OK) s->failures++;
+    TRACE_END("resync", span, NULL);
+    s->timeout_ms = timeout;
+}
+
+obd_reply_t obd_session_query(obd_session_t* s, const char* cmd, char* response, int maxlen) {
+    obd_reply_t r = obd_session_command(s, cmd, response, maxlen);
+    int obd = strncmp(cmd, "AT", 2) != 0;
+
+    if (r == OBD_REPLY_OK && obd && adapter_was_reset(cmd, response)) {
+        metrics_add(s->metrics, M_ADAPTER_RESET, 1);
+        obd_session_setup(s);
+        r = obd_session_command(s, cmd, response, maxlen);
+    }
+    if (r == OBD_REPLY_OK && obd && !obd_reply_well_formed(response)) {
+        metrics_add(s->metrics, M_GARBLED, 1);
+        r = OBD_REPLY_GARBLED;
+    }
+
+    switch (r) {
+        case OBD_REPLY_TIMEOUT:
+        case OBD_REPLY_IO_ERROR:
+        case OBD_REPLY_GARBLED:
+            s->failures++;
+            break;
+        default:
+            s->failures = 0;
+            return r;
+    }
+
+    if (r == OBD_REPLY_IO_ERROR || s->failures >= OBD_RECONNECT_AFTER) try_reconnect(s);
+    else if (r == OBD_REPLY_TIMEOUT) resync(s);
+    return r;
+}
@@ -0,0 +1,145 @@
+/*
+ * obd_session.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+#ifndef OBD_SESSION_H
+#define OBD_SESSION_H
+
+//
+// ELM327 command/response session.
+//
+// Replaces the "write, usleep(300000), read" pattern of the examples:
+// a command is written and the reply is read until the '>' prompt, so a
+// command costs exactly as long as the adapter needs. Every command is
+// timed and classified into the metrics (obd_metrics.h).
+//
+// The bytes go through a transport: a plain file descriptor by default, or
+// e.g. the capture replay of obd_capture.h. A capture writer attached with
+// obd_session_set_capture() records every byte in both directions.
+//
+// obd_session_query() adds recovery on top of obd_session_command():
+//
+//    garbled reply        (bad characters, odd hex digits) counted as a failure
+//    adapter reset        (banner or command echo) setup replayed, command retried
+//    timeout              "AT E0" probe to get back in step with the prompt
+//    3 failures in a row  or an I/O error: the reconnect callback, at most
+//                         once per OBD_RECONNECT_BACKOFF_MS, then the setup
+//
+// obd_session_init_adapter() brings the adapter to the setup state without
+// the AT Z reboot (about a second on an ELM327, plus its banner):
+//
+//    AT D                 defaults back, no reboot; the probe that the adapter
+//                         listens at all, OBD_RESYNC_TIMEOUT_MS
+//    AT WS                when AT D is "?" (some clones); AT Z only when
+//                         neither answers
+//    AT DPN               reads the state: echo and "\n" show in the reply,
+//                         "A6" or "0" is the automatic protocol
+//    setup                E, L: sent only when AT DPN showed otherwise; S, H:
+//                         only when not the default after the reset (S1, H0);
+//                         AT SP 0: only for a fixed protocol, as AT SP writes
+//                         the adapter's EEPROM
+//
+
+#include <stdint.h>
+
+#include "obd_metrics.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OBD_DEFAULT_TIMEOUT_MS 5000
+#define OBD_RESYNC_TIMEOUT_MS 500
+#define OBD_RECONNECT_AFTER 3
+#define OBD_RECONNECT_BACKOFF_MS 1000
+
+typedef enum {
+    OBD_REPLY_OK,
+    OBD_REPLY_NO_DATA,
+    OBD_REPLY_UNKNOWN,       // "?"
+    OBD_REPLY_BUFFER_FULL,
+    OBD_REPLY_CAN_ERROR,
+    OBD_REPLY_ERROR,         // UNABLE TO CONNECT, STOPPED, BUS ERROR, ...
+    OBD_REPLY_TIMEOUT,
+    OBD_REPLY_IO_ERROR,
+    OBD_REPLY_GARBLED        // only from obd_session_query()
+} obd_reply_t;
+
+typedef struct {
+    const char* name;
+    // Bytes read; 0 when nothing arrived within timeout_ms, -1 on error or EOF
+    int (*read)(void* ctx, char* buf, int len, int timeout_ms);
+    // Bytes written, -1 on error
+    int (*write)(void* ctx, const char* buf, int len);
+} obd_transport_ops_t;
+
+struct obd_capture;
+struct obd_session;
+
+// Re-establishes the link (e.g. obd_device_open() again), 0 on success
+typedef int (*obd_reconnect_fn)(struct obd_session* s, void* arg);
+
+typedef struct obd_session {
+    int fd;                  // -1 for transports that are not a descriptor
+    int timeout_ms;
+    obd_metrics_t* metrics;  // may be NULL
+    const obd_transport_ops_t* ops;
+    void* ctx;
+    struct obd_capture* capture;  // may be NULL
+
+    // Recovery, see obd_session_query()
+    const char* const* setup;     // NULL terminated, replayed after a reset or reconnect
+    obd_reconnect_fn reconnect;   // may be NULL
+    void* reconnect_arg;
+    int failures;                 // timeouts, I/O errors and garbled replies in a row
+    uint64_t next_reconnect_us;
+} obd_session_t;
+
+extern const obd_transport_ops_t OBD_FD_TRANSPORT;
+
+void obd_session_init(obd_session_t* s, int fd, obd_metrics_t* metrics);
+void obd_session_init_transport(obd_session_t* s, const obd_transport_ops_t* ops, void* ctx,
+                                obd_metrics_t* metrics);
+void obd_session_set_capture(obd_session_t* s, struct obd_capture* capture);
+// Swaps the descriptor of a file descriptor session, e.g. after a reconnect
+void obd_session_set_fd(obd_session_t* s, int fd);
+
+// Sends cmd + "\r" and reads the reply up to the prompt. The prompt is
+// stripped; response is always NUL terminated.
+obd_reply_t obd_session_command(obd_session_t* s, const char* cmd, char* response, int maxlen);
+
+void obd_session_set_recovery(obd_session_t* s, const char* const* setup, obd_reconnect_fn reconnect, void* arg);
+// Sends the setup commands, returns the number that did not answer OK
+int obd_session_setup(obd_session_t* s);
+
+typedef struct {
+    const char* reset;            // "AT D", "AT WS" or "AT Z"
+    int commands;                 // sent, the reset included
+    int skipped;                  // setup commands already in effect
+    int failed;                   // setup commands that did not answer OK
+    uint64_t elapsed_us;
+} obd_init_t;
+
+// Reset and setup the fast way described above; the number of setup
+// commands that did not answer OK
+int obd_session_init_adapter(obd_session_t* s, obd_init_t* init);
+// obd_session_command() with the recovery described above
+obd_reply_t obd_session_query(obd_session_t* s, const char* cmd, char* response, int maxlen);
+
+// Hex digits, spaces and frame numbers only, every line a whole number of bytes
+int obd_reply_well_formed(const char* response);
+
+obd_reply_t obd_classify_reply(const char* response);
+const char* obd_reply_name(obd_reply_t r);
+
+// CLOCK_MONOTONIC in microseconds
+uint64_t obd_now_us(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,246 @@
+/*
+ * obd_shm.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "obd_shm.h"
+
+static size_t shm_size(int rows) {
+    return sizeof(obd_shm_header_t) + (size_t)rows * sizeof(obd_shm_row_t);
+}
+
+static void clear_pending(obd_shm_writer_t* w) {
+    w->pending.nvalid = 0;
+    for (int i = 0; i < OBD_MAX_CHANNELS; ++i) w->pending.values[i] = NAN;
+}
+
+// Seqlock write side: odd while the data is inconsistent.
+static inline void seq_begin(uint32_t* seq) {
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void seq_end(uint32_t* seq) {
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
+}
+
+int obd_shm_create(obd_shm_writer_t* w, const char* name,
+                   const obd_shm_channel_t* channels, int nchannels, int rows) {
+    memset(w, 0, sizeof(*w));
+    if (nchannels > OBD_MAX_CHANNELS) nchannels = OBD_MAX_CHANNELS;
+    if (rows <= 0) rows = OBD_SHM_DEFAULT_ROWS;
+    snprintf(w->name, sizeof(w->name), "%s", name);
+
+    // A fresh object every run: readers of the old one keep a valid mapping
+    // and notice live == 0 instead of reading a header being rewritten.
+    shm_unlink(w->name);
+    int fd = shm_open(w->name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        perror("shm_open");
+        return -1;
+    }
+
+    w->size = shm_size(rows);
+    if (ftruncate(fd, (off_t)w->size) != 0) {
+        perror("ftruncate");
+        close(fd);
+        shm_unlink(w->name);
+        return -1;
+    }
+
+    void* p = mmap(NULL, w->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        perror("mmap");
+        shm_unlink(w->name);
+        return -1;
+    }
+
+    w->hdr = (obd_shm_header_t*)p;
+    w->ring = (obd_shm_row_t*)((char*)p + sizeof(obd_shm_header_t));
+
+    obd_shm_header_t* h = w->hdr;
+    h->version = OBD_SHM_VERSION;
+    h->header_size = sizeof(obd_shm_header_t);
+    h->row_size = sizeof(obd_shm_row_t);
+    h->rows = (uint32_t)rows;
+    h->nchannels = (uint32_t)nchannels;
+    h->writer_pid = (int32_t)getpid();
+    h->live = 1;
+    memcpy(h->channels, channels, nchannels * sizeof(obd_shm_channel_t));
+    for (int i = 0; i < OBD_MAX_CHANNELS; ++i) h->latest[i].value = NAN;
+
+    // Magic last: a reader that sees it also sees the rest of the header
+    __atomic_store_n(&h->magic, OBD_SHM_MAGIC, __ATOMIC_RELEASE);
+
+    clear_pending(w);
+    return 0;
+}
+
+void obd_shm_set(obd_shm_writer_t* w, int channel, int64_t t_us, double value) {
+    if (!w->hdr || channel < 0 || channel >= (int)w->hdr->nchannels) return;
+
+    obd_shm_latest_t* l = &w->hdr->latest[channel];
+    seq_begin(&l->seq);
+    l->t_us = t_us;
+    l->value = value;
+    seq_end(&l->seq);
+
+    if (isnan(w->pending.values[channel])) w->pending.nvalid++;
+    w->pending.values[channel] = value;
+}
+
+void obd_shm_commit(obd_shm_writer_t* w, int64_t t_us) {
+    if (!w->hdr) return;
+
+    obd_shm_header_t* h = w->hdr;
+    uint64_t head = h->head;
+    obd_shm_row_t* row = &w->ring[head % h->rows];
+
+    seq_begin(&row->seq);
+    row->nvalid = w->pending.nvalid;
+    row->t_us = t_us;
+    memcpy(row->values, w->pending.values, h->nchannels * sizeof(double));
+    seq_end(&row->seq);
+
+    __atomic_store_n(&h->head, head + 1, __ATOMIC_RELEASE);
+    clear_pending(w);
+}
+
+void obd_shm_close(obd_shm_writer_t* w) {
+    if (!w->hdr) return;
+    __atomic_store_n(&w->hdr->live, 0, __ATOMIC_RELEASE);
+    munmap(w->hdr, w->size);
+    shm_unlink(w->name);
+    w->hdr = NULL;
+}
+
+int obd_shm_schema_from_pids(obd_shm_channel_t* out, const obd_pid_t* pids, int n) {
+    if (n > OBD_MAX_CHANNELS) n = OBD_MAX_CHANNELS;
+    for (int i = 0; i < n; ++i) {
+        memset(&out[i], 0, sizeof(out[i]));
+        snprintf(out[i].name, sizeof(out[i].name), "%s", pids[i].name);
+        snprintf(out[i].unit, sizeof(out[i].unit), "%s", pids[i].unit);
+        out[i].decimals = pids[i].decimals;
+    }
+    return n;
+}
+
+int obd_shm_attach(obd_shm_reader_t* r, const char* name) {
+    struct stat st;
+
+    memset(r, 0, sizeof(*r));
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        perror("shm_open");
+        return -1;
+    }
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(obd_shm_header_t)) {
+        fprintf(stderr, "%s: not an OBD sample ring\n", name);
+        close(fd);
+        return -1;
+    }
+
+    void* p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+    }
+
+    const obd_shm_header_t* h = (const obd_shm_header_t*)p;
+    if (__atomic_load_n(&h->magic, __ATOMIC_ACQUIRE) != OBD_SHM_MAGIC ||
+        h->version != OBD_SHM_VERSION ||
+        h->header_size != sizeof(obd_shm_header_t) ||
+        h->row_size != sizeof(obd_shm_row_t) ||
+        h->nchannels > OBD_MAX_CHANNELS ||
+        (size_t)st.st_size < shm_size(h->rows)) {
+        fprintf(stderr, "%s: unsupported layout or writer still starting\n", name);
+        munmap(p, st.st_size);
+        return -1;
+    }
+
+    r->hdr = h;
+    r->ring = (const obd_shm_row_t*)((const char*)p + sizeof(obd_shm_header_t));
+    r->size = st.st_size;
+    return 0;
+}
+
+void obd_shm_detach(obd_shm_reader_t* r) {
+    if (r->hdr) munmap((void*)r->hdr, r->size);
+    r->hdr = NULL;
+}
+
+int obd_shm_live(const obd_shm_reader_t* r) {
+    if (__atomic_load_n(&r->hdr->live, __ATOMIC_ACQUIRE) == 0) return 0;
+    // A killed writer never clears live
+    return kill(r->hdr->writer_pid, 0) == 0 || errno == EPERM;
+}
+
+int obd_shm_find(const obd_shm_reader_t* r, const char* channel) {
+    for (uint32_t i = 0; i < r->hdr->nchannels; ++i) {
+        if (strcmp(r->hdr->channels[i].name, channel) == 0) return (int)i;
+    }
+    return -1;
+}
+
+uint64_t obd_shm_head(const obd_shm_reader_t* r) {
+    return __atomic_load_n(&r->hdr->head, __ATOMIC_ACQUIRE);
+}
+
+int obd_shm_latest(const obd_shm_reader_t* r, int channel, double* value, int64_t* t_us) {
+    if (channel < 0 || channel >= (int)r->hdr->nchannels) return -1;
+    const obd_shm_latest_t* l = &r->hdr->latest[channel];
+
+    for (int attempt = 0; attempt < OBD_SHM_READ_RETRIES; ++attempt) {
+        uint32_t s1 = __atomic_load_n(&l->seq, __ATOMIC_ACQUIRE);
+        if (s1 & 1) continue;
+        int64_t t = l->t_us;
+        double v = l->value;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&l->seq, __ATOMIC_RELAXED) != s1) continue;
+
+        if (s1 == 0) return -1;
+        if (value) *value = v;
+        if (t_us) *t_us = t;
+        return 0;
+    }
+    return -1;
+}
+
+int obd_shm_read_row(const obd_shm_reader_t* r, uint64_t index, obd_shm_row_t* out) {
+    const obd_shm_header_t* h = r->hdr;
+    const obd_shm_row_t* row = &r->ring[index % h->rows];
+
+    for (int attempt = 0; attempt < OBD_SHM_READ_RETRIES; ++attempt) {
+        uint64_t head = obd_shm_head(r);
+        if (index >= head || head - index > h->rows) return -1;
+
+        uint32_t s1 = __atomic_load_n(&row->seq, __ATOMIC_ACQUIRE);
+        if (s1 & 1) continue;
+        out->nvalid = row->nvalid;
+        out->t_us = row->t_us;
+        memcpy(out->values, row->values, h->nchannels * sizeof(double));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&row->seq, __ATOMIC_RELAXED) != s1) continue;
+
+        // The slot may have been reused for a newer row while we copied
+        if (obd_shm_head(r) - index > h->rows) return -1;
+        out->seq = s1;
+        for (uint32_t i = h->nchannels; i < OBD_MAX_CHANNELS; ++i) out->values[i] = NAN;
+        return 0;
+    }
+    return -1;
+}
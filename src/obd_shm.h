@@ -0,0 +1,134 @@
+/*
+ * obd_shm.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+#ifndef OBD_SHM_H
+#define OBD_SHM_H
+
+//
+// Live samples in shared memory (/dev/shm/obd_samples by default).
+//
+// The logger publishes every decoded value into one POSIX shared memory
+// object; local consumers (dashboard, alert scripts, a display on the Pi)
+// map it read-only and read the latest values and recent history with
+// plain loads, no syscalls and no disk I/O.
+//
+// Layout:
+//
+//    obd_shm_header_t      magic, geometry and the channel schema
+//                          (name, unit, decimals), so readers need no
+//                          compiled-in PID table, plus the latest value
+//                          and timestamp of every channel
+//    obd_shm_row_t[rows]   ring of complete polling rounds; row k lives in
+//                          slot k % rows, head counts published rows
+//
+// Every latest value and every ring slot is guarded by its own seqlock:
+// the writer makes seq odd, writes, then makes it even again. A reader
+// copies the data and retries if seq was odd or changed meanwhile. There is
+// a single writer and readers never write, so any number of them can
+// attach without slowing the logger down. A writer killed in the middle of
+// an update leaves seq odd for good, so readers give up after
+// OBD_SHM_READ_RETRIES attempts instead of spinning.
+//
+// Missing values (the ECU did not answer) are NaN.
+//
+
+#include <stdint.h>
+
+#include "obd_pids.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OBD_SHM_MAGIC 0x314d485344424f00ull   // "\0OBDSHM1"
+#define OBD_SHM_VERSION 1
+#define OBD_SHM_DEFAULT_NAME "/obd_samples"
+#define OBD_SHM_DEFAULT_ROWS 4096
+#define OBD_SHM_READ_RETRIES 100000   // an update takes well under a microsecond
+
+typedef struct {
+    char name[24];
+    char unit[12];
+    int32_t decimals;
+} obd_shm_channel_t;
+
+typedef struct {
+    uint32_t seq;
+    uint32_t reserved;
+    int64_t t_us;       // unix time, microseconds
+    double value;
+} obd_shm_latest_t;
+
+typedef struct {
+    uint32_t seq;
+    uint32_t nvalid;    // channels that answered in this round
+    int64_t t_us;       // unix time of the round, microseconds
+    double values[OBD_MAX_CHANNELS];
+} obd_shm_row_t;
+
+typedef struct {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t row_size;
+    uint32_t rows;
+    uint32_t nchannels;
+    int32_t writer_pid;
+    uint32_t live;      // cleared when the writer closes
+    uint32_t reserved;
+    uint64_t head;      // rows ever published
+    obd_shm_channel_t channels[OBD_MAX_CHANNELS];
+    obd_shm_latest_t latest[OBD_MAX_CHANNELS];
+} obd_shm_header_t;
+
+typedef struct {
+    char name[64];
+    obd_shm_header_t* hdr;
+    obd_shm_row_t* ring;
+    size_t size;
+    obd_shm_row_t pending;
+} obd_shm_writer_t;
+
+typedef struct {
+    const obd_shm_header_t* hdr;
+    const obd_shm_row_t* ring;
+    size_t size;
+} obd_shm_reader_t;
+
+// Writer side, used by the logger. Replaces any existing object of the
+// same name, so readers attached to a previous run see live == 0.
+int obd_shm_create(obd_shm_writer_t* w, const char* name,
+                   const obd_shm_channel_t* channels, int nchannels, int rows);
+void obd_shm_set(obd_shm_writer_t* w, int channel, int64_t t_us, double value);
+void obd_shm_commit(obd_shm_writer_t* w, int64_t t_us);
+void obd_shm_close(obd_shm_writer_t* w);
+
+// Schema entries straight from the PID table.
+int obd_shm_schema_from_pids(obd_shm_channel_t* out, const obd_pid_t* pids, int n);
+
+// Reader side. All calls after attach are plain memory reads.
+int obd_shm_attach(obd_shm_reader_t* r, const char* name);
+void obd_shm_detach(obd_shm_reader_t* r);
+// The writer has not closed the object and its process is still there
+int obd_shm_live(const obd_shm_reader_t* r);
+int obd_shm_find(const obd_shm_reader_t* r, const char* channel);
+uint64_t obd_shm_head(const obd_shm_reader_t* r);
+
+// Latest value of a channel; returns 0, or -1 if it was never published or
+// stayed locked for OBD_SHM_READ_RETRIES attempts.
+int obd_shm_latest(const obd_shm_reader_t* r, int channel, double* value, int64_t* t_us);
+
+// Copies row `index` (0 .. head-1). Returns 0, or -1 if it is not published
+// yet, was already overwritten by the ring wrapping around or stayed locked
+// for OBD_SHM_READ_RETRIES attempts.
+int obd_shm_read_row(const obd_shm_reader_t* r, uint64_t index, obd_shm_row_t* out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
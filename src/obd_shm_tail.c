@@ -0,0 +1,132 @@
+/*
+ * obd_shm_tail.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+//
+// Example reader for the live sample ring published by obd_logger_merged.
+//
+// Prints the latest value of every channel, or with -f follows the ring and
+// prints each polling round as a CSV line, like tail -f on the log but
+// without touching the SD card. Channel names and units come from the
+// schema in shared memory, so this program knows nothing about PIDs.
+//
+// Compile & Run
+// =============
+//
+// gcc obd_shm_tail.c obd_shm.c -o obd_shm_tail -lrt -lm
+//
+// ./obd_shm_tail                 latest values
+// ./obd_shm_tail -n 60           last 60 rounds, then exit
+// ./obd_shm_tail -f              follow
+// ./obd_shm_tail -s /obd_samples -f
+//
+// Example Output
+// ==============
+//
+// RPM          812 rpm      (0.4 s ago)
+// Speed          0 km/h     (0.4 s ago)
+// Coolant       88 C        (0.4 s ago)
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+
+#include "obd_shm.h"
+#include "obd_time.h"
+
+static void print_header(const obd_shm_reader_t* r) {
+    printf("Timestamp");
+    for (uint32_t i = 0; i < r->hdr->nchannels; ++i) printf(",%s", r->hdr->channels[i].name);
+    printf("\n");
+}
+
+static void print_row(const obd_shm_reader_t* r, const obd_shm_row_t* row) {
+    char ts[64];
+    obd_format_time(ts, sizeof(ts), row->t_us);
+    printf("%s", ts);
+
+    for (uint32_t i = 0; i < r->hdr->nchannels; ++i) {
+        if (isnan(row->values[i])) printf(",");
+        else printf(",%.*f", r->hdr->channels[i].decimals, row->values[i]);
+    }
+    printf("\n");
+}
+
+static void print_latest(const obd_shm_reader_t* r) {
+    int64_t now = obd_unix_now_us();
+
+    for (uint32_t i = 0; i < r->hdr->nchannels; ++i) {
+        const obd_shm_channel_t* c = &r->hdr->channels[i];
+        double v;
+        int64_t t;
+
+        if (obd_shm_latest(r, (int)i, &v, &t) != 0) {
+            printf("%-10s %8s\n", c->name, "-");
+        } else if (isnan(v)) {
+            printf("%-10s %8s %-8s (%.1f s ago)\n", c->name, "n/a", c->unit, (now - t) / 1e6);
+        } else {
+            printf("%-10s %8.*f %-8s (%.1f s ago)\n", c->name, c->decimals, v, c->unit, (now - t) / 1e6);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    const char* name = OBD_SHM_DEFAULT_NAME;
+    int follow = 0;
+    long last = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "fn:s:")) != -1) {
+        switch (opt) {
+            case 'f': follow = 1; break;
+            case 'n': last = atol(optarg); break;
+            case 's': name = optarg; break;
+            default:
+                fprintf(stderr, "Usage: %s [-s shm_name] [-n rows] [-f]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    obd_shm_reader_t r;
+    if (obd_shm_attach(&r, name) != 0) return 1;
+
+    if (!follow && last == 0) {
+        print_latest(&r);
+        obd_shm_detach(&r);
+        return 0;
+    }
+
+    uint64_t head = obd_shm_head(&r);
+    uint64_t next = head > (uint64_t)last ? head - last : 0;
+    obd_shm_row_t row;
+
+    print_header(&r);
+    for (;;) {
+        head = obd_shm_head(&r);
+        if (head - next > r.hdr->rows) {
+            fprintf(stderr, "skipped %llu rows\n", (unsigned long long)(head - r.hdr->rows - next));
+            next = head - r.hdr->rows;
+        }
+        for (; next < head; ++next) {
+            if (obd_shm_read_row(&r, next, &row) == 0) print_row(&r, &row);
+        }
+        fflush(stdout);
+
+        if (!follow) break;
+        if (!obd_shm_live(&r)) {
+            fprintf(stderr, "writer stopped\n");
+            break;
+        }
+        usleep(100000);
+    }
+
+    obd_shm_detach(&r);
+    return 0;
+}
@@ -0,0 +1,374 @@
+/*
+ * obd_sinks.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "obd_sinks.h"
+#include "obd_store.h"
+#include "obd_rollup.h"
+#include "obd_shm.h"
+#include "obd_http.h"
+#include "obd_trip.h"
+#include "obd_time.h"
+
+static int add_or_free(obd_bus_t* bus, const obd_sink_ops_t* ops, void* ctx,
+                       int capacity, obd_bus_policy_t policy, int block_ms) {
+    int idx = obd_bus_add_sink(bus, ops, ctx, capacity, policy, block_ms);
+    if (idx < 0) {
+        if (ops->close) ops->close(ctx);
+    }
+    return idx;
+}
+
+// Request-to-disk latency: from the start of the polling round to the end
+// of the write() that put the sample in the file.
+typedef struct {
+    metrics_hist_t* hist;
+    int n;
+    int64_t t_us[SINK_DISK_QUEUE];
+} disk_latency_t;
+
+static void latency_init(disk_latency_t* l, obd_bus_t* bus, const char* sink) {
+    l->hist = metrics_histogram(bus->metrics, "obd_sample_disk_latency_seconds",
+                                "Time from the first request of a round to its sample being written out.",
+                                "sink", sink);
+    l->n = 0;
+}
+
+// Returns 1 when the pending list is full and the caller should flush now
+static int latency_pending(disk_latency_t* l, int64_t t_us) {
+    if (l->n < SINK_DISK_QUEUE) l->t_us[l->n++] = t_us;
+    return l->n == SINK_DISK_QUEUE;
+}
+
+static void latency_flushed(disk_latency_t* l) {
+    int64_t now = obd_unix_now_us();
+    for (int i = 0; i < l->n; ++i) {
+        metrics_observe(l->hist, now > l->t_us[i] ? (uint64_t)(now - l->t_us[i]) : 0);
+    }
+    l->n = 0;
+}
+
+// CSV
+// ===
+
+typedef struct {
+    FILE* f;
+    disk_latency_t latency;
+    int trips;                  // one file per trip in dir
+    uint32_t trip;
+    char dir[256];
+} csv_sink_t;
+
+static void csv_header(FILE* f, const obd_bus_t* bus) {
+    if (bus->info[0]) fprintf(f, "# %s\n", bus->info);
+    fprintf(f, "Timestamp");
+    for (int i = 0; i < bus->nchannels; ++i) fprintf(f, ",%s", bus->channels[i].name);
+    fprintf(f, "\n");
+}
+
+// Starts the file of a new trip; 1 when the sample goes to a file
+static int csv_follow_trip(csv_sink_t* c, const obd_bus_t* bus, const obd_sample_t* s) {
+    if (s->trip != c->trip) {
+        if (c->f) {
+            fclose(c->f);
+            latency_flushed(&c->latency);
+            c->f = NULL;
+        }
+        c->trip = s->trip;
+        if (c->trip) {
+            char path[512];
+            obd_trip_path(path, sizeof(path), c->dir, "obd_log", c->trip, "csv");
+            c->f = fopen(path, "w");
+            if (!c->f) perror(path);
+            else csv_header(c->f, bus);
+        }
+    }
+    return c->f && s->valid;
+}
+
+static void csv_write(void* ctx, const obd_bus_t* bus, const obd_batch_t* batch) {
+    csv_sink_t* c = ctx;
+
+    for (int k = 0; k < batch->count; ++k) {
+        const obd_sample_t* s = &batch->samples[k];
+        if (c->trips && !csv_follow_trip(c, bus, s)) continue;
+
+        char line[1024];
+        char ts[64];
+
+        obd_format_time(ts, sizeof(ts), s->t_us);
+        int pos = snprintf(line, sizeof(line), "%s", ts);
+        for (int i = 0; i < bus->nchannels && pos < (int)sizeof(line); ++i) {
+            char field[32];
+            obd_pid_format(&bus->channels[i], (s->valid & (1u << i)) ? s->values[i] : -1, field, sizeof(field));
+            pos += snprintf(line + pos, sizeof(line) - pos, ",%s", field);
+        }
+        fprintf(c->f, "%s\n", line);
+        if (latency_pending(&c->latency, s->t_us)) {
+            fflush(c->f);
+            latency_flushed(&c->latency);
+        }
+    }
+}
+
+static void csv_idle(void* ctx) {
+    csv_sink_t* c = ctx;
+    if (c->f) fflush(c->f);
+    latency_flushed(&c->latency);
+}
+
+static void csv_close(void* ctx) {
+    csv_sink_t* c = ctx;
+    if (c->f) fclose(c->f);
+    free(c);
+}
+
+static const obd_sink_ops_t CSV_OPS = { "csv", csv_write, csv_idle, csv_close };
+
+int obd_sink_csv(obd_bus_t* bus, const char* path) {
+    csv_sink_t* c = calloc(1, sizeof(*c));
+    if (!c) return -1;
+    c->f = fopen(path, "w");
+    if (!c->f) {
+        perror(path);
+        free(c);
+        return -1;
+    }
+
+    csv_header(c->f, bus);
+    latency_init(&c->latency, bus, "csv");
+
+    return add_or_free(bus, &CSV_OPS, c, SINK_DISK_QUEUE, OBD_BUS_BLOCK, SINK_DISK_BLOCK_MS);
+}
+
+int obd_sink_csv_trips(obd_bus_t* bus, const char* dir) {
+    csv_sink_t* c = calloc(1, sizeof(*c));
+    if (!c) return -1;
+    c->trips = 1;
+    snprintf(c->dir, sizeof(c->dir), "%s", dir);
+    latency_init(&c->latency, bus, "csv");
+
+    return add_or_free(bus, &CSV_OPS, c, SINK_DISK_QUEUE, OBD_BUS_BLOCK, SINK_DISK_BLOCK_MS);
+}
+
+// Binary store
+// ============
+
+typedef struct {
+    obd_store_writer_t w;       // w.f is NULL between trips
+    disk_latency_t latency;
+    int trips;
+    uint32_t trip;
+    char dir[256];
+} store_sink_t;
+
+static int store_follow_trip(store_sink_t* st, const obd_bus_t* bus, const obd_sample_t* s) {
+    if (s->trip != st->trip) {
+        obd_store_close(&st->w);
+        latency_flushed(&st->latency);
+        st->trip = s->trip;
+        if (st->trip) {
+            char path[512];
+            obd_trip_path(path, sizeof(path), st->dir, "obd_log", st->trip, "bin");
+            obd_store_create_info(&st->w, path, bus->channels, bus->nchannels, bus->info);   // w.f stays NULL on failure
+        }
+    }
+    return st->w.f && s->valid;
+}
+
+static void store_write(void* ctx, const obd_bus_t* bus, const obd_batch_t* batch) {
+    store_sink_t* st = ctx;
+
+    for (int k = 0; k < batch->count; ++k) {
+        const obd_sample_t* s = &batch->samples[k];
+        if (st->trips && !store_follow_trip(st, bus, s)) continue;
+        obd_store_append(&st->w, s->t_us, s->valid, s->values);
+        if (latency_pending(&st->latency, s->t_us)) {
+            obd_store_flush(&st->w);
+            latency_flushed(&st->latency);
+        }
+    }
+}
+
+static void store_idle(void* ctx) {
+    store_sink_t* st = ctx;
+    obd_store_flush(&st->w);
+    latency_flushed(&st->latency);
+}
+
+static void store_close(void* ctx) {
+    obd_store_close(&((store_sink_t*)ctx)->w);
+    free(ctx);
+}
+
+static const obd_sink_ops_t STORE_OPS = { "store", store_write, store_idle, store_close };
+
+int obd_sink_store(obd_bus_t* bus, const char* path) {
+    store_sink_t* st = calloc(1, sizeof(*st));
+    if (!st) return -1;
+    if (obd_store_create_info(&st->w, path, bus->channels, bus->nchannels, bus->info) != 0) {
+        free(st);
+        return -1;
+    }
+    latency_init(&st->latency, bus, "store");
+    return add_or_free(bus, &STORE_OPS, st, SINK_DISK_QUEUE, OBD_BUS_BLOCK, SINK_DISK_BLOCK_MS);
+}
+
+int obd_sink_store_trips(obd_bus_t* bus, const char* dir) {
+    store_sink_t* st = calloc(1, sizeof(*st));
+    if (!st) return -1;
+    st->trips = 1;
+    snprintf(st->dir, sizeof(st->dir), "%s", dir);
+    latency_init(&st->latency, bus, "store");
+    return add_or_free(bus, &STORE_OPS, st, SINK_DISK_QUEUE, OBD_BUS_BLOCK, SINK_DISK_BLOCK_MS);
+}
+
+// Rollups
+// =======
+
+static void rollup_write(void* ctx, const obd_bus_t* bus, const obd_batch_t* batch) {
+    for (int k = 0; k < batch->count; ++k) {
+        const obd_sample_t* s = &batch->samples[k];
+        for (int i = 0; i < bus->nchannels; ++i) {
+            if (s->valid & (1u << i)) rollup_add(ctx, i, (time_t)(s->t_us / 1000000), s->values[i]);
+        }
+    }
+}
+
+static void rollup_idle(void* ctx) {
+    rollup_flush(ctx);
+}
+
+static void rollup_sink_close(void* ctx) {
+    rollup_close(ctx);
+    free(ctx);
+}
+
+static const obd_sink_ops_t ROLLUP_OPS = { "rollup", rollup_write, rollup_idle, rollup_sink_close };
+
+int obd_sink_rollup(obd_bus_t* bus, const char* dir) {
+    const char* names[OBD_MAX_CHANNELS];
+    rollup_t* r = malloc(sizeof(*r));
+    if (!r) return -1;
+
+    for (int i = 0; i < bus->nchannels; ++i) names[i] = bus->channels[i].name;
+    if (rollup_open(r, dir, names, bus->nchannels) != 0) {
+        free(r);
+        return -1;
+    }
+    return add_or_free(bus, &ROLLUP_OPS, r, SINK_DISK_QUEUE, OBD_BUS_BLOCK, SINK_DISK_BLOCK_MS);
+}
+
+// Shared memory
+// =============
+
+static void shm_write(void* ctx, const obd_bus_t* bus, const obd_batch_t* batch) {
+    for (int k = 0; k < batch->count; ++k) {
+        const obd_sample_t* s = &batch->samples[k];
+        for (int i = 0; i < bus->nchannels; ++i) {
+            if (s->valid & (1u << i)) obd_shm_set(ctx, i, s->t_us, s->values[i]);
+        }
+        obd_shm_commit(ctx, s->t_us);
+    }
+}
+
+static void shm_sink_close(void* ctx) {
+    obd_shm_close(ctx);
+    free(ctx);
+}
+
+static const obd_sink_ops_t SHM_OPS = { "shm", shm_write, NULL, shm_sink_close };
+
+int obd_sink_shm(obd_bus_t* bus, const char* name, int rows) {
+    obd_shm_channel_t schema[OBD_MAX_CHANNELS];
+    obd_shm_writer_t* w = malloc(sizeof(*w));
+    if (!w) return -1;
+
+    int n = obd_shm_schema_from_pids(schema, bus->channels, bus->nchannels);
+    if (obd_shm_create(w, name, schema, n, rows) != 0) {
+        free(w);
+        return -1;
+    }
+    return add_or_free(bus, &SHM_OPS, w, SINK_LIVE_QUEUE, OBD_BUS_DROP, 0);
+}
+
+// HTTP ring
+// =========
+
+typedef struct {
+    const obd_bus_t* bus;
+    pthread_mutex_t lock;
+    int rows;
+    uint64_t head;
+    obd_sample_t ring[];
+} http_ring_t;
+
+static void http_ring_write(void* ctx, const obd_bus_t* bus, const obd_batch_t* batch) {
+    http_ring_t* h = ctx;
+
+    pthread_mutex_lock(&h->lock);
+    for (int k = 0; k < batch->count; ++k) {
+        h->ring[h->head % h->rows] = batch->samples[k];
+        h->head++;
+    }
+    pthread_mutex_unlock(&h->lock);
+}
+
+static const obd_sink_ops_t HTTP_RING_OPS = { "http", http_ring_write, NULL, NULL };
+
+static void print_samples(FILE* out, const char* query, void* ctx) {
+    http_ring_t* h = ctx;
+    const obd_bus_t* bus = h->bus;
+    int n = 60;
+
+    if (strncmp(query, "n=", 2) == 0) n = atoi(query + 2);
+    if (n < 1) n = 1;
+    if (n > h->rows) n = h->rows;
+
+    fprintf(out, "{\"channels\":[");
+    for (int i = 0; i < bus->nchannels; ++i) {
+        fprintf(out, "%s{\"name\":\"%s\",\"unit\":\"%s\"}", i ? "," : "",
+                bus->channels[i].name, bus->channels[i].unit);
+    }
+    fprintf(out, "],\"samples\":[");
+
+    pthread_mutex_lock(&h->lock);
+    uint64_t from = h->head > (uint64_t)n ? h->head - n : 0;
+    for (uint64_t k = from; k < h->head; ++k) {
+        const obd_sample_t* s = &h->ring[k % h->rows];
+        fprintf(out, "%s\n{\"t\":%.3f", k > from ? "," : "", s->t_us / 1e6);
+        for (int i = 0; i < bus->nchannels; ++i) {
+            if (s->valid & (1u << i))
+                fprintf(out, ",\"%s\":%.*f", bus->channels[i].name, bus->channels[i].decimals, s->values[i]);
+        }
+        fprintf(out, "}");
+    }
+    pthread_mutex_unlock(&h->lock);
+
+    fprintf(out, "\n]}\n");
+}
+
+int obd_sink_http_ring(obd_bus_t* bus, const char* path, int rows) {
+    if (rows < 1) rows = 1;
+    http_ring_t* h = calloc(1, sizeof(*h) + rows * sizeof(obd_sample_t));
+    if (!h) return -1;
+    h->bus = bus;
+    h->rows = rows;
+    pthread_mutex_init(&h->lock, NULL);
+
+    // Lives as long as the HTTP server, which never stops
+    if (http_route(path, "application/json", print_samples, h) != 0) {
+        free(h);
+        return -1;
+    }
+    return obd_bus_add_sink(bus, &HTTP_RING_OPS, h, SINK_LIVE_QUEUE, OBD_BUS_DROP, 0);
+}
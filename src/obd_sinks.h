@@ -0,0 +1,58 @@
+/*
+ * obd_sinks.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+#ifndef OBD_SINKS_H
+#define OBD_SINKS_H
+
+//
+// Standard sinks for the sample bus (obd_bus.h).
+//
+// Each constructor opens its output, registers the sink on the bus and
+// returns the sink index, or -1 if the output could not be opened (the
+// logger then runs without it).
+//
+//    csv      obd_log_*.csv, the classic format (-1 for missing values),
+//             after a "# ..." line with the bus info when there is one
+//    store    obd_log_*.bin, compact binary records (obd_store.h)
+//    trips    csv / store with one file per trip (obd_trip.h)
+//    rollup   1 s / 1 min / 1 h aggregates (obd_rollup.h)
+//    shm      live ring in /dev/shm (obd_shm.h)
+//    http     last N rounds as JSON on the status HTTP server
+//
+// Files on disk use OBD_BUS_BLOCK with a short timeout so a busy SD card
+// loses nothing under normal load; the live sinks just drop when behind.
+//
+
+#include "obd_bus.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SINK_DISK_QUEUE 256
+#define SINK_DISK_BLOCK_MS 100
+#define SINK_LIVE_QUEUE 16
+
+int obd_sink_csv(obd_bus_t* bus, const char* path);
+int obd_sink_store(obd_bus_t* bus, const char* path);
+
+// One obd_log_<trip start>.csv / .bin in dir per trip; rounds outside a
+// trip and rounds where nothing answered are not written.
+int obd_sink_csv_trips(obd_bus_t* bus, const char* dir);
+int obd_sink_store_trips(obd_bus_t* bus, const char* dir);
+int obd_sink_rollup(obd_bus_t* bus, const char* dir);
+int obd_sink_shm(obd_bus_t* bus, const char* name, int rows);
+
+// Registers `path` (e.g. "/samples") on obd_http, so call it before
+// http_start(). GET /samples?n=60 returns the last 60 rounds.
+int obd_sink_http_ring(obd_bus_t* bus, const char* path, int rows);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
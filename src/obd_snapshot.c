@@ -0,0 +1,241 @@
+/*
+ * obd_snapshot.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "obd_snapshot.h"
+#include "obd_dtc.h"
+#include "obd_trip.h"
+#include "obd_time.h"
+
+int obd_snapshot_init(obd_snapshot_t* s, const obd_pid_t* channels, int nchannels, int npids,
+                      const char* dir, int pre_s, int burst_s) {
+    memset(s, 0, sizeof(*s));
+    s->channels = channels;
+    s->nchannels = nchannels > OBD_MAX_CHANNELS ? OBD_MAX_CHANNELS : nchannels;
+    s->npids = npids < s->nchannels ? npids : s->nchannels;
+    snprintf(s->dir, sizeof(s->dir), "%s", dir);
+    s->pre_us = (int64_t)pre_s * 1000000;
+    s->burst_us = (int64_t)burst_s * 1000000;
+
+    s->ring = calloc(OBD_SNAPSHOT_RING, sizeof(s->ring[0]));
+    s->points = malloc(OBD_SNAPSHOT_MAX_POINTS * sizeof(s->points[0]));
+    if (!s->ring || !s->points) {
+        perror("malloc");
+        obd_snapshot_close(s);
+        return -1;
+    }
+    return 0;
+}
+
+void obd_snapshot_set_clock(obd_snapshot_t* s, obd_snapshot_clock_fn clock, void* arg) {
+    s->clock = clock;
+    s->clock_arg = arg;
+}
+
+void obd_snapshot_record(obd_snapshot_t* s, const obd_sample_t* sample) {
+    if (!s->ring) return;
+    s->ring[s->ring_head] = *sample;
+    s->ring_head = (s->ring_head + 1) % OBD_SNAPSHOT_RING;
+    if (s->ring_count < OBD_SNAPSHOT_RING) s->ring_count++;
+}
+
+static uint32_t involved_pids(const obd_snapshot_t* s, int channel) {
+    if (channel >= 0 && channel < s->npids) return 1u << channel;
+    return s->npids >= 32 ? 0xFFFFFFFFu : (1u << s->npids) - 1;
+}
+
+void obd_snapshot_trigger(obd_snapshot_t* s, const char* event, int channel, int64_t t_us) {
+    if (!s->ring) return;
+
+    if (!s->pending && !s->active) {
+        if (obd_now_us() < s->holdoff_until_us) {
+            s->suppressed++;
+            return;
+        }
+        s->pending = 1;
+        s->t_us = t_us;
+        s->involved = 0;
+        s->nevents = 0;
+        s->freeze_valid = 0;
+        s->freeze_dtc[0] = '\0';
+        s->npoints = 0;
+    }
+    s->involved |= involved_pids(s, channel);
+    if (s->nevents < OBD_SNAPSHOT_MAX_EVENTS) snprintf(s->events[s->nevents++], sizeof(s->events[0]), "%s", event);
+}
+
+// Freeze frame
+// ============
+
+// The data bytes after "42 <pid> 00", NULL when the reply has none
+static const unsigned char* freeze_data(const char* response, int pid, int nbytes, unsigned char* bytes, int max) {
+    int len = obd_pid_reply_bytes(response, bytes, max);
+    for (int i = 0; i + 3 + nbytes <= len; ++i) {
+        if (bytes[i] == 0x42 && bytes[i + 1] == pid && bytes[i + 2] == 0x00) return bytes + i + 3;
+    }
+    return NULL;
+}
+
+static void read_freeze_frame(obd_snapshot_t* s, obd_session_t* session) {
+    char response[256], cmd[16];
+    unsigned char bytes[64];
+
+    // 0202 names the DTC that stored the frame; without it there is no frame
+    obd_session_query(session, "020200", response, sizeof(response));
+    const unsigned char* d = freeze_data(response, 0x02, 2, bytes, sizeof(bytes));
+    if (!d || (d[0] == 0 && d[1] == 0)) return;
+    obd_dtc_format((uint16_t)(d[0] << 8 | d[1]), s->freeze_dtc);
+
+    for (int i = 0; i < s->npids; ++i) {
+        const obd_pid_t* pid = &s->channels[i];
+        int number = obd_pid_number(pid);
+        if (number < 0) continue;
+
+        snprintf(cmd, sizeof(cmd), "02%02X00", number);
+        obd_session_query(session, cmd, response, sizeof(response));
+        d = freeze_data(response, number, pid->nbytes, bytes, sizeof(bytes));
+        if (!d) continue;
+        s->freeze[i] = obd_pid_decode(pid, d);
+        s->freeze_valid |= 1u << i;
+    }
+}
+
+// Writing
+// =======
+
+static void write_value(FILE* f, const obd_pid_t* channel, double value) {
+    char text[32];
+    obd_pid_format(channel, value, text, sizeof(text));
+    fputs(text, f);
+}
+
+static void write_snapshot(obd_snapshot_t* s) {
+    char path[512], tmp[520], ts[32];
+    time_t start = (time_t)(s->t_us / 1000000);
+
+    obd_trip_path(path, sizeof(path), s->dir, "obd_snapshot", (uint32_t)start, "json");
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE* f = fopen(tmp, "w");
+    if (!f) {
+        perror(tmp);
+        return;
+    }
+
+    strftime(ts, sizeof(ts), "%Y-%m-%d %H:%M:%S", localtime(&start));
+    fprintf(f, "{\"time\":\"%s\",\"t_us\":%lld,\"events\":[", ts, (long long)s->t_us);
+    for (int i = 0; i < s->nevents; ++i) fprintf(f, "%s\"%s\"", i ? "," : "", s->events[i]);
+
+    fprintf(f, "],\n\"freeze\":{");
+    if (s->freeze_dtc[0]) {
+        fprintf(f, "\"dtc\":\"%s\"", s->freeze_dtc);
+        for (int i = 0; i < s->npids; ++i) {
+            if (!(s->freeze_valid & (1u << i))) continue;
+            fprintf(f, ",\"%s\":", s->channels[i].name);
+            write_value(f, &s->channels[i], s->freeze[i]);
+        }
+    }
+
+    fprintf(f, "},\n\"channels\":[");
+    for (int i = 0; i < s->nchannels; ++i) fprintf(f, "%s\"%s\"", i ? "," : "", s->channels[i].name);
+    fprintf(f, "],\n\"rounds\":[");
+
+    // Oldest first, from pre_s before the trigger
+    int k = 0;
+    for (int n = 0; s->pre_us > 0 && n < s->ring_count; ++n) {
+        const obd_sample_t* r = &s->ring[(s->ring_head - s->ring_count + n + OBD_SNAPSHOT_RING) % OBD_SNAPSHOT_RING];
+        if (r->t_us < s->t_us - s->pre_us) continue;
+        fprintf(f, "%s\n[%.2f", k++ ? "," : "", (r->t_us - s->t_us) / 1e6);
+        for (int i = 0; i < s->nchannels; ++i) {
+            fputc(',', f);
+            if (r->valid & (1u << i)) write_value(f, &s->channels[i], r->values[i]);
+            else fputs("null", f);
+        }
+        fputc(']', f);
+    }
+
+    fprintf(f, "],\n\"burst\":{");
+    k = 0;
+    for (int i = 0; i < s->npids; ++i) {
+        if (!(s->involved & (1u << i)) || s->burst_us == 0) continue;
+        fprintf(f, "%s\n\"%s\":[", k++ ? "," : "", s->channels[i].name);
+        int m = 0;
+        for (int p = 0; p < s->npoints; ++p) {
+            if (s->points[p].channel != i) continue;
+            fprintf(f, "%s[%.3f,", m++ ? "," : "", (s->points[p].t_us - s->t_us) / 1e6);
+            write_value(f, &s->channels[i], s->points[p].value);
+            fputc(']', f);
+        }
+        fputc(']', f);
+    }
+    fprintf(f, "}}\n");
+
+    if (fclose(f) != 0 || rename(tmp, path) != 0) {
+        perror(path);
+        remove(tmp);
+        return;
+    }
+    s->written++;
+    printf("Snapshot: %s (%s, %d burst values)\n", path, s->events[0], s->npoints);
+    fflush(stdout);
+}
+
+// Burst
+// =====
+
+int64_t obd_snapshot_now(const obd_snapshot_t* s) {
+    return s->clock ? s->clock(s->clock_arg) : obd_unix_now_us();
+}
+
+static void burst_pass(obd_snapshot_t* s, obd_session_t* session) {
+    char response[256];
+
+    for (int i = 0; i < s->npids; ++i) {
+        if (!(s->involved & (1u << i))) continue;
+        double value;
+        int found;
+
+        obd_session_query(session, s->channels[i].command, response, sizeof(response));
+        if (obd_pid_parse_multi(response, &i, 1, &value, &found) == 1 && s->npoints < OBD_SNAPSHOT_MAX_POINTS) {
+            obd_snapshot_point_t* p = &s->points[s->npoints++];
+            p->t_us = obd_snapshot_now(s);
+            p->channel = i;
+            p->value = value;
+        }
+    }
+}
+
+void obd_snapshot_run(obd_snapshot_t* s, obd_session_t* session, uint64_t until_us) {
+    if (s->pending) {
+        s->pending = 0;
+        s->active = 1;
+        read_freeze_frame(s, session);
+        s->burst_end_us = obd_now_us() + s->burst_us;
+    }
+    if (!s->active) return;
+
+    while (s->burst_us > 0 && obd_now_us() < s->burst_end_us) {
+        burst_pass(s, session);
+        if (obd_now_us() >= until_us) return;
+    }
+
+    write_snapshot(s);
+    s->active = 0;
+    s->holdoff_until_us = obd_now_us() + OBD_SNAPSHOT_HOLDOFF_S * 1000000ull;
+}
+
+void obd_snapshot_close(obd_snapshot_t* s) {
+    if (s->active) write_snapshot(s);
+    s->active = s->pending = 0;
+    free(s->ring);
+    free(s->points);
+    s->ring = NULL;
+    s->points = NULL;
+}
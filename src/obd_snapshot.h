@@ -0,0 +1,125 @@
+/*
+ * obd_snapshot.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+#ifndef OBD_SNAPSHOT_H
+#define OBD_SNAPSHOT_H
+
+//
+// Event snapshots: full-resolution context around a new DTC or an alert.
+//
+// obd_snapshot_trigger() is called as the event happens; the snapshot then
+// collects:
+//
+//    rounds  the regular samples from pre_s seconds before the trigger to
+//            the end of the burst, out of a ring the loop fills with every
+//            round (obd_snapshot_record()), so nothing is logged at a
+//            higher rate just in case
+//    freeze  mode 02 freeze frame 0, what the ECU stored with its DTC, read
+//            right after the trigger ("020C00" -> "42 0C 00 1A F8"); 0202
+//            first, and nothing else when it has no frame
+//    burst   the involved PIDs polled back to back for burst_s. The burst
+//            runs in obd_snapshot_run(), in the idle time between the
+//            regular rounds, so the log keeps its rate
+//
+// An alert involves the PID of its channel (every PID for a derived channel),
+// a DTC every PID. When the burst ends everything goes to one record,
+// obd_snapshot_<trigger time>.json (.tmp and rename):
+//
+//    {"time":"2026-10-18 20:14:03","t_us":1792347243000000,"events":["dtc P0133 stored"],
+//     "freeze":{"dtc":"P0133","RPM":1850,"Coolant":64},
+//     "channels":["RPM","Speed",...],
+//     "rounds":[[-29.81,2100,54,...],[-28.80,null,54,...],...],
+//     "burst":{"RPM":[[0.012,2250],[0.061,2262],...]}}
+//
+// Times are seconds from the trigger, null a channel that did not answer.
+// Trigger, rounds and burst values are on the same clock, the one the
+// samples are stamped with: the wall clock, or the capture's clock under
+// replay (obd_snapshot_set_clock()).
+// Triggers during a snapshot are added to its events; after one is written
+// new triggers are ignored (counted in suppressed) for OBD_SNAPSHOT_HOLDOFF_S,
+// so a flapping alert cannot keep the adapter in burst mode.
+//
+// Everything runs in the acquisition thread; there is no locking.
+//
+
+#include <stdint.h>
+
+#include "obd_bus.h"
+#include "obd_session.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OBD_SNAPSHOT_PRE_S 30
+#define OBD_SNAPSHOT_BURST_S 5
+#define OBD_SNAPSHOT_HOLDOFF_S 60
+#define OBD_SNAPSHOT_RING 512           // rounds kept for the pre-trigger window
+#define OBD_SNAPSHOT_MAX_POINTS 8192    // burst values per snapshot
+#define OBD_SNAPSHOT_MAX_EVENTS 8
+
+typedef struct {
+    int64_t t_us;
+    int channel;
+    double value;
+} obd_snapshot_point_t;
+
+// Unix microseconds on the clock of the samples
+typedef int64_t (*obd_snapshot_clock_fn)(void* arg);
+
+typedef struct {
+    const obd_pid_t* channels;
+    int nchannels;
+    int npids;                  // channels[0 .. npids) are OBD_PIDS, the polled ones
+    char dir[256];
+    int64_t pre_us, burst_us;
+    obd_snapshot_clock_fn clock;    // NULL: the wall clock
+    void* clock_arg;
+
+    obd_sample_t* ring;
+    int ring_head, ring_count;
+
+    // Snapshot being taken
+    int pending, active;
+    int64_t t_us;               // trigger, unix microseconds
+    uint64_t burst_end_us;      // CLOCK_MONOTONIC
+    uint64_t holdoff_until_us;
+    uint32_t involved;          // PIDs to burst, bit per channel
+    char events[OBD_SNAPSHOT_MAX_EVENTS][48];
+    int nevents;
+    double freeze[OBD_MAX_CHANNELS];
+    uint32_t freeze_valid;
+    char freeze_dtc[6];
+    obd_snapshot_point_t* points;
+    int npoints;
+
+    uint64_t written, suppressed;
+} obd_snapshot_t;
+
+// 0 on success; pre_s / burst_s of 0 leave that part out
+int obd_snapshot_init(obd_snapshot_t* s, const obd_pid_t* channels, int nchannels, int npids,
+                      const char* dir, int pre_s, int burst_s);
+// Stamps burst values (and obd_snapshot_now()) from clock instead of the
+// wall clock, e.g. obd_replay_unix_us() under replay
+void obd_snapshot_set_clock(obd_snapshot_t* s, obd_snapshot_clock_fn clock, void* arg);
+// Now on the snapshot's clock, for triggers that have no sample time
+int64_t obd_snapshot_now(const obd_snapshot_t* s);
+// Every published round, before it goes to the bus
+void obd_snapshot_record(obd_snapshot_t* s, const obd_sample_t* sample);
+// channel -1 involves every PID
+void obd_snapshot_trigger(obd_snapshot_t* s, const char* event, int channel, int64_t t_us);
+// Takes a pending or running snapshot forward until until_us (CLOCK_MONOTONIC),
+// at least one burst pass; returns at once when there is none
+void obd_snapshot_run(obd_snapshot_t* s, obd_session_t* session, uint64_t until_us);
+// Writes a snapshot still running and frees the buffers
+void obd_snapshot_close(obd_snapshot_t* s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,168 @@
+/*
+ * obd_store.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "obd_store.h"
+
+static uint32_t record_size(uint32_t nchannels) {
+    uint32_t size = 8 + 4 + 4 * nchannels;
+    return (size + 7) & ~7u;
+}
+
+int obd_store_create(obd_store_writer_t* w, const char* path, const obd_pid_t* pids, int n) {
+    return obd_store_create_info(w, path, pids, n, NULL);
+}
+
+int obd_store_create_info(obd_store_writer_t* w, const char* path, const obd_pid_t* pids, int n, const char* info) {
+    obd_store_header_t h = { 0 };
+    struct timespec ts;
+    char text[OBD_STORE_MAX_INFO] = "";
+
+    memset(w, 0, sizeof(*w));
+    if (n > OBD_MAX_CHANNELS) n = OBD_MAX_CHANNELS;
+
+    w->f = fopen(path, "wb");
+    if (!w->f) {
+        perror("store fopen");
+        return -1;
+    }
+    setvbuf(w->f, NULL, _IOFBF, OBD_STORE_BUFFER);
+    w->nchannels = (uint32_t)n;
+    w->record_size = record_size(n);
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    h.magic = OBD_STORE_MAGIC;
+    h.version = OBD_STORE_VERSION;
+    // Padded so the records stay 8 byte aligned in a mapping
+    if (info) snprintf(text, sizeof(text), "%s", info);
+    uint32_t info_size = text[0] ? (uint32_t)(strlen(text) + 1 + 7) & ~7u : 0;
+    h.header_size = sizeof(h) + n * sizeof(obd_store_channel_t) + info_size;
+    h.record_size = w->record_size;
+    h.nchannels = (uint32_t)n;
+    h.created_us = (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    fwrite(&h, sizeof(h), 1, w->f);
+
+    for (int i = 0; i < n; ++i) {
+        obd_store_channel_t c;
+        memset(&c, 0, sizeof(c));
+        snprintf(c.name, sizeof(c.name), "%s", pids[i].name);
+        snprintf(c.unit, sizeof(c.unit), "%s", pids[i].unit);
+        c.decimals = pids[i].decimals;
+        fwrite(&c, sizeof(c), 1, w->f);
+    }
+    if (info_size) {
+        char padded[OBD_STORE_MAX_INFO + 8] = { 0 };
+        memcpy(padded, text, strlen(text));
+        fwrite(padded, info_size, 1, w->f);
+    }
+
+    if (ferror(w->f)) {
+        perror("store write");
+        fclose(w->f);
+        w->f = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+int obd_store_append(obd_store_writer_t* w, int64_t t_us, uint32_t valid, const double* values) {
+    if (!w->f) return -1;
+
+    obd_store_record_t* rec = (obd_store_record_t*)w->record;
+    memset(w->record, 0, w->record_size);
+    rec->t_us = t_us;
+    rec->valid = valid;
+    for (uint32_t i = 0; i < w->nchannels; ++i) {
+        if (valid & (1u << i)) rec->values[i] = (float)values[i];
+    }
+    return fwrite(w->record, w->record_size, 1, w->f) == 1 ? 0 : -1;
+}
+
+int obd_store_flush(obd_store_writer_t* w) {
+    return w->f ? fflush(w->f) : 0;
+}
+
+void obd_store_close(obd_store_writer_t* w) {
+    if (w->f) fclose(w->f);
+    w->f = NULL;
+}
+
+int obd_store_open(obd_store_reader_t* r, const char* path) {
+    struct stat st;
+
+    memset(r, 0, sizeof(*r));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(obd_store_header_t)) {
+        fprintf(stderr, "%s: not a sample log\n", path);
+        close(fd);
+        return -1;
+    }
+
+    void* p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+    }
+
+    const obd_store_header_t* h = (const obd_store_header_t*)p;
+    size_t schema_end = sizeof(*h) + h->nchannels * sizeof(obd_store_channel_t);
+    if (h->magic != OBD_STORE_MAGIC || (h->version != 1 && h->version != OBD_STORE_VERSION) ||
+        h->nchannels > OBD_MAX_CHANNELS || h->record_size != record_size(h->nchannels) ||
+        (h->version == 1 ? h->header_size != schema_end : h->header_size < schema_end) ||
+        (size_t)st.st_size < h->header_size) {
+        fprintf(stderr, "%s: not a sample log or unsupported version\n", path);
+        munmap(p, st.st_size);
+        return -1;
+    }
+
+    r->hdr = h;
+    r->channels = (const obd_store_channel_t*)(h + 1);
+    // The info text ends with a NUL inside header_size, or there is none
+    r->info = h->header_size > schema_end && ((const char*)p)[h->header_size - 1] == '\0'
+                  ? (const char*)p + schema_end : "";
+    r->records = (const unsigned char*)p + h->header_size;
+    r->count = (st.st_size - h->header_size) / h->record_size;
+    r->size = st.st_size;
+
+    // Sequential scans are the common case
+    madvise(p, st.st_size, MADV_SEQUENTIAL);
+    return 0;
+}
+
+void obd_store_unmap(obd_store_reader_t* r) {
+    if (r->hdr) munmap((void*)r->hdr, r->size);
+    r->hdr = NULL;
+}
+
+int obd_store_find_channel(const obd_store_reader_t* r, const char* name) {
+    for (uint32_t i = 0; i < r->hdr->nchannels; ++i) {
+        if (strcmp(r->channels[i].name, name) == 0) return (int)i;
+    }
+    return -1;
+}
+
+uint64_t obd_store_lower_bound(const obd_store_reader_t* r, int64_t t_us) {
+    uint64_t lo = 0, hi = r->count;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (obd_store_record(r, mid)->t_us < t_us) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
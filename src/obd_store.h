@@ -0,0 +1,105 @@
+/*
+ * obd_store.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+#ifndef OBD_STORE_H
+#define OBD_STORE_H
+
+//
+// Compact binary sample log (obd_log_YYYYMMDD_HHMMSS.bin).
+//
+// A self-describing header with the channel schema is followed by fixed-size
+// records, one per polling round:
+//
+//    int64_t  t_us       unix time, microseconds
+//    uint32_t valid      bit i set when channel i answered
+//    float    values[n]
+//
+// Records are appended in time order, so the reader maps the file and finds
+// a timestamp with a binary search instead of parsing text. A torn record
+// at the end (power cut) is ignored.
+//
+// Version 2 adds an info text after the schema, NUL terminated and padded
+// to 8 bytes inside header_size: the vehicle stamp of obd_vehicle.h, the
+// same line the CSV carries as "# ...". Version 1 files still open.
+//
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "obd_pids.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OBD_STORE_MAGIC 0x31524f5453444f00ull   // "\0ODSTOR1"
+#define OBD_STORE_VERSION 2
+#define OBD_STORE_MAX_INFO 256
+#define OBD_STORE_BUFFER (64 * 1024)    // stdio buffer of a writer
+
+typedef struct {
+    char name[24];
+    char unit[12];
+    int32_t decimals;
+} obd_store_channel_t;
+
+typedef struct {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t header_size;   // this struct, the schema and the info text
+    uint32_t record_size;
+    uint32_t nchannels;
+    int64_t created_us;
+} obd_store_header_t;
+
+typedef struct {
+    int64_t t_us;
+    uint32_t valid;
+    float values[];
+} obd_store_record_t;
+
+typedef struct {
+    FILE* f;
+    uint32_t nchannels;
+    uint32_t record_size;
+    unsigned char record[8 + 4 + 4 * OBD_MAX_CHANNELS + 4];
+} obd_store_writer_t;
+
+typedef struct {
+    const obd_store_header_t* hdr;
+    const obd_store_channel_t* channels;
+    const char* info;           // "" when the file has none
+    const unsigned char* records;
+    uint64_t count;
+    size_t size;
+} obd_store_reader_t;
+
+// Writer side. values[i] is ignored unless bit i of valid is set.
+int obd_store_create(obd_store_writer_t* w, const char* path, const obd_pid_t* pids, int n);
+// info may be NULL or empty; longer than OBD_STORE_MAX_INFO - 1 is cut
+int obd_store_create_info(obd_store_writer_t* w, const char* path, const obd_pid_t* pids, int n, const char* info);
+int obd_store_append(obd_store_writer_t* w, int64_t t_us, uint32_t valid, const double* values);
+int obd_store_flush(obd_store_writer_t* w);
+void obd_store_close(obd_store_writer_t* w);
+
+// Reader side, the whole file is mapped read-only.
+int obd_store_open(obd_store_reader_t* r, const char* path);
+void obd_store_unmap(obd_store_reader_t* r);
+int obd_store_find_channel(const obd_store_reader_t* r, const char* name);
+
+static inline const obd_store_record_t* obd_store_record(const obd_store_reader_t* r, uint64_t i) {
+    return (const obd_store_record_t*)(r->records + i * r->hdr->record_size);
+}
+
+// Index of the first record with t_us >= t_us, count if there is none.
+uint64_t obd_store_lower_bound(const obd_store_reader_t* r, int64_t t_us);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,43 @@
+/*
+ * obd_time.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+#ifndef OBD_TIME_H
+#define OBD_TIME_H
+
+//
+// Wall clock helpers shared by the logger, its sinks and the tools.
+//
+// Sample, log and record timestamps are unix microseconds (int64_t);
+// intervals and deadlines use obd_now_us() (CLOCK_MONOTONIC) instead.
+// Header only, so the small tools need no extra source to link.
+//
+
+#include <stdint.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// CLOCK_REALTIME in microseconds
+static inline int64_t obd_unix_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// "2026-10-18 20:14:03", local time
+static inline void obd_format_time(char* out, int maxlen, int64_t t_us) {
+    time_t t = (time_t)(t_us / 1000000);
+    strftime(out, maxlen, "%Y-%m-%d %H:%M:%S", localtime(&t));
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,143 @@
+/*
+ * obd_trace.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "obd_trace.h"
+
+typedef struct {
+    const char* name;
+    uint64_t ts_us;
+    uint32_t dur_us;
+    char arg[12];
+} trace_event_t;
+
+typedef struct {
+    int tid;
+    char name[24];      // "thread-" and any int
+    uint64_t head;      // events ever written, ring index is head % size
+    trace_event_t events[TRACE_EVENTS_PER_THREAD];
+} trace_buffer_t;
+
+int obd_trace_enabled = 0;
+
+static char trace_path[512];
+static trace_buffer_t* buffers[TRACE_MAX_THREADS];
+static int nbuffers;
+static __thread trace_buffer_t* my_buffer;
+static __thread int my_buffer_failed;
+
+void trace_init(const char* path) {
+    snprintf(trace_path, sizeof(trace_path), "%s", path);
+    obd_trace_enabled = 1;
+}
+
+// Copies in without the characters JSON would need escaped ('"', '\',
+// control characters): args are whatever a client sent, and trace_dump()
+// writes them as they are
+static void copy_plain(char* out, int maxlen, const char* in) {
+    int n = 0;
+    for (; *in && n < maxlen - 1; ++in) {
+        unsigned char ch = (unsigned char)*in;
+        if (ch >= 0x20 && ch != '"' && ch != '\\') out[n++] = (char)ch;
+    }
+    out[n] = '\0';
+}
+
+static trace_buffer_t* thread_buffer(void) {
+    if (my_buffer || my_buffer_failed) return my_buffer;
+
+    int slot = __atomic_fetch_add(&nbuffers, 1, __ATOMIC_RELAXED);
+    trace_buffer_t* b = (slot < TRACE_MAX_THREADS) ? calloc(1, sizeof(*b)) : NULL;
+    if (!b) {
+        my_buffer_failed = 1;
+        return NULL;
+    }
+
+    b->tid = (int)syscall(SYS_gettid);
+    snprintf(b->name, sizeof(b->name), "thread-%d", slot);
+    __atomic_store_n(&buffers[slot], b, __ATOMIC_RELEASE);
+    my_buffer = b;
+    return b;
+}
+
+void trace_thread_name(const char* name) {
+    trace_buffer_t* b = obd_trace_enabled ? thread_buffer() : NULL;
+    if (b) copy_plain(b->name, sizeof(b->name), name);
+}
+
+void trace_span(const char* name, uint64_t start, const char* arg) {
+    trace_buffer_t* b = thread_buffer();
+    if (!b) return;
+
+    uint64_t head = b->head;
+    trace_event_t* e = &b->events[head % TRACE_EVENTS_PER_THREAD];
+    e->name = name;
+    e->ts_us = start;
+    e->dur_us = (uint32_t)(trace_now_us() - start);
+    if (arg) copy_plain(e->arg, sizeof(e->arg), arg);
+    else e->arg[0] = '\0';
+    __atomic_store_n(&b->head, head + 1, __ATOMIC_RELEASE);
+}
+
+int trace_dump(void) {
+    if (!obd_trace_enabled) return 0;
+
+    char tmp[600];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", trace_path);
+    FILE* f = fopen(tmp, "w");
+    if (!f) {
+        perror("trace fopen");
+        return -1;
+    }
+
+    int pid = (int)getpid();
+    int n = __atomic_load_n(&nbuffers, __ATOMIC_RELAXED);
+    if (n > TRACE_MAX_THREADS) n = TRACE_MAX_THREADS;
+    int first = 1;
+    long total = 0;
+
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    for (int i = 0; i < n; ++i) {
+        trace_buffer_t* b = __atomic_load_n(&buffers[i], __ATOMIC_ACQUIRE);
+        if (!b) continue;
+
+        fprintf(f, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                first ? "" : ",\n", pid, b->tid, b->name);
+        first = 0;
+
+        // The owner may still be writing: skip a margin at the old end of
+        // the ring, where slots can be overwritten while we read them.
+        uint64_t head = __atomic_load_n(&b->head, __ATOMIC_ACQUIRE);
+        uint64_t from = 0;
+        if (head > TRACE_EVENTS_PER_THREAD)
+            from = head - TRACE_EVENTS_PER_THREAD + TRACE_EVENTS_PER_THREAD / 16;
+
+        for (uint64_t k = from; k < head; ++k) {
+            const trace_event_t* e = &b->events[k % TRACE_EVENTS_PER_THREAD];
+            fprintf(f, ",\n{\"ph\":\"X\",\"cat\":\"obd\",\"name\":\"%s\",\"pid\":%d,\"tid\":%d,\"ts\":%llu,\"dur\":%u",
+                    e->name, pid, b->tid, (unsigned long long)e->ts_us, e->dur_us);
+            if (e->arg[0]) fprintf(f, ",\"args\":{\"arg\":\"%s\"}", e->arg);
+            fprintf(f, "}");
+            total++;
+        }
+    }
+
+    fprintf(f, "\n]}\n");
+    if (fclose(f) != 0 || rename(tmp, trace_path) != 0) {
+        perror("trace write");
+        return -1;
+    }
+
+    printf("Trace: %ld events written to %s\n", total, trace_path);
+    return 0;
+}
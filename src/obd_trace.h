@@ -0,0 +1,65 @@
+/*
+ * obd_trace.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+#ifndef OBD_TRACE_H
+#define OBD_TRACE_H
+
+//
+// Optional span tracing, dumped as Chrome trace JSON.
+//
+// Open the dump in chrome://tracing or https://ui.perfetto.dev to see the
+// polling loop on a timeline: write, wait-for-prompt, parse, decode, sink
+// enqueue and disk flush for every PID.
+//
+// Each thread records into its own fixed ring of events; the writer only
+// does a store-release of its head index, so recording never locks. When
+// tracing is off TRACE_BEGIN() is a single branch and TRACE_END() does
+// nothing.
+//
+
+#include <stdint.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TRACE_MAX_THREADS 16
+#define TRACE_EVENTS_PER_THREAD 32768
+
+extern int obd_trace_enabled;
+
+static inline uint64_t trace_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+}
+
+#define TRACE_BEGIN() (obd_trace_enabled ? trace_now_us() : 0)
+#define TRACE_END(name, start, arg) \
+    do { if (start) trace_span((name), (start), (arg)); } while (0)
+
+// Tracing stays off until trace_init() is called with an output path.
+void trace_init(const char* path);
+
+// Records a complete span [start, now). name must be a string literal,
+// arg (may be NULL) is copied, e.g. the command "010C", without '"', '\'
+// and control characters.
+void trace_span(const char* name, uint64_t start, const char* arg);
+
+// Name shown for the calling thread's track.
+void trace_thread_name(const char* name);
+
+// Writes every buffered event to the path given to trace_init().
+// Call from normal context, e.g. when the SIGUSR1 flag is seen or at exit.
+int trace_dump(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,227 @@
+/*
+ * obd_trip.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "obd_trip.h"
+#include "obd_sinks.h"
+#include "obd_time.h"
+
+void obd_trip_init(obd_trip_t* t, const obd_pid_t* channels, int nchannels, int end_s) {
+    memset(t, 0, sizeof(*t));
+    t->rpm = obd_pid_index(channels, nchannels, "RPM");
+    t->speed = obd_pid_index(channels, nchannels, "Speed");
+    t->end_us = (int64_t)(end_s > 0 ? end_s : 1) * 1000000;
+    pthread_mutex_init(&t->lock, NULL);
+}
+
+void obd_trip_voltage(obd_trip_t* t, const char* reply) {
+    double v;
+    char unit;
+    const char* p = reply + strspn(reply, " \r\n>");
+    t->voltage = sscanf(p, "%lf%c", &v, &unit) == 2 && unit == 'V' ? v : 0;
+}
+
+static int channel_above_zero(const obd_sample_t* s, int ch) {
+    return ch >= 0 && (s->valid & (1u << ch)) && s->values[ch] > 0;
+}
+
+int obd_trip_update(obd_trip_t* t, obd_sample_t* s) {
+    int running = channel_above_zero(s, t->rpm) || channel_above_zero(s, t->speed) ||
+                  t->voltage >= OBD_TRIP_CHARGING_V;
+    int opened = 0;
+
+    if (running) {
+        if (!t->trip) {
+            t->trip = (uint32_t)(s->t_us / 1000000);
+            t->trips++;
+            opened = 1;
+        }
+        t->last_running_us = s->t_us;
+    } else if (t->trip && s->t_us - t->last_running_us >= t->end_us) {
+        t->trip = 0;
+    }
+    s->trip = t->trip;
+    return opened;
+}
+
+void obd_trip_dtc(obd_trip_t* t, const char* code) {
+    pthread_mutex_lock(&t->lock);
+    int seen = 0;
+    for (int i = 0; i < t->ndtcs && !seen; ++i)
+        seen = t->dtcs[i].trip == t->trip && strcmp(t->dtcs[i].code, code) == 0;
+
+    if (!seen && t->trip) {
+        // Full: the oldest entry belongs to a trip long summarised
+        if (t->ndtcs == OBD_TRIP_MAX_DTCS) {
+            memmove(t->dtcs, t->dtcs + 1, (OBD_TRIP_MAX_DTCS - 1) * sizeof(t->dtcs[0]));
+            t->ndtcs--;
+        }
+        t->dtcs[t->ndtcs].trip = t->trip;
+        snprintf(t->dtcs[t->ndtcs].code, sizeof(t->dtcs[0].code), "%s", code);
+        t->ndtcs++;
+    }
+    pthread_mutex_unlock(&t->lock);
+}
+
+void obd_trip_path(char* out, int maxlen, const char* dir, const char* prefix, uint32_t trip, const char* ext) {
+    char ts[32];
+    time_t start = (time_t)trip;
+    strftime(ts, sizeof(ts), "%Y%m%d_%H%M%S", localtime(&start));
+    snprintf(out, maxlen, "%s/%s_%s.%s", dir, prefix, ts, ext);
+}
+
+// Summary sink
+// ============
+
+typedef struct {
+    uint64_t n;
+    double sum, min, max;
+} channel_stats_t;
+
+// Running totals of the trip being summarised
+typedef struct {
+    uint32_t trip;
+    uint64_t samples;
+    int64_t first_us, last_us, end_us;
+    double distance_km, moving_s, idle_s;
+    int prev_state;             // 0 stopped, 1 idling, 2 moving
+    int64_t prev_us;
+    double prev_speed;
+    int prev_speed_valid;
+    channel_stats_t stats[OBD_MAX_CHANNELS];
+} trip_totals_t;
+
+typedef struct {
+    obd_trip_t* trips;
+    const obd_bus_t* bus;
+    char dir[256];
+    trip_totals_t cur;
+} trip_summary_t;
+
+static void summary_add(trip_totals_t* ts, const obd_trip_t* t, const obd_sample_t* s, int nchannels) {
+    if (ts->samples++ == 0) ts->first_us = ts->end_us = s->t_us;
+
+    for (int i = 0; i < nchannels; ++i) {
+        if (!(s->valid & (1u << i))) continue;
+        channel_stats_t* c = &ts->stats[i];
+        double v = s->values[i];
+        if (c->n++ == 0) c->min = c->max = v;
+        if (v < c->min) c->min = v;
+        if (v > c->max) c->max = v;
+        c->sum += v;
+    }
+
+    // Time since the previous sample goes to the state the car was in then
+    double dt = (s->t_us - ts->prev_us) / 1e6;
+    if (ts->prev_us && dt > 0 && dt <= OBD_TRIP_MAX_GAP_S) {
+        if (ts->prev_state == 2) ts->moving_s += dt;
+        else if (ts->prev_state == 1) ts->idle_s += dt;
+    }
+
+    int speed_valid = t->speed >= 0 && (s->valid & (1u << t->speed));
+    double speed = speed_valid ? s->values[t->speed] : 0;
+    if (speed_valid && ts->prev_speed_valid && dt > 0 && dt <= OBD_TRIP_MAX_GAP_S)
+        ts->distance_km += (ts->prev_speed + speed) / 2 * dt / 3600;
+
+    int rpm = channel_above_zero(s, t->rpm);
+    ts->prev_state = speed > 0 ? 2 : rpm ? 1 : 0;
+    if (ts->prev_state) ts->end_us = s->t_us;
+    ts->prev_us = s->t_us;
+    ts->prev_speed = speed;
+    ts->prev_speed_valid = speed_valid;
+    ts->last_us = s->t_us;
+}
+
+static void summary_write(trip_summary_t* sum, const char* closed) {
+    const obd_bus_t* bus = sum->bus;
+    obd_trip_t* trips = sum->trips;
+    trip_totals_t* ts = &sum->cur;
+    char path[512], tmp[520], start[32], end[32];
+
+    if (!ts->trip || ts->samples == 0) return;
+    // Without RPM or speed the trip ends with its last sample
+    if (trips->rpm < 0 && trips->speed < 0) ts->end_us = ts->last_us;
+
+    obd_trip_path(path, sizeof(path), sum->dir, "obd_trip", ts->trip, "json");
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE* f = fopen(tmp, "w");
+    if (!f) {
+        perror(tmp);
+        return;
+    }
+
+    obd_format_time(start, sizeof(start), (int64_t)ts->trip * 1000000);
+    obd_format_time(end, sizeof(end), ts->end_us);
+    fprintf(f, "{\"trip\":%u,\"start\":\"%s\",\"end\":\"%s\",\"duration_s\":%.1f,\"distance_km\":%.2f,"
+               "\"moving_s\":%.1f,\"idle_s\":%.1f,\"samples\":%llu,\"closed\":\"%s\",\"dtcs\":[",
+            ts->trip, start, end, (ts->end_us - ts->first_us) / 1e6, ts->distance_km,
+            ts->moving_s, ts->idle_s, (unsigned long long)ts->samples, closed);
+
+    pthread_mutex_lock(&trips->lock);
+    int k = 0;
+    for (int i = 0; i < trips->ndtcs; ++i) {
+        if (trips->dtcs[i].trip == ts->trip) fprintf(f, "%s\"%s\"", k++ ? "," : "", trips->dtcs[i].code);
+    }
+    pthread_mutex_unlock(&trips->lock);
+
+    fprintf(f, "],\"channels\":{");
+    k = 0;
+    for (int i = 0; i < bus->nchannels; ++i) {
+        const channel_stats_t* c = &ts->stats[i];
+        int dec = bus->channels[i].decimals;
+        if (c->n == 0) continue;
+        fprintf(f, "%s\n\"%s\":{\"min\":%.*f,\"max\":%.*f,\"avg\":%.*f,\"n\":%llu}", k++ ? "," : "",
+                bus->channels[i].name, dec, c->min, dec, c->max, dec + 1, c->sum / c->n, (unsigned long long)c->n);
+    }
+    fprintf(f, "}}\n");
+
+    if (fclose(f) != 0 || rename(tmp, path) != 0) {
+        perror(path);
+        remove(tmp);
+        return;
+    }
+    printf("Trip closed (%s): %s, %.1f min, %.2f km\n", closed, path, (ts->end_us - ts->first_us) / 6e7,
+           ts->distance_km);
+    fflush(stdout);
+}
+
+static void summary_batch(void* ctx, const obd_bus_t* bus, const obd_batch_t* batch) {
+    trip_summary_t* sum = ctx;
+
+    for (int k = 0; k < batch->count; ++k) {
+        const obd_sample_t* s = &batch->samples[k];
+        if (s->trip != sum->cur.trip) {
+            summary_write(sum, "engine_off");
+            memset(&sum->cur, 0, sizeof(sum->cur));
+            sum->cur.trip = s->trip;
+        }
+        if (sum->cur.trip) summary_add(&sum->cur, sum->trips, s, bus->nchannels);
+    }
+}
+
+static void summary_close(void* ctx) {
+    summary_write(ctx, "shutdown");
+    free(ctx);
+}
+
+static const obd_sink_ops_t SUMMARY_OPS = { "trip", summary_batch, NULL, summary_close };
+
+int obd_sink_trip_summary(obd_bus_t* bus, obd_trip_t* t, const char* dir) {
+    trip_summary_t* sum = calloc(1, sizeof(*sum));
+    if (!sum) return -1;
+    sum->trips = t;
+    sum->bus = bus;
+    snprintf(sum->dir, sizeof(sum->dir), "%s", dir);
+
+    int idx = obd_bus_add_sink(bus, &SUMMARY_OPS, sum, SINK_DISK_QUEUE, OBD_BUS_BLOCK, SINK_DISK_BLOCK_MS);
+    if (idx < 0) free(sum);
+    return idx;
+}
@@ -0,0 +1,89 @@
+/*
+ * obd_trip.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+#ifndef OBD_TRIP_H
+#define OBD_TRIP_H
+
+//
+// Trip segmentation.
+//
+// A trip runs while the engine does: RPM above 0, the car moving, or the
+// battery at charging voltage (AT RV, which the adapter answers even when
+// the ECU has gone to sleep). It ends after end_s seconds without any of
+// them, OBD_TRIP_END_S by default.
+//
+// obd_trip_update() runs in the acquisition loop and stamps every sample
+// with its trip number, the unix second the trip started (0 between trips).
+// The trip sinks of obd_sinks.h open obd_log_<start>.csv / .bin when the
+// number changes and leave out rounds where nothing answered, so one file
+// holds one drive and the engine-off NO DATA rounds never reach the disk.
+//
+// The summary sink keeps per-channel count, sum, min and max, the distance
+// (speed integrated over time), idle and moving time and the DTCs reported
+// during the trip, all updated per sample. When the trip closes it writes
+// obd_trip_<start>.json, a few hundred bytes to read instead of the log:
+//
+//    {"trip":1792347600,"start":"2026-10-18 20:00:00","end":"2026-10-18 20:31:12",
+//     "duration_s":1872.0,"distance_km":23.41,"moving_s":1554.0,"idle_s":318.0,
+//     "samples":1872,"closed":"engine_off","dtcs":["P0133"],
+//     "channels":{"RPM":{"min":0,"max":3410,"avg":1822,"n":1870}, ...}}
+//
+// "closed" is "shutdown" when the logger stopped during the trip.
+//
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "obd_bus.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OBD_TRIP_END_S 30
+#define OBD_TRIP_CHARGING_V 13.2
+#define OBD_TRIP_VOLTAGE_S 5        // how often the logger reads AT RV
+#define OBD_TRIP_MAX_GAP_S 5.0      // longer gaps are not integrated
+#define OBD_TRIP_MAX_DTCS 32
+
+typedef struct {
+    uint32_t trip;
+    char code[8];
+} obd_trip_dtc_t;
+
+typedef struct {
+    int rpm, speed;             // channel indexes, -1 when the table has none
+    int64_t end_us;
+    uint32_t trip;              // current trip, 0 between trips
+    int64_t last_running_us;
+    double voltage;             // last AT RV reading, 0 when unknown
+    uint64_t trips;
+
+    // DTCs seen, tagged with their trip, read by the summary sink
+    pthread_mutex_t lock;
+    obd_trip_dtc_t dtcs[OBD_TRIP_MAX_DTCS];
+    int ndtcs;
+} obd_trip_t;
+
+void obd_trip_init(obd_trip_t* t, const obd_pid_t* channels, int nchannels, int end_s);
+// "12.6V" as answered to AT RV; anything else makes the voltage unknown
+void obd_trip_voltage(obd_trip_t* t, const char* reply);
+// Sets s->trip; returns 1 when the sample opened a new trip
+int obd_trip_update(obd_trip_t* t, obd_sample_t* s);
+// A DTC reported now, counted once per trip
+void obd_trip_dtc(obd_trip_t* t, const char* code);
+
+// <dir>/<prefix>_YYYYMMDD_HHMMSS.<ext> for the trip start time
+void obd_trip_path(char* out, int maxlen, const char* dir, const char* prefix, uint32_t trip, const char* ext);
+
+int obd_sink_trip_summary(obd_bus_t* bus, obd_trip_t* t, const char* dir);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
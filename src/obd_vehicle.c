@@ -0,0 +1,201 @@
+/*
+ * obd_vehicle.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "obd_vehicle.h"
+#include "obd_pids.h"
+
+#define VIN_PID 0x02
+#define CALID_PID 0x04
+#define CVN_PID 0x06
+#define ECU_NAME_PID 0x0A
+
+int obd_vehicle_item(const char* response, int pid, int item_len, unsigned char* out) {
+    unsigned char bytes[256];
+    int len = obd_pid_reply_bytes(response, bytes, sizeof(bytes));
+    int i = 0;
+
+    while (i + 3 <= len && !(bytes[i] == 0x49 && bytes[i + 1] == pid)) ++i;
+    if (i + 3 > len) return -1;
+
+    // ISO 9141: "49 02 01 d d d d", "49 02 02 d d d d", ... (a 4 byte item
+    // looks the same either way)
+    if (i + 10 <= len && bytes[i + 7] == 0x49 && bytes[i + 8] == pid && bytes[i + 9] == 0x02) {
+        unsigned char joined[64];
+        int n = 0;
+        for (int k = 1; i + 7 <= len && bytes[i] == 0x49 && bytes[i + 1] == pid && bytes[i + 2] == k; ++k, i += 7) {
+            if (n + 4 > (int)sizeof(joined)) break;
+            memcpy(joined + n, bytes + i + 3, 4);
+            n += 4;
+        }
+        if (n < item_len) return -1;
+        memcpy(out, joined + n - item_len, item_len);
+        return 0;
+    }
+
+    // CAN: "49 02 01" and the whole item, joined from the ISO-TP frames
+    if (i + 3 + item_len > len) return -1;
+    memcpy(out, bytes + i + 3, item_len);
+    return 0;
+}
+
+// Printable characters only: no NUL padding, spaces, tabs or commas, which
+// would break the cache and the header lines
+static void item_text(const unsigned char* item, int len, char* out) {
+    int n = 0;
+    for (int i = 0; i < len; ++i) {
+        if (item[i] > ' ' && item[i] < 0x7F && item[i] != ',') out[n++] = (char)item[i];
+    }
+    out[n] = '\0';
+}
+
+static int read_item(obd_session_t* session, int pid, int item_len, unsigned char* item) {
+    char cmd[8], response[512];
+    snprintf(cmd, sizeof(cmd), "09%02X", pid);
+    obd_session_query(session, cmd, response, sizeof(response));
+    return obd_vehicle_item(response, pid, item_len, item);
+}
+
+// Cache
+// =====
+
+typedef struct {
+    obd_vehicle_t v;
+    long long updated;
+} entry_t;
+
+static int load_cache(const char* path, entry_t* entries) {
+    char line[512];
+    int n = 0;
+
+    FILE* f = fopen(path, "r");
+    if (!f) return 0;
+    while (n < OBD_VEHICLE_CACHE_MAX && fgets(line, sizeof(line), f)) {
+        const char* field[7];
+        int nfields = 0;
+        char* p = line;
+
+        line[strcspn(line, "\r\n")] = '\0';
+        while (nfields < 7) {
+            field[nfields++] = p;
+            p = strchr(p, '\t');
+            if (!p) break;
+            *p++ = '\0';
+        }
+        if (nfields < 7 || !field[0][0]) continue;
+
+        entry_t* e = &entries[n++];
+        memset(e, 0, sizeof(*e));
+        snprintf(e->v.adapter, sizeof(e->v.adapter), "%s", field[0]);
+        snprintf(e->v.protocol, sizeof(e->v.protocol), "%s", field[1]);
+        snprintf(e->v.vin, sizeof(e->v.vin), "%s", field[2]);
+        snprintf(e->v.calid, sizeof(e->v.calid), "%s", field[3]);
+        snprintf(e->v.cvn, sizeof(e->v.cvn), "%s", field[4]);
+        snprintf(e->v.ecu, sizeof(e->v.ecu), "%s", field[5]);
+        e->updated = atoll(field[6]);
+    }
+    fclose(f);
+    return n;
+}
+
+static void save_cache(const char* path, const entry_t* entries, int n) {
+    char tmp[520];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+    FILE* f = fopen(tmp, "w");
+    if (!f) {
+        perror(tmp);
+        return;
+    }
+    for (int i = 0; i < n; ++i) {
+        const obd_vehicle_t* v = &entries[i].v;
+        fprintf(f, "%s\t%s\t%s\t%s\t%s\t%s\t%lld\n", v->adapter, v->protocol, v->vin, v->calid, v->cvn, v->ecu,
+                entries[i].updated);
+    }
+    if (fclose(f) != 0 || rename(tmp, path) != 0) {
+        perror(path);
+        remove(tmp);
+    }
+}
+
+static entry_t* find_entry(entry_t* entries, int n, const obd_vehicle_t* v) {
+    for (int i = 0; i < n; ++i) {
+        if (strcmp(entries[i].v.adapter, v->adapter) == 0 && strcmp(entries[i].v.protocol, v->protocol) == 0)
+            return &entries[i];
+    }
+    return NULL;
+}
+
+// Reading
+// =======
+
+int obd_vehicle_read(obd_vehicle_t* v, obd_session_t* session, const char* adapter, const char* cache_path) {
+    entry_t entries[OBD_VEHICLE_CACHE_MAX];
+    unsigned char item[20];
+    char response[64];
+
+    memset(v, 0, sizeof(*v));
+    item_text((const unsigned char*)adapter, (int)strnlen(adapter, sizeof(v->adapter) - 1), v->adapter);
+
+    // The CVN is one frame and changes with the ECU or its software
+    if (read_item(session, CVN_PID, 4, item) == 0)
+        snprintf(v->cvn, sizeof(v->cvn), "%02X%02X%02X%02X", item[0], item[1], item[2], item[3]);
+
+    // After the first request, which makes an automatic search settle: "A6"
+    // then, "6" when the protocol was set
+    obd_session_query(session, "AT DPN", response, sizeof(response));
+    const char* p = response + strspn(response, "\r\n ");
+    if (*p == 'A') ++p;
+    snprintf(v->protocol, sizeof(v->protocol), "%.*s", (int)strcspn(p, "\r\n "), p);
+
+    int n = cache_path ? load_cache(cache_path, entries) : 0;
+    entry_t* e = find_entry(entries, n, v);
+    if (e && v->cvn[0] && strcmp(e->v.cvn, v->cvn) == 0) {
+        memcpy(v->vin, e->v.vin, sizeof(v->vin));
+        memcpy(v->calid, e->v.calid, sizeof(v->calid));
+        memcpy(v->ecu, e->v.ecu, sizeof(v->ecu));
+        v->cached = 1;
+        return 0;
+    }
+
+    if (read_item(session, VIN_PID, 17, item) == 0) item_text(item, 17, v->vin);
+    if (read_item(session, CALID_PID, 16, item) == 0) item_text(item, 16, v->calid);
+    if (read_item(session, ECU_NAME_PID, 20, item) == 0) item_text(item, 20, v->ecu);
+    if (!v->vin[0] && !v->calid[0] && !v->cvn[0] && !v->ecu[0]) return -1;
+
+    if (cache_path) {
+        if (!e && n < OBD_VEHICLE_CACHE_MAX) {
+            e = &entries[n++];
+        } else if (!e) {
+            // Full: the entry updated longest ago makes room
+            e = &entries[0];
+            for (int i = 1; i < n; ++i) {
+                if (entries[i].updated < e->updated) e = &entries[i];
+            }
+        }
+        e->v = *v;
+        e->updated = (long long)time(NULL);
+        save_cache(cache_path, entries, n);
+    }
+    return 0;
+}
+
+void obd_vehicle_format(const obd_vehicle_t* v, char* out, int maxlen) {
+    const char* names[] = { "vin", "calid", "cvn", "ecu", "protocol", "adapter" };
+    const char* values[] = { v->vin, v->calid, v->cvn, v->ecu, v->protocol, v->adapter };
+    int pos = 0;
+
+    out[0] = '\0';
+    for (int i = 0; i < 6 && pos < maxlen; ++i) {
+        if (!values[i][0]) continue;
+        pos += snprintf(out + pos, maxlen - pos, "%s%s=%s", pos ? " " : "", names[i], values[i]);
+    }
+}
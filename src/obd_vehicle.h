@@ -0,0 +1,69 @@
+/*
+ * obd_vehicle.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: arek1
+ */
+
+#ifndef OBD_VEHICLE_H
+#define OBD_VEHICLE_H
+
+//
+// Vehicle identity from mode 09, read once per vehicle.
+//
+//    0902  VIN      17 ASCII characters
+//    0904  CALID    16 ASCII characters, calibration ID of the ECU software
+//    0906  CVN      4 bytes, checksum of that calibration
+//    090A  ECUNAME  20 characters, "ECM\0-EngineControl"
+//
+// VIN, CALID and ECU name are multi-frame on CAN (flow control, several
+// hundred ms on a BT adapter) and four to five messages on ISO 9141; CVN is
+// a single frame. The answers are cached in obd_vehicle.cache, keyed by
+// adapter and protocol:
+//
+//    <adapter>\t<protocol>\t<vin>\t<calid>\t<cvn>\t<ecu>\t<updated unix time>
+//
+// obd_vehicle_read() asks only for 0906 when the cache has an entry and
+// takes the rest from the cache while the CVN matches. Another car on the
+// same adapter, or a reflashed ECU, has another CVN and is read in full.
+// An ECU without 0906 is read in full every time.
+//
+// obd_vehicle_format() gives the line stamped on every log segment header
+// ("# vin=..." in the CSV, the info text of the binary store).
+//
+
+#include "obd_session.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OBD_VEHICLE_CACHE_FILE "obd_vehicle.cache"
+#define OBD_VEHICLE_CACHE_MAX 32
+
+typedef struct {
+    char adapter[64];
+    char protocol[8];           // ELM "AT DPN", "6" for CAN 11/500
+    char vin[18];
+    char calid[17];
+    char cvn[9];                // hex
+    char ecu[21];
+    int cached;                 // 1 when VIN, CALID and ECU name came from the cache
+} obd_vehicle_t;
+
+// The item_len data bytes of a mode 09 reply to pid, CAN or ISO 9141
+// (numbered four byte messages, padding in front dropped); -1 without one
+int obd_vehicle_item(const char* response, int pid, int item_len, unsigned char* out);
+
+// Fills v for the vehicle behind session, through the cache at cache_path
+// (may be NULL). 0 when the ECU answered any of it, -1 when not.
+int obd_vehicle_read(obd_vehicle_t* v, obd_session_t* session, const char* adapter, const char* cache_path);
+
+// "vin=... calid=... cvn=... ecu=... protocol=... adapter=...", empty fields left out
+void obd_vehicle_format(const obd_vehicle_t* v, char* out, int maxlen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif